@@ -33,6 +33,7 @@
 #include <string>
 #include <iostream>
 #include <stdlib.h>
+#include <vector>
 
 // ASKAPsoft includes
 #include "askap/Application.h"
@@ -57,12 +58,16 @@
 #include "dataaccess/OnDemandNoiseAndFlagDA.h"
 #include "askap/RangePartition.h"
 #include "boost/shared_ptr.hpp"
+#include "boost/thread/mutex.hpp"
 
 // Local packages includes
 #include "askap/measurementequation/ICalibrationApplicator.h"
 #include "askap/measurementequation/CalibrationApplicatorME.h"
+#include "askap/measurementequation/CalSolutionCache.h"
 #include "askap/measurementequation/CalibrationIterator.h"
 #include "askap/parallel/ParallelWriteIterator.h"
+#include "askap/parallel/CalApplyPipeline.h"
+#include "askap/utils/MSUtils.h"
 
 // casacore includes
 #include "casacore/casa/OS/Timer.h"
@@ -88,56 +93,30 @@ class CcalApplyApp : public askap::Application
                 StatReporter stats;
                 LOFAR::ParameterSet subset(config().makeSubset("Ccalapply."));
 
-                itsDistribute = comms.isParallel() ? subset.getBool("distribute", true) : false;
+                itsSplitBeams = comms.isParallel() ? subset.getBool("splitbeams", false) : false;
+                itsDistribute = comms.isParallel() && !itsSplitBeams ? subset.getBool("distribute", true) : false;
 
                 if (itsDistribute) {
                     ASKAPLOG_INFO_STR(logger, "Data will be distributed between "<<(comms.nProcs() - 1)<<" workers, master will write data");
                 }
 
-                if (comms.isWorker() || !itsDistribute) {
-
-                    // Get Measurement Set accessor
-                    // could've passed optional parameters for the parallel iterator too, but it's fine tuning
-                    IDataSharedIter it = itsDistribute ? IDataSharedIter(new ParallelWriteIterator(comms)) : getDataIterator(subset, comms);
-
-                    // Setup calibration applicator
-                    const boost::shared_ptr<ParallelWriteIterator> pwIt = it.dynamicCast<ParallelWriteIterator>();
-                    boost::shared_ptr<ICalibrationApplicator> calME = buildCalApplicator(subset, pwIt ? pwIt->chanOffset() : 0u);
-
-                    ASKAPDEBUGASSERT(it);
-                    ASKAPDEBUGASSERT(calME);
-
-                    casa::Timer timer;
-
-                    // Apply calibration
-                    uint64_t count = 1;
-                    double calculationTime = 0.;
-                    for (it.init(); it != it.end(); it.next()) {
-                        if (count % 100 == 0) {
-                            ASKAPLOG_DEBUG_STR(logger, "Progress - Chunk " << count<< " nRows = "<<it->nRow());
-                        }
-                        ++count;
-                        timer.mark();
-
-                        if (itsNoiseAndFlagDANeeded) {
-                            // quick and dirty for now (mv: note, it will definitely ignore updates to noise and may ignore
-                            // updates to flags as well, if the appropriate accessor doesn't support write operation!)
-                            accessors::OnDemandNoiseAndFlagDA acc(*it);
-                            acc.rwVisibility() = it->visibility();
-
-                            calME->correct(acc);
-
-                            it->rwVisibility() = acc.rwVisibility();
-
-                            const boost::shared_ptr<IFlagDataAccessor> fda = boost::dynamic_pointer_cast<IFlagDataAccessor>(boost::shared_ptr<IDataAccessor>(it.operator->(), utility::NullDeleter()));
-                            ASKAPCHECK(fda, "Data accessor is of type which does not support overwritting flag information");
-                            fda->rwFlag() = acc.rwFlag();
-                        } else {
-                            calME->correct(*it);
-                        }
-                        calculationTime += timer.real();
+                if (itsSplitBeams) {
+                    // every rank copies its own beams into separate datasets and corrects them in place,
+                    // so no table is written by more than one rank and there is no master
+                    const std::string ms = subset.getString("dataset");
+                    const std::string outPattern = subset.getString("splitbeams.output", defaultBeamPattern(ms));
+                    const casa::uInt nBeams = nBeamsInDataset(ms);
+                    ASKAPLOG_INFO_STR(logger, nBeams<<" beams will be split between "<<comms.nProcs()<<
+                                      " ranks and written to "<<outPattern);
+                    for (casa::uInt beam = static_cast<casa::uInt>(comms.rank()); beam < nBeams;
+                         beam += static_cast<casa::uInt>(comms.nProcs())) {
+                         const std::string beamMs = beamDatasetName(outPattern, beam);
+                         copyBeam(ms, beam, beamMs);
+                         ASKAPLOG_INFO_STR(logger, "Applying calibration to beam "<<beam<<" in "<<beamMs);
+                         applyCalibration(subset, comms, beamMs);
                     }
-                    ASKAPLOG_INFO_STR(logger, "Time spent in calculation and data movement (but excluding I/O): "<<calculationTime<<" seconds");
+                } else if (comms.isWorker() || !itsDistribute) {
+                    applyCalibration(subset, comms);
                 } else {
                     // server code. Note, noise is not propagated back (as for the serial case)
                     ParallelWriteIterator::masterIteration(comms, getDataIterator(subset, comms), ParallelWriteIterator::SYNCFLAG | ParallelWriteIterator::READ);
@@ -170,6 +149,91 @@ class CcalApplyApp : public askap::Application
         /// It's ignored in the serial mode.
         bool itsDistribute;
 
+        /// @brief this flag indicates that each rank processes a subset of beams
+        /// @details In this mode all ranks read the same dataset, each one taking the beams assigned
+        /// to it in a round-robin fashion. Every beam is copied into its own dataset (named according to
+        /// the splitbeams.output pattern) and corrected there, the input dataset is left unchanged.
+        /// Rows of different beams share the tiles of the data column, so they can't be written in
+        /// place by several processes.
+        bool itsSplitBeams;
+
+        /// @brief apply calibration to the data handled by this rank
+        /// @details The data are corrected either serially (chunk by chunk) or, if the pipeline
+        /// is enabled, by separate reader, correction and writer threads.
+        /// @param[in] parset parset with parameters of this application
+        /// @param[in] comms communication object
+        /// @param[in] ms dataset to correct, an empty string means the dataset given in the parset
+        void applyCalibration(const LOFAR::ParameterSet& parset, const askap::askapparallel::AskapParallel &comms,
+                              const std::string &ms = "")
+        {
+            if (parset.getBool("pipeline", false)) {
+                ASKAPCHECK(!itsDistribute, "Pipeline can't be used with the data distributed by the master, "
+                           "set either Ccalapply.distribute = false or Ccalapply.splitbeams = true");
+                const casa::uInt nWorkers = parset.getUint32("pipeline.nworkers", 2);
+                const casa::uInt depth = parset.getUint32("pipeline.depth", 2 * nWorkers);
+                ASKAPCHECK(nWorkers > 0, "pipeline.nworkers should be positive");
+                // all workers share one cached solution source, its table access is serialised
+                // with the data access of the pipeline
+                const boost::shared_ptr<boost::mutex> ioMutex(new boost::mutex);
+                const ICalSolutionConstSource::ShPtr solutionSource = buildSolutionSource(parset, 0u, ioMutex);
+                // each worker needs its own applicator, they are not thread safe
+                std::vector<boost::shared_ptr<ICalibrationApplicator> > applicators;
+                for (casa::uInt worker = 0; worker < nWorkers; ++worker) {
+                     applicators.push_back(buildCalApplicator(parset, solutionSource));
+                }
+                CalApplyPipeline pipeline(applicators, depth, itsNoiseAndFlagDANeeded, ioMutex);
+                // the second iterator over the same data is used to write the corrected chunks back
+                pipeline.run(getDataIterator(parset, comms, ms), getDataIterator(parset, comms, ms));
+                ASKAPLOG_INFO_STR(logger, "Pipeline has processed "<<pipeline.nChunks()<<" chunks, time spent in calculation by all workers: "<<
+                                  pipeline.calculationTime()<<" seconds");
+                return;
+            }
+
+            // Get Measurement Set accessor
+            // could've passed optional parameters for the parallel iterator too, but it's fine tuning
+            IDataSharedIter it = itsDistribute ? IDataSharedIter(new ParallelWriteIterator(comms)) : getDataIterator(parset, comms, ms);
+
+            // Setup calibration applicator
+            const boost::shared_ptr<ParallelWriteIterator> pwIt = it.dynamicCast<ParallelWriteIterator>();
+            boost::shared_ptr<ICalibrationApplicator> calME = buildCalApplicator(parset,
+                      buildSolutionSource(parset, pwIt ? pwIt->chanOffset() : 0u));
+
+            ASKAPDEBUGASSERT(it);
+            ASKAPDEBUGASSERT(calME);
+
+            casa::Timer timer;
+
+            // Apply calibration
+            uint64_t count = 1;
+            double calculationTime = 0.;
+            for (it.init(); it != it.end(); it.next()) {
+                if (count % 100 == 0) {
+                    ASKAPLOG_DEBUG_STR(logger, "Progress - Chunk " << count<< " nRows = "<<it->nRow());
+                }
+                ++count;
+                timer.mark();
+
+                if (itsNoiseAndFlagDANeeded) {
+                    // quick and dirty for now (mv: note, it will definitely ignore updates to noise and may ignore
+                    // updates to flags as well, if the appropriate accessor doesn't support write operation!)
+                    accessors::OnDemandNoiseAndFlagDA acc(*it);
+                    acc.rwVisibility() = it->visibility();
+
+                    calME->correct(acc);
+
+                    it->rwVisibility() = acc.rwVisibility();
+
+                    const boost::shared_ptr<IFlagDataAccessor> fda = boost::dynamic_pointer_cast<IFlagDataAccessor>(boost::shared_ptr<IDataAccessor>(it.operator->(), utility::NullDeleter()));
+                    ASKAPCHECK(fda, "Data accessor is of type which does not support overwritting flag information");
+                    fda->rwFlag() = acc.rwFlag();
+                } else {
+                    calME->correct(*it);
+                }
+                calculationTime += timer.real();
+            }
+            ASKAPLOG_INFO_STR(logger, "Time spent in calculation and data movement (but excluding I/O): "<<calculationTime<<" seconds");
+        }
+
         static casa::MFrequency::Ref getFreqRefFrame(const LOFAR::ParameterSet& parset)
         {
             const string freqFrame = parset.getString("freqframe", "topo");
@@ -187,8 +251,29 @@ class CcalApplyApp : public askap::Application
             }
         }
 
-        boost::shared_ptr<ICalibrationApplicator> buildCalApplicator(
-                const LOFAR::ParameterSet& parset, const casa::uInt chanOffset = 0u)
+        /// @brief default name pattern of the per-beam datasets
+        /// @details The beam placeholder is inserted before the .ms extension of the input dataset
+        /// (e.g. sb1234.ms gives sb1234_beam%b.ms)
+        /// @param[in] ms input measurement set name
+        /// @return name pattern for beamDatasetName
+        static std::string defaultBeamPattern(const std::string &ms)
+        {
+            const std::string ext(".ms");
+            if ((ms.size() > ext.size()) && (ms.compare(ms.size() - ext.size(), ext.size(), ext) == 0)) {
+                return ms.substr(0, ms.size() - ext.size()) + "_beam%b" + ext;
+            }
+            return ms + "_beam%b";
+        }
+
+        /// @brief create the calibration solution source
+        /// @param[in] parset parset with parameters of this application
+        /// @param[in] chanOffset channel offset for the solutions (for the distributed data)
+        /// @param[in] ioMutex optional mutex serialising table access with other threads. If given,
+        /// the source is always wrapped into the cache which locks this mutex to access the solutions
+        /// @return shared pointer to the solution source
+        ICalSolutionConstSource::ShPtr buildSolutionSource(const LOFAR::ParameterSet& parset,
+                const casa::uInt chanOffset = 0u,
+                const boost::shared_ptr<boost::mutex> &ioMutex = boost::shared_ptr<boost::mutex>()) const
         {
             // Create solution source
             ICalSolutionConstSource::ShPtr solutionSource =
@@ -218,6 +303,22 @@ class CcalApplyApp : public askap::Application
                 ASKAPLOG_DEBUG_STR(logger, "Setup an adapter to adjust channels by "<<chanOffset);
                 solutionSource.reset(new ChanAdapterCalSolutionConstSource(solutionSource, chanOffset));
             }
+            if (ioMutex || parset.getBool("calibrate.cache", false)) {
+                ASKAPLOG_DEBUG_STR(logger, "Calibration solutions will be cached in memory");
+                solutionSource.reset(new CalSolutionCache(solutionSource, ioMutex));
+            }
+            return solutionSource;
+        }
+
+        /// @brief create the calibration applicator
+        /// @param[in] parset parset with parameters of this application
+        /// @param[in] solutionSource calibration solution source (can be shared between applicators,
+        /// if it is thread safe)
+        /// @return shared pointer to the applicator
+        boost::shared_ptr<ICalibrationApplicator> buildCalApplicator(const LOFAR::ParameterSet& parset,
+                const ICalSolutionConstSource::ShPtr &solutionSource)
+        {
+            ASKAPASSERT(solutionSource);
 
             // Create applicator
             boost::shared_ptr<ICalibrationApplicator> calME(new CalibrationApplicatorME(solutionSource));
@@ -229,12 +330,15 @@ class CcalApplyApp : public askap::Application
             calME->allowFlag(allowFlag);
             calME->beamIndependent(parset.getBool("calibrate.ignorebeam", false));
             calME->channelIndependent(parset.getBool("calibrate.ignorechannel",false));
+            calME->numberOfThreads(parset.getUint32("calibrate.nthreads", 1));
             return calME;
         }
 
-        IDataSharedIter getDataIterator(const LOFAR::ParameterSet& parset, const askap::askapparallel::AskapParallel &comms) const
+        IDataSharedIter getDataIterator(const LOFAR::ParameterSet& parset, const askap::askapparallel::AskapParallel &comms,
+                                        const std::string &dataset = "") const
         {
-            const string ms = itsDistribute ? parset.getString("dataset") : comms.substitute(parset.getString("dataset"));
+            const string ms = dataset.size() > 0 ? dataset :
+                  (itsDistribute ? parset.getString("dataset") : comms.substitute(parset.getString("dataset")));
             TableDataSource ds(ms);
 
             IDataSelectorPtr sel=ds.createSelector();
@@ -30,17 +30,22 @@
 #include <sstream>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 
 // ASKAPsoft includes
 #include <casacore/casa/Arrays/IPosition.h>
 #include <askap/utils/CommandLineParser.h>
+#include <askap/utils/CubeUtils.h>
 #include <askap/AskapError.h>
+#include <askapparallel/AskapParallel.h>
 #include <casacore/coordinates/Coordinates/CoordinateSystem.h>
 #include <casacore/coordinates/Coordinates/Coordinate.h>
 #include <casacore/coordinates/Coordinates/LinearCoordinate.h>
 #include <casacore/casa/Quanta/MVDirection.h>
 #include <askap/imageaccess/CasaImageAccess.h>
 #include <casacore/images/Images/PagedImage.h>
+#include <casacore/lattices/Lattices/TiledShape.h>
 
 // Using
 using namespace askap;
@@ -48,13 +53,25 @@ using namespace std;
 
 // Main function
 int main(int argc, const char** argv) { 
+    // This class must have scope outside the main try/catch block
+    askapparallel::AskapParallel comms(argc, argv);
     try {
-        if (argc < 3) {
+        // optional parameters go first, the rest are input images followed by the output
+        int nFlagArgs = 0;
+        while ((1 + nFlagArgs < argc) && (string(argv[1 + nFlagArgs]) == "-m" || string(argv[1 + nFlagArgs]) == "-t")) {
+            nFlagArgs += 2;
+        }
+        if (argc - nFlagArgs < 3) {
             throw cmdlineparser::XParser();
         }
         cmdlineparser::Parser parser; // a command line parser
+        // memory limit in MB and number of reading threads
+        cmdlineparser::FlaggedParameter<int> maxMemory("-m", 1024);
+        cmdlineparser::FlaggedParameter<int> nThreads("-t", 2);
+        parser.add(maxMemory, cmdlineparser::Parser::return_default);
+        parser.add(nThreads, cmdlineparser::Parser::return_default);
         // command line parameter
-        std::vector<cmdlineparser::GenericParameter<std::string> > inputParameters(argc-2);     
+        std::vector<cmdlineparser::GenericParameter<std::string> > inputParameters(argc-2-nFlagArgs);     
         for (std::vector<cmdlineparser::GenericParameter<std::string> >::iterator it = inputParameters.begin();
                 it!= inputParameters.end(); ++it) {
             parser.add(*it);
@@ -63,13 +80,19 @@ int main(int argc, const char** argv) {
         parser.add(outfile);
 
         parser.process(argc, argv);
+        ASKAPCHECK(maxMemory > 0, "Memory limit should be positive");
+        ASKAPCHECK(nThreads > 0, "Number of threads should be positive");
 
         std::vector<std::string> inputFiles(inputParameters.size());
         for (size_t i=0;i<inputFiles.size();++i) {
             inputFiles[i] = inputParameters[i].getValue();
-            std::cout<<"Input image "<<i<<" is "<<inputFiles[i]<<std::endl;
+            if (comms.isMaster()) {
+                std::cout<<"Input image "<<i<<" is "<<inputFiles[i]<<std::endl;
+            }
+        }
+        if (comms.isMaster()) {
+            std::cout<<"Output will be stored to "<<outfile.getValue()<<std::endl;
         }
-        std::cout<<"Output will be stored to "<<outfile.getValue()<<std::endl;
         ASKAPCHECK(inputFiles.size()>0, "At least one input image should be defined");
         // Although this is now templated - going to restrict to casacore::Float for the moment
         accessors::CasaImageAccess<casacore::Float>  ia;
@@ -82,43 +105,72 @@ int main(int argc, const char** argv) {
         }
         newShape[shape.nelements()] = int(inputFiles.size());
 
-        casa::CoordinateSystem csys = ia.coordSys(inputFiles[0]);     
-        csys.addCoordinate(casa::LinearCoordinate(1));
+        // every input goes into its own tiles, so inputs can be written independently
+        const casa::IPosition inTile = casa::TiledShape(shape).tileShape();
+        casa::IPosition newTile(newShape.nelements(), 1);
+        for (int i = 0; i<int(shape.nelements()); ++i) {
+            newTile[i] = inTile[i];
+        }
+
+        // the output is created by the master, other ranks wait and open it
+        if (comms.isMaster()) {
+            casa::CoordinateSystem csys = ia.coordSys(inputFiles[0]);     
+            csys.addCoordinate(casa::LinearCoordinate(1));
+            casa::PagedImage<float> outimg(casa::TiledShape(newShape, newTile), csys, outfile.getValue());
+        }
+        comms.barrier();
 
-        casa::PagedImage<float> outimg(casa::TiledShape(newShape), csys, outfile.getValue());
+        // inputs are distributed between ranks and copied in slabs along the last axis,
+        // so only a few slabs are held in memory at any time
+        const casa::uInt axis = shape.nelements() - 1;
+        const int nBuffers = 2 * nThreads;
+        const int depth = slabDepth(shape, axis, size_t(maxMemory) * 1024 * 1024, nBuffers, inTile[axis]);
+        std::vector<ImageSlab> slabs;
+        // number of slabs of each rank, all ranks have to agree on the number of write rounds
+        std::vector<int> nSlabs(comms.nProcs(), 0);
         for (size_t i=0; i<inputFiles.size(); ++i) {
-            const casa::Array<float> buf = ia.read(inputFiles[i]);
-            ASKAPCHECK(buf.shape().nonDegenerate() == shape.nonDegenerate(), "Image "<<inputFiles[i]<<
-                    " has "<<buf.shape()<<" shape which is different from the shape of the first image "<<shape);
-
-#ifdef _OPENMP
-            #pragma omp parallel sections
-            {
-                #pragma omp section
-#endif
-                {
-                    const float peak = casa::abs(casa::max(buf));
-                    const float sum = casa::abs(casa::sum(buf));
-                    std::cout<<"Image "<<inputFiles[i]<<" has a peak of "<<peak<<", sum of "<<sum << std::endl;
-                }
+            const int owner = int(i % comms.nProcs());
+            const casa::IPosition inShape = ia.shape(inputFiles[i]);
+            ASKAPCHECK(inShape.nonDegenerate() == shape.nonDegenerate(), "Image "<<inputFiles[i]<<
+                    " has "<<inShape<<" shape which is different from the shape of the first image "<<shape);
+            ASKAPCHECK(inShape.nelements() == shape.nelements(), "Image "<<inputFiles[i]<<
+                    " has "<<inShape.nelements()<<" axes, the first image has "<<shape.nelements());
+            casa::IPosition where(newShape.nelements(),0);
+            where[shape.nelements()] = int(i);
+            const std::vector<ImageSlab> inSlabs = makeSlabs(i, casa::IPosition(shape.nelements(), 0),
+                    inShape - 1, where, axis, depth);
+            nSlabs[owner] += int(inSlabs.size());
+            if (owner == comms.rank()) {
+                slabs.insert(slabs.end(), inSlabs.begin(), inSlabs.end());
+            }
+        }
 
-#ifdef _OPENMP
-                #pragma omp section
-#endif
-                { 
-                    casa::IPosition where(newShape.nelements(),0);
-                    where[shape.nelements()] = int(i);
-                    outimg.putSlice(buf, where);
-                }
-#ifdef _OPENMP
+        // writes of different ranks into the output are serialised by a token
+        boost::shared_ptr<SlabWriteToken> token;
+        if (comms.nProcs() > 1) {
+            token.reset(new SlabWriteToken(comms, *std::max_element(nSlabs.begin(), nSlabs.end())));
+        }
+        std::vector<float> peaks;
+        std::vector<double> sums;
+        {
+            casa::PagedImage<float> outimg(outfile.getValue());
+            copySlabs(inputFiles, slabs, outimg, nThreads, nBuffers, peaks, sums, token);
+        }
+        if (token) {
+            token->finish();
+        }
+        for (size_t i=0; i<inputFiles.size(); ++i) {
+            if (int(i % comms.nProcs()) == comms.rank()) {
+                std::cout<<"Image "<<inputFiles[i]<<" has a peak of "<<std::abs(peaks[i])<<
+                           ", sum of "<<std::abs(sums[i]) << std::endl;
             }
-#endif
-        }         
+        }
+        comms.barrier();
     }
     ///==============================================================================
     catch (const cmdlineparser::XParser &ex) {
-        std::cerr << "Usage: " << argv[0] << " input_cube1 [input_cube2 ... input_cubeLast] output_image"
-            << std::endl;
+        std::cerr << "Usage: " << argv[0] << " [-m memory_limit_in_MB] [-t number_of_threads] "
+            "input_cube1 [input_cube2 ... input_cubeLast] output_image" << std::endl;
     }
 
     catch (const askap::AskapError& x) {
@@ -31,6 +31,9 @@
 #include <casacore/images/Images/ImageInterface.h>
 #include <casacore/images/Images/PagedImage.h>
 #include <casacore/images/Images/SubImage.h>
+#include <casacore/lattices/Lattices/TiledShape.h>
+#include <askap/utils/CubeUtils.h>
+#include <askapparallel/AskapParallel.h>
 
 
 
@@ -44,6 +47,8 @@ using namespace std;
 
 // Main function
 int main(int argc, const char** argv) { 
+  // This class must have scope outside the main try/catch block
+  askapparallel::AskapParallel comms(argc, argv);
   try {
      cmdlineparser::Parser parser; // a command line parser
      // command line parameter
@@ -53,23 +58,32 @@ int main(int argc, const char** argv) {
 // 	 cmdlineparser::GenericParameter<int> startchan;
      cmdlineparser::FlaggedParameter<int> startchan("-c",-1);
      cmdlineparser::FlaggedParameter<std::string> subsection("-s","[]");
+     // memory limit in MB
+     cmdlineparser::FlaggedParameter<int> maxMemory("-m",1024);
 	 
      parser.add(nchan,cmdlineparser::Parser::return_default); // optional
      parser.add(startchan,cmdlineparser::Parser::return_default);
      parser.add(subsection,cmdlineparser::Parser::return_default);
+     parser.add(maxMemory,cmdlineparser::Parser::return_default);
      parser.add(imgfile);
      parser.add(outfile);
      
      
      parser.process(argc, argv);
+     ASKAPCHECK(maxMemory > 0, "Memory limit should be positive");
+     casa::IPosition blc;
+     casa::IPosition trc;
+     casa::IPosition outShape;
+     casa::CoordinateSystem outCoordSys;
+     {
      casa::PagedImage<casa::Float> img(imgfile.getValue());
      ASKAPCHECK(img.ok(),"Error loading "<<imgfile.getValue());
      ASKAPCHECK(img.shape().nelements()>=3,"Work with at least 3D cubes!");
      
      const casa::IPosition shape = img.shape();
      
-     casa::IPosition blc(shape.nelements(),0);
-     casa::IPosition trc(shape);
+     blc = casa::IPosition(shape.nelements(),0);
+     trc = shape;
 
      std::string section = subsection.getValue();
 
@@ -106,17 +120,58 @@ int main(int argc, const char** argv) {
        throw cmdlineparser::XParser();
      }
 
-     std::cerr << "blc  = " << blc << ", trc = " << trc << "\n";
+     if (comms.isMaster()) {
+         std::cerr << "blc  = " << blc << ", trc = " << trc << "\n";
+     }
 
      casa::Slicer slc(blc,trc,casa::IPosition(shape.nelements(),1));
      
      casa::SubImage<casa::Float> si = casa::SubImage<casa::Float>(img,slc,casa::AxesSpecifier(casa::True));
-     casa::PagedImage<casa::Float> res(si.shape(),si.coordinates(),std::string(outfile.getValue()));
-     res.put(si.get());
+     outShape = si.shape();
+     outCoordSys = si.coordinates();
+     }
+
+     // the output is created by the master, other ranks wait and open it
+     if (comms.isMaster()) {
+         casa::PagedImage<casa::Float> res(casa::TiledShape(outShape),outCoordSys,std::string(outfile.getValue()));
+     }
+     comms.barrier();
+
+     // the region is copied in slabs of channels distributed between ranks, so only two
+     // slabs are held in memory by each rank and reading overlaps with writing
+     const casa::uInt axis = outShape.nelements() > 3 ? 3 : outShape.nelements() - 1;
+     const int nBuffers = 2;
+     const int depth = slabDepth(outShape, axis, size_t(maxMemory) * 1024 * 1024, nBuffers,
+                                 casa::TiledShape(outShape).tileShape()(axis));
+     // trc holds the length of the region
+     const std::vector<ImageSlab> allSlabs = makeSlabs(0, blc, blc + trc - 1,
+                                 casa::IPosition(outShape.nelements(),0), axis, depth);
+     std::vector<ImageSlab> slabs;
+     for (size_t i = 0; i < allSlabs.size(); ++i) {
+          if (int(i % comms.nProcs()) == comms.rank()) {
+              slabs.push_back(allSlabs[i]);
+          }
+     }
+     // writes of different ranks into the output are serialised by a token, the master
+     // has the largest number of slabs
+     boost::shared_ptr<SlabWriteToken> token;
+     if (comms.nProcs() > 1) {
+         token.reset(new SlabWriteToken(comms, int((allSlabs.size() + comms.nProcs() - 1) / comms.nProcs())));
+     }
+     std::vector<float> peaks;
+     std::vector<double> sums;
+     {
+         casa::PagedImage<casa::Float> res(outfile.getValue());
+         copySlabs(std::vector<std::string>(1, imgfile.getValue()), slabs, res, 1, nBuffers, peaks, sums, token);
+     }
+     if (token) {
+         token->finish();
+     }
+     comms.barrier();
   }
   ///==============================================================================
   catch (const cmdlineparser::XParser &ex) {
-	 std::cerr << "Usage: " << argv[0] << " [-n number_of_chan] [-c start_chan] [-s subsection_string] input_cube output_image"
+	 std::cerr << "Usage: " << argv[0] << " [-n number_of_chan] [-c start_chan] [-s subsection_string] [-m memory_limit_in_MB] input_cube output_image"
 			<< std::endl
 		   << "       One of -c or -s must be used" << std::endl
 		   << "       Format for subsection_string is [*,100:200,*,*], where * means entire axis, and range is minimum to maximum pixel value" << std::endl;
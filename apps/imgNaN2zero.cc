@@ -33,10 +33,14 @@
 #include <casacore/casa/Quanta/Quantum.h>
 #include <casacore/measures/Measures/MDirection.h>
 #include <casacore/casa/Quanta/MVDirection.h>
+#include <askap/imageaccess/CasaImageAccess.h>
+#include <askap/utils/ImageStreamer.h>
+#include <askap/utils/IImageChunkOperator.h>
 
 
 #include <stdexcept>
 #include <iostream>
+#include <vector>
 
 using namespace askap;
 using namespace std;
@@ -51,42 +55,70 @@ void printDirection(ostream &os,const casa::MDirection &dir)  {
 }
 
 
+/// @brief operator replacing NaNs by zeros
+/// @details The number of replaced NaNs is counted separately for each thread.
+class NaN2ZeroOperator : public IImageChunkOperator {
+public:
+    /// @brief constructor
+    /// @param[in] nThreads number of threads
+    explicit NaN2ZeroOperator(int nThreads) : itsCounts(nThreads, 0) {}
+
+    /// @brief replace NaNs in one chunk
+    /// @param[in] chunk pixels of the chunk
+    /// @param[in] blc position of the chunk in the image
+    /// @param[in] thread index of the calling thread
+    /// @return true if any NaNs have been replaced
+    virtual bool process(casa::Array<casa::Float> &chunk, const casa::IPosition &, int thread) {
+        float *data = chunk.data();
+        const size_t nElements = chunk.nelements();
+        size_t count = 0;
+        for (size_t i = 0; i < nElements; ++i) {
+             const bool isNaN = std::isnan(data[i]);
+             count += isNaN;
+             data[i] = isNaN ? 0.f : data[i];
+        }
+        itsCounts[thread] += count;
+        return count > 0;
+    }
+
+    /// @brief total number of replaced NaNs
+    /// @return number of NaNs replaced by all threads
+    size_t count() const {
+        size_t total = 0;
+        for (size_t thread = 0; thread < itsCounts.size(); ++thread) {
+             total += itsCounts[thread];
+        }
+        return total;
+    }
+
+private:
+    /// @brief number of replaced NaNs for each thread
+    std::vector<size_t> itsCounts;
+};
+
 // Main function
 int main(int argc, const char** argv) { 
   try {
      cmdlineparser::Parser parser; // a command line parser
      // command line parameter
+	 cmdlineparser::FlaggedParameter<int> nThreads("-t",1);
 	 cmdlineparser::GenericParameter<std::string> imgfile;
+	 parser.add(nThreads,cmdlineparser::Parser::return_default);
 	 parser.add(imgfile);
 
 	 // I hope const_cast is temporary here
 	 parser.process(argc, const_cast<char**> (argv));
-     casa::PagedImage<casa::Float> img(imgfile.getValue());
-     const casa::IPosition shape = img.shape();
-     ASKAPASSERT(shape.nelements()>=2);
-     casa::IPosition curpos(shape.nelements(),0);
-     casa::uInt nElements = shape.product();
-     casa::uInt countNaNs = 0;
-     for (casa::uInt i=0;i<nElements;++i) {
-          float val = img(curpos);
-          if (std::isnan(val)) {
-              val = 0;
-              ++countNaNs;
-          }
-          img.putAt(val,curpos);
-          for (int dim=0;dim<int(shape.nelements());++dim) {
-               ++curpos[dim];
-               if (curpos[dim]<shape[dim]) {
-                   break;
-               }
-               curpos[dim] = 0;
-          }
-     }
-     std::cout<<"Replaced "<<countNaNs<<" NaNs"<<std::endl;
+     accessors::CasaImageAccess<casa::Float> ia;
+     // the image is processed in chunks of whole tiles, only chunks with NaNs are written back
+     ImageStreamer streamer(ia, imgfile.getValue(), nThreads);
+     ASKAPASSERT(streamer.shape().nelements()>=2);
+     NaN2ZeroOperator op(streamer.nThreads());
+     streamer.run(op);
+     std::cout<<"Replaced "<<op.count()<<" NaNs"<<std::endl;
   }
   ///==============================================================================
   catch (const cmdlineparser::XParser &ex) {
-	 std::cerr << "Usage: " << argv[0] << " imagefile"
+	 std::cerr << "Usage: " << argv[0] << " [-t number_of_threads] imagefile"
 			<< std::endl;
   }
 
@@ -33,6 +33,9 @@
 #include <casacore/casa/Quanta/Quantum.h>
 #include <casacore/measures/Measures/MDirection.h>
 #include <casacore/casa/Quanta/MVDirection.h>
+#include <askap/imageaccess/CasaImageAccess.h>
+#include <askap/utils/ImageStreamer.h>
+#include <askap/utils/IImageChunkOperator.h>
 
 
 #include <stdexcept>
@@ -51,18 +54,47 @@ void printDirection(ostream &os,const casa::MDirection &dir)  {
 }
 
 
+/// @brief operator multiplying pixels by a constant factor
+class ScaleOperator : public IImageChunkOperator {
+public:
+    /// @brief constructor
+    /// @param[in] factor scaling factor
+    explicit ScaleOperator(float factor) : itsFactor(factor) {}
+
+    /// @brief scale one chunk
+    /// @param[in] chunk pixels of the chunk
+    /// @param[in] blc position of the chunk in the image
+    /// @param[in] thread index of the calling thread
+    /// @return true, the chunk is always changed
+    virtual bool process(casa::Array<casa::Float> &chunk, const casa::IPosition &, int) {
+        float *data = chunk.data();
+        const size_t nElements = chunk.nelements();
+        for (size_t i = 0; i < nElements; ++i) {
+             data[i] *= itsFactor;
+        }
+        return true;
+    }
+
+private:
+    /// @brief scaling factor
+    float itsFactor;
+};
+
 // Main function
 int main(int argc, const char** argv) { 
   try {
      cmdlineparser::Parser parser; // a command line parser
      // command line parameter
+	 cmdlineparser::FlaggedParameter<int> nThreads("-t",1);
 	 cmdlineparser::GenericParameter<std::string> imgfile;
+	 parser.add(nThreads,cmdlineparser::Parser::return_default);
 	 parser.add(imgfile);
 
 	 // I hope const_cast is temporary here
 	 parser.process(argc, const_cast<char**> (argv));
-         casa::PagedImage<casa::Float> img(imgfile.getValue());
-         casa::IPosition shape = img.shape();
+         accessors::CasaImageAccess<casa::Float> ia;
+         ImageStreamer streamer(ia, imgfile.getValue(), nThreads);
+         const casa::IPosition shape = streamer.shape();
          ASKAPASSERT(shape.nelements()>=2);
          const int xcentre = 269;
          const int ycentre = 247;
@@ -71,19 +103,20 @@ int main(int argc, const char** argv) {
          ASKAPASSERT(ycentre+boxsz<shape[1]);
          ASKAPASSERT(xcentre-boxsz>=0);
          ASKAPASSERT(ycentre-boxsz>=0);
-         for (int x=xcentre-boxsz;x<=xcentre+boxsz;++x) {
-              for (int y=xcentre-boxsz;y<=xcentre+boxsz;++y) {
-                   casa::IPosition pos(shape.nelements(),0);
-                   pos[0]=x;
-                   pos[1]=shape[1]-y-1;
-                   const float val = img(pos);
-                   img.putAt(val*10., pos);
-              }
-         }
+         // the box is flipped vertically and, as before, centred at xcentre along both axes
+         casa::IPosition blc(shape.nelements(),0);
+         casa::IPosition trc(shape.nelements(),0);
+         blc[0] = xcentre-boxsz;
+         trc[0] = xcentre+boxsz;
+         blc[1] = shape[1]-xcentre-boxsz-1;
+         trc[1] = shape[1]-xcentre+boxsz-1;
+         streamer.setRegion(blc,trc);
+         ScaleOperator op(10.);
+         streamer.run(op);
   }
   ///==============================================================================
   catch (const cmdlineparser::XParser &ex) {
-	 std::cerr << "Usage: " << argv[0] << " imagefile"
+	 std::cerr << "Usage: " << argv[0] << " [-t number_of_threads] imagefile"
 			<< std::endl;
   }
 
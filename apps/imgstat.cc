@@ -29,8 +29,6 @@
 
 #include <casacore/casa/Arrays/IPosition.h>
 #include <casacore/images/Images/PagedImage.h>
-#include <casacore/images/Images/SubImage.h>
-#include <casacore/images/Images/ImageStatistics.h>
 #include <askap/utils/CommandLineParser.h>
 #include <askap/AskapError.h>
 #include <casacore/coordinates/Coordinates/DirectionCoordinate.h>
@@ -40,10 +38,18 @@
 #include <casacore/casa/Quanta/Quantum.h>
 #include <casacore/measures/Measures/MDirection.h>
 #include <casacore/casa/Quanta/MVDirection.h>
+#include <askap/imageaccess/CasaImageAccess.h>
+#include <askap/utils/ImageStreamer.h>
+#include <askap/utils/IImageChunkOperator.h>
 
 
 #include <stdexcept>
 #include <iostream>
+#include <iomanip>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 
 using namespace askap;
 
@@ -57,28 +63,376 @@ void printDirection(std::ostream &os,const casa::MDirection &dir)  {
 }
 
 
+/// @brief statistics of an image accumulated chunk by chunk
+/// @details NaNs are ignored (the streamer passes pixels masked out in the image
+/// as NaNs). Results are accumulated separately for each thread and merged by the
+/// get methods.
+class StatsOperator : public IImageChunkOperator {
+public:
+    /// @brief constructor
+    /// @param[in] nThreads number of threads
+    explicit StatsOperator(int nThreads) : itsStats(nThreads) {}
+
+    /// @brief accumulate statistics of one chunk
+    /// @param[in] chunk pixels of the chunk
+    /// @param[in] blc position of the chunk in the image
+    /// @param[in] thread index of the calling thread
+    /// @return false, the chunk is not changed
+    virtual bool process(casa::Array<casa::Float> &chunk, const casa::IPosition &blc, int thread) {
+        const float *data = chunk.data();
+        const size_t nElements = chunk.nelements();
+        ThreadStats &stats = itsStats[thread];
+        size_t minIndex = nElements;
+        size_t maxIndex = nElements;
+        float minVal = 0.;
+        float maxVal = 0.;
+        size_t count = 0;
+        double sumsq = 0.;
+        for (size_t i = 0; i < nElements; ++i) {
+             const float val = data[i];
+             if (std::isnan(val)) {
+                 continue;
+             }
+             ++count;
+             sumsq += double(val) * val;
+             if (minIndex == nElements || val < minVal) {
+                 minVal = val;
+                 minIndex = i;
+             }
+             if (maxIndex == nElements || val > maxVal) {
+                 maxVal = val;
+                 maxIndex = i;
+             }
+        }
+        if (count > 0) {
+            if (stats.count == 0 || minVal < stats.min) {
+                stats.min = minVal;
+                stats.minPos = blc + casa::toIPositionInArray(minIndex, chunk.shape());
+            }
+            if (stats.count == 0 || maxVal > stats.max) {
+                stats.max = maxVal;
+                stats.maxPos = blc + casa::toIPositionInArray(maxIndex, chunk.shape());
+            }
+            stats.count += count;
+            stats.sumsq += sumsq;
+        }
+        return false;
+    }
+
+    /// @brief number of pixels which are not NaN
+    size_t count() const { return merged().count; }
+
+    /// @brief minimum and maximum with their positions
+    /// @param[out] minVal minimum
+    /// @param[out] maxVal maximum
+    /// @param[out] minPos position of the minimum
+    /// @param[out] maxPos position of the maximum
+    void getMinMax(float &minVal, float &maxVal, casa::IPosition &minPos, casa::IPosition &maxPos) const {
+        const ThreadStats stats = merged();
+        ASKAPCHECK(stats.count > 0, "No valid pixels found");
+        minVal = stats.min;
+        maxVal = stats.max;
+        minPos = stats.minPos;
+        maxPos = stats.maxPos;
+    }
+
+    /// @brief root mean square
+    float rms() const {
+        const ThreadStats stats = merged();
+        ASKAPCHECK(stats.count > 0, "No valid pixels found");
+        return std::sqrt(stats.sumsq / stats.count);
+    }
+
+private:
+    /// @brief statistics accumulated by one thread
+    struct ThreadStats {
+        ThreadStats() : count(0), sumsq(0.), min(0.), max(0.) {}
+        size_t count;
+        double sumsq;
+        float min;
+        float max;
+        casa::IPosition minPos;
+        casa::IPosition maxPos;
+    };
+
+    /// @brief merge the statistics of all threads
+    ThreadStats merged() const {
+        ThreadStats result;
+        for (size_t thread = 0; thread < itsStats.size(); ++thread) {
+             const ThreadStats &stats = itsStats[thread];
+             if (stats.count == 0) {
+                 continue;
+             }
+             if (result.count == 0 || stats.min < result.min) {
+                 result.min = stats.min;
+                 result.minPos = stats.minPos;
+             }
+             if (result.count == 0 || stats.max > result.max) {
+                 result.max = stats.max;
+                 result.maxPos = stats.maxPos;
+             }
+             result.count += stats.count;
+             result.sumsq += stats.sumsq;
+        }
+        return result;
+    }
+
+    /// @brief statistics for each thread
+    std::vector<ThreadStats> itsStats;
+};
+
+/// @brief range of values narrowed by successive histograms
+/// @details A value is in the range if it falls into the selected bins of every histogram.
+struct HistogramRange {
+    /// @brief number of bins in each histogram
+    static const int theirNBins = 65536;
+
+    /// @brief bin of a value in one of the histograms
+    /// @param[in] level index of the histogram
+    /// @param[in] val value
+    /// @return bin index
+    int bin(size_t level, float val) const {
+        const int index = int((val - lo[level]) * scale[level]);
+        return std::max(0, std::min(theirNBins - 1, index));
+    }
+
+    /// @brief test whether a value is in the range
+    /// @param[in] val value
+    /// @return true if the value falls into the selected bins of all histograms
+    bool contains(float val) const {
+        if (std::isnan(val)) {
+            return false;
+        }
+        for (size_t level = 0; level < firstBin.size(); ++level) {
+             if (val < lo[level] || val > hi[level]) {
+                 return false;
+             }
+             const int index = bin(level, val);
+             if (index < firstBin[level] || index > lastBin[level]) {
+                 return false;
+             }
+        }
+        return true;
+    }
+
+    /// @brief start a new histogram covering the current range
+    /// @param[in] minVal smallest value in the range
+    /// @param[in] maxVal largest value in the range
+    void addLevel(float minVal, float maxVal) {
+        lo.push_back(minVal);
+        hi.push_back(maxVal);
+        scale.push_back(maxVal > minVal ? theirNBins / (double(maxVal) - minVal) : 0.);
+        firstBin.push_back(0);
+        lastBin.push_back(theirNBins - 1);
+    }
+
+    std::vector<float> lo;
+    std::vector<float> hi;
+    std::vector<double> scale;
+    std::vector<int> firstBin;
+    std::vector<int> lastBin;
+};
+
+/// @brief histogram of the values in the current range
+/// @details The smallest and the largest value in the range are also found.
+class HistogramOperator : public IImageChunkOperator {
+public:
+    /// @brief constructor
+    /// @param[in] range range of values (the histogram is built at its last level)
+    /// @param[in] nThreads number of threads
+    HistogramOperator(const HistogramRange &range, int nThreads) : itsRange(range),
+          itsCounts(nThreads, std::vector<size_t>(HistogramRange::theirNBins, 0)),
+          itsMin(nThreads, std::numeric_limits<float>::max()),
+          itsMax(nThreads, -std::numeric_limits<float>::max()) {}
+
+    /// @brief add the values of one chunk to the histogram
+    /// @param[in] chunk pixels of the chunk
+    /// @param[in] blc position of the chunk in the image
+    /// @param[in] thread index of the calling thread
+    /// @return false, the chunk is not changed
+    virtual bool process(casa::Array<casa::Float> &chunk, const casa::IPosition &, int thread) {
+        const float *data = chunk.data();
+        const size_t nElements = chunk.nelements();
+        const size_t level = itsRange.lo.size() - 1;
+        std::vector<size_t> &counts = itsCounts[thread];
+        for (size_t i = 0; i < nElements; ++i) {
+             if (itsRange.contains(data[i])) {
+                 ++counts[itsRange.bin(level, data[i])];
+                 itsMin[thread] = std::min(itsMin[thread], data[i]);
+                 itsMax[thread] = std::max(itsMax[thread], data[i]);
+             }
+        }
+        return false;
+    }
+
+    /// @brief smallest value in the range
+    float min() const { return *std::min_element(itsMin.begin(), itsMin.end()); }
+
+    /// @brief largest value in the range
+    float max() const { return *std::max_element(itsMax.begin(), itsMax.end()); }
+
+    /// @brief merged histogram
+    /// @return number of values in each bin
+    std::vector<size_t> counts() const {
+        std::vector<size_t> result(HistogramRange::theirNBins, 0);
+        for (size_t thread = 0; thread < itsCounts.size(); ++thread) {
+             for (int bin = 0; bin < HistogramRange::theirNBins; ++bin) {
+                  result[bin] += itsCounts[thread][bin];
+             }
+        }
+        return result;
+    }
+
+private:
+    /// @brief range of values
+    const HistogramRange &itsRange;
+    /// @brief histogram for each thread
+    std::vector<std::vector<size_t> > itsCounts;
+    /// @brief smallest value found by each thread
+    std::vector<float> itsMin;
+    /// @brief largest value found by each thread
+    std::vector<float> itsMax;
+};
+
+/// @brief collect all values in the current range
+class CollectOperator : public IImageChunkOperator {
+public:
+    /// @brief constructor
+    /// @param[in] range range of values
+    /// @param[in] nThreads number of threads
+    CollectOperator(const HistogramRange &range, int nThreads) : itsRange(range), itsValues(nThreads) {}
+
+    /// @brief collect the values of one chunk
+    /// @param[in] chunk pixels of the chunk
+    /// @param[in] blc position of the chunk in the image
+    /// @param[in] thread index of the calling thread
+    /// @return false, the chunk is not changed
+    virtual bool process(casa::Array<casa::Float> &chunk, const casa::IPosition &, int thread) {
+        const float *data = chunk.data();
+        const size_t nElements = chunk.nelements();
+        for (size_t i = 0; i < nElements; ++i) {
+             if (itsRange.contains(data[i])) {
+                 itsValues[thread].push_back(data[i]);
+             }
+        }
+        return false;
+    }
+
+    /// @brief values collected by all threads
+    std::vector<float> values() const {
+        std::vector<float> result;
+        for (size_t thread = 0; thread < itsValues.size(); ++thread) {
+             result.insert(result.end(), itsValues[thread].begin(), itsValues[thread].end());
+        }
+        return result;
+    }
+
+private:
+    /// @brief range of values
+    const HistogramRange &itsRange;
+    /// @brief values collected by each thread
+    std::vector<std::vector<float> > itsValues;
+};
+
+/// @brief exact median of an image with bounded memory
+/// @details The histogram of the values is refined until the bins holding the
+/// middle values are small enough to be collected and sorted.
+/// @param[in] streamer image streamer
+/// @param[in] count number of values which are neither NaN nor masked
+/// @param[in] minVal smallest value
+/// @param[in] maxVal largest value
+/// @return median (the mean of the two middle values for an even count)
+float streamedMedian(ImageStreamer &streamer, size_t count, float minVal, float maxVal) {
+    ASKAPCHECK(count > 0, "No valid pixels found");
+    const size_t maxCollect = 1 << 24;
+    // ranks of the middle values
+    const size_t rank1 = (count - 1) / 2;
+    const size_t rank2 = count / 2;
+    // number of values below the current range
+    size_t below = 0;
+    size_t inRange = count;
+    HistogramRange range;
+    range.addLevel(minVal, maxVal);
+    if (minVal == maxVal) {
+        return minVal;
+    }
+    while (inRange > maxCollect) {
+        HistogramOperator histOp(range, streamer.nThreads());
+        streamer.run(histOp);
+        if (histOp.min() == histOp.max()) {
+            // e.g. a large number of blanked pixels set to zero
+            return histOp.min();
+        }
+        const std::vector<size_t> counts = histOp.counts();
+        const size_t level = range.lo.size() - 1;
+        int bin1 = -1;
+        int bin2 = -1;
+        size_t cumulative = below;
+        size_t belowFirst = below;
+        for (int bin = 0; bin < HistogramRange::theirNBins && bin2 < 0; ++bin) {
+             if (bin1 < 0 && cumulative + counts[bin] > rank1) {
+                 bin1 = bin;
+                 belowFirst = cumulative;
+             }
+             if (cumulative + counts[bin] > rank2) {
+                 bin2 = bin;
+             }
+             cumulative += counts[bin];
+        }
+        ASKAPCHECK(bin1 >= 0 && bin2 >= 0, "Failed to locate the median in the histogram");
+        range.firstBin[level] = bin1;
+        range.lastBin[level] = bin2;
+        below = belowFirst;
+        const size_t newInRange = cumulative - belowFirst;
+        if (newInRange == inRange) {
+            // all values fall into one bin, the range can't be narrowed further
+            break;
+        }
+        inRange = newInRange;
+        // the next histogram covers the selected bins
+        minVal = range.lo[level] + bin1 / range.scale[level];
+        maxVal = range.lo[level] + (bin2 + 1) / range.scale[level];
+        range.addLevel(minVal, maxVal);
+    }
+    CollectOperator collectOp(range, streamer.nThreads());
+    streamer.run(collectOp);
+    std::vector<float> values = collectOp.values();
+    ASKAPCHECK(values.size() > rank2 - below, "Failed to collect the middle values");
+    std::nth_element(values.begin(), values.begin() + (rank1 - below), values.end());
+    const float val1 = values[rank1 - below];
+    std::nth_element(values.begin(), values.begin() + (rank2 - below), values.end());
+    const float val2 = values[rank2 - below];
+    return 0.5 * (val1 + val2);
+}
+
 // Main function
 int main(int argc, const char** argv) { 
   try {
      cmdlineparser::Parser parser; // a command line parser
 	 // command line parameters
 	 cmdlineparser::FlagParameter doWtStats("-w");      
+	 cmdlineparser::FlaggedParameter<int> nThreads("-t",1);
 	 cmdlineparser::GenericParameter<std::string> imgfile;
 	 parser.add(doWtStats,cmdlineparser::Parser::return_default);
+	 parser.add(nThreads,cmdlineparser::Parser::return_default);
 	 parser.add(imgfile);
 
 	 // I hope const_cast is temporary here
 	 parser.process(argc, const_cast<char**> (argv));
-     casa::PagedImage<casa::Float> img(imgfile.getValue());
-     casa::ImageStatistics<casa::Float> imstat(img, casa::False);
+     accessors::CasaImageAccess<casa::Float> ia;
+     const casa::CoordinateSystem csys = ia.coordSys(imgfile.getValue());
+     ImageStreamer streamer(ia, imgfile.getValue(), nThreads);
+     // exclude masked pixels from all statistics like ImageStatistics did
+     streamer.applyMask();
+     StatsOperator statsOp(streamer.nThreads());
+     streamer.run(statsOp);
      float tmin,tmax;
-     imstat.getFullMinMax(tmin,tmax);
      casa::IPosition minPos,maxPos;
-     imstat.getMinMaxPos(minPos,maxPos);
-     casa::Int direction_coordinate = img.coordinates().findCoordinate(casa::Coordinate::DIRECTION);
+     statsOp.getMinMax(tmin,tmax,minPos,maxPos);
+     casa::Int direction_coordinate = csys.findCoordinate(casa::Coordinate::DIRECTION);
      ASKAPASSERT(direction_coordinate>=0);
      ASKAPASSERT(maxPos.nelements()>=2);
-     const casa::DirectionCoordinate &dc = img.coordinates().directionCoordinate(direction_coordinate);
+     const casa::DirectionCoordinate &dc = csys.directionCoordinate(direction_coordinate);
      casa::Vector<casa::Double> pixel(2);
      pixel(0)=casa::Double(maxPos[0]);
      pixel(1)=casa::Double(maxPos[1]);
@@ -93,20 +447,11 @@ int main(int argc, const char** argv) {
      std::cout<<std::setprecision(15)<<res.getValue().getLong("deg").getValue()<<" "<<
                 res.getValue().getLat("deg").getValue()<<" # RA DEC"<<std::endl;
      
-     casa::Array<float> statBuf;
-     if (imstat.getConvertedStatistic(statBuf,casa::LatticeStatsBase::RMS)) {
-         casa::Vector<float> statVec(statBuf.reform(casa::IPosition(1,statBuf.nelements())));
-         ASKAPCHECK(statVec.nelements() == 1, "Expect exactly one element in the array returned by getConvertedStatistics; you have: "<<statVec);         
-         std::cout<<statVec[0]<<" ";
-     }
-     if (imstat.getConvertedStatistic(statBuf,casa::LatticeStatsBase::MEDIAN)) {
-         casa::Vector<float> statVec(statBuf.reform(casa::IPosition(1,statBuf.nelements())));
-         ASKAPCHECK(statVec.nelements() == 1, "Expect exactly one element in the array returned by getConvertedStatistics; you have: "<<statVec);         
-         std::cout<<statVec[0]<<" # RMS MEDIAN"<<std::endl;
-     }
+     std::cout<<statsOp.rms()<<" ";
+     std::cout<<streamedMedian(streamer, statsOp.count(), tmin, tmax)<<" # RMS MEDIAN"<<std::endl;
      if (doWtStats.defined()) {
          // making a slice to get inner quarter
-         const casa::IPosition shape = img.shape();
+         const casa::IPosition shape = streamer.shape();
          ASKAPCHECK(shape.nelements() >= 2, "Need 2D images for the '-w' option");
          casa::IPosition blc(shape.nelements(),0);
          casa::IPosition trc(shape);
@@ -122,18 +467,19 @@ int main(int argc, const char** argv) {
          trc[1] = 3*blc[1];
          ASKAPCHECK(blc[0]>=0 && blc[1]>=0, "BLC is negative: "<<blc<<", shape="<<shape);
          ASKAPCHECK(trc[1]<shape[1] && trc[0]<shape[0], "TRC extends beyond the edge: "<<trc<<", shape="<<shape<<" blc="<<blc);
-         casa::Slicer slc(blc,trc,casa::IPosition(shape.nelements(),1),casa::Slicer::endIsLast);
-         casa::SubImage<casa::Float> si(img,slc,casa::AxesSpecifier(casa::True));
-         casa::ImageStatistics<casa::Float> imStatWt(si, casa::False);
-         imStatWt.getFullMinMax(tmin,tmax);
+         streamer.setRegion(blc,trc);
+         StatsOperator wtStatsOp(streamer.nThreads());
+         streamer.run(wtStatsOp);
+         wtStatsOp.getMinMax(tmin,tmax,minPos,maxPos);
          std::cout<<tmax<<" "<<tmin<<" # MAX MIN in the inner quarter"<<std::endl; 
      }     
   }
   ///==============================================================================
   catch (const cmdlineparser::XParser &ex) {
-	 std::cerr << "Usage: " << argv[0] << " [-w] imagefile"
+	 std::cerr << "Usage: " << argv[0] << " [-w] [-t number_of_threads] imagefile"
 			<< std::endl<<
-			"  -w print min/max of the inner quarter (useful for weights analysis)"<<std::endl;
+			"  -w print min/max of the inner quarter (useful for weights analysis)"<<std::endl<<
+			"  -t number of threads processing the image"<<std::endl;
   }
 
   catch (const askap::AskapError& x) {
@@ -27,6 +27,28 @@ using namespace askap::synthesis;
 
 namespace askap {
 
+/// @brief wait for the write token from the previous rank
+/// @details This is essentially a serialiser - it is required for CASA image types
+/// but not FITS. The master starts the chain in every round.
+/// @param[in] comms communication object
+static void waitForWriteToken(askap::askapparallel::AskapParallel &comms) {
+  if (!comms.isMaster()) {
+    int buf;
+    int from = comms.rank() - 1;
+    comms.receive((void *) &buf,sizeof(int),from);
+  }
+}
+
+/// @brief pass the write token to the next rank
+/// @param[in] comms communication object
+static void passWriteToken(askap::askapparallel::AskapParallel &comms) {
+  if (comms.rank() < comms.nProcs()-1) { // last rank doesnot use this method
+    int buf = 0;
+    int to = comms.rank()+1;
+    comms.send((void *) &buf,sizeof(int),to);
+  }
+}
+
 // @brief do the merge
 /// @param[in] parset subset with parameters
 static void mergeMPI(const LOFAR::ParameterSet &parset, askap::askapparallel::AskapParallel &comms) {
@@ -122,35 +144,119 @@ static void mergeMPI(const LOFAR::ParameterSet &parset, askap::askapparallel::As
     ASKAPCHECK(shape.nelements()>=3,"Work with at least 3D cubes!");
     ASKAPLOG_INFO_STR(logger," - ImageAccess Shape " << shape);
 
-    // lets calculate the allocations ...
+    originalNchan = shape[3];
+
+    // the spatial shape of the output doesn't depend on the channel, so all ranks can
+    // get it from the first plane of each input before the work is distributed
+    for (vector<string>::iterator it = inImgNames.begin(); it != inImgNames.end(); ++it) {
+      const casa::IPosition inShape = iacc.shape(*it);
+      casa::IPosition inblc(inShape.nelements(),0);
+      casa::IPosition intrc(inShape - 1);
+      intrc[3] = 0;
+      inCoordSysVec.push_back(iacc.coordSysSlice(*it,inblc,intrc));
+      casa::IPosition planeShape(inShape);
+      planeShape[3] = 1;
+      inShapeVec.push_back(planeShape);
+    }
+    accumulator.setOutputParameters(inShapeVec, inCoordSysVec);
+    casa::IPosition outShape = accumulator.outShape();
+    outShape[3] = originalNchan;
 
-    casa::IPosition blc(shape.nelements(),0);
-    casa::IPosition trc(shape);
-    originalNchan = trc[3];
+    // Build the full output cube here, before any rank writes to it. The metadata are
+    // written now as well, because the FITS header may grow and move the data.
+    if (comms.isMaster()) { // build this cube - does not need to loop over the outWgtNames
 
-    if (comms.rank() >= trc[3]) {
-      ASKAPLOG_WARN_STR(logger,"Rank " << comms.rank() << " has no work to merge");
-      return;
-    }
-    if (trc[3] % comms.nProcs() != 0) {
-      ASKAPLOG_WARN_STR(logger,"Unbalanced allocation: num of ranks:" << comms.nProcs() << " not a factor of number of channels: "<< trc[3]);
-    }
-    if (comms.nProcs() >= trc[3]) {
-      myFullAllocationSize = 1;
-    }
-    else {
-      myFullAllocationSize = trc[3]/comms.nProcs();
-    }
+      ASKAPLOG_INFO_STR(logger, "++++++++++++++++++++++++++++++++++++++++++");
+      ASKAPLOG_INFO_STR(logger, "Building output mosaic " << outImgName);
+      ASKAPLOG_INFO_STR(logger, "++++++++++++++++++++++++++++++++++++++++++");
+
+      // set one of the input images as a reference for metadata (the first by default)
+      uint psfref = 0;
+      if (parset.isDefined("psfref")) psfref = parset.getUint("psfref");
+
+      ASKAPLOG_INFO_STR(logger, "Getting brightness info for the output image from input number " << psfref);
+      // get pixel units from the selected reference image
+
+      string units = iacc.getUnits(inImgNames[psfref]);
+      ASKAPLOG_INFO_STR(logger, "Got units as " << units);
+
+      ASKAPLOG_INFO_STR(logger, "Getting PSF beam info for the output image from input number " << psfref);
+      // get psf beam information from the selected reference image
+      Vector<Quantum<double> > psf;
+      Vector<Quantum<double> > psftmp = iacc.beamInfo(inImgNames[psfref]);
+      if (psftmp.nelements()<3) {
+        ASKAPLOG_WARN_STR(logger, inImgNames[psfref] <<
+        ": beamInfo needs at least 3 elements. Not writing PSF");
+      }
+      else if ((psftmp[0].getValue("rad")==0) || (psftmp[1].getValue("rad")==0)) {
+        ASKAPLOG_WARN_STR(logger, inImgNames[psfref] <<
+          ": beamInfo invalid. Not writing PSF");
+      }
+      else {
+        psf = psftmp;
+      }
+
+      ASKAPLOG_INFO_STR(logger, " Creating output file - Shape " << outShape << " OriginalNchan " << originalNchan);
+      iacc.create(outImgName, outShape, accumulator.outCoordSys());
+      iacc.makeDefaultMask(outImgName);
+      iacc.setUnits(outImgName,units);
+      if (psf.nelements()>=3)
+        iacc.setBeamInfo(outImgName, psf[0].getValue("rad"), psf[1].getValue("rad"), psf[2].getValue("rad"));
+
+      if (accumulator.outWgtDuplicates()[outImgName]) {
+        ASKAPLOG_INFO_STR(logger, "Accumulated weight image " << outWgtName << " already written");
+      } else {
+        outWgtName = accumulator.outWgtNames()[outImgName];
+        ASKAPLOG_INFO_STR(logger, "Writing accumulated weight image to " << outWgtName);
+        iacc.create(outWgtName, outShape, accumulator.outCoordSys());
+        iacc.makeDefaultMask(outWgtName);
+        iacc.setUnits(outWgtName,units);
+        if (psf.nelements()>=3)
+          iacc.setBeamInfo(outWgtName, psf[0].getValue("rad"), psf[1].getValue("rad"), psf[2].getValue("rad"));
+      }
+      if (accumulator.doSensitivity()) {
+        outSenName = accumulator.outSenNames()[outImgName];
+        ASKAPLOG_INFO_STR(logger, "Writing accumulated sensitivity image to " << outSenName);
+        iacc.create(outSenName, outShape, accumulator.outCoordSys());
+        iacc.makeDefaultMask(outSenName);
+        iacc.setUnits(outSenName,units);
+        if (psf.nelements()>=3)
+          iacc.setBeamInfo(outSenName, psf[0].getValue("rad"), psf[1].getValue("rad"), psf[2].getValue("rad"));
+      }
+    } // built the output cube for this image
+    comms.barrier();
 
-    myFullAllocationStart = comms.rank()*myFullAllocationSize;
+    // lets calculate the allocations ...
+    // Each rank gets a contiguous slab of whole tiles (or FITS records), so ranks
+    // never touch the storage of the others. The slabs are balanced to within one
+    // storage unit.
+
+    const string imageType = parset.getString("imagetype","casa");
+    const int granularity = channelWriteGranularity(imageType, outShape);
+    allocateChannels(originalNchan, comms.nProcs(), comms.rank(), granularity,
+                     myFullAllocationStart, myFullAllocationSize);
     myFullAllocationStop = myFullAllocationStart + myFullAllocationSize;
 
-    // unless last rank
-    if (comms.rank() == comms.nProcs()-1) {
-      myFullAllocationSize = trc[3] - myFullAllocationStart; // we are using End is Last
+    ASKAPLOG_INFO_STR(logger,"FullAllocation starts at " << myFullAllocationStart << " and is " << myFullAllocationSize <<
+                      " in size, " << granularity << " channel(s) per storage unit");
+    if (myFullAllocationSize == 0) {
+      ASKAPLOG_WARN_STR(logger,"Rank " << comms.rank() << " has no work to merge");
     }
 
-    ASKAPLOG_INFO_STR(logger,"FullAllocation starts at " << myFullAllocationStart << " and is " << myFullAllocationSize << " in size");
+    // FITS slabs are written concurrently. Writes to CASA images are serialised by a
+    // token passed from rank to rank once per write. Allocations differ in size, so
+    // the token goes round in lock-step rounds: the number of rounds is set by the
+    // largest allocation (rank 0), and ranks with nothing left to write still pass
+    // the token on.
+    const bool serialiseWrites = (imageType != "fits");
+    int nWriteRounds = 0;
+    if (serialiseWrites) {
+      int firstStart = 0;
+      int firstSize = 0;
+      allocateChannels(originalNchan, comms.nProcs(), 0, granularity, firstStart, firstSize);
+      nWriteRounds = (firstSize + myAllocationSize - 1) / myAllocationSize;
+    }
+    int nRoundsDone = 0;
 
 
     // So the plan is to iterate over each channel ...
@@ -158,6 +264,9 @@ static void mergeMPI(const LOFAR::ParameterSet &parset, askap::askapparallel::As
 
     for (myAllocationStart = myFullAllocationStart; myAllocationStart < myFullAllocationStop; myAllocationStart = myAllocationStart +  myAllocationSize) {
 
+      inShapeVec.clear();
+      inCoordSysVec.clear();
+
 
 
 
@@ -187,7 +296,7 @@ static void mergeMPI(const LOFAR::ParameterSet &parset, askap::askapparallel::As
 
 
         ASKAPCHECK(inblc[3]>=0 && inblc[3]<shape[3], "Start channel is outside the number of channels or negative, shape: "<<shape);
-        ASKAPCHECK(trc[3]<=shape[3], "Subcube extends beyond the original cube, shape:"<<shape);
+        ASKAPCHECK(intrc[3]<shape[3], "Subcube extends beyond the original cube, shape:"<<shape);
 
         ASKAPLOG_INFO_STR(logger, " - Corners " << "input bottom lc  = " << inblc << ", input top rc = " << intrc << "\n");
         inCoordSysVec.push_back(iacc.coordSysSlice(*it,inblc,intrc));
@@ -216,42 +325,6 @@ static void mergeMPI(const LOFAR::ParameterSet &parset, askap::askapparallel::As
 
 
 
-      // Build the full output cube here:
-      // test for master .... (and first channel)
-      // this loop uses the accumulator.outShape() method - but only the spatial dimensions
-      //
-
-
-      if (comms.isMaster() && myAllocationStart == myFullAllocationStart) { // build this cube - does not need to loop over the outWgtNames
-
-        ASKAPLOG_INFO_STR(logger, "++++++++++++++++++++++++++++++++++++++++++");
-        ASKAPLOG_INFO_STR(logger, "Building output mosaic " << outImgName);
-        ASKAPLOG_INFO_STR(logger, "++++++++++++++++++++++++++++++++++++++++++");
-        casa::IPosition outShape  = accumulator.outShape();
-        // has the channel dimension of the allocation - so lets fix that.
-        outShape[3] = originalNchan;
-
-        ASKAPLOG_INFO_STR(logger, " Creating output file - Shape " << outShape << " OriginalNchan " << originalNchan);
-        iacc.create(outImgName, outShape, accumulator.outCoordSys());
-        iacc.makeDefaultMask(outImgName);
-
-        if (accumulator.outWgtDuplicates()[outImgName]) {
-          ASKAPLOG_INFO_STR(logger, "Accumulated weight image " << outWgtName << " already written");
-        } else {
-          outWgtName = accumulator.outWgtNames()[outImgName];
-          ASKAPLOG_INFO_STR(logger, "Writing accumulated weight image to " << outWgtName);
-          iacc.create(outWgtName, outShape, accumulator.outCoordSys());
-          iacc.makeDefaultMask(outWgtName);
-
-        }
-        if (accumulator.doSensitivity()) {
-          outSenName = accumulator.outSenNames()[outImgName];
-          ASKAPLOG_INFO_STR(logger, "Writing accumulated sensitivity image to " << outSenName);
-          iacc.create(outSenName, outShape, accumulator.outCoordSys());
-          iacc.makeDefaultMask(outSenName);
-
-        }
-      } // built the output cube for this image
 
       // here we have to loop over the channels and let everything else take care of the
       // other planes ...
@@ -328,93 +401,32 @@ static void mergeMPI(const LOFAR::ParameterSet &parset, askap::askapparallel::As
 
           if (parset.isDefined("removebeam")) {
 
-              Array<float> taylor0;
-              Array<float> taylor1;
-              Array<float> taylor2;
-
+              // need to get all the taylor terms for this image, the current one is
+              // already in memory, the others are read once
               ASKAPLOG_INFO_STR(linmoslogger, "Scaling Taylor terms -- inImage = " << inImgNames[img]);
-              // need to get all the taylor terms for this image
-              string ImgName = inImgName;
-              int inPixIsTaylor = 0;
-              for (int n = 0; n < accumulator.numTaylorTerms(); ++n) {
-                  const string taylorN = "taylor." + boost::lexical_cast<string>(n);
-                  // find the taylor.0 image for this image
-                  size_t pos0 = ImgName.find(taylorN);
-                  if (pos0!=string::npos) {
-                      ImgName.replace(pos0, taylorN.length(), accumulator.taylorTag());
-                      ASKAPLOG_INFO_STR(linmoslogger, "This is a Taylor " << n << " image");
-                      inPixIsTaylor = n;
-                      break;
-                  }
-
-                  // now go through each taylor term
-
-              }
-
-
-              ASKAPLOG_INFO_STR(linmoslogger, "To avoid altering images on disk re-reading the Taylor terms");
-              for (int n = 0; n < accumulator.numTaylorTerms(); ++n) {
-
-                  size_t pos0 = ImgName.find(accumulator.taylorTag());
-                  if (pos0!=string::npos) {
-                      const string taylorN = "taylor." + boost::lexical_cast<string>(n);
-                      ImgName.replace(pos0, taylorN.length(), taylorN);
-
-
-                      switch (n)
-                      {
-                      case 0:
-                          ASKAPLOG_INFO_STR(linmoslogger, "Reading -- Taylor0");
-                          ASKAPLOG_INFO_STR(linmoslogger, "Reading -- inImage = " << ImgName);
-                          taylor0 = iacc.read(ImgName,blc,trc);
-                          ASKAPLOG_INFO_STR(linmoslogger, "Shape -- " << taylor0.shape());
-                          break;
-                      case 1:
-                          ASKAPLOG_INFO_STR(linmoslogger, "Reading -- Taylor1");
-                          ASKAPLOG_INFO_STR(linmoslogger, "Reading -- inImage = " << ImgName);
-                          taylor1 = iacc.read(ImgName,blc,trc);
-                          ASKAPLOG_INFO_STR(linmoslogger, "Shape -- " << taylor1.shape());
-                          break;
-                      case 2:
-                          ASKAPLOG_INFO_STR(linmoslogger, "Reading -- Taylor2");
-                          ASKAPLOG_INFO_STR(linmoslogger, "Reading -- inImage = " << ImgName);
-                          taylor2 = iacc.read(ImgName,blc,trc);
-                          ASKAPLOG_INFO_STR(linmoslogger, "Shape -- " << taylor2.shape());
-                          break;
-
-                      }
-                      ImgName.replace(pos0, accumulator.taylorTag().length(), accumulator.taylorTag());
+              const int nTerms = accumulator.numTaylorTerms();
+              const int inPixIsTaylor = taylorTermIndex(inImgName, nTerms);
+              ASKAPCHECK(inPixIsTaylor >= 0, "Image " << inImgName << " is not a Taylor-term image, can't remove the beam");
+              ASKAPLOG_INFO_STR(linmoslogger, "This is a Taylor " << inPixIsTaylor << " image");
+              vector<Array<float> > taylor(3);
+              for (int n = 0; n < nTerms; ++n) {
+                  if (n == inPixIsTaylor) {
+                      taylor[n].reference(inPix);
+                  } else {
+                      const string ImgName = taylorTermName(inImgName, inPixIsTaylor, n);
+                      ASKAPLOG_INFO_STR(linmoslogger, "Reading -- inImage = " << ImgName);
+                      taylor[n] = iacc.read(ImgName,blc,trc);
+                      ASKAPLOG_INFO_STR(linmoslogger, "Shape -- " << taylor[n].shape());
                   }
-
-                  // now go through each taylor term
-
               }
 
-
-              casa::IPosition thispos(taylor0.shape().nelements(),0);
+              // the arrays are corrected in place, so inPix gets the scaled version
+              casa::IPosition thispos(taylor[0].shape().nelements(),0);
               ASKAPLOG_INFO_STR(logger, " removing Beam for Taylor terms - slice " << thispos);
-              accumulator.removeBeamFromTaylorTerms(taylor0,taylor1,taylor2,thispos,iacc.coordSys(inImgName));
-
-
-              // now we need to set the inPix to be the scaled version
-              // Note this means we are reading the Taylor terms 3 times for every
-              // read. But I'm not sure this matters.
-
-              switch (inPixIsTaylor)
-              {
-              case 0:
-                  inPix = taylor0.copy();
-                  break;
-              case 1:
-                  inPix = taylor1.copy();
-                  break;
-              case 2:
-                  inPix = taylor2.copy();
-                  break;
-              }
+              accumulator.removeBeamFromTaylorTerms(taylor[0],taylor[1],taylor[2],thispos,iacc.coordSys(inImgName));
 
           }
-            
+
           Array<float> inWgtPix;
           Array<float> inSenPix;
 
@@ -559,86 +571,40 @@ static void mergeMPI(const LOFAR::ParameterSet &parset, askap::askapparallel::As
         curpos = deweightIter.position();
         accumulator.deweightPlane(outPix, outWgtPix, outSenPix, curpos);
       }
-      // set one of the input images as a reference for metadata (the first by default)
-      uint psfref = 0;
-      if (parset.isDefined("psfref")) psfref = parset.getUint("psfref");
-
-      ASKAPLOG_INFO_STR(logger, "Getting brightness info for the output image from input number " << psfref);
-      // get pixel units from the selected reference image
-
-      string units = iacc.getUnits(inImgNames[psfref]);
-      ASKAPLOG_INFO_STR(logger, "Got units as " << units);
-
-      ASKAPLOG_INFO_STR(logger, "Getting PSF beam info for the output image from input number " << psfref);
-      // get psf beam information from the selected reference image
-      Vector<Quantum<double> > psf;
-      Vector<Quantum<double> > psftmp = iacc.beamInfo(inImgNames[psfref]);
-      if (psftmp.nelements()<3) {
-        ASKAPLOG_WARN_STR(logger, inImgNames[psfref] <<
-        ": beamInfo needs at least 3 elements. Not writing PSF");
-      }
-      else if ((psftmp[0].getValue("rad")==0) || (psftmp[1].getValue("rad")==0)) {
-        ASKAPLOG_WARN_STR(logger, inImgNames[psfref] <<
-          ": beamInfo invalid. Not writing PSF");
-      }
-      else {
-        psf = psftmp;
-      }
       // write accumulated images and weight images
-      ASKAPLOG_INFO_STR(logger, "Writing accumulated image to " << outImgName);
-      casa::IPosition outShape = accumulator.outShape();
-
-      if (comms.isMaster()) {
-
-
+      if (serialiseWrites) {
         ASKAPLOG_INFO_STR(logger, "Ensuring serial access to cubes");
-
-
-      }
-      else { // this is essentially a serializer - it is required for CASA image types
-      // but not FITS
-        int buf;
-        int from = comms.rank() - 1;
-        comms.receive((void *) &buf,sizeof(int),from);
+        waitForWriteToken(comms);
       }
-      casa::IPosition loc(outShape.nelements(),0);
+      ASKAPLOG_INFO_STR(logger, "Writing accumulated image to " << outImgName);
+      casa::IPosition loc(outPix.ndim(),0);
       loc[3] = myAllocationStart;
       ASKAPLOG_INFO_STR(logger, " - location " << loc);
       iacc.write(outImgName,outPix,loc);
       iacc.writeMask(outImgName,outMask,loc);
-      iacc.setUnits(outImgName,units);
-
-      if (psf.nelements()>=3)
-        iacc.setBeamInfo(outImgName, psf[0].getValue("rad"), psf[1].getValue("rad"), psf[2].getValue("rad"));
 
       if (accumulator.outWgtDuplicates()[outImgName]) {
         ASKAPLOG_INFO_STR(logger, "Accumulated weight image " << outWgtName << " already written");
       }
       else {
-
         iacc.write(outWgtName,outWgtPix,loc);
         iacc.writeMask(outWgtName,outMask,loc);
-        iacc.setUnits(outWgtName,units);
-        if (psf.nelements()>=3)
-          iacc.setBeamInfo(outWgtName, psf[0].getValue("rad"), psf[1].getValue("rad"), psf[2].getValue("rad"));
       }
 
       if (accumulator.doSensitivity()) {
-
         iacc.write(outSenName,outSenPix,loc);
         iacc.writeMask(outSenName,outMask,loc);
-        iacc.setUnits(outSenName,units);
-
-      if (psf.nelements()>=3)
-        iacc.setBeamInfo(outSenName, psf[0].getValue("rad"), psf[1].getValue("rad"), psf[2].getValue("rad"));
       }
-
-      if (comms.rank() < comms.nProcs()-1) { // last rank doesnot use this method
-        int buf;
-        int to = comms.rank()+1;
-        comms.send((void *) &buf,sizeof(int),to);
+      if (serialiseWrites) {
+        passWriteToken(comms);
+        ++nRoundsDone;
       }
     }
+    // keep the token moving for the rounds this rank has nothing to write in
+    for (; nRoundsDone < nWriteRounds; ++nRoundsDone) {
+      waitForWriteToken(comms);
+      passWriteToken(comms);
+    }
   }
 }
 class linmosMPIApp : public askap::Application
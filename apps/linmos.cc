@@ -36,6 +36,8 @@
 #include <sstream>
 #include <typeinfo>
 #include <iostream>
+#include <algorithm>
+#include <utility>
 
 // other 3rd party
 #include <Common/ParameterSet.h>
@@ -43,6 +45,10 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
 #include <casacore/casa/Arrays/Array.h>
 #include <casacore/coordinates/Coordinates/Coordinate.h>
 #include <casacore/images/Images/ImageRegrid.h>
@@ -162,92 +168,31 @@ static void merge(const LOFAR::ParameterSet &parset) {
 
             if (parset.isDefined("removebeam")) {
 
-                Array<float> taylor0;
-                Array<float> taylor1;
-                Array<float> taylor2;
-
+                // need to get all the taylor terms for this image, the current one is
+                // already in memory, the others are read once
                 ASKAPLOG_INFO_STR(linmoslogger, "Scaling Taylor terms -- inImage = " << inImgNames[img]);
-                // need to get all the taylor terms for this image
-                string ImgName = inImgName;
-                int inPixIsTaylor = 0;
-                for (int n = 0; n < accumulator.numTaylorTerms(); ++n) {
-                    const string taylorN = "taylor." + boost::lexical_cast<string>(n);
-                    // find the taylor.0 image for this image
-                    size_t pos0 = ImgName.find(taylorN);
-                    if (pos0!=string::npos) {
-                        ImgName.replace(pos0, taylorN.length(), accumulator.taylorTag());
-                        ASKAPLOG_INFO_STR(linmoslogger, "This is a Taylor " << n << " image");
-                        inPixIsTaylor = n;
-                        break;
+                const int nTerms = accumulator.numTaylorTerms();
+                const int inPixIsTaylor = taylorTermIndex(inImgName, nTerms);
+                ASKAPCHECK(inPixIsTaylor >= 0, "Image " << inImgName << " is not a Taylor-term image, can't remove the beam");
+                ASKAPLOG_INFO_STR(linmoslogger, "This is a Taylor " << inPixIsTaylor << " image");
+                vector<Array<float> > taylor(3);
+                for (int n = 0; n < nTerms; ++n) {
+                    if (n == inPixIsTaylor) {
+                        taylor[n].reference(inPix);
+                    } else {
+                        const string ImgName = taylorTermName(inImgName, inPixIsTaylor, n);
+                        ASKAPLOG_INFO_STR(linmoslogger, "Reading -- inImage = " << ImgName);
+                        taylor[n] = iacc.read(ImgName);
+                        ASKAPLOG_INFO_STR(linmoslogger, "Shape -- " << taylor[n].shape());
                     }
-
-                    // now go through each taylor term
-
-                }
-
-
-                ASKAPLOG_INFO_STR(linmoslogger, "To avoid altering images on disk re-reading the Taylor terms");
-                for (int n = 0; n < accumulator.numTaylorTerms(); ++n) {
-
-                    size_t pos0 = ImgName.find(accumulator.taylorTag());
-                    if (pos0!=string::npos) {
-                        const string taylorN = "taylor." + boost::lexical_cast<string>(n);
-                        ImgName.replace(pos0, taylorN.length(), taylorN);
-
-
-                        switch (n)
-                        {
-                        case 0:
-                            ASKAPLOG_INFO_STR(linmoslogger, "Reading -- Taylor0");
-                            ASKAPLOG_INFO_STR(linmoslogger, "Reading -- inImage = " << ImgName);
-                            taylor0 = iacc.read(ImgName);
-                            ASKAPLOG_INFO_STR(linmoslogger, "Shape -- " << taylor0.shape());
-                            break;
-                        case 1:
-                            ASKAPLOG_INFO_STR(linmoslogger, "Reading -- Taylor1");
-                            ASKAPLOG_INFO_STR(linmoslogger, "Reading -- inImage = " << ImgName);
-                            taylor1 = iacc.read(ImgName);
-                            ASKAPLOG_INFO_STR(linmoslogger, "Shape -- " << taylor1.shape());
-                            break;
-                        case 2:
-                            ASKAPLOG_INFO_STR(linmoslogger, "Reading -- Taylor2");
-                            ASKAPLOG_INFO_STR(linmoslogger, "Reading -- inImage = " << ImgName);
-                            taylor2 = iacc.read(ImgName);
-                            ASKAPLOG_INFO_STR(linmoslogger, "Shape -- " << taylor2.shape());
-                            break;
-
-                        }
-                        ImgName.replace(pos0, accumulator.taylorTag().length(), accumulator.taylorTag());
-                    }
-
-                    // now go through each taylor term
-
                 }
 
-
-                casa::IPosition thispos(taylor0.shape().nelements(),0);
+                // the arrays are corrected in place, so inPix gets the scaled version
+                casa::IPosition thispos(taylor[0].shape().nelements(),0);
                 ASKAPLOG_INFO_STR(logger, " removing Beam for Taylor terms - slice " << thispos);
-                accumulator.removeBeamFromTaylorTerms(taylor0,taylor1,taylor2,thispos,iacc.coordSys(inImgName));
-
-
-                // now we need to set the inPix to be the scaled version
-                // Note this means we are reading the Taylor terms 3 times for every
-                // read. But I'm not sure this matters.
+                accumulator.removeBeamFromTaylorTerms(taylor[0],taylor[1],taylor[2],thispos,iacc.coordSys(inImgName));
 
-                switch (inPixIsTaylor)
-                {
-                case 0:
-                    inPix = taylor0.copy();
-                    break;
-                case 1:
-                    inPix = taylor1.copy();
-                    break;
-                case 2:
-                    inPix = taylor2.copy();
-                    break;
-                }
-
-            }            
+            }
 
             Array<float> inWgtPix;
             Array<float> inSenPix;
@@ -417,6 +362,470 @@ static void merge(const LOFAR::ParameterSet &parset) {
 
 };
 
+/// @brief mosaics built together by mergeStreaming and their inputs
+struct MosaicGroup {
+    /// @brief names of the output mosaics (one per Taylor term)
+    vector<string> outImgNames;
+    /// @brief names of the output weight images (empty if written by another mosaic)
+    vector<string> outWgtNames;
+    /// @brief names of the output sensitivity images
+    vector<string> outSenNames;
+    /// @brief input images of each mosaic
+    vector<vector<string> > inImgNames;
+    /// @brief input weight images of each mosaic
+    vector<vector<string> > inWgtNames;
+    /// @brief input sensitivity images of each mosaic
+    vector<vector<string> > inSenNames;
+    /// @brief shapes of the input images
+    vector<IPosition> inShapeVec;
+    /// @brief coordinate systems of the input images
+    vector<CoordinateSystem> inCoordSysVec;
+    /// @brief beam centres for the primary beam model (empty if not used)
+    Vector<MVDirection> beamCentres;
+    /// @brief coordinate system of the mosaics
+    CoordinateSystem outCoordSys;
+    /// @brief shape of the mosaics
+    IPosition outShape;
+    /// @brief true if sensitivity images are built
+    bool doSensitivity;
+    /// @brief true if the beam is removed from the Taylor terms
+    bool removeBeam;
+    /// @brief weight below which the output pixels are masked
+    float wgtCutoff;
+};
+
+/// @brief build one tile of all mosaics in a group
+/// @details Only the parts of the input images overlapping the tile are read and regridded.
+/// All access to the images, coordinate conversions and the regridder setup are done with
+/// ioMutex locked, so several tiles can be built in parallel, each with its own accumulator.
+/// @param[in] accumulator accumulator used for this tile
+/// @param[in] iacc image accessor
+/// @param[in] group mosaics to build
+/// @param[in] blc bottom left corner of the tile
+/// @param[in] trc top right corner (inclusive) of the tile
+/// @param[in] ioMutex mutex serialising the image access and casacore coordinate conversions
+static void mergeTile(imagemath::LinmosAccumulator<float> &accumulator,
+                      accessors::IImageAccess<casacore::Float> &iacc,
+                      const MosaicGroup &group, const IPosition &blc, const IPosition &trc,
+                      boost::mutex &ioMutex) {
+
+    const size_t nMosaics = group.outImgNames.size();
+    const IPosition tileShape = trc - blc + 1;
+    ASKAPLOG_INFO_STR(logger, "Processing tile " << blc << " - " << trc);
+
+    // make the tile the output of the accumulator
+    Vector<Float> origin(blc.nelements(), 0.);
+    for (uInt dim = 0; dim < origin.nelements(); ++dim) {
+        origin(dim) = blc(dim);
+    }
+    CoordinateSystem tileCoordSys;
+    {
+        boost::lock_guard<boost::mutex> lock(ioMutex);
+        tileCoordSys = group.outCoordSys.subImage(origin,
+              Vector<Float>(blc.nelements(), 1.), tileShape.asVector());
+        accumulator.setOutputParameters(vector<IPosition>(1, tileShape), vector<CoordinateSystem>(1, tileCoordSys));
+    }
+    ASKAPCHECK(accumulator.outShape() == tileShape, "Unexpected shape of the output tile: " <<
+               accumulator.outShape() << ", expected " << tileShape);
+
+    // set up the output pixel arrays
+    vector<Array<float> > outPix(nMosaics), outWgtPix(nMosaics), outSenPix(nMosaics);
+    for (size_t m = 0; m < nMosaics; ++m) {
+        outPix[m] = Array<float>(tileShape,0.);
+        outWgtPix[m] = Array<float>(tileShape,0.);
+        if (group.doSensitivity) {
+            outSenPix[m] = Array<float>(tileShape,0.);
+        }
+    }
+
+    bool regridderInitialised = false;
+    for (size_t img = 0; img < group.inShapeVec.size(); ++img) {
+
+        // find the part of this input covering the tile
+        IPosition inBlc(blc);
+        IPosition inTrc(trc);
+        bool overlaps = false;
+        {
+            boost::lock_guard<boost::mutex> lock(ioMutex);
+            overlaps = overlappingRegion(tileCoordSys, tileShape, group.inCoordSysVec[img], group.inShapeVec[img], inBlc, inTrc);
+        }
+        if (!overlaps) {
+            continue;
+        }
+        const string &inImgName = group.inImgNames[0][img];
+        ASKAPLOG_INFO_STR(logger, " - input image " << inImgName << ", region " << inBlc << " - " << inTrc);
+        const IPosition inShape = inTrc - inBlc + 1;
+
+        // read the region of each input once, including all Taylor terms
+        CoordinateSystem inCoordSys;
+        vector<Array<float> > inPix(nMosaics), inWgtPix(nMosaics), inSenPix(nMosaics);
+        vector<Array<float> > taylor(3);
+        {
+            boost::lock_guard<boost::mutex> lock(ioMutex);
+            inCoordSys = iacc.coordSysSlice(inImgName, inBlc, inTrc);
+            if (group.removeBeam) {
+                const int nTerms = accumulator.numTaylorTerms();
+                const int firstTerm = taylorTermIndex(inImgName, nTerms);
+                ASKAPCHECK(firstTerm >= 0, "Image " << inImgName << " is not a Taylor-term image, can't remove the beam");
+                for (int n = 0; n < nTerms; ++n) {
+                    taylor[n] = iacc.read(taylorTermName(inImgName, firstTerm, n), inBlc, inTrc);
+                }
+            } else {
+                for (size_t m = 0; m < nMosaics; ++m) {
+                    inPix[m] = iacc.read(group.inImgNames[m][img], inBlc, inTrc);
+                }
+            }
+            for (size_t m = 0; m < nMosaics; ++m) {
+                if (group.inWgtNames[m].size() > 0) {
+                    if ((m > 0) && (group.inWgtNames[m][img] == group.inWgtNames[m - 1][img])) {
+                        inWgtPix[m].reference(inWgtPix[m - 1]);
+                    } else {
+                        inWgtPix[m] = iacc.read(group.inWgtNames[m][img], inBlc, inTrc);
+                    }
+                }
+                if (group.doSensitivity) {
+                    if ((m > 0) && (group.inSenNames[m][img] == group.inSenNames[m - 1][img])) {
+                        inSenPix[m].reference(inSenPix[m - 1]);
+                    } else {
+                        inSenPix[m] = iacc.read(group.inSenNames[m][img], inBlc, inTrc);
+                    }
+                }
+            }
+        }
+
+        // Coordinate and measures conversions (used to compare the grids, to find the beam
+        // offsets and to set up the regridder and its temporary images) go through static
+        // casacore caches which are not thread safe, so they are done with the mutex locked too
+        bool regridRequired = false;
+        {
+            boost::lock_guard<boost::mutex> lock(ioMutex);
+            accumulator.setInputParameters(inShape, inCoordSys, img);
+            if (group.removeBeam) {
+                accumulator.removeBeamFromTaylorTerms(taylor[0], taylor[1], taylor[2],
+                           IPosition(inShape.nelements(), 0), inCoordSys);
+            }
+
+            // test whether to simply add weighted pixels, or whether a regrid is required
+            regridRequired = !accumulator.coordinatesAreEqual();
+            if ( regridRequired ) {
+                // the output changes with every tile, so the regridder is set up once per tile
+                if (!regridderInitialised || accumulator.outputBufferSetupRequired()) {
+                    accumulator.initialiseRegridder();
+                    regridderInitialised = true;
+                }
+                accumulator.initialiseOutputBuffers();
+                accumulator.initialiseInputBuffers();
+            }
+            else {
+                // not regridding so point output image buffers at the input buffers
+                accumulator.initialiseInputBuffers();
+                accumulator.redirectOutputBuffers();
+            }
+        }
+        if (group.removeBeam) {
+            for (size_t m = 0; m < nMosaics; ++m) {
+                const int term = taylorTermIndex(group.inImgNames[m][img], accumulator.numTaylorTerms());
+                ASKAPCHECK(term >= 0, "Image " << group.inImgNames[m][img] << " is not a Taylor-term image");
+                inPix[m].reference(taylor[term]);
+            }
+        }
+        for (size_t m = 0; m < nMosaics; ++m) {
+            ASKAPASSERT(inWgtPix[m].nelements() == 0 || inPix[m].shape() == inWgtPix[m].shape());
+            ASKAPASSERT(inSenPix[m].nelements() == 0 || inPix[m].shape() == inSenPix[m].shape());
+        }
+
+        // The regridding itself maps pixels through the per-thread copies of the coordinate
+        // systems into the per-thread temporary images, which is safe while the input and the
+        // output share the direction reference frame. A conversion between frames uses the
+        // shared measures tables, so then the regridding is serialised as well.
+        const bool sameFrame = inCoordSys.directionCoordinate(inCoordSys.findCoordinate(Coordinate::DIRECTION)).directionType() ==
+                   tileCoordSys.directionCoordinate(tileCoordSys.findCoordinate(Coordinate::DIRECTION)).directionType();
+
+        // iterator over planes (e.g. freq & polarisation), regridding and accumulating
+        // weights and weighted images for every mosaic
+        scimath::MultiDimArrayPlaneIter planeIter(accumulator.inShape());
+        for (; planeIter.hasMore(); planeIter.next()) {
+            IPosition curpos = planeIter.position();
+            for (size_t m = 0; m < nMosaics; ++m) {
+                accumulator.loadAndWeightInputBuffers(curpos, inPix[m], inWgtPix[m], inSenPix[m]);
+                if ( regridRequired ) {
+                    if (sameFrame) {
+                        accumulator.regrid();
+                    } else {
+                        boost::lock_guard<boost::mutex> lock(ioMutex);
+                        accumulator.regrid();
+                    }
+                }
+                accumulator.accumulatePlane(outPix[m], outWgtPix[m], outSenPix[m], curpos);
+            }
+        }
+    } // img loop (over input images)
+
+    // mask, deweight and write the tile of every mosaic
+    for (size_t m = 0; m < nMosaics; ++m) {
+        // the final weight has to be equal to or bigger than the cutoff, see merge
+        Array<bool> outMask(tileShape);
+        Array<bool>::iterator iterMask = outMask.begin();
+        for (Array<float>::iterator iterWgt = outWgtPix[m].begin(); iterWgt != outWgtPix[m].end(); ++iterWgt, ++iterMask) {
+            if (*iterWgt >= group.wgtCutoff) {
+                *iterMask = casa::True;
+            } else {
+                *iterMask = casa::False;
+                setNaN(*iterWgt);
+            }
+        }
+
+        scimath::MultiDimArrayPlaneIter deweightIter(tileShape);
+        for (; deweightIter.hasMore(); deweightIter.next()) {
+            IPosition curpos = deweightIter.position();
+            accumulator.deweightPlane(outPix[m], outWgtPix[m], outSenPix[m], curpos);
+        }
+
+        boost::lock_guard<boost::mutex> lock(ioMutex);
+        iacc.write(group.outImgNames[m], outPix[m], blc);
+        iacc.writeMask(group.outImgNames[m], outMask, blc);
+        if (group.outWgtNames[m] != "") {
+            iacc.write(group.outWgtNames[m], outWgtPix[m], blc);
+            iacc.writeMask(group.outWgtNames[m], outMask, blc);
+        }
+        if (group.doSensitivity) {
+            iacc.write(group.outSenNames[m], outSenPix[m], blc);
+            iacc.writeMask(group.outSenNames[m], outMask, blc);
+        }
+    }
+}
+
+/// @brief thread building tiles of a group of mosaics
+/// @details Each thread has its own accumulator and takes the next tile to be built
+/// from the shared list until all tiles are done. While one thread reads or writes
+/// images, the others regrid and accumulate.
+/// @param[in] parset subset with parameters
+/// @param[in] group mosaics to build
+/// @param[in] tiles bottom left and top right corners of all tiles
+/// @param[in] nextTile index of the next tile to be built (shared between threads)
+/// @param[in] tileMutex mutex protecting nextTile
+/// @param[in] ioMutex mutex serialising the image access
+/// @param[out] error error message (empty if successful)
+static void mergeTiles(const LOFAR::ParameterSet &parset, const MosaicGroup &group,
+                       const vector<std::pair<IPosition, IPosition> > &tiles, size_t &nextTile,
+                       boost::mutex &tileMutex, boost::mutex &ioMutex, std::string &error) {
+    try {
+        accessors::IImageAccess<casacore::Float>& iacc = SynthesisParamsHelper::imageHandler();
+        imagemath::LinmosAccumulator<float> accumulator;
+        {
+            boost::lock_guard<boost::mutex> lock(ioMutex);
+            ASKAPCHECK(accumulator.loadParset(parset), "Failed to set up the accumulator");
+        }
+        accumulator.doSensitivity(group.doSensitivity);
+        if (group.beamCentres.nelements() > 0) {
+            accumulator.beamCentres(group.beamCentres);
+        }
+        while (true) {
+            size_t tile;
+            {
+                boost::lock_guard<boost::mutex> lock(tileMutex);
+                if (nextTile >= tiles.size()) {
+                    break;
+                }
+                tile = nextTile++;
+            }
+            mergeTile(accumulator, iacc, group, tiles[tile].first, tiles[tile].second, ioMutex);
+        }
+    } catch (const std::exception &ex) {
+        error = ex.what();
+    }
+}
+
+/// @brief do the merge tile by tile
+/// @details The output mosaics are built in tiles covering a part of the sky and a range
+/// of channels. Only the parts of the input images overlapping the current tile are read
+/// and regridded, so the memory use is bounded by the tile size rather than by the size
+/// of the mosaic. If the beam is removed from Taylor-term images, the mosaics of all
+/// Taylor terms of a field are built together, so every term is read only once.
+/// Tiles are independent and can be built by several threads (nthreads parameter). The threaded
+/// mode is experimental: only weighting, regridding within one direction frame and accumulation
+/// run concurrently, everything touching casacore tables, coordinates or measures is serialised.
+/// @param[in] parset subset with parameters
+static void mergeStreaming(const LOFAR::ParameterSet &parset) {
+
+    ASKAPLOG_INFO_STR(linmoslogger, "ASKAP linear mosaic task (streaming) " << ASKAP_PACKAGE_VERSION);
+    ASKAPLOG_INFO_STR(linmoslogger, "Parset parameters:\n" << parset);
+
+    // initialise an image accumulator
+    imagemath::LinmosAccumulator<float> accumulator;
+
+    // load the parset
+    if ( !accumulator.loadParset(parset) ) return;
+
+    // initialise an image accessor
+    accessors::IImageAccess<casacore::Float>& iacc = SynthesisParamsHelper::imageHandler();
+
+    const bool removeBeam = parset.isDefined("removebeam");
+    const int tileSize = parset.getInt("streaming.tilesize", 2048);
+    const size_t maxMemory = size_t(parset.getUint("streaming.maxmemory", 2048)) * 1024 * 1024;
+    const int nThreads = parset.getInt("nthreads", 1);
+    ASKAPCHECK(tileSize > 0, "streaming.tilesize should be positive");
+    ASKAPCHECK(nThreads > 0, "nthreads should be positive");
+    if (nThreads > 1) {
+        ASKAPLOG_WARN_STR(logger, "Building tiles with " << nThreads << " threads is experimental");
+    }
+    const float cutoff = parset.getFloat("cutoff", 0.01);
+    const uint psfref = parset.getUint("psfref", 0);
+
+    // with removebeam all Taylor terms of a field are processed together
+    vector<string> mosaics;
+    map<string,string> outWgtNames = accumulator.outWgtNames();
+    for(map<string,string>::iterator ii=outWgtNames.begin(); ii!=outWgtNames.end(); ++ii) {
+        mosaics.push_back(ii->first);
+    }
+    const vector<vector<string> > groups = groupTaylorMosaics(mosaics, removeBeam ? accumulator.numTaylorTerms() : 0);
+
+    for (size_t grp = 0; grp < groups.size(); ++grp) {
+
+        MosaicGroup group;
+        group.outImgNames = groups[grp];
+        group.removeBeam = removeBeam;
+        group.wgtCutoff = cutoff * cutoff;
+        const size_t nMosaics = group.outImgNames.size();
+        ASKAPLOG_INFO_STR(logger, "++++++++++++++++++++++++++++++++++++++++++");
+        ASKAPLOG_INFO_STR(logger, "Preparing mosaic(s) " << group.outImgNames);
+
+        group.doSensitivity = accumulator.genSensitivityImage()[group.outImgNames[0]];
+        accumulator.doSensitivity(group.doSensitivity);
+
+        // get input and output files for these mosaics
+        group.inImgNames.resize(nMosaics);
+        group.inWgtNames.resize(nMosaics);
+        group.inSenNames.resize(nMosaics);
+        for (size_t m = 0; m < nMosaics; ++m) {
+            const string &outImgName = group.outImgNames[m];
+            ASKAPCHECK(accumulator.genSensitivityImage()[outImgName] == group.doSensitivity,
+                "Mosaics of all Taylor terms should either have or not have sensitivity images");
+            group.inImgNames[m] = accumulator.inImgNameVecs()[outImgName];
+            ASKAPCHECK(group.inImgNames[m].size() == group.inImgNames[0].size(),
+                "Mosaics of all Taylor terms should have the same number of input images");
+            ASKAPLOG_INFO_STR(logger, " - input images for " << outImgName << ": " << group.inImgNames[m]);
+            if (accumulator.weightType() == FROM_WEIGHT_IMAGES || accumulator.weightType() == COMBINED) {
+                group.inWgtNames[m] = accumulator.inWgtNameVecs()[outImgName];
+                ASKAPLOG_INFO_STR(logger, " - input weights images: " << group.inWgtNames[m]);
+            }
+            if (group.doSensitivity) {
+                group.inSenNames[m] = accumulator.inSenNameVecs()[outImgName];
+                ASKAPLOG_INFO_STR(logger, " - input sensitivity images: " << group.inSenNames[m]);
+                group.outSenNames.push_back(accumulator.outSenNames()[outImgName]);
+            }
+            if (accumulator.outWgtDuplicates()[outImgName]) {
+                ASKAPLOG_INFO_STR(logger, "Accumulated weight image " << accumulator.outWgtNames()[outImgName] << " already written");
+                group.outWgtNames.push_back("");
+            } else {
+                group.outWgtNames.push_back(accumulator.outWgtNames()[outImgName]);
+            }
+        }
+        if (accumulator.weightType() == FROM_BP_MODEL) {
+            group.beamCentres = loadBeamCentres(parset,iacc,group.inImgNames[0]);
+            accumulator.beamCentres(group.beamCentres);
+        }
+
+        // set the output coordinate system and shape, based on the overlap of input images
+        // (the same for all Taylor terms)
+        for (size_t img = 0; img < group.inImgNames[0].size(); ++img) {
+            group.inShapeVec.push_back(iacc.shape(group.inImgNames[0][img]));
+            group.inCoordSysVec.push_back(iacc.coordSys(group.inImgNames[0][img]));
+        }
+        accumulator.setOutputParameters(group.inShapeVec, group.inCoordSysVec);
+        group.outShape = accumulator.outShape();
+        group.outCoordSys = accumulator.outCoordSys();
+        const IPosition &outShape = group.outShape;
+        ASKAPASSERT(outShape.nelements()>=2);
+
+        // create the output images upfront, the tiles are written as they are done
+        for (size_t m = 0; m < nMosaics; ++m) {
+
+            ASKAPLOG_INFO_STR(logger, "Getting PSF beam info for the output image from input number " << psfref);
+            string units = iacc.getUnits(group.inImgNames[m][psfref]);
+            ASKAPLOG_INFO_STR(logger, "Got units as " << units);
+            Vector<Quantum<double> > psf;
+            Vector<Quantum<double> > psftmp = iacc.beamInfo(group.inImgNames[m][psfref]);
+            if (psftmp.nelements()<3) {
+                ASKAPLOG_WARN_STR(logger, group.inImgNames[m][psfref] <<
+                    ": beamInfo needs at least 3 elements. Not writing PSF");
+            }
+            else if ((psftmp[0].getValue("rad")==0) || (psftmp[1].getValue("rad")==0)) {
+                ASKAPLOG_WARN_STR(logger, group.inImgNames[m][psfref] <<
+                    ": beamInfo invalid. Not writing PSF");
+            }
+            else {
+                psf = psftmp;
+            }
+
+            vector<string> names(1, group.outImgNames[m]);
+            if (group.outWgtNames[m] != "") {
+                names.push_back(group.outWgtNames[m]);
+            }
+            if (group.doSensitivity) {
+                names.push_back(group.outSenNames[m]);
+            }
+            for (vector<string>::const_iterator ci = names.begin(); ci != names.end(); ++ci) {
+                ASKAPLOG_INFO_STR(logger, "Creating " << *ci << " with shape " << outShape);
+                iacc.create(*ci, outShape, group.outCoordSys);
+                iacc.makeDefaultMask(*ci);
+                iacc.setUnits(*ci, units);
+                if (psf.nelements()>=3)
+                    iacc.setBeamInfo(*ci, psf[0].getValue("rad"), psf[1].getValue("rad"), psf[2].getValue("rad"));
+            }
+        }
+
+        // size of the tiles: the full spectral axis is split into chunks, so all tiles
+        // being built at the same time (image, weight, sensitivity and mask of every mosaic
+        // plus the regridded input) fit into the memory limit
+        const int tileNx = std::min(tileSize, int(outShape(0)));
+        const int tileNy = std::min(tileSize, int(outShape(1)));
+        const int nChan = outShape.nelements() > 3 ? outShape(3) : 1;
+        const size_t bytesPerPixel = (4 * nMosaics + 2) * sizeof(float) * nThreads;
+        const size_t pixelsPerChannel = size_t(tileNx) * tileNy * (outShape.nelements() > 2 ? outShape(2) : 1);
+        const int tileNchan = std::max(1, std::min(nChan, int(maxMemory / (bytesPerPixel * pixelsPerChannel))));
+        ASKAPLOG_INFO_STR(logger, "Building the mosaic(s) in tiles of " << tileNx << " x " << tileNy <<
+                          " pixels and " << tileNchan << " channel(s)");
+
+        vector<std::pair<IPosition, IPosition> > tiles;
+        for (int chan = 0; chan < nChan; chan += tileNchan) {
+          for (int y = 0; y < outShape(1); y += tileNy) {
+            for (int x = 0; x < outShape(0); x += tileNx) {
+              IPosition blc(outShape.nelements(), 0);
+              IPosition trc(outShape - 1);
+              blc(0) = x;
+              blc(1) = y;
+              trc(0) = std::min(x + tileNx, int(outShape(0))) - 1;
+              trc(1) = std::min(y + tileNy, int(outShape(1))) - 1;
+              if (outShape.nelements() > 3) {
+                  blc(3) = chan;
+                  trc(3) = std::min(chan + tileNchan, nChan) - 1;
+              }
+              tiles.push_back(std::make_pair(blc, trc));
+            }
+          }
+        }
+
+        const int nWorkers = std::min(nThreads, int(tiles.size()));
+        ASKAPLOG_INFO_STR(logger, "Building " << tiles.size() << " tiles with " << nWorkers << " thread(s)");
+        size_t nextTile = 0;
+        boost::mutex tileMutex;
+        boost::mutex ioMutex;
+        vector<std::string> errors(nWorkers);
+        boost::thread_group workers;
+        for (int thread = 0; thread < nWorkers; ++thread) {
+            workers.create_thread(boost::bind(mergeTiles, boost::cref(parset), boost::cref(group),
+                        boost::cref(tiles), boost::ref(nextTile), boost::ref(tileMutex), boost::ref(ioMutex),
+                        boost::ref(errors[thread])));
+        }
+        workers.join_all();
+        for (int thread = 0; thread < nWorkers; ++thread) {
+            ASKAPCHECK(errors[thread].empty(), "Error building the mosaic in thread " << thread << ": " << errors[thread]);
+        }
+
+    } // grp loop (separate mosaics for different image types)
+}
+
 class LinmosApp : public askap::Application
 {
     public:
@@ -425,7 +834,11 @@ class LinmosApp : public askap::Application
             StatReporter stats;
             LOFAR::ParameterSet subset(config().makeSubset("linmos."));
             SynthesisParamsHelper::setUpImageHandler(subset);
-            merge(subset);
+            if (subset.getBool("streaming", false) || (subset.getInt("nthreads", 1) > 1)) {
+                mergeStreaming(subset);
+            } else {
+                merge(subset);
+            }
             stats.logSummary();
             return 0;
         }
@@ -36,6 +36,8 @@
 #include <iomanip>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 #include <stdio.h>
 
 // ASKAPsoft includes
@@ -46,7 +48,10 @@
 #include <askapparallel/AskapParallel.h>
 
 #include <imageaccess/ImageAccessFactory.h>
+#include <askap/utils/ImageStreamer.h>
+#include <askap/utils/IImageChunkOperator.h>
 #include <casacore/coordinates/Coordinates/CoordinateSystem.h>
+#include <casacore/coordinates/Coordinates/SpectralCoordinate.h>
 
 #include <casacore/casa/Arrays/Vector.h>
 #include <casacore/casa/Arrays/ArrayMath.h>
@@ -56,6 +61,105 @@ ASKAP_LOGGER(logger, ".maskChannels");
 
 using namespace askap;
 
+/// @brief statistics of each channel, computed in a single pass over the image
+/// @details The chunks given to this operator have to contain whole channels, so every
+/// channel is processed by one thread only. NaNs are ignored.
+class ChannelStatsOperator : public IImageChunkOperator {
+public:
+    /// @brief constructor
+    /// @param[in] specAxis spectral axis of the image
+    /// @param[in] nChan number of channels
+    ChannelStatsOperator(int specAxis, unsigned int nChan) : itsSpecAxis(specAxis),
+          itsMean(nChan,0.), itsStd(nChan,0.), itsMedian(nChan,0.), itsMadfm(nChan,0.),
+          itsOnepc(nChan,0.), itsMin(nChan,0.), itsMax(nChan,0.) {}
+
+    /// @brief compute statistics of all channels of a chunk
+    /// @param[in] chunk pixels of the chunk
+    /// @param[in] blc position of the chunk in the image
+    /// @param[in] thread index of the calling thread
+    /// @return false, the chunk is not changed
+    virtual bool process(casa::Array<casa::Float> &chunk, const casa::IPosition &blc, int) {
+        const casa::IPosition shape = chunk.shape();
+        const float *data = chunk.data();
+        size_t inner = 1;
+        size_t outer = 1;
+        for (int dim = 0; dim < int(shape.nelements()); ++dim) {
+             if (dim < itsSpecAxis) {
+                 inner *= shape(dim);
+             } else if (dim > itsSpecAxis) {
+                 outer *= shape(dim);
+             }
+        }
+        const size_t nChanChunk = shape(itsSpecAxis);
+        std::vector<float> values;
+        values.reserve(inner * outer);
+        for (size_t c = 0; c < nChanChunk; ++c) {
+             const size_t chan = blc(itsSpecAxis) + c;
+             values.clear();
+             double sum = 0.;
+             double sumsq = 0.;
+             for (size_t o = 0; o < outer; ++o) {
+                  const float *plane = data + (o * nChanChunk + c) * inner;
+                  for (size_t i = 0; i < inner; ++i) {
+                       if (!casa::isNaN(plane[i])) {
+                           values.push_back(plane[i]);
+                           sum += plane[i];
+                           sumsq += double(plane[i]) * plane[i];
+                       }
+                  }
+             }
+             const size_t n = values.size();
+             if (n == 0) {
+                 continue;
+             }
+             itsMean[chan] = sum / n;
+             itsStd[chan] = std::sqrt(std::max(0., sumsq / n - itsMean[chan] * itsMean[chan]));
+             itsMin[chan] = *std::min_element(values.begin(), values.end());
+             itsMax[chan] = *std::max_element(values.begin(), values.end());
+             itsOnepc[chan] = fractile(values, 0.01);
+             const float median = fractile(values, 0.5);
+             itsMedian[chan] = median;
+             for (size_t i = 0; i < n; ++i) {
+                  values[i] = std::abs(values[i] - median);
+             }
+             itsMadfm[chan] = fractile(values, 0.5);
+        }
+        return false;
+    }
+
+    /// @brief mean of each channel
+    const casa::Vector<double>& mean() const { return itsMean; }
+    /// @brief standard deviation of each channel
+    const casa::Vector<double>& stddev() const { return itsStd; }
+    /// @brief median of each channel
+    const casa::Vector<double>& median() const { return itsMedian; }
+    /// @brief median absolute deviation from the median of each channel
+    const casa::Vector<double>& madfm() const { return itsMadfm; }
+    /// @brief first percentile of each channel
+    const casa::Vector<double>& onepc() const { return itsOnepc; }
+    /// @brief minimum of each channel
+    const casa::Vector<double>& minval() const { return itsMin; }
+    /// @brief maximum of each channel
+    const casa::Vector<double>& maxval() const { return itsMax; }
+
+private:
+    /// @brief fractile of a set of values (the order of the values is changed)
+    static float fractile(std::vector<float> &values, double fraction) {
+        const size_t pos = size_t((values.size() - 1) * fraction);
+        std::nth_element(values.begin(), values.begin() + pos, values.end());
+        return values[pos];
+    }
+
+    int itsSpecAxis;
+    casa::Vector<double> itsMean;
+    casa::Vector<double> itsStd;
+    casa::Vector<double> itsMedian;
+    casa::Vector<double> itsMadfm;
+    casa::Vector<double> itsOnepc;
+    casa::Vector<double> itsMin;
+    casa::Vector<double> itsMax;
+};
+
 class MaskChanApp : public askap::Application
 {
 public:
@@ -69,47 +173,92 @@ public:
                 LOFAR::ParameterSet subset(config().makeSubset("MaskChannels."));
 
                 std::string statsfile = subset.getString("statsFile","");
-                ASKAPLOG_INFO_STR(logger, "Reading stats file " << statsfile);
 
                 std::string image = subset.getString("image","");
                 bool editImage = subset.getBool("editImage", false);
                 bool editStats = subset.getBool("editStats", false);
                 float threshold = subset.getFloat("threshold", 10.);
-                
-                std::ifstream fin(statsfile.c_str());
-                ASKAPCHECK(fin.is_open(), "Could not open statsFile " << statsfile);
-                    
+
+                boost::shared_ptr<accessors::IImageAccess<casacore::Float> > iacc = accessors::imageAccessFactory(subset);
+                casa::IPosition shape = iacc->shape(image);
+                ASKAPLOG_INFO_STR(logger, "Shape of input image = " << shape);
+                casa::CoordinateSystem coo = iacc->coordSys(image);
+                int specAxis = coo.spectralAxisNumber();
+                ASKAPLOG_INFO_STR(logger, "Spectral axis = " << specAxis);
+
                 std::string line, name;
                 unsigned int size=0;
-                
-                while (getline(fin, line),
-                       !fin.eof()) {
-                    if (line[0] != '#') {
-                        size++;
+                std::ifstream fin;
+
+                if (statsfile != "") {
+                    ASKAPLOG_INFO_STR(logger, "Reading stats file " << statsfile);
+                    fin.open(statsfile.c_str());
+                    ASKAPCHECK(fin.is_open(), "Could not open statsFile " << statsfile);
+                    
+                    while (getline(fin, line),
+                           !fin.eof()) {
+                        if (line[0] != '#') {
+                            size++;
+                        }
                     }
+                    fin.close();
+                } else {
+                    ASKAPCHECK(specAxis >= 0, "Image " << image << " has no spectral axis");
+                    size = shape[specAxis];
                 }
-                fin.close();
 
                 ASKAPLOG_INFO_STR(logger, "Will get " << size << " channels of statistics");
 
                 casa::Vector<unsigned int> chan(size);
                 casa::Vector<double> freq(size),mean(size),std(size),median(size),madfm(size),onepc(size),minval(size),maxval(size);
-                unsigned int nrow=0;
-
-                fin.open(statsfile.c_str());
                 std::string title,units;
-                getline(fin,title);
-                getline(fin,units);
-                while (getline(fin, line),
-                       !fin.eof()) {
-                    if (line[0] != '#') {
-                        std::stringstream ss(line);
-                        ss >> chan[nrow] >> freq[nrow] >> mean[nrow] >> std[nrow] >> median[nrow] >> madfm[nrow] >> onepc[nrow] >> minval[nrow] >> maxval[nrow];
-                        nrow++;
+
+                if (statsfile != "") {
+                    unsigned int nrow=0;
+                    fin.open(statsfile.c_str());
+                    getline(fin,title);
+                    getline(fin,units);
+                    while (getline(fin, line),
+                           !fin.eof()) {
+                        if (line[0] != '#') {
+                            std::stringstream ss(line);
+                            ss >> chan[nrow] >> freq[nrow] >> mean[nrow] >> std[nrow] >> median[nrow] >> madfm[nrow] >> onepc[nrow] >> minval[nrow] >> maxval[nrow];
+                            nrow++;
+                        }
                     }
-                }
 
-                ASKAPLOG_INFO_STR(logger, "Successfully read " << nrow << " rows");
+                    ASKAPLOG_INFO_STR(logger, "Successfully read " << nrow << " rows");
+                } else {
+                    // all statistics are computed in a single pass, with chunks made of whole channels
+                    const int nThreads = subset.getInt("nthreads", 1);
+                    const size_t maxMemory = size_t(subset.getUint("maxmemory", 1024)) * 1024 * 1024;
+                    ASKAPLOG_INFO_STR(logger, "Computing statistics of " << image << " with " << nThreads << " thread(s)");
+                    ImageStreamer streamer(*iacc, image, nThreads, maxMemory);
+                    for (int dim = 0; dim < int(shape.nelements()); ++dim) {
+                         if (dim != specAxis) {
+                             streamer.keepWhole(dim);
+                         }
+                    }
+                    ChannelStatsOperator op(specAxis, size);
+                    streamer.run(op);
+                    mean = op.mean();
+                    std = op.stddev();
+                    median = op.median();
+                    madfm = op.madfm();
+                    onepc = op.onepc();
+                    minval = op.minval();
+                    maxval = op.maxval();
+                    const int specCoord = coo.findCoordinate(casa::Coordinate::SPECTRAL);
+                    const casa::SpectralCoordinate &sc = coo.spectralCoordinate(specCoord);
+                    for (unsigned int i = 0; i < size; ++i) {
+                         chan[i] = i;
+                         casa::Double world;
+                         ASKAPCHECK(sc.toWorld(world, casa::Double(i)), "Failed to convert channel " << i << " to frequency");
+                         freq[i] = world / 1.e6;
+                    }
+                    title = "#  Channel   Frequency        Mean         Std      Median       MADFM       1%ile         Min         Max";
+                    units = "#                 (MHz)  (" + iacc->getUnits(image) + ")";
+                }
 
                 std::vector<double> tmpratio;
                 for(size_t i=0;i<size;i++){
@@ -130,12 +279,6 @@ public:
                                   << med + threshold * mad );
 
 
-                boost::shared_ptr<accessors::IImageAccess<casacore::Float> > iacc = accessors::imageAccessFactory(subset);
-                casa::IPosition shape = iacc->shape(image);
-                ASKAPLOG_INFO_STR(logger, "Shape of input image = " << shape);
-                casa::CoordinateSystem coo = iacc->coordSys(image);
-                int specAxis = coo.spectralAxisNumber();
-                ASKAPLOG_INFO_STR(logger, "Spectral axis = " << specAxis);
                 casa::IPosition chanShape=shape;
                 ASKAPLOG_INFO_STR(logger, "Shape of a single channel = " << chanShape);
                 chanShape[specAxis]=1;
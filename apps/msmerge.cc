@@ -36,13 +36,20 @@
 #include <vector>
 #include <algorithm>
 #include <iterator>
+#include <cstring>
 
 // ASKAPsoft includes
 #include "askap/AskapError.h"
 #include "askap/AskapLogging.h"
 #include "askap/StatReporter.h"
 #include "askap/Log4cxxLogSink.h"
+#include "askap/distributedimager/MSLayoutHelper.h"
 #include "boost/shared_ptr.hpp"
+#include "boost/bind.hpp"
+#include "boost/ref.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/thread/mutex.hpp"
+#include "boost/thread/condition_variable.hpp"
 #include "boost/exception/all.hpp"
 #include "boost/program_options.hpp"
 #include "casacore/casa/OS/File.h"
@@ -381,8 +388,138 @@ void mergeSpectralWindow(const std::vector< boost::shared_ptr<const ROMSColumns>
     dc.totalBandwidth().put(DEST_ROW, totalBandwidth);
 }
 
+/// @brief buffer with merged data and flags for one block of rows
+/// @details Two buffers are used, so the input measurement sets can be read
+/// into one while the other is written to the output.
+struct MergeBuffer {
+    /// @brief merged visibilities (nPol x nChanTotal x nRows)
+    casa::Cube<casa::Complex> data;
+    /// @brief merged flags (nPol x nChanTotal x nRows)
+    casa::Cube<casa::Bool> flag;
+    /// @brief index of the block of rows this buffer is assigned to
+    casa::uInt block;
+    /// @brief number of inputs which have filled their part of this buffer
+    casa::uInt nFilled;
+};
+
+/// @brief shared state of the reader threads and the writer
+struct MergeState {
+    /// @brief double buffer
+    MergeBuffer buffers[2];
+    /// @brief protects buffer assignment and counters
+    boost::mutex mutex;
+    /// @brief notified when a buffer is filled or released
+    boost::condition_variable changed;
+    /// @brief serialises all table access of the readers and the writer
+    /// @details casacore tables share the table cache and are not thread safe, even
+    /// if different tables are accessed, so only copying between buffers is concurrent
+    boost::mutex ioMutex;
+    /// @brief set if any thread failed
+    bool aborted;
+};
+
+/// @brief copy rows of one input into the merged cube
+/// @details The cubes are contiguous with polarisation varying fastest, so the
+/// spectra of each row occupy a contiguous block in both the source and the
+/// destination.
+/// @param[in] src data of one input (nPol x nChan x nRows)
+/// @param[in] dest merged data (nPol x nChanTotal x nRows)
+/// @param[in] destChan first channel of this input in the merged cube
+template<typename T>
+void copyRows(const casa::Cube<T> &src, casa::Cube<T> &dest, casa::uInt destChan)
+{
+    ASKAPDEBUGASSERT(src.nrow() == dest.nrow());
+    ASKAPDEBUGASSERT(src.nplane() == dest.nplane());
+    ASKAPDEBUGASSERT(destChan + src.ncolumn() <= dest.ncolumn());
+    casa::Bool deleteSrc;
+    const T *srcPtr = src.getStorage(deleteSrc);
+    T *destPtr = dest.data();
+    const size_t srcRowSize = src.nrow() * src.ncolumn();
+    const size_t destRowSize = dest.nrow() * dest.ncolumn();
+    const size_t offset = destChan * dest.nrow();
+    for (casa::uInt row = 0; row < src.nplane(); ++row) {
+        std::memcpy(destPtr + row * destRowSize + offset, srcPtr + row * srcRowSize, srcRowSize * sizeof(T));
+    }
+    src.freeStorage(srcPtr, deleteSrc);
+}
+
+/// @brief resize the buffer for the given block of rows
+/// @param[in] buffer buffer to set up
+/// @param[in] block block index
+/// @param[in] nRows total number of rows
+/// @param[in] blockSize number of rows per block
+void assignBuffer(MergeBuffer &buffer, casa::uInt block, casa::uInt nRows, casa::uInt blockSize)
+{
+    buffer.block = block;
+    buffer.nFilled = 0;
+    const casa::uInt firstRow = block * blockSize;
+    if (firstRow < nRows) {
+        const casa::uInt nRowsThisBlock = std::min(nRows - firstRow, blockSize);
+        if (buffer.data.nplane() != nRowsThisBlock) {
+            buffer.data.resize(buffer.data.nrow(), buffer.data.ncolumn(), nRowsThisBlock);
+            buffer.flag.resize(buffer.flag.nrow(), buffer.flag.ncolumn(), nRowsThisBlock);
+        }
+    }
+}
+
+/// @brief read one input measurement set (runs in a thread)
+/// @details For every block of rows, data and flags are read and copied into the
+/// part of the merged buffer corresponding to this input.
+/// @param[in] state shared state
+/// @param[in] src columns of the input
+/// @param[in] input index of the input
+/// @param[in] destChan first channel of this input in the merged cube
+/// @param[in] nRows total number of rows
+/// @param[in] blockSize number of rows per block
+/// @param[out] error error message, empty if no error occurred
+void readInput(MergeState &state, const ROMSColumns &src, casa::uInt input, casa::uInt destChan,
+               casa::uInt nRows, casa::uInt blockSize, std::string &error)
+{
+    try {
+        const casa::uInt nBlocks = (nRows + blockSize - 1) / blockSize;
+        for (casa::uInt block = 0; block < nBlocks; ++block) {
+            MergeBuffer &buffer = state.buffers[block % 2];
+            {
+                boost::unique_lock<boost::mutex> lock(state.mutex);
+                while ((buffer.block != block) && !state.aborted) {
+                    state.changed.wait(lock);
+                }
+                if (state.aborted) {
+                    return;
+                }
+            }
+            const casa::uInt row = block * blockSize;
+            const Slicer rowslicer(IPosition(1, row), IPosition(1, buffer.data.nplane()),
+                    Slicer::endIsLength);
+            casa::Cube<casa::Complex> srcData;
+            casa::Cube<casa::Bool> srcFlag;
+            {
+                boost::lock_guard<boost::mutex> lock(state.ioMutex);
+                srcData = src.data().getColumnRange(rowslicer);
+                srcFlag = src.flag().getColumnRange(rowslicer);
+            }
+            // each input writes its own range of channels, so no locking is required
+            copyRows(srcData, buffer.data, destChan);
+            copyRows(srcFlag, buffer.flag, destChan);
+            {
+                boost::lock_guard<boost::mutex> lock(state.mutex);
+                ++buffer.nFilled;
+            }
+            state.changed.notify_all();
+        }
+    } catch (const std::exception &ex) {
+        error = ex.what();
+        {
+            boost::lock_guard<boost::mutex> lock(state.mutex);
+            state.aborted = true;
+        }
+        state.changed.notify_all();
+    }
+}
+
 void mergeMainTable(const std::vector< boost::shared_ptr<const ROMSColumns> >& srcMscs,
-                    casa::MeasurementSet& dest, const IPosition& tileShape)
+                    casa::MeasurementSet& dest, const IPosition& tileShape,
+                    bool deriveColumns = false)
 {
     MSColumns dc(dest);
     // Add rows upfront
@@ -390,72 +527,137 @@ void mergeMainTable(const std::vector< boost::shared_ptr<const ROMSColumns> >& s
     const casa::uInt nRows = sc.nrow();
     dest.addRow(nRows);
     ASKAPLOG_INFO_STR(logger,  "tileshape="<< tileShape(0) << ","<<tileShape(1)<<","<<tileShape(2) );
+    if (nRows == 0) {
+        return;
+    }
     // 2: Size the matrix for data and flag
     const uInt nPol = sc.data()(0).shape()(0);
     uInt nChanTotal = 0;
+    std::vector<casa::uInt> destChans(srcMscs.size());
     for (uInt i = 0; i < srcMscs.size(); i++) {
+        destChans[i] = nChanTotal;
         nChanTotal += srcMscs[i]->data().shape(0)(1);
     }
-    casa::Cube<casa::Complex> data(nPol, nChanTotal,tileShape(2));
-    casa::Cube<casa::Bool> flag(nPol, nChanTotal,tileShape(2));
+    ASKAPCHECK(tileShape(2) > 0, "Number of rows per tile should be positive");
+    // Write whole tiles only, but as many of them at once as fit into about 256 MB
+    // of buffer, so each output tile is written exactly once
+    const size_t bytesPerRow = nPol * nChanTotal * (sizeof(casa::Complex) + sizeof(casa::Bool));
+    const size_t rowsPerTile = tileShape(2);
+    const size_t tilesPerBlock = std::max(size_t(1),
+            size_t(256 * 1024 * 1024) / (bytesPerRow * rowsPerTile));
+    const casa::uInt blockSize = std::min(size_t(nRows), tilesPerBlock * rowsPerTile);
+    ASKAPLOG_INFO_STR(logger, "Writing " << blockSize << " rows at a time");
+    const casa::uInt nBlocks = (nRows + blockSize - 1) / blockSize;
+
+    MergeState state;
+    state.aborted = false;
+    for (uInt b = 0; b < 2; ++b) {
+        state.buffers[b].data.resize(nPol, nChanTotal, blockSize);
+        state.buffers[b].flag.resize(nPol, nChanTotal, blockSize);
+        assignBuffer(state.buffers[b], b, nRows, blockSize);
+    }
+
+    // 3: Start one reader per input, they copy data into the merged buffers
+    ASKAPLOG_INFO_STR(logger, "Reading " << srcMscs.size() << " inputs concurrently");
+    std::vector<std::string> errors(srcMscs.size());
+    boost::thread_group readers;
+    for (uInt i = 0; i < srcMscs.size(); ++i) {
+        readers.create_thread(boost::bind(readInput, boost::ref(state), boost::cref(*srcMscs[i]), i,
+                    destChans[i], nRows, blockSize, boost::ref(errors[i])));
+    }
 
-    // For each row
+    // For each block of rows
     int lastPerc = 0;
-    for (uInt row = 0; row < nRows; row+=tileShape(2)) {
-        int nRowsThisIteration = std::min(nRows-row+0l,tileShape(2));
-        const Slicer rowslicer(IPosition(1, row), IPosition(1, nRowsThisIteration),
-                Slicer::endIsLength);
-        if (10*row/nRows > lastPerc/10) {
-            ASKAPLOG_INFO_STR(logger,  "Merging row " << row << " of " << nRows);
-            lastPerc = 100*row/nRows;
-        }
+    try {
+        for (uInt block = 0; block < nBlocks; ++block) {
+            const uInt row = block * blockSize;
+            MergeBuffer &buffer = state.buffers[block % 2];
+            const uInt nRowsThisIteration = buffer.data.nplane();
+            const Slicer rowslicer(IPosition(1, row), IPosition(1, nRowsThisIteration),
+                    Slicer::endIsLength);
+            if (10*row/nRows > lastPerc/10) {
+                ASKAPLOG_INFO_STR(logger,  "Merging row " << row << " of " << nRows);
+                lastPerc = 100*row/nRows;
+            }
 
-        // 1: Copy over the simple cells (i.e. those not needing merging)
-        dc.scanNumber().putColumnRange(rowslicer, sc.scanNumber().getColumnRange(rowslicer));
-        dc.fieldId().putColumnRange(rowslicer, sc.fieldId().getColumnRange(rowslicer));
-        dc.dataDescId().putColumnRange(rowslicer, sc.dataDescId().getColumnRange(rowslicer));
-        dc.time().putColumnRange(rowslicer, sc.time().getColumnRange(rowslicer));
-        dc.timeCentroid().putColumnRange(rowslicer, sc.timeCentroid().getColumnRange(rowslicer));
-        dc.arrayId().putColumnRange(rowslicer, sc.arrayId().getColumnRange(rowslicer));
-        dc.processorId().putColumnRange(rowslicer, sc.processorId().getColumnRange(rowslicer));
-        dc.exposure().putColumnRange(rowslicer, sc.exposure().getColumnRange(rowslicer));
-        dc.interval().putColumnRange(rowslicer, sc.interval().getColumnRange(rowslicer));
-        dc.observationId().putColumnRange(rowslicer, sc.observationId().getColumnRange(rowslicer));
-        dc.antenna1().putColumnRange(rowslicer, sc.antenna1().getColumnRange(rowslicer));
-        dc.antenna2().putColumnRange(rowslicer, sc.antenna2().getColumnRange(rowslicer));
-        dc.feed1().putColumnRange(rowslicer, sc.feed1().getColumnRange(rowslicer));
-        dc.feed2().putColumnRange(rowslicer, sc.feed2().getColumnRange(rowslicer));
-        dc.uvw().putColumnRange(rowslicer, sc.uvw().getColumnRange(rowslicer));
-        dc.flagRow().putColumnRange(rowslicer, sc.flagRow().getColumnRange(rowslicer));
-        dc.weight().putColumnRange(rowslicer, sc.weight().getColumnRange(rowslicer));
-        dc.sigma().putColumnRange(rowslicer, sc.sigma().getColumnRange(rowslicer));
-
-        if (nRowsThisIteration!=tileShape(2)) {
-            // for the last set of rows we may need to resize
-            data.resize(nPol,nChanTotal,nRowsThisIteration);
-            flag.resize(nPol,nChanTotal,nRowsThisIteration);
-        }
+            // 1: Copy over the simple cells (i.e. those not needing merging)
+            {
+                boost::lock_guard<boost::mutex> lock(state.ioMutex);
+                dc.scanNumber().putColumnRange(rowslicer, sc.scanNumber().getColumnRange(rowslicer));
+                dc.fieldId().putColumnRange(rowslicer, sc.fieldId().getColumnRange(rowslicer));
+                dc.dataDescId().putColumnRange(rowslicer, sc.dataDescId().getColumnRange(rowslicer));
+                const casa::Vector<casa::Double> time = sc.time().getColumnRange(rowslicer);
+                dc.time().putColumnRange(rowslicer, time);
+                dc.timeCentroid().putColumnRange(rowslicer,
+                        deriveColumns ? time : sc.timeCentroid().getColumnRange(rowslicer));
+                dc.arrayId().putColumnRange(rowslicer, sc.arrayId().getColumnRange(rowslicer));
+                dc.processorId().putColumnRange(rowslicer, sc.processorId().getColumnRange(rowslicer));
+                dc.exposure().putColumnRange(rowslicer, sc.exposure().getColumnRange(rowslicer));
+                dc.interval().putColumnRange(rowslicer, sc.interval().getColumnRange(rowslicer));
+                dc.observationId().putColumnRange(rowslicer, sc.observationId().getColumnRange(rowslicer));
+                dc.antenna1().putColumnRange(rowslicer, sc.antenna1().getColumnRange(rowslicer));
+                dc.antenna2().putColumnRange(rowslicer, sc.antenna2().getColumnRange(rowslicer));
+                dc.feed1().putColumnRange(rowslicer, sc.feed1().getColumnRange(rowslicer));
+                dc.feed2().putColumnRange(rowslicer, sc.feed2().getColumnRange(rowslicer));
+                dc.uvw().putColumnRange(rowslicer, sc.uvw().getColumnRange(rowslicer));
+                const casa::Matrix<casa::Float> sigma = sc.sigma().getColumnRange(rowslicer);
+                dc.sigma().putColumnRange(rowslicer, sigma);
+                if (deriveColumns) {
+                    dc.weight().putColumnRange(rowslicer, cp::MSLayoutHelper::weightsFromSigmas(sigma));
+                } else {
+                    dc.flagRow().putColumnRange(rowslicer, sc.flagRow().getColumnRange(rowslicer));
+                    dc.weight().putColumnRange(rowslicer, sc.weight().getColumnRange(rowslicer));
+                }
+            }
 
-        // 3: Copy the data from each input into the output matrix
-        uInt destChan = 0;
-        for (uInt i = 0; i < srcMscs.size(); ++i) {
-            const casa::Cube<casa::Complex> srcData = srcMscs[i]->data().getColumnRange(rowslicer);
-            const casa::Cube<casa::Bool> srcFlag = srcMscs[i]->flag().getColumnRange(rowslicer);
-            const uInt nChan = srcMscs[i]->data().shape(0)(1);
-            for (uInt irow = 0; irow < nRowsThisIteration; irow++) {
-                data(Slice(), Slice(destChan,nChan), irow) = srcData(Slice(), Slice(), irow);
-                flag(Slice(), Slice(destChan,nChan), irow) = srcFlag(Slice(), Slice(), irow);
+            // wait until all inputs have been copied into the buffer
+            {
+                boost::unique_lock<boost::mutex> lock(state.mutex);
+                while ((buffer.nFilled < srcMscs.size()) && !state.aborted) {
+                    state.changed.wait(lock);
+                }
+                if (state.aborted) {
+                    break;
+                }
             }
-            destChan += nChan;
+
+            // 4: Add those merged cells
+            {
+                const casa::Vector<casa::Bool> flagRow = deriveColumns ?
+                        cp::MSLayoutHelper::rowFlags(buffer.flag) : casa::Vector<casa::Bool>();
+                boost::lock_guard<boost::mutex> lock(state.ioMutex);
+                dc.data().putColumnRange(rowslicer, buffer.data);
+                dc.flag().putColumnRange(rowslicer, buffer.flag);
+                if (deriveColumns) {
+                    dc.flagRow().putColumnRange(rowslicer, flagRow);
+                }
+            }
+
+            // release the buffer for the block after next
+            {
+                boost::lock_guard<boost::mutex> lock(state.mutex);
+                assignBuffer(buffer, block + 2, nRows, blockSize);
+            }
+            state.changed.notify_all();
         }
-        // 4: Add those merged cells
-        dc.data().putColumnRange(rowslicer, data);
-        dc.flag().putColumnRange(rowslicer, flag);
+    } catch (...) {
+        {
+            boost::lock_guard<boost::mutex> lock(state.mutex);
+            state.aborted = true;
+        }
+        state.changed.notify_all();
+        readers.join_all();
+        throw;
+    }
+    readers.join_all();
+    for (uInt i = 0; i < errors.size(); ++i) {
+        ASKAPCHECK(errors[i].empty(), "Error reading input " << i << ": " << errors[i]);
     }
 }
 
 void merge(const std::vector<std::string>& inFiles, const std::string& outFile, casa::uInt tileNcorr = 4,
-    casa::uInt tileNchan = 1, casa::uInt tileNrow = 0)
+    casa::uInt tileNchan = 1, casa::uInt tileNrow = 0, const std::string& layout = "",
+    bool deriveColumns = false)
 {
     // Open the input measurement sets
     std::vector< boost::shared_ptr<const casa::MeasurementSet> > in;
@@ -468,6 +670,16 @@ void merge(const std::vector<std::string>& inFiles, const std::string& outFile,
         inColumns.push_back(boost::shared_ptr<const ROMSColumns>(new ROMSColumns(*p)));
         nChanOut += inColumns.back()->data().shape(0)(1);
     }
+    if (layout != "") {
+        // Tile shape follows the access pattern of the imager reading the output
+        const cp::MSLayoutHelper::AccessPattern pattern = cp::MSLayoutHelper::fromString(layout);
+        const casa::uInt nCorr = inColumns[0]->data().shape(0)(0);
+        const IPosition tileShape = cp::MSLayoutHelper::dataTileShape(pattern, nCorr, nChanOut, 1024 * 1024);
+        tileNcorr = tileShape(0);
+        tileNchan = tileShape(1);
+        tileNrow = tileShape(2);
+        ASKAPLOG_INFO_STR(logger, "Using " << layout << " layout, tile shape " << tileShape);
+    }
     if (tileNcorr < 1) tileNcorr = 1;
     if (tileNchan < 1) tileNchan = 1;
     // Set tileNrow large, but not so large that caching takes > 1GB
@@ -526,7 +738,7 @@ void merge(const std::vector<std::string>& inFiles, const std::string& outFile,
 
     // Merge main table
     ASKAPLOG_INFO_STR(logger,  "Merging main table");
-    mergeMainTable(inColumns, *out,IPosition(3,tileNcorr,tileNchan,tileNrow));
+    mergeMainTable(inColumns, *out,IPosition(3,tileNcorr,tileNchan,tileNrow), deriveColumns);
     // Uncomment this to check if the caching is working
     //RODataManAccessor(**(in.begin()), "TiledData", False).showCacheStatistics (cout);
     //RODataManAccessor(*out, "TiledData", False).showCacheStatistics (cout);
@@ -557,6 +769,8 @@ int main(int argc, const char** argv)
         int tileNcorr;
         int tileNchan;
         int tileNrow;
+        std::string layout;
+        bool deriveColumns = false;
         std::string outName;
         std::vector<std::string> inNamesVec;
         std::vector<std::string> inNames;
@@ -568,6 +782,8 @@ int main(int argc, const char** argv)
         ("tileNcorr,x", po::value<int>(&tileNcorr)->default_value(4), "Number of correlations per tile")
         ("tileNchan,c", po::value<int>(&tileNchan)->default_value(1), "Number of channels per tile")
         ("tileNrow,r", po::value<int>(&tileNrow)->default_value(0), "Number of rows per tile")
+        ("layout,l", po::value<std::string>(&layout)->default_value(""), "Choose the tile shape for the given access pattern (spectral or continuum) instead of the explicit tiling")
+        ("derivecolumns,d", po::bool_switch(&deriveColumns), "Derive TIME_CENTROID, WEIGHT and FLAG_ROW from TIME, SIGMA and FLAG")
         ("input-file,i", po::value< vector<string> >(&inNames), "Input file(s) - you can also just list them after the other options")
         ("output-file,o",po::value<std::string>(&outName)->default_value("out.ms"),"Output filename");
 
@@ -625,7 +841,7 @@ int main(int argc, const char** argv)
                 inNamesVec.push_back(*it);
         }
 
-        merge(inNamesVec, outName, tileNcorr, tileNchan, tileNrow);
+        merge(inNamesVec, outName, tileNcorr, tileNchan, tileNrow, layout, deriveColumns);
 
         stats.logSummary();
         ///==============================================================================
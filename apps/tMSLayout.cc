@@ -0,0 +1,202 @@
+/// @file
+/// @brief benchmark of the visibility column layouts
+/// @details This test writes a synthetic DATA column tiled for each of the access
+/// patterns supported by MSLayoutHelper and measures the read throughput for the way
+/// the spectral-line imager (one channel for all rows) and the continuum imager
+/// (all channels for a block of rows) access the data. The tables are deleted at the
+/// end. Note, the results include the effect of the operating system cache, use
+/// a data size exceeding the available memory to get the disk throughput. Usage:
+///   tMSLayout [number of rows] [number of channels] [number of correlations]
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+
+#include <askap/AskapLogging.h>
+#include <casacore/casa/Logging/LogIO.h>
+#include <askap/Log4cxxLogSink.h>
+ASKAP_LOGGER(logger, "");
+
+#include <askap/AskapError.h>
+#include <askap/distributedimager/MSLayoutHelper.h>
+
+// casa
+#include <casacore/casa/OS/Timer.h>
+#include <casacore/casa/Arrays/Cube.h>
+#include <casacore/casa/Arrays/IPosition.h>
+#include <casacore/casa/Arrays/Slicer.h>
+#include <casacore/tables/Tables/Table.h>
+#include <casacore/tables/Tables/TableDesc.h>
+#include <casacore/tables/Tables/SetupNewTab.h>
+#include <casacore/tables/Tables/ArrColDesc.h>
+#include <casacore/tables/Tables/ArrayColumn.h>
+#include <casacore/tables/DataMan/TiledShapeStMan.h>
+
+// std
+#include <stdexcept>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdlib>
+#include <string>
+#include <algorithm>
+
+using namespace askap;
+using namespace askap::cp;
+
+/// @brief create and fill a table with the DATA column tiled for the given pattern
+/// @param[in] name table name
+/// @param[in] pattern access pattern to tile the column for
+/// @param[in] nRows number of rows
+/// @param[in] nChan number of channels
+/// @param[in] nCorr number of correlations
+void createTable(const std::string &name, const MSLayoutHelper::AccessPattern pattern,
+                 const casacore::uInt nRows, const casacore::uInt nChan, const casacore::uInt nCorr) {
+  casacore::TableDesc td("", "1", casacore::TableDesc::Scratch);
+  td.addColumn(casacore::ArrayColumnDesc<casacore::Complex>("DATA", casacore::IPosition(2, nCorr, nChan),
+               casacore::ColumnDesc::FixedShape));
+  casacore::SetupNewTable newtab(name, td, casacore::Table::New);
+  const casacore::IPosition tileShape = MSLayoutHelper::dataTileShape(pattern, nCorr, nChan, 1024 * 1024);
+  casacore::TiledShapeStMan stman("TiledData", tileShape);
+  newtab.bindColumn("DATA", stman);
+  casacore::Table table(newtab, nRows);
+  casacore::ArrayColumn<casacore::Complex> data(table, "DATA");
+
+  const casacore::uInt blockSize = tileShape(2) > 1 ? tileShape(2) : 1;
+  for (casacore::uInt row = 0; row < nRows; row += blockSize) {
+       const casacore::uInt nRowsThisBlock = std::min(blockSize, nRows - row);
+       casacore::Cube<casacore::Complex> buf(nCorr, nChan, nRowsThisBlock);
+       for (casacore::uInt r = 0; r < nRowsThisBlock; ++r) {
+            buf.xyPlane(r) = casacore::Complex(float(row + r), 0.);
+       }
+       data.putColumnRange(casacore::Slicer(casacore::IPosition(1, row), casacore::IPosition(1, nRowsThisBlock),
+                           casacore::Slicer::endIsLength), buf);
+  }
+  ASKAPLOG_INFO_STR(logger, "Created "<<name<<" with tile shape "<<tileShape);
+}
+
+/// @brief read the table in the way the spectral-line imager does
+/// @details Each channel is read for all rows in turn.
+/// @param[in] table table to read
+/// @return read throughput in MB/s
+double readSpectral(const casacore::Table &table) {
+  casacore::ROArrayColumn<casacore::Complex> data(table, "DATA");
+  const casacore::IPosition shape = data.shape(0);
+  casacore::Timer timer;
+  timer.mark();
+  double checksum = 0.;
+  for (casacore::Int chan = 0; chan < shape(1); ++chan) {
+       const casacore::Slicer slicer(casacore::IPosition(2, 0, chan), casacore::IPosition(2, shape(0), 1),
+                                     casacore::Slicer::endIsLength);
+       const casacore::Array<casacore::Complex> buf = data.getColumn(slicer);
+       checksum += real(buf(casacore::IPosition(buf.ndim(), 0)));
+  }
+  const double elapsed = timer.real();
+  ASKAPLOG_DEBUG_STR(logger, "Checksum: "<<checksum);
+  return double(table.nrow()) * shape.product() * sizeof(casacore::Complex) / 1048576. / elapsed;
+}
+
+/// @brief read the table in the way the continuum imager does
+/// @details All channels are read for a block of rows in turn.
+/// @param[in] table table to read
+/// @param[in] blockSize number of rows per block
+/// @return read throughput in MB/s
+double readContinuum(const casacore::Table &table, const casacore::uInt blockSize) {
+  casacore::ROArrayColumn<casacore::Complex> data(table, "DATA");
+  const casacore::IPosition shape = data.shape(0);
+  const casacore::uInt nRows = table.nrow();
+  casacore::Timer timer;
+  timer.mark();
+  double checksum = 0.;
+  for (casacore::uInt row = 0; row < nRows; row += blockSize) {
+       const casacore::uInt nRowsThisBlock = std::min(blockSize, nRows - row);
+       const casacore::Array<casacore::Complex> buf = data.getColumnRange(casacore::Slicer(
+                 casacore::IPosition(1, row), casacore::IPosition(1, nRowsThisBlock), casacore::Slicer::endIsLength));
+       checksum += real(buf(casacore::IPosition(buf.ndim(), 0)));
+  }
+  const double elapsed = timer.real();
+  ASKAPLOG_DEBUG_STR(logger, "Checksum: "<<checksum);
+  return double(nRows) * shape.product() * sizeof(casacore::Complex) / 1048576. / elapsed;
+}
+
+int main(int argc, const char **argv) {
+  std::ifstream config("askap.log_cfg", std::ifstream::in);
+  if (config) {
+      ASKAPLOG_INIT("askap.log_cfg");
+  } else {
+      std::ostringstream ss;
+      ss << argv[0] << ".log_cfg";
+      ASKAPLOG_INIT(ss.str().c_str());
+  }
+
+  try {
+     // Ensure that CASA log messages are captured
+     casa::LogSinkInterface* globalSink = new Log4cxxLogSink();
+     casa::LogSink::globalSink(globalSink);
+
+     if (argc > 4) {
+         std::cerr<<"Usage: "<<argv[0]<<" [number of rows] [number of channels] [number of correlations]"<<std::endl;
+         return -2;
+     }
+     const int nRows = argc > 1 ? atoi(argv[1]) : 20000;
+     const int nChan = argc > 2 ? atoi(argv[2]) : 288;
+     const int nCorr = argc > 3 ? atoi(argv[3]) : 4;
+     ASKAPCHECK(nRows > 0, "Number of rows should be positive");
+     ASKAPCHECK(nChan > 0, "Number of channels should be positive");
+     ASKAPCHECK(nCorr > 0, "Number of correlations should be positive");
+
+     // the continuum imager reads the data in chunks of a few hundred rows
+     const casacore::uInt imagerBlockSize = 1000;
+     const MSLayoutHelper::AccessPattern patterns[] = {MSLayoutHelper::SPECTRAL, MSLayoutHelper::CONTINUUM};
+     for (size_t p = 0; p < 2; ++p) {
+          const std::string layout = MSLayoutHelper::toString(patterns[p]);
+          const std::string name = "tMSLayout_" + layout + ".tab";
+          createTable(name, patterns[p], nRows, nChan, nCorr);
+          double spectralRate = 0.;
+          double continuumRate = 0.;
+          {
+            // reopen the table, so nothing is left in the table cache
+            casacore::Table table(name);
+            spectralRate = readSpectral(table);
+          }
+          {
+            casacore::Table table(name);
+            continuumRate = readContinuum(table, imagerBlockSize);
+            table.markForDelete();
+          }
+          ASKAPLOG_INFO_STR(logger, "layout = "<<layout<<" nrows = "<<nRows<<" nchan = "<<nChan<<
+                            " ncorr = "<<nCorr<<", spectral access: "<<spectralRate<<
+                            " MB/s, continuum access: "<<continuumRate<<" MB/s");
+          std::cout<<layout<<" "<<nRows<<" "<<nChan<<" "<<nCorr<<" "<<spectralRate<<" "<<continuumRate<<std::endl;
+     }
+  }
+  catch(const AskapError &ce) {
+     ASKAPLOG_FATAL_STR(logger, "AskapError has been caught. "<<ce.what());
+     return -1;
+  }
+  catch(const std::exception &ex) {
+     ASKAPLOG_FATAL_STR(logger, "std::exception has been caught. "<<ex.what());
+     return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,182 @@
+/// @file
+/// @brief benchmark of the model broadcast
+/// @details This test broadcasts a synthetic model image from the master to all
+/// workers with each of the supported encodings and reports the time per broadcast
+/// (including decoding by the workers) against the number of ranks. Usage:
+///   mpirun -np N tModelBroadcast [npix] [fraction of non-zero pixels] [number of repetitions]
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+
+#include <askap/AskapLogging.h>
+#include <casacore/casa/Logging/LogIO.h>
+#include <askap/Log4cxxLogSink.h>
+ASKAP_LOGGER(logger, "");
+
+#include <askap/AskapError.h>
+#include <askap/askapparallel/AskapParallel.h>
+#include <askap/parallel/SynParallel.h>
+#include <askap/parallel/CompressedBlobCodec.h>
+#include <askap/scimath/fitting/Params.h>
+#include <askap/scimath/fitting/Axes.h>
+#include <Common/ParameterSet.h>
+
+#include <Blob/BlobString.h>
+#include <Blob/BlobOBufString.h>
+#include <Blob/BlobOStream.h>
+
+// casa
+#include <casacore/casa/OS/Timer.h>
+#include <casacore/casa/Arrays/Array.h>
+#include <casacore/casa/Arrays/IPosition.h>
+
+// std
+#include <stdexcept>
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include <string>
+
+using namespace askap;
+using namespace askap::synthesis;
+
+/// @brief make a synthetic model
+/// @details Values are single precision numbers held as doubles like in the
+/// real models produced by the solvers.
+/// @param[in] npix image size
+/// @param[in] fraction fraction of non-zero pixels
+/// @return shared pointer to the model
+scimath::Params::ShPtr makeModel(const int npix, const double fraction) {
+  scimath::Params::ShPtr model(new scimath::Params);
+  casacore::Array<double> pixels(casacore::IPosition(4, npix, npix, 1, 1), 0.);
+  const size_t nNonZero = static_cast<size_t>(fraction * pixels.nelements());
+  srand(1);
+  double *data = pixels.data();
+  for (size_t i = 0; i < nNonZero; ++i) {
+       data[rand() % pixels.nelements()] = static_cast<float>(rand()) / RAND_MAX;
+  }
+  scimath::Axes axes;
+  axes.add("RA", -0.01, 0.01);
+  axes.add("DEC", -0.01, 0.01);
+  axes.add("STOKES", 0., 0.);
+  axes.add("FREQUENCY", 1.4e9, 1.4e9);
+  model->add("image.test", pixels, axes);
+  model->add("peak_residual", 1.);
+  return model;
+}
+
+/// @brief size of the model after serialisation and encoding
+/// @param[in] model model to serialise
+/// @param[in] mode encoding mode
+/// @return size in bytes
+size_t encodedSize(const scimath::Params &model, const CompressedBlobCodec::Mode mode) {
+  LOFAR::BlobString bs;
+  bs.resize(0);
+  LOFAR::BlobOBufString bob(bs);
+  LOFAR::BlobOStream out(bob);
+  out.putStart("model", 1);
+  out << model;
+  out.putEnd();
+  std::vector<int8_t> encoded;
+  CompressedBlobCodec::encode(bs.data(), bs.size(), mode, encoded);
+  return encoded.size();
+}
+
+void doBroadcastTest(askap::askapparallel::AskapParallel &comms, const int npix, const double fraction,
+                     const int nRepeat) {
+  const scimath::Params::ShPtr model = makeModel(npix, fraction);
+  const char* modes[] = {"none", "rle", "shuffle"};
+  for (size_t m = 0; m < 3; ++m) {
+       LOFAR::ParameterSet parset;
+       parset.add("modelcompression", modes[m]);
+       SynParallel syn(comms, parset);
+       if (comms.isMaster()) {
+           syn.params() = model;
+       }
+       comms.barrier();
+       casacore::Timer timer;
+       timer.mark();
+       for (int i = 0; i < nRepeat; ++i) {
+            if (comms.isMaster()) {
+                syn.broadcastModel();
+            } else {
+                syn.receiveModel();
+            }
+            comms.barrier();
+       }
+       const double perBroadcast = timer.real() / nRepeat;
+       if (comms.isWorker()) {
+           ASKAPCHECK(syn.params()->has("image.test"), "Model has not been received");
+       }
+       if (comms.isMaster()) {
+           const size_t size = encodedSize(*model, CompressedBlobCodec::modeFromString(modes[m]));
+           ASKAPLOG_INFO_STR(logger, "nprocs = "<<comms.nProcs()<<" npix = "<<npix<<" fraction = "<<fraction<<
+                             " encoding = "<<modes[m]<<" size = "<<size<<" bytes, time per broadcast = "<<
+                             perBroadcast<<" s");
+           std::cout<<comms.nProcs()<<" "<<npix<<" "<<fraction<<" "<<modes[m]<<" "<<size<<" "<<perBroadcast<<std::endl;
+       }
+  }
+}
+
+int main(int argc, const char **argv) {
+  // This class must have scope outside the main try/catch block
+  askap::askapparallel::AskapParallel comms(argc, argv);
+
+  try {
+     // Ensure that CASA log messages are captured
+     casa::LogSinkInterface* globalSink = new Log4cxxLogSink();
+     casa::LogSink::globalSink(globalSink);
+
+     if (argc > 4) {
+         std::cerr<<"Usage: "<<argv[0]<<" [npix] [fraction of non-zero pixels] [number of repetitions]"<<std::endl;
+         return -2;
+     }
+     ASKAPCHECK(comms.isParallel(), "This test could only be run as a parallel MPI job");
+     const int npix = argc > 1 ? atoi(argv[1]) : 2048;
+     const double fraction = argc > 2 ? atof(argv[2]) : 0.01;
+     const int nRepeat = argc > 3 ? atoi(argv[3]) : 5;
+     ASKAPCHECK(npix > 0, "Image size should be positive");
+     ASKAPCHECK((fraction >= 0.) && (fraction <= 1.), "Fraction of non-zero pixels should be between 0 and 1");
+     ASKAPCHECK(nRepeat > 0, "Number of repetitions should be positive");
+
+     casa::Timer timer;
+     timer.mark();
+     doBroadcastTest(comms, npix, fraction, nRepeat);
+     ASKAPLOG_INFO_STR(logger, "Job: "<<timer.real());
+
+  }
+  catch(const AskapError &ce) {
+     ASKAPLOG_FATAL_STR(logger, "AskapError has been caught. "<<ce.what());
+     comms.abort();
+  }
+  catch(const std::exception &ex) {
+     ASKAPLOG_FATAL_STR(logger, "std::exception has been caught. "<<ex.what());
+     comms.abort();
+  }
+  catch(...) {
+     ASKAPLOG_FATAL_STR(logger, "an unexpected exception has been caught");
+     comms.abort();
+  }
+  return 0;
+}
@@ -63,6 +63,7 @@ ASKAP_LOGGER(logger, ".adviseDI");
 #include <Blob/BlobOStream.h>
 
 
+#include <map>
 #include <vector>
 #include <string>
 #include <float.h>
@@ -596,6 +597,8 @@ void AdviseDI::prepare() {
         }
 
     }
+    checkWriterChannelBlocks();
+
     for (int grp = 1; grp < itsComms.nGroups(); grp++) {
         for (int wrk = 0; wrk < nWorkersPerGroup; wrk++) {
             itsAllocatedWork[grp*nWorkersPerGroup+wrk] = itsAllocatedWork[wrk];
@@ -614,6 +617,36 @@ void AdviseDI::prepare() {
     isPrepared = true;
     ASKAPLOG_DEBUG_STR(logger, "Prepared the advice");
 }
+void AdviseDI::checkWriterChannelBlocks() const {
+    const int tileNChan = itsParset.getInt32("Images.tilenchan", 1);
+    if ((tileNChan <= 1) || (itsParset.getInt32("nwriters", 1) <= 1) || !itsParset.getBool("singleoutputfile", false)) {
+        return;
+    }
+    // writer of each block of channels, indexed by the first channel of the block
+    std::map<unsigned int, unsigned int> blockWriters;
+    for (size_t wrk = 0; wrk < itsAllocatedWork.size(); wrk++) {
+        for (size_t unit = 0; unit < itsAllocatedWork[wrk].size(); unit++) {
+            const cp::ContinuumWorkUnit &wu = itsAllocatedWork[wrk][unit];
+            if (wu.get_payloadType() != cp::ContinuumWorkUnit::WORK) {
+                continue;
+            }
+            const unsigned int blockStart = wu.get_globalChannel() - wu.get_globalChannel() % tileNChan;
+            const std::map<unsigned int, unsigned int>::const_iterator ci = blockWriters.find(blockStart);
+            if (ci == blockWriters.end()) {
+                blockWriters[blockStart] = wu.get_writer();
+            } else {
+                ASKAPCHECK(ci->second == wu.get_writer(), "Channels " << blockStart << " to " <<
+                           blockStart + tileNChan - 1 << " share a storage tile of the single output cube, but are "
+                           "written by ranks " << ci->second << " and " << wu.get_writer() <<
+                           ". Choose nchanpercore, nwriters and Images.tilenchan so that the channel range of "
+                           "each writer is a multiple of Images.tilenchan");
+            }
+        }
+    }
+    ASKAPLOG_INFO_STR(logger, "Channel ranges of " << itsParset.getInt32("nwriters", 1) <<
+                      " writers are aligned to blocks of " << tileNChan << " channels");
+}
+
 cp::ContinuumWorkUnit AdviseDI::getAllocation(int id) {
     cp::ContinuumWorkUnit rtn;
     if (itsAllocatedWork[id].empty() == true) {
@@ -177,6 +177,13 @@ namespace askap {
 
             std::vector<int> getBeams();
 
+            /// @brief check that writers of a single cube don't share storage tiles
+            /// @details With singleoutputfile = true all writers write their channels into the same
+            /// cube, in blocks of Images.tilenchan channels aligned to multiples of it (see CubeBuilder).
+            /// Every block must therefore be written by one writer only, otherwise two processes would
+            /// update the same tile. An exception is thrown if the channel allocation breaks this.
+            void checkWriterChannelBlocks() const;
+
 
         };
 
@@ -113,6 +113,12 @@ void CalcCore::doCalc()
     ASKAPLOG_DEBUG_STR(logger, "Calculating NE .... for channel " << itsChannel);
     if (!itsEquation) {
 
+        // tables are not thread safe - set up the iterator with the lock held if other threads read data
+        boost::unique_lock<boost::mutex> dataLock;
+        if (itsDataMutex) {
+            dataLock = boost::unique_lock<boost::mutex>(*itsDataMutex);
+        }
+
         accessors::TableDataSource ds = itsData;
 
         // Setup data iterator
@@ -131,6 +137,11 @@ void CalcCore::doCalc()
         conv->setEpochFrame();
 
         IDataSharedIter it = ds.createIterator(sel, conv);
+        if (dataLock.owns_lock()) {
+            // the prefetching thread locks the mutex each time it reads the data
+            dataLock.unlock();
+        }
+        it = prefetchIfRequested(it, itsDataMutex);
 
 
         ASKAPCHECK(itsModel, "Model not defined");
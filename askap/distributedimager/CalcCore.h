@@ -45,6 +45,9 @@
 #include <casacore/casa/Arrays/Vector.h>
 #include <askap/dataaccess/TableDataSource.h>
 
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
 // Local includes
 
 
@@ -95,6 +98,13 @@ namespace cp {
 
         casacore::Array<casacore::Complex> getGrid();
 
+        /// @brief serialise data access with other threads
+        /// @details If set, the tables are accessed only while this mutex is locked
+        /// and the data are read ahead in a separate thread (see PrefetchIterator).
+        /// This is used when a number of channels are imaged concurrently by the same rank.
+        /// @param[in] mutex mutex shared between all threads accessing the data
+        void setDataAccessMutex(const boost::shared_ptr<boost::mutex> &mutex) { itsDataMutex = mutex; }
+
     private:
 
         // Parameter set
@@ -120,6 +130,9 @@ namespace cp {
         // Its channel in the dataset
         int itsChannel;
 
+        // Mutex serialising table access between threads (empty if not required)
+        boost::shared_ptr<boost::mutex> itsDataMutex;
+
         // No support for assignment
         CalcCore& operator=(const CalcCore& rhs);
 
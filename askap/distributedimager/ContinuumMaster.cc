@@ -185,7 +185,11 @@ void ContinuumMaster::run(void)
         imager.broadcastModel(); // initially empty model
 
         imager.calcNE(); // Needed here because it resets the itsNE
-        imager.receiveNE();
+        if (imager.distributedFacets()) {
+            imager.receiveFacetsFromWorkers();
+        } else {
+            imager.receiveNE();
+        }
         imager.writeModel();
 
     }
@@ -247,7 +251,12 @@ void ContinuumMaster::run(void)
         ASKAPLOG_INFO_STR(logger, "Cycles complete - Receiving residuals for latest model");
         imager.calcNE(); // Needed here becuase it resets the itsNE as Master
                         // Nothing else is done
-        imager.receiveNE(); // updates the residuals from workers
+        // updates the residuals from workers
+        if (imager.distributedFacets()) {
+            imager.receiveFacetsFromWorkers();
+        } else {
+            imager.receiveNE();
+        }
         ASKAPLOG_INFO_STR(logger, "Writing out model");
         imager.writeModel();
 
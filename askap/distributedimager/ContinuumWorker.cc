@@ -36,12 +36,16 @@
 #include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <utility>
 
 #include <sys/stat.h>
 #include <unistd.h>
 
 #include "boost/shared_ptr.hpp"
 #include "boost/filesystem.hpp"
+#include "boost/thread/thread.hpp"
+#include "boost/bind.hpp"
 // ASKAPsoft includes
 #include <askap/AskapLogging.h>
 #include <askap/AskapError.h>
@@ -51,6 +55,7 @@
 #include <askap/scimath/fitting/Params.h>
 #include <askap/gridding/IVisGridder.h>
 #include <askap/gridding/VisGridderFactory.h>
+#include <askap/gridding/SerialisedFFT.h>
 #include <askap/measurementequation/SynthesisParamsHelper.h>
 #include <askap/measurementequation/ImageFFTEquation.h>
 #include <askap/measurementequation/SynthesisParamsHelper.h>
@@ -95,6 +100,11 @@ ContinuumWorker::ContinuumWorker(LOFAR::ParameterSet& parset,
     itsAdvisor = boost::shared_ptr<synthesis::AdviseDI> (new synthesis::AdviseDI(itsComms, itsParset));
     itsAdvisor->prepare();
 
+    // lossless compression of the images sent to the writer: none, rle or shuffle (default)
+    itsImageCompression = CompressedBlobCodec::modeFromString(itsParset.getString("imagecompression", "shuffle"));
+    ASKAPLOG_DEBUG_STR(logger, "Images will be sent to the writer with "<<
+                       CompressedBlobCodec::toString(itsImageCompression)<<" encoding");
+
     // lets properly size the storage
     const int nchanpercore = itsParset.getInt32("nchanpercore", 1);
     workUnits.resize(0);
@@ -621,6 +631,26 @@ void ContinuumWorker::processChannels()
       << uvwMachineCacheTolerance / casacore::C::pi * 180. * 3600. << " arcsec");
 
 
+  // several channels can be imaged at the same time by this rank in spectral line mode
+  const int nThreads = itsParset.getInt32("nthreads", 1);
+  ASKAPCHECK(nThreads > 0, "Number of threads is supposed to be a positive number, you have " << nThreads);
+
+  if (nThreads > 1) {
+    ASKAPCHECK(localSolver, "Imaging channels in threads requires the local solver (solverpercore=true)");
+    ASKAPCHECK(!updateDir, "Imaging channels in threads is not supported in on-the-fly mosaicking mode");
+    ASKAPCHECK(!itsParsets[0].getBool("usetmpfs", false), "Imaging channels in threads is not supported with usetmpfs");
+    // FFTW planning is not thread safe: gridders go through serialisedFFT2D and the
+    // solve/restore stages of each thread hold the same process-wide mutex
+
+    processChannelsInThreads(nThreads);
+
+    // write out the beam log
+    ASKAPLOG_INFO_STR(logger, "About to log the full set of restoring beams");
+    logBeamInfo();
+
+    return;
+  }
+
   // the workUnits may include different epochs (for the same channel)
   // the order is strictly by channel - with multiple work units per channel.
   // so you can increment the workUnit until the frequency changes - then you know you
@@ -944,7 +974,18 @@ void ContinuumWorker::processChannels()
         else if (!localSolver){ // probably continuum mode ....
           // If we are in continuum mode we have probaby ran through the whole allocation
           // lets send it to the master for processing.
-          rootImager.sendNE();
+          // With distributed facets the workers solve for their facets themselves during
+          // the major cycles. After the last cycle the master needs the normal equations to
+          // write the residuals and restore, they are sent facet by facet.
+          if (rootImager.distributedFacets() && !stopping) {
+            rootImager.solveFacetsInWorkers();
+          }
+          else if (rootImager.distributedFacets()) {
+            rootImager.sendFacetsToMaster();
+          }
+          else {
+            rootImager.sendNE();
+          }
           // now we have to wait for the model (solution) to come back.
           // we need to wait for the first empty model.
           ASKAPLOG_INFO_STR(logger, "Rank " << itsComms.rank() << " at barrier");
@@ -1108,161 +1149,356 @@ void ContinuumWorker::processChannels()
 
       }
 
-      ASKAPLOG_INFO_STR(logger, "writing channel into cube");
+      writeOrSendChannel(rootImager.params(), workUnitCount);
 
-      if (itsComms.isWriter()) {
+      /// outside the clean-loop write out the slice
+    }
 
-        ASKAPLOG_INFO_STR(logger, "I have (including my own) " << itsComms.getOutstanding() << " units to write");
-        ASKAPLOG_INFO_STR(logger, "I have " << itsComms.getClients().size() << " clients with work");
-        int cubeChannel = workUnits[workUnitCount - 1].get_globalChannel() - this->baseCubeGlobalChannel;
-        ASKAPLOG_INFO_STR(logger, "Attempting to write channel " << cubeChannel << " of " << this->nchanCube);
-        ASKAPCHECK((cubeChannel >= 0 || cubeChannel < this->nchanCube), "cubeChannel outside range of cube slice");
-        handleImageParams(rootImager.params(), cubeChannel);
-        ASKAPLOG_INFO_STR(logger, "Written channel " << cubeChannel);
+    catch (const askap::AskapError& e) {
 
-        itsComms.removeChannelFromWriter(itsComms.rank());
+      if (!localSolver) {
+        ASKAPLOG_WARN_STR(logger, "Askap error processing a channel in continuum mode");
+        throw;
+      }
 
-        itsComms.removeChannelFromWorker(itsComms.rank());
+      ASKAPLOG_WARN_STR(logger, "Askap error in channel processing skipping: " << e.what());
+      std::cerr << "Askap error in: " << e.what() << std::endl;
 
-        /// write everyone elses
+      // Need to either send an empty map - or
+      skipFailedChannel(workUnitCount - 1); // last good one - needed for the correct freq label and writer
+      // No need to increment workunit. Although this assumes that we are here becuase we failed the solveNE not the calcNE
 
-        /// one per client ... I dont care what order they come in at
 
-        int targetOutstanding = itsComms.getOutstanding() - itsComms.getClients().size();
-        if (targetOutstanding < 0) {
-          targetOutstanding = 0;
-        }
-        ASKAPLOG_INFO_STR(logger, "this iteration target is " << targetOutstanding);
-        ASKAPLOG_INFO_STR(logger, "iteration count is " << itsComms.getOutstanding());
+    }
 
-        while (itsComms.getOutstanding() > targetOutstanding) {
-          if (itsComms.getOutstanding() <= (workUnits.size() - workUnitCount)) {
-            ASKAPLOG_INFO_STR(logger, "local remaining count is " << (workUnits.size() - workUnitCount)) ;
+    catch (const std::exception& e) {
+      ASKAPLOG_WARN_STR(logger, "Unexpected exception in: " << e.what());
+      std::cerr << "Unexpected exception in: " << e.what();
+      // I need to repeat the bookkeeping here as errors other than AskapErrors are thrown by solveNE
+      if (!localSolver) {
+        /// this is MFS/continuum mode
+        /// throw this further up - this avoids a failure in continuum mode generating bogus - or furphy-like
+        /// error messages
+        throw e;
+      }
 
-            break;
-          }
+      // Need to either send an empty map - or
+      skipFailedChannel(workUnitCount - 1); // last good one - needed for the correct freq label and writer
+      // No need to increment workunit. Although this assumes that we are here becuase we failed the solveNE not the calcNE
 
+    }
 
-          ContinuumWorkRequest result;
+  } // next workunit if required.
 
-          int id;
-          /// this is a blocking receive
-          ASKAPLOG_INFO_STR(logger, "Waiting for a write request");
-          result.receiveRequest(id, itsComms);
-          ASKAPLOG_INFO_STR(logger, "Received a request to write from rank " << id);
-          int cubeChannel = result.get_globalChannel() - this->baseCubeGlobalChannel;
+  // cleanup
+  writeOutstandingChannels();
 
-          try {
-            ASKAPLOG_INFO_STR(logger, "Attempting to write channel " << cubeChannel << " of " << this->nchanCube);
-            ASKAPCHECK((cubeChannel >= 0 || cubeChannel < this->nchanCube), "cubeChannel outside range of cube slice");
+  // write out the beam log
+  ASKAPLOG_INFO_STR(logger, "About to log the full set of restoring beams");
+  logBeamInfo();
 
-            handleImageParams(result.get_params(), cubeChannel);
+}
 
-            ASKAPLOG_INFO_STR(logger, "Written the slice from rank" << id);
-          }
+void ContinuumWorker::processChannelsInThreads(const int nThreads)
+{
+  ASKAPLOG_INFO_STR(logger, "Imaging up to " << nThreads << " channels concurrently");
+
+  // the workunits are ordered by channel - with multiple work units (epochs or beams) per channel.
+  // Group them, so each channel can be given to a separate thread
+  std::vector<std::pair<size_t, size_t> > channels;
+  for (size_t unit = 0; unit < workUnits.size();) {
+    if ((workUnits[unit].get_payloadType() == ContinuumWorkUnit::DONE) ||
+        (workUnits[unit].get_payloadType() == ContinuumWorkUnit::NA)) {
+      ++unit;
+      continue;
+    }
+    size_t end = unit + 1;
+    while ((end < workUnits.size()) &&
+           (workUnits[end].get_channelFrequency() == workUnits[unit].get_channelFrequency())) {
+      ++end;
+    }
+    channels.push_back(std::make_pair(unit, end));
+    unit = end;
+  }
+  ASKAPLOG_INFO_STR(logger, "Have " << channels.size() << " channels to image");
+
+  if (channels.size() > 0) {
+    // one gridder prototype for all threads. The measurement equations clone it, so
+    // each thread has its own grid. Set sharecf for the gridder to share convolution functions
+    const IVisGridder::ShPtr gridder = VisGridderFactory::make(itsParsets[channels[0].first]);
+    // tables are not thread safe, all access to the data is serialised via this mutex
+    const boost::shared_ptr<boost::mutex> dataMutex(new boost::mutex);
+
+    for (size_t batchStart = 0; batchStart < channels.size(); batchStart += nThreads) {
+      const size_t batchSize = std::min(channels.size() - batchStart, static_cast<size_t>(nThreads));
+      std::vector<askap::scimath::Params::ShPtr> results(batchSize);
+      std::vector<std::string> errors(batchSize);
+
+      boost::thread_group threads;
+      for (size_t i = 0; i < batchSize; ++i) {
+        const std::pair<size_t, size_t> &units = channels[batchStart + i];
+        threads.create_thread(boost::bind(&ContinuumWorker::imageChannelInThread, this,
+                              units.first, units.second, gridder, dataMutex,
+                              boost::ref(results[i]), boost::ref(errors[i])));
+      }
+      threads.join_all();
+
+      // all communication and writing is done in the main thread, in the order of channels
+      for (size_t i = 0; i < batchSize; ++i) {
+        const std::pair<size_t, size_t> &units = channels[batchStart + i];
+        if (results[i]) {
+          writeOrSendChannel(results[i], units.second);
+        } else {
+          ASKAPLOG_WARN_STR(logger, "Askap error in channel processing skipping: " << errors[i]);
+          std::cerr << "Askap error in: " << errors[i] << std::endl;
+          skipFailedChannel(units.first);
+        }
+      }
+    }
+  }
 
-          catch (const askap::AskapError& e) {
-            ASKAPLOG_WARN_STR(logger, "Failed to write a channel to the cube: " << e.what());
-          }
+  writeOutstandingChannels();
+}
 
-          itsComms.removeChannelFromWriter(itsComms.rank());
-          ASKAPLOG_INFO_STR(logger, "this iteration target is " << targetOutstanding);
-          ASKAPLOG_INFO_STR(logger, "iteration count is " << itsComms.getOutstanding());
-        }
+void ContinuumWorker::imageChannelInThread(const size_t firstUnit, const size_t endUnit,
+          askap::synthesis::IVisGridder::ShPtr gridder, boost::shared_ptr<boost::mutex> dataMutex,
+          askap::scimath::Params::ShPtr &result, std::string &error)
+{
+  try {
+    result = imageChannel(firstUnit, endUnit, gridder, dataMutex);
+  }
+  catch (const std::exception &e) {
+    result.reset();
+    error = e.what();
+  }
+}
 
-      } else {
+askap::scimath::Params::ShPtr ContinuumWorker::imageChannel(const size_t firstUnit, const size_t endUnit,
+          askap::synthesis::IVisGridder::ShPtr gridder, const boost::shared_ptr<boost::mutex> &dataMutex)
+{
+  ASKAPDEBUGASSERT(firstUnit < endUnit);
+  ASKAPDEBUGASSERT(dataMutex);
+
+  const bool dumpgrids = itsParsets[firstUnit].getBool("dumpgrids",false);
+  const int nCycles = itsParset.getInt32("ncycles", 0);
+  const std::string majorcycle = itsParset.getString("threshold.majorcycle", "-1Jy");
+  const double targetPeakResidual = SynthesisParamsHelper::convertQuantity(majorcycle, "Jy");
+  const double frequency = workUnits[firstUnit].get_channelFrequency();
+  const string colName = itsParsets[firstUnit].getString("datacolumn", "DATA");
+  const int uvwMachineCacheSize = itsParset.getInt32("nUVWMachines", 1);
+  const double uvwMachineCacheTolerance = SynthesisParamsHelper::convertQuantity(itsParset.getString("uvwMachineDirTolerance", "1e-6rad"), "rad");
 
-        ContinuumWorkRequest result;
-        result.set_params(rootImager.params());
-        result.set_globalChannel(workUnits[workUnitCount - 1].get_globalChannel());
-        /// send the work to the writer with a blocking send
-        result.sendRequest(workUnits[workUnitCount - 1].get_writer(), itsComms);
-        itsComms.removeChannelFromWorker(itsComms.rank());
+  ASKAPLOG_INFO_STR(logger, "Imaging channel with frequency " << frequency << " Hz using workunits " <<
+                    firstUnit + 1 << " to " << endUnit << " of " << workUnits.size());
 
+  // the first workunit is processed outside the major cycle loop (as in processChannels),
+  // other workunits of the same channel are merged into it
+  boost::shared_ptr<CalcCore> rootImagerPtr;
+  {
+    boost::unique_lock<boost::mutex> lock(*dataMutex);
+    // MEMORY_BUFFERS mode opens the MS readonly
+    TableDataSource ds(workUnits[firstUnit].get_dataset(), TableDataSource::MEMORY_BUFFERS, colName);
+    rootImagerPtr.reset(new CalcCore(itsParsets[firstUnit], itsComms, ds, gridder,
+                        workUnits[firstUnit].get_localChannel()));
+    setupImage(rootImagerPtr->params(), frequency, false);
+  }
+  rootImagerPtr->setDataAccessMutex(dataMutex);
+  CalcCore& rootImager = *rootImagerPtr; // just for the semantics
+
+  rootImager.calcNE();
+
+  for (int majorCycleNumber = 0; majorCycleNumber <= nCycles; ++majorCycleNumber) {
+
+    for (size_t unit = firstUnit + 1; unit < endUnit; ++unit) {
+      try {
+        boost::shared_ptr<CalcCore> workingImagerPtr;
+        {
+          boost::unique_lock<boost::mutex> lock(*dataMutex);
+          TableDataSource myDs(workUnits[unit].get_dataset(), TableDataSource::DEFAULT, colName);
+          myDs.configureUVWMachineCache(uvwMachineCacheSize, uvwMachineCacheTolerance);
+          workingImagerPtr.reset(new CalcCore(itsParsets[unit], itsComms, myDs, rootImager.gridder(),
+                                 workUnits[unit].get_localChannel()));
+        }
+        workingImagerPtr->setDataAccessMutex(dataMutex);
+        workingImagerPtr->replaceModel(rootImager.params());
+        workingImagerPtr->calcNE();
+        rootImager.getNE()->merge(*workingImagerPtr->getNE());
+        // the tables are released with the lock held
+        boost::unique_lock<boost::mutex> lock(*dataMutex);
+        workingImagerPtr.reset();
+      }
+      catch (const askap::AskapError& e) {
+        ASKAPLOG_WARN_STR(logger, "Askap error in imaging - skipping accumulation: carrying on - this will result in a blank channel" << e.what());
       }
+    }
 
-      /// outside the clean-loop write out the slice
+    if (majorCycleNumber == nCycles) {
+      break;
     }
 
+    // check the model - have we reached a stopping threshold.
+    if (rootImager.params()->has("peak_residual")) {
+      const double peak_residual = rootImager.params()->scalarValue("peak_residual");
+      ASKAPLOG_INFO_STR(logger, "Reached peak residual of " << peak_residual);
+      if (peak_residual < targetPeakResidual) {
+        ASKAPLOG_INFO_STR(logger, "It is below the major cycle threshold of "
+                          << targetPeakResidual << " Jy. Stopping.");
+        break;
+      }
+    }
+
+    {
+      // deconvolution and preconditioning use FFTs (with non thread-safe planning),
+      // so other threads are held while this one solves. Gridder FFTs lock the same mutex.
+      boost::lock_guard<boost::mutex> fftLock(fftMutex());
+      rootImager.solveNE();
+    }
+
+    ASKAPLOG_INFO_STR(logger, "Continuuing - Reset normal equations");
+    rootImager.getNE()->reset();
+    try {
+      rootImager.calcNE();
+    }
     catch (const askap::AskapError& e) {
+      ASKAPLOG_WARN_STR(logger, "Askap error in calcNE after majorcycle: " << e.what());
+    }
+  }
+  ASKAPLOG_INFO_STR(logger," Finished the major cycles");
 
-      if (!localSolver) {
-        ASKAPLOG_WARN_STR(logger, "Askap error processing a channel in continuum mode");
-        throw;
-      }
+  rootImager.updateSolver();
 
-      ASKAPLOG_WARN_STR(logger, "Askap error in channel processing skipping: " << e.what());
-      std::cerr << "Askap error in: " << e.what() << std::endl;
+  ASKAPLOG_INFO_STR(logger,"Adding model.slice");
+  ASKAPCHECK(rootImager.params()->has("image.slice"), "Params are missing image.slice parameter");
+  rootImager.params()->add("model.slice", rootImager.params()->value("image.slice"));
 
-      // Need to either send an empty map - or
-      if (itsComms.isWriter()) {
-        ASKAPLOG_INFO_STR(logger, "Marking bad channel as processed in count for writer\n");
-        itsComms.removeChannelFromWriter(itsComms.rank());
-      } else {
-        int goodUnitCount = workUnitCount - 1; // last good one - needed for the correct freq label and writer
-        ASKAPLOG_INFO_STR(logger, "Failed on count " << goodUnitCount);
-        ASKAPLOG_INFO_STR(logger, "Sending blankparams to writer " << workUnits[goodUnitCount].get_writer());
-        askap::scimath::Params::ShPtr blankParams;
+  if (dumpgrids) {
+    ASKAPLOG_INFO_STR(logger,"Adding grid.slice");
+    casacore::Array<casacore::Complex> garr = rootImager.getGrid();
+    casacore::Vector<casacore::Complex> garrVec(garr.reform(IPosition(1,garr.nelements())));
+    rootImager.params()->addComplexVector("grid.slice",garrVec);
+  }
 
-        blankParams.reset(new Params);
-        ASKAPCHECK(blankParams, "blank parameters (images) not initialised");
+  rootImager.check();
 
-        setupImage(blankParams, workUnits[goodUnitCount].get_channelFrequency());
+  if (itsParsets[0].getBool("restore", false)) {
+    ASKAPLOG_INFO_STR(logger, "Running restore");
+    // restoring convolves with FFTs, serialised with other threads (see above)
+    boost::lock_guard<boost::mutex> fftLock(fftMutex());
+    rootImager.restoreImage();
+  }
 
+  const askap::scimath::Params::ShPtr result = rootImager.params();
+  // the tables are released with the lock held
+  boost::unique_lock<boost::mutex> lock(*dataMutex);
+  rootImagerPtr.reset();
+  return result;
+}
 
-        ContinuumWorkRequest result;
-        result.set_params(blankParams);
-        result.set_globalChannel(workUnits[goodUnitCount].get_globalChannel());
-        /// send the work to the writer with a blocking send
-        result.sendRequest(workUnits[goodUnitCount].get_writer(), itsComms);
-        ASKAPLOG_INFO_STR(logger, "Sent\n");
-      }
-      // No need to increment workunit. Although this assumes that we are here becuase we failed the solveNE not the calcNE
+void ContinuumWorker::writeOrSendChannel(askap::scimath::Params::ShPtr params, const int nextUnit)
+{
+  ASKAPLOG_INFO_STR(logger, "writing channel into cube");
+
+  if (itsComms.isWriter()) {
+
+    ASKAPLOG_INFO_STR(logger, "I have (including my own) " << itsComms.getOutstanding() << " units to write");
+    ASKAPLOG_INFO_STR(logger, "I have " << itsComms.getClients().size() << " clients with work");
+    int cubeChannel = workUnits[nextUnit - 1].get_globalChannel() - this->baseCubeGlobalChannel;
+    ASKAPLOG_INFO_STR(logger, "Attempting to write channel " << cubeChannel << " of " << this->nchanCube);
+    ASKAPCHECK((cubeChannel >= 0 || cubeChannel < this->nchanCube), "cubeChannel outside range of cube slice");
+    handleImageParams(params, cubeChannel);
+    ASKAPLOG_INFO_STR(logger, "Written channel " << cubeChannel);
+
+    itsComms.removeChannelFromWriter(itsComms.rank());
+
+    itsComms.removeChannelFromWorker(itsComms.rank());
 
+    /// write everyone elses
 
+    /// one per client ... I dont care what order they come in at
+
+    int targetOutstanding = itsComms.getOutstanding() - itsComms.getClients().size();
+    if (targetOutstanding < 0) {
+      targetOutstanding = 0;
     }
+    ASKAPLOG_INFO_STR(logger, "this iteration target is " << targetOutstanding);
+    ASKAPLOG_INFO_STR(logger, "iteration count is " << itsComms.getOutstanding());
 
-    catch (const std::exception& e) {
-      ASKAPLOG_WARN_STR(logger, "Unexpected exception in: " << e.what());
-      std::cerr << "Unexpected exception in: " << e.what();
-      // I need to repeat the bookkeeping here as errors other than AskapErrors are thrown by solveNE
-      if (!localSolver) {
-        /// this is MFS/continuum mode
-        /// throw this further up - this avoids a failure in continuum mode generating bogus - or furphy-like
-        /// error messages
-        throw e;
+    while (itsComms.getOutstanding() > targetOutstanding) {
+      if (itsComms.getOutstanding() <= (workUnits.size() - nextUnit)) {
+        ASKAPLOG_INFO_STR(logger, "local remaining count is " << (workUnits.size() - nextUnit)) ;
+
+        break;
       }
 
-      // Need to either send an empty map - or
-      if (itsComms.isWriter()) {
-        ASKAPLOG_INFO_STR(logger, "Marking bad channel as processed in count for writer\n");
-        itsComms.removeChannelFromWriter(itsComms.rank());
-      } else {
-        int goodUnitCount = workUnitCount - 1; // last good one - needed for the correct freq label and writer
-        ASKAPLOG_INFO_STR(logger, "Failed on count " << goodUnitCount);
-        ASKAPLOG_INFO_STR(logger, "Sending blankparams to writer " << workUnits[goodUnitCount].get_writer());
-        askap::scimath::Params::ShPtr blankParams;
 
-        blankParams.reset(new Params);
-        ASKAPCHECK(blankParams, "blank parameters (images) not initialised");
+      ContinuumWorkRequest result;
+
+      int id;
+      /// this is a blocking receive
+      ASKAPLOG_INFO_STR(logger, "Waiting for a write request");
+      result.receiveRequest(id, itsComms);
+      ASKAPLOG_INFO_STR(logger, "Received a request to write from rank " << id);
+      int cubeChannel = result.get_globalChannel() - this->baseCubeGlobalChannel;
+
+      try {
+        ASKAPLOG_INFO_STR(logger, "Attempting to write channel " << cubeChannel << " of " << this->nchanCube);
+        ASKAPCHECK((cubeChannel >= 0 || cubeChannel < this->nchanCube), "cubeChannel outside range of cube slice");
 
-        setupImage(blankParams, workUnits[goodUnitCount].get_channelFrequency());
+        handleImageParams(result.get_params(), cubeChannel);
 
+        ASKAPLOG_INFO_STR(logger, "Written the slice from rank" << id);
+      }
 
-        ContinuumWorkRequest result;
-        result.set_params(blankParams);
-        result.set_globalChannel(workUnits[goodUnitCount].get_globalChannel());
-        /// send the work to the writer with a blocking send
-        result.sendRequest(workUnits[goodUnitCount].get_writer(), itsComms);
-        ASKAPLOG_INFO_STR(logger, "Sent\n");
+      catch (const askap::AskapError& e) {
+        ASKAPLOG_WARN_STR(logger, "Failed to write a channel to the cube: " << e.what());
       }
-      // No need to increment workunit. Although this assumes that we are here becuase we failed the solveNE not the calcNE
 
+      itsComms.removeChannelFromWriter(itsComms.rank());
+      ASKAPLOG_INFO_STR(logger, "this iteration target is " << targetOutstanding);
+      ASKAPLOG_INFO_STR(logger, "iteration count is " << itsComms.getOutstanding());
     }
 
-  } // next workunit if required.
+  } else {
 
-  // cleanup
+    ContinuumWorkRequest result;
+    result.set_params(params);
+    result.set_globalChannel(workUnits[nextUnit - 1].get_globalChannel());
+    result.set_compression(itsImageCompression);
+    /// send the work to the writer with a blocking send
+    result.sendRequest(workUnits[nextUnit - 1].get_writer(), itsComms);
+    itsComms.removeChannelFromWorker(itsComms.rank());
+
+  }
+}
+
+void ContinuumWorker::skipFailedChannel(const int goodUnit)
+{
+  if (itsComms.isWriter()) {
+    ASKAPLOG_INFO_STR(logger, "Marking bad channel as processed in count for writer\n");
+    itsComms.removeChannelFromWriter(itsComms.rank());
+  } else {
+    ASKAPLOG_INFO_STR(logger, "Failed on count " << goodUnit);
+    ASKAPLOG_INFO_STR(logger, "Sending blankparams to writer " << workUnits[goodUnit].get_writer());
+    askap::scimath::Params::ShPtr blankParams;
+
+    blankParams.reset(new Params);
+    ASKAPCHECK(blankParams, "blank parameters (images) not initialised");
+
+    setupImage(blankParams, workUnits[goodUnit].get_channelFrequency());
+
+
+    ContinuumWorkRequest result;
+    result.set_params(blankParams);
+    result.set_globalChannel(workUnits[goodUnit].get_globalChannel());
+    result.set_compression(itsImageCompression);
+    /// send the work to the writer with a blocking send
+    result.sendRequest(workUnits[goodUnit].get_writer(), itsComms);
+    ASKAPLOG_INFO_STR(logger, "Sent\n");
+  }
+}
+
+void ContinuumWorker::writeOutstandingChannels()
+{
   if (itsComms.isWriter()) {
 
     while (itsComms.getOutstanding() > 0) {
@@ -1286,12 +1522,17 @@ void ContinuumWorker::processChannels()
 
       itsComms.removeChannelFromWriter(itsComms.rank());
     }
-  }
-
-  // write out the beam log
-  ASKAPLOG_INFO_STR(logger, "About to log the full set of restoring beams");
-  logBeamInfo();
 
+    // all channels have been received, write incomplete blocks of channels (if buffered)
+    ASKAPLOG_INFO_STR(logger, "Flushing buffered channels into the cubes");
+    if (itsImageCube) itsImageCube->flush();
+    if (itsPSFCube) itsPSFCube->flush();
+    if (itsResidualCube) itsResidualCube->flush();
+    if (itsWeightsCube) itsWeightsCube->flush();
+    if (itsPSFimageCube) itsPSFimageCube->flush();
+    if (itsRestoredCube) itsRestoredCube->flush();
+    if (itsGriddedVis) itsGriddedVis->flush();
+  }
 }
 
 void ContinuumWorker::copyModel(askap::scimath::Params::ShPtr SourceParams, askap::scimath::Params::ShPtr SinkParams)
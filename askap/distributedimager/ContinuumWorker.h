@@ -33,6 +33,7 @@
 
 // ASKAPsoft includes
 #include "boost/shared_ptr.hpp"
+#include "boost/thread/mutex.hpp"
 #include <Common/ParameterSet.h>
 #include <askap/scimath/fitting/INormalEquations.h>
 #include <askap/scimath/fitting/Params.h>
@@ -44,6 +45,7 @@
 #include "askap/distributedimager/MSSplitter.h"
 #include "askap/distributedimager/CalcCore.h"
 #include "askap/messages/ContinuumWorkUnit.h"
+#include "askap/parallel/CompressedBlobCodec.h"
 #include "askap/distributedimager/CubeBuilder.h"
 #include "askap/distributedimager/CubeComms.h"
 namespace askap {
@@ -77,6 +79,9 @@ class ContinuumWorker
         // Whether the gridder is a Mosaicking one
         bool itsGridderCanMosaick;
 
+        // Encoding of the channel images sent to the writer
+        synthesis::CompressedBlobCodec::Mode itsImageCompression;
+
         // Cache a workunit to a different location
         void cacheWorkUnit(ContinuumWorkUnit& wu, LOFAR::ParameterSet& unitParset);
         // Process a workunit
@@ -94,6 +99,34 @@ class ContinuumWorker
 
         void processChannels();
 
+        // Process the channel allocation (spectral line mode) imaging up to nThreads
+        // channels concurrently. All MPI traffic and cube writing is done by the main thread.
+        void processChannelsInThreads(int nThreads);
+
+        // Image one channel in the local solver mode using workunits [firstUnit, endUnit)
+        // which share the same frequency. This method can be called from several threads,
+        // the mutex is locked while the tables are accessed. Returns the image parameters.
+        askap::scimath::Params::ShPtr imageChannel(size_t firstUnit, size_t endUnit,
+                    askap::synthesis::IVisGridder::ShPtr gridder,
+                    const boost::shared_ptr<boost::mutex> &dataMutex);
+
+        // Thread entry point for imageChannel, errors are returned in the error string
+        void imageChannelInThread(size_t firstUnit, size_t endUnit,
+                    askap::synthesis::IVisGridder::ShPtr gridder,
+                    boost::shared_ptr<boost::mutex> dataMutex,
+                    askap::scimath::Params::ShPtr &result, std::string &error);
+
+        // Write the channel into the cube (if this rank is a writer) or send it to the writer.
+        // nextUnit is the first workunit following those of this channel.
+        void writeOrSendChannel(askap::scimath::Params::ShPtr params, int nextUnit);
+
+        // Bookkeeping for a channel which failed to image - a blank channel is sent
+        // to the writer. goodUnit is the workunit giving the frequency and the writer.
+        void skipFailedChannel(int goodUnit);
+
+        // Receive and write all channels still outstanding from other ranks (writers only)
+        void writeOutstandingChannels();
+
         // For a given workunit, just process a single snapshot - the channel is specified
         // in the parset ...
         void processSnapshot(LOFAR::ParameterSet& parset);
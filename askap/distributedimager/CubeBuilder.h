@@ -31,6 +31,8 @@
 
 // System includes
 #include <string>
+#include <map>
+#include <vector>
 
 // ASKAPsoft includes
 #include <boost/shared_ptr.hpp>
@@ -59,11 +61,25 @@ class CubeBuilder {
 
         CubeBuilder(const LOFAR::ParameterSet& parset,const std:: string& name);            
 
-        /// Destructor
+        /// Destructor, writes any buffered channels
         ~CubeBuilder();
 
+        /// @brief write a single channel into the cube
+        /// @details If Images.tilenchan is greater than 1, the channels are written in blocks
+        /// of this size aligned to multiples of it (CASA cubes created by this class are tiled
+        /// with this number of channels per tile). A channel is buffered until all channels of its block have been
+        /// received, then the whole block is written at once. This way several writer ranks
+        /// can write disjoint channel ranges of the same cube (singleoutputfile = true) at the
+        /// same time without sharing storage tiles.
+        /// @param[in] arr image for the channel
+        /// @param[in] chan channel number in the cube
         void writeSlice(const casacore::Array<T>& arr, const casacore::uInt chan);
 
+        /// @brief write all buffered channels
+        /// @details Incomplete blocks are written as contiguous runs of channels, so channels
+        /// not received by this writer are not overwritten.
+        void flush();
+
         casacore::CoordinateSystem
         createCoordinateSystem(const LOFAR::ParameterSet& parset,
                                const casacore::uInt nx,
@@ -78,9 +94,37 @@ class CubeBuilder {
 
     private:
 
-        
+        /// @brief setup writing in blocks of channels
+        /// @param[in] parset parameter set (Images.tilenchan is used)
+        /// @param[in] nchan number of channels in the cube (0 if not yet known)
+        void initChannelBlocks(const LOFAR::ParameterSet& parset, const casacore::uInt nchan);
+
+        /// @brief create the cube
+        /// @details CASA cubes are tiled with Images.tilenchan channels per tile, so each block
+        /// of channels written at once occupies whole storage tiles. Other image types are
+        /// created with the default layout.
+        /// @param[in] cubeShape shape of the cube
+        /// @param[in] csys coordinate system of the cube
+        void createCube(const casacore::IPosition& cubeShape, const casacore::CoordinateSystem& csys);
+
+        /// @brief write a block of channels
+        /// @param[in] blockStart first channel of the block
+        void writeBlock(const casacore::uInt blockStart);
+
         boost::shared_ptr<accessors::IImageAccess<T> > itsCube;
 
+    /// Number of channels written at once (1 means no buffering)
+        casacore::uInt itsChannelBlock;
+
+    /// Number of channels in the cube (0 if not yet known)
+        casacore::uInt itsNChan;
+
+    /// Buffered channels for each incomplete block (indexed by the first channel of the block)
+        std::map<casacore::uInt, casacore::Array<T> > itsBlocks;
+
+    /// Flags showing which channels of each buffered block have been received
+        std::map<casacore::uInt, std::vector<bool> > itsBlockFilled;
+
 
     /// Image name from parset - must start with "image."
         std::string itsFilename;
@@ -35,6 +35,7 @@
 #include <iomanip>
 #include <string>
 #include <vector>
+#include <algorithm>
 
 // ASKAPsoft includes
 #include <askap/AskapError.h>
@@ -52,6 +53,7 @@
 #include <casacore/coordinates/Coordinates/CoordinateSystem.h>
 #include <casacore/measures/Measures/Stokes.h>
 #include <casacore/images/Images/PagedImage.h>
+#include <casacore/lattices/Lattices/TiledShape.h>
 #include <casacore/casa/Quanta/Unit.h>
 #include <casacore/casa/Quanta/QC.h>
 
@@ -208,6 +210,7 @@ CubeBuilder<casacore::Complex>::CubeBuilder(const LOFAR::ParameterSet& parset,co
     ASKAPLOG_INFO_STR(CubeBuilderLogger, "Instantiating Cube Builder by co-opting existing Complex cube");
     boost::shared_ptr<CasaImageAccess<casacore::Complex> > iaCASA(new CasaImageAccess<casacore::Complex>());
     itsCube = iaCASA;
+    initChannelBlocks(parset, 0);
 }
 
 template <class T>
@@ -241,6 +244,7 @@ CubeBuilder<T>::CubeBuilder(const LOFAR::ParameterSet& parset,const std::string&
 
     ASKAPLOG_INFO_STR(CubeBuilderLogger, "Instantiating Cube Builder co-opting existing cube");
     itsCube = accessors::imageAccessFactory(parset);
+    initChannelBlocks(parset, 0);
 
 }
 template <> inline
@@ -309,11 +313,6 @@ CubeBuilder<casacore::Complex>::CubeBuilder(const LOFAR::ParameterSet& parset,
     const casacore::uInt ny = imageShapeVector[1];
     const casacore::IPosition cubeShape(4, nx, ny, npol, nchan);
 
-    // Use a tile shape appropriate for plane-by-plane access
-    casacore::IPosition tileShape(cubeShape.nelements(), 1);
-    tileShape(0) = 256;
-    tileShape(1) = 256;
-
     const casacore::CoordinateSystem csys = createCoordinateSystem(parset, nx, ny, f0, inc);
 
     ASKAPLOG_INFO_STR(CubeBuilderLogger, "Creating Cube " << itsFilename <<
@@ -322,7 +321,8 @@ CubeBuilder<casacore::Complex>::CubeBuilder(const LOFAR::ParameterSet& parset,
                        "], f0: " << f0.getValue("MHz") << " MHz, finc: " <<
                        inc.getValue("kHz") << " kHz");
 
-    itsCube->create(itsFilename, cubeShape, csys);
+    initChannelBlocks(parset, nchan);
+    createCube(cubeShape, csys);
 
     // default flux units are Jy/pixel. If we set the restoring beam
     // later on, can set to Jy/beam
@@ -396,11 +396,6 @@ CubeBuilder<T>::CubeBuilder(const LOFAR::ParameterSet& parset,
     const casacore::uInt ny = imageShapeVector[1];
     const casacore::IPosition cubeShape(4, nx, ny, npol, nchan);
 
-    // Use a tile shape appropriate for plane-by-plane access
-    casacore::IPosition tileShape(cubeShape.nelements(), 1);
-    tileShape(0) = 256;
-    tileShape(1) = 256;
-
     const casacore::CoordinateSystem csys = createCoordinateSystem(parset, nx, ny, f0, inc);
 
     ASKAPLOG_INFO_STR(CubeBuilderLogger, "Creating Cube " << itsFilename <<
@@ -409,7 +404,8 @@ CubeBuilder<T>::CubeBuilder(const LOFAR::ParameterSet& parset,
                        "], f0: " << f0.getValue("MHz") << " MHz, finc: " <<
                        inc.getValue("kHz") << " kHz");
 
-    itsCube->create(itsFilename, cubeShape, csys);
+    initChannelBlocks(parset, nchan);
+    createCube(cubeShape, csys);
 
     // default flux units are Jy/pixel. If we set the restoring beam
     // later on, can set to Jy/beam
@@ -420,12 +416,136 @@ CubeBuilder<T>::CubeBuilder(const LOFAR::ParameterSet& parset,
 template < class T >
 CubeBuilder<T>::~CubeBuilder()
 {
+    try {
+        flush();
+    } catch (const std::exception &ex) {
+        ASKAPLOG_ERROR_STR(CubeBuilderLogger, "Failed to write buffered channels into " << itsFilename <<
+                           ": " << ex.what());
+    }
+}
+
+template < class T >
+void CubeBuilder<T>::initChannelBlocks(const LOFAR::ParameterSet& parset, const casacore::uInt nchan)
+{
+    const int block = parset.getInt32("Images.tilenchan", 1);
+    ASKAPCHECK(block > 0, "Images.tilenchan should be positive, you have " << block);
+    itsChannelBlock = block;
+    itsNChan = nchan;
+    if (itsChannelBlock > 1) {
+        ASKAPLOG_INFO_STR(CubeBuilderLogger, "Channels of " << itsFilename << " will be written in blocks of " <<
+                          itsChannelBlock);
+    }
+}
+
+template < class T >
+void CubeBuilder<T>::createCube(const casacore::IPosition& cubeShape, const casacore::CoordinateSystem& csys)
+{
+    // Use a tile shape appropriate for plane-by-plane access. Each tile holds a whole block of
+    // channels, so blocks written by different ranks never share a storage tile
+    casacore::IPosition tileShape(cubeShape.nelements(), 1);
+    tileShape(0) = cubeShape(0) < 256 ? cubeShape(0) : 256;
+    tileShape(1) = cubeShape(1) < 256 ? cubeShape(1) : 256;
+    const casacore::uInt nchan = cubeShape(3);
+    tileShape(3) = std::min(itsChannelBlock, nchan);
+
+    const boost::shared_ptr<accessors::CasaImageAccess<T> > casaCube =
+          boost::dynamic_pointer_cast<accessors::CasaImageAccess<T> >(itsCube);
+    if (casaCube) {
+        ASKAPLOG_INFO_STR(CubeBuilderLogger, "Creating CASA cube " << itsFilename << " with tile shape " << tileShape);
+        casacore::PagedImage<T> img(casacore::TiledShape(cubeShape, tileShape), csys, itsFilename);
+    } else {
+        if (itsChannelBlock > 1) {
+            ASKAPLOG_WARN_STR(CubeBuilderLogger, "Tile shape can't be set for " << itsFilename <<
+                              ", Images.tilenchan only groups channels in memory for this image type");
+        }
+        itsCube->create(itsFilename, cubeShape, csys);
+    }
 }
+
 template < class T >
 void CubeBuilder<T>::writeSlice(const casacore::Array<T>& arr, const casacore::uInt chan)
 {
-    casacore::IPosition where(4, 0, 0, 0, chan);
-    itsCube->write(itsFilename,arr, where);
+    if (itsChannelBlock <= 1) {
+        casacore::IPosition where(4, 0, 0, 0, chan);
+        itsCube->write(itsFilename,arr, where);
+        return;
+    }
+
+    // slices are 4-dimensional with a single channel, but allow for degenerate axes missing
+    const casacore::IPosition shape = arr.shape();
+    ASKAPCHECK((shape.nelements() >= 2) && (shape.nelements() <= 4), "Unexpected shape of the slice: " << shape);
+    const casacore::IPosition sliceShape(4, shape(0), shape(1), shape.nelements() > 2 ? shape(2) : 1, 1);
+    ASKAPCHECK(sliceShape.product() == shape.product(), "Slice should contain a single channel, shape: " << shape);
+
+    // the number of channels is not known by the ranks which haven't created the cube
+    // until the cube exists
+    if (itsNChan == 0) {
+        itsNChan = itsCube->shape(itsFilename)(3);
+    }
+    ASKAPCHECK(chan < itsNChan, "Channel " << chan << " is outside the cube of " << itsNChan << " channels");
+
+    const casacore::uInt blockStart = chan - chan % itsChannelBlock;
+    const casacore::uInt blockSize = std::min(itsChannelBlock, itsNChan - blockStart);
+    if (itsBlocks.find(blockStart) == itsBlocks.end()) {
+        itsBlocks[blockStart].resize(casacore::IPosition(4, sliceShape(0), sliceShape(1), sliceShape(2), blockSize));
+        itsBlockFilled[blockStart].assign(blockSize, false);
+    }
+    casacore::Array<T> &buffer = itsBlocks[blockStart];
+    std::vector<bool> &filled = itsBlockFilled[blockStart];
+    ASKAPCHECK(buffer.shape().getFirst(3) == sliceShape.getFirst(3), "Shape of the slice " << shape <<
+               " is different from other channels in the same block " << buffer.shape());
+
+    casacore::IPosition blc(4, 0, 0, 0, chan - blockStart);
+    casacore::IPosition trc(buffer.shape() - 1);
+    trc(3) = blc(3);
+    buffer(blc, trc) = arr.reform(sliceShape);
+    filled[chan - blockStart] = true;
+
+    if (std::find(filled.begin(), filled.end(), false) == filled.end()) {
+        writeBlock(blockStart);
+    }
+}
+
+template < class T >
+void CubeBuilder<T>::flush()
+{
+    while (itsBlocks.size() > 0) {
+        writeBlock(itsBlocks.begin()->first);
+    }
+}
+
+template < class T >
+void CubeBuilder<T>::writeBlock(const casacore::uInt blockStart)
+{
+    const typename std::map<casacore::uInt, casacore::Array<T> >::iterator blockIt = itsBlocks.find(blockStart);
+    ASKAPDEBUGASSERT(blockIt != itsBlocks.end());
+    const std::vector<bool> &filled = itsBlockFilled[blockStart];
+    const casacore::Array<T> &buffer = blockIt->second;
+    // write contiguous runs of channels received. The allocation of channels to writers is aligned
+    // to blocks (see AdviseDI::checkWriterChannelBlocks), so missing channels haven't been imaged at all
+    if (std::find(filled.begin(), filled.end(), false) != filled.end()) {
+        ASKAPLOG_WARN_STR(CubeBuilderLogger, "Block of channels starting at " << blockStart << " of " << itsFilename <<
+                          " is incomplete, channels not received are left blank");
+    }
+    for (casacore::uInt first = 0; first < filled.size();) {
+        if (!filled[first]) {
+            ++first;
+            continue;
+        }
+        casacore::uInt end = first;
+        while ((end < filled.size()) && filled[end]) {
+            ++end;
+        }
+        casacore::IPosition blc(4, 0, 0, 0, first);
+        casacore::IPosition trc(buffer.shape() - 1);
+        trc(3) = end - 1;
+        ASKAPLOG_DEBUG_STR(CubeBuilderLogger, "Writing channels " << blockStart + first << " to " <<
+                           blockStart + end - 1 << " into " << itsFilename);
+        itsCube->write(itsFilename, buffer(blc, trc), casacore::IPosition(4, 0, 0, 0, blockStart + first));
+        first = end;
+    }
+    itsBlocks.erase(blockIt);
+    itsBlockFilled.erase(blockStart);
 }
 
 template < class T >
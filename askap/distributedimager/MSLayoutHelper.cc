@@ -0,0 +1,94 @@
+/// @file MSLayoutHelper.cc
+///
+/// @brief storage layout and derived columns of measurement sets written by the splitting tools
+///
+/// @copyright (c) 2012 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+// Include own header file first
+#include "MSLayoutHelper.h"
+
+// System includes
+#include <algorithm>
+#include <complex>
+
+// ASKAPsoft includes
+#include "askap/AskapError.h"
+
+using namespace askap;
+using namespace askap::cp;
+
+MSLayoutHelper::AccessPattern MSLayoutHelper::fromString(const std::string& name)
+{
+    if (name == "spectral") {
+        return SPECTRAL;
+    } else if (name == "continuum") {
+        return CONTINUUM;
+    }
+    ASKAPTHROW(AskapError, "Unknown access pattern " << name << ", supported values are spectral and continuum");
+}
+
+std::string MSLayoutHelper::toString(AccessPattern pattern)
+{
+    return pattern == SPECTRAL ? "spectral" : "continuum";
+}
+
+casacore::IPosition MSLayoutHelper::dataTileShape(AccessPattern pattern, casacore::uInt nCorr,
+                                                  casacore::uInt nChan, casacore::uInt bucketSize)
+{
+    ASKAPCHECK(nCorr > 0, "Number of correlations should be positive");
+    ASKAPCHECK(nChan > 0, "Number of channels should be positive");
+    const casacore::uInt bytesPerSpectralPoint = sizeof(std::complex<float>) * nCorr;
+    casacore::uInt tileNchan = 1;
+    if (pattern == CONTINUUM) {
+        tileNchan = std::min(nChan, std::max(1u, bucketSize / bytesPerSpectralPoint));
+    }
+    const casacore::uInt tileNrow = std::max(1u, bucketSize / (bytesPerSpectralPoint * tileNchan));
+    return casacore::IPosition(3, nCorr, tileNchan, tileNrow);
+}
+
+casacore::Vector<casacore::Bool> MSLayoutHelper::rowFlags(const casacore::Cube<casacore::Bool>& flag)
+{
+    casacore::Vector<casacore::Bool> result(flag.nplane(), true);
+    casacore::Bool deleteIt;
+    const casacore::Bool* flagPtr = flag.getStorage(deleteIt);
+    const size_t rowSize = flag.nrow() * flag.ncolumn();
+    for (casacore::uInt row = 0; row < flag.nplane(); ++row) {
+        const casacore::Bool* rowPtr = flagPtr + row * rowSize;
+        result[row] = std::find(rowPtr, rowPtr + rowSize, false) == rowPtr + rowSize;
+    }
+    flag.freeStorage(flagPtr, deleteIt);
+    return result;
+}
+
+casacore::Matrix<casacore::Float> MSLayoutHelper::weightsFromSigmas(const casacore::Matrix<casacore::Float>& sigma)
+{
+    casacore::Matrix<casacore::Float> result(sigma.shape());
+    for (casacore::uInt row = 0; row < sigma.ncolumn(); ++row) {
+        for (casacore::uInt corr = 0; corr < sigma.nrow(); ++corr) {
+            const casacore::Float s = sigma(corr, row);
+            result(corr, row) = s > 0 ? 1. / (s * s) : 0.;
+        }
+    }
+    return result;
+}
@@ -0,0 +1,96 @@
+/// @file MSLayoutHelper.h
+///
+/// @brief storage layout and derived columns of measurement sets written by the splitting tools
+/// @details msmerge and MSSplitter write new measurement sets. The tile shape of the
+/// visibility columns determines how efficiently these data can be read later on, so it
+/// is chosen to match the access pattern of the imager: spectral-line imaging reads one
+/// channel for all rows, continuum imaging reads all channels for a block of rows. Some
+/// columns of the main table can also be derived from other columns instead of being
+/// read from the input.
+///
+/// @copyright (c) 2012 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#ifndef ASKAP_CP_MSLAYOUTHELPER_H
+#define ASKAP_CP_MSLAYOUTHELPER_H
+
+// System includes
+#include <string>
+
+// ASKAPsoft includes
+#include "casacore/casa/aips.h"
+#include "casacore/casa/Arrays/IPosition.h"
+#include "casacore/casa/Arrays/Vector.h"
+#include "casacore/casa/Arrays/Matrix.h"
+#include "casacore/casa/Arrays/Cube.h"
+
+namespace askap {
+namespace cp {
+
+class MSLayoutHelper {
+    public:
+        /// Expected access pattern of the visibility data
+        enum AccessPattern {
+            /// one channel is read for all rows (spectral-line imaging)
+            SPECTRAL,
+            /// all channels are read for a block of rows (continuum imaging)
+            CONTINUUM
+        };
+
+        /// @brief convert string into access pattern
+        /// @details Recognised values are "spectral" and "continuum".
+        /// @throws AskapError if the name is not recognised
+        static AccessPattern fromString(const std::string& name);
+
+        /// @brief convert access pattern into string
+        static std::string toString(AccessPattern pattern);
+
+        /// @brief tile shape of the visibility columns for the given access pattern
+        /// @details For the spectral pattern each tile holds a single channel and as
+        /// many rows as fit into the bucket. For the continuum pattern each tile holds
+        /// the whole spectrum (or as much of it as fits into the bucket) and the remaining
+        /// space is used for rows.
+        /// @param[in] pattern expected access pattern
+        /// @param[in] nCorr number of correlations
+        /// @param[in] nChan number of channels
+        /// @param[in] bucketSize size of a tile in bytes
+        /// @return tile shape (correlations, channels, rows)
+        static casacore::IPosition dataTileShape(AccessPattern pattern, casacore::uInt nCorr,
+                                                 casacore::uInt nChan, casacore::uInt bucketSize);
+
+        /// @brief derive FLAG_ROW from FLAG
+        /// @details A row is flagged if all its correlations and channels are flagged.
+        /// @param[in] flag flags (correlations x channels x rows)
+        /// @return row flags
+        static casacore::Vector<casacore::Bool> rowFlags(const casacore::Cube<casacore::Bool>& flag);
+
+        /// @brief derive WEIGHT from SIGMA
+        /// @details The weight is 1/sigma^2, or zero if sigma is not positive.
+        /// @param[in] sigma noise (correlations x rows)
+        /// @return weights (correlations x rows)
+        static casacore::Matrix<casacore::Float> weightsFromSigmas(const casacore::Matrix<casacore::Float>& sigma);
+};
+
+}
+}
+#endif
@@ -27,6 +27,7 @@
 
 // Include own header file
 #include "MSSplitter.h"
+#include "MSLayoutHelper.h"
 
 // System includes
 #include <sstream>
@@ -69,11 +70,41 @@ using namespace casa;
 using namespace std;
 using namespace cp;
 
+namespace {
+
+// Deselects rows whose value is not in the given set. Consecutive rows
+// usually share the same value (e.g. scan or beam), so the result of the
+// last set lookup is reused.
+void applySetFilter(const casacore::Vector<casacore::Int>& values,
+                    const std::set<uint32_t>& allowed,
+                    casacore::Vector<casacore::Bool>& selected)
+{
+    ASKAPDEBUGASSERT(values.nelements() == selected.nelements());
+    bool haveLast = false;
+    casacore::Int lastValue = 0;
+    bool lastResult = false;
+    for (uInt i = 0; i < values.nelements(); ++i) {
+        if (!selected[i]) continue;
+        if (!haveLast || values[i] != lastValue) {
+            lastValue = values[i];
+            lastResult = allowed.find(static_cast<uint32_t>(lastValue)) != allowed.end();
+            haveLast = true;
+        }
+        selected[i] = lastResult;
+    }
+}
+
+}
+
 MSSplitter::MSSplitter(LOFAR::ParameterSet& Parset)
     : itsTimeBegin(std::numeric_limits<double>::min()),
     itsTimeEnd(std::numeric_limits<double>::max()),
+    itsDeriveColumns(Parset.getBool("derivecolumns", false)),
     itsParset(Parset)
 {
+    if (itsDeriveColumns) {
+        ASKAPLOG_DEBUG_STR(logger, "TIME_CENTROID, WEIGHT and FLAG_ROW will be derived from other columns");
+    }
 
     // Read beam selection parameters
     if (itsParset.isDefined("beams")) {
@@ -103,13 +134,12 @@ MSSplitter::MSSplitter(LOFAR::ParameterSet& Parset)
 
 boost::shared_ptr<casacore::MeasurementSet> MSSplitter::create(
     const std::string& filename, const casacore::Bool addSigmaSpec,
-    casacore::uInt bucketSize, casacore::uInt tileNcorr, casacore::uInt tileNchan)
+    casacore::uInt bucketSize, const casacore::IPosition& tileShape)
 {
     if (bucketSize < 8192) bucketSize = 8192;
 
-    if (tileNcorr < 1) tileNcorr = 1;
-
-    if (tileNchan < 1) tileNchan = 1;
+    ASKAPDEBUGASSERT(tileShape.nelements() == 3);
+    const casacore::uInt tileNcorr = tileShape(0) > 1 ? tileShape(0) : 1;
 
     ASKAPLOG_DEBUG_STR(logger, "Creating dataset " << filename);
 
@@ -150,11 +180,8 @@ boost::shared_ptr<casacore::MeasurementSet> MSSplitter::create(
 
     // These columns contain the bulk of the data so save them in a tiled way
     {
-        // Get nr of rows in a tile.
-        const int bytesPerRow = sizeof(std::complex<float>) * tileNcorr * tileNchan;
-        const int nrowTile = std::max(1u, bucketSize / bytesPerRow);
-        TiledShapeStMan dataMan("TiledData",
-                                IPosition(3, tileNcorr, tileNchan, nrowTile));
+        ASKAPLOG_DEBUG_STR(logger, "Tile shape of the visibility columns: " << tileShape);
+        TiledShapeStMan dataMan("TiledData", tileShape);
         newMS.bindColumn(MeasurementSet::columnName(MeasurementSet::DATA),
                          dataMan);
         newMS.bindColumn(MeasurementSet::columnName(MeasurementSet::FLAG),
@@ -467,32 +494,55 @@ bool MSSplitter::rowFiltersExist() const
         || itsTimeEnd < std::numeric_limits<double>::max();
 }
 
-bool MSSplitter::rowIsFiltered(uint32_t scanid, uint32_t fieldid,
-                               uint32_t feed1, uint32_t feed2,
-                               double time) const
+std::vector<std::pair<uInt, uInt> > MSSplitter::selectRowRuns(const ROMSColumns& sc) const
 {
-    // Include all rows if no filters exist
-    if (!rowFiltersExist()) return false;
-
-    if (time < itsTimeBegin || time > itsTimeEnd) return true;
-
-    if (!itsScans.empty() && itsScans.find(scanid) == itsScans.end()) return true;
+    std::vector<std::pair<uInt, uInt> > runs;
+    const uInt nRows = sc.nrow();
+    if (!rowFiltersExist()) {
+        if (nRows > 0) runs.push_back(std::make_pair(0u, nRows));
+        return runs;
+    }
 
-    if (!itsFieldIds.empty() && itsFieldIds.find(fieldid) == itsFieldIds.end()) return true;
+    const bool timeFilterExists = itsTimeBegin > std::numeric_limits<double>::min()
+        || itsTimeEnd < std::numeric_limits<double>::max();
 
-    if (!itsBeams.empty()) {
-        if (itsBeams.find(feed1) == itsBeams.end() ||
-            itsBeams.find(feed2) == itsBeams.end()) {
-            // beam not found in any element of row
-            return true;
+    // Key columns are read in blocks to limit the memory footprint for very
+    // large measurement sets
+    const uInt blockSize = 1024 * 1024;
+    for (uInt start = 0; start < nRows; start += blockSize) {
+        const uInt n = min(blockSize, nRows - start);
+        const Slicer slicer(IPosition(1, start), IPosition(1, n), Slicer::endIsLength);
+        casacore::Vector<casacore::Bool> selected(n, true);
+
+        if (timeFilterExists) {
+            const casacore::Vector<casacore::Double> time = sc.time().getColumnRange(slicer);
+            for (uInt i = 0; i < n; ++i) {
+                selected[i] = (time[i] >= itsTimeBegin) && (time[i] <= itsTimeEnd);
+            }
+        }
+        if (!itsScans.empty()) {
+            applySetFilter(sc.scanNumber().getColumnRange(slicer), itsScans, selected);
+        }
+        if (!itsFieldIds.empty()) {
+            applySetFilter(sc.fieldId().getColumnRange(slicer), itsFieldIds, selected);
+        }
+        if (!itsBeams.empty()) {
+            applySetFilter(sc.feed1().getColumnRange(slicer), itsBeams, selected);
+            applySetFilter(sc.feed2().getColumnRange(slicer), itsBeams, selected);
         }
 
-        else {
-            return false;
+        // Merge selected rows into contiguous runs (which may span blocks)
+        for (uInt i = 0; i < n; ++i) {
+            if (!selected[i]) continue;
+            const uInt row = start + i;
+            if (!runs.empty() && (runs.back().first + runs.back().second == row)) {
+                ++runs.back().second;
+            } else {
+                runs.push_back(std::make_pair(row, 1u));
+            }
         }
     }
-
-    return false;
+    return runs;
 }
 
 void MSSplitter::splitMainTable(const casacore::MeasurementSet& source,
@@ -508,9 +558,24 @@ void MSSplitter::splitMainTable(const casacore::MeasurementSet& source,
     const ROMSColumns sc(source);
     MSColumns dc(dest);
 
-    // Add rows upfront if no row based filters exist
-    const casacore::uInt nRows = sc.nrow();
-    if (!rowFiltersExist()) dest.addRow(nRows);
+    // Work out which rows are to be copied. Without row based filters this is
+    // a single run spanning the whole table, otherwise the filters are evaluated
+    // for all rows upfront so selected rows can still be copied in bulk
+    const std::vector<std::pair<uInt, uInt> > runs = selectRowRuns(sc);
+    casacore::uInt nRows = 0;
+    for (std::vector<std::pair<uInt, uInt> >::const_iterator ci = runs.begin();
+            ci != runs.end(); ++ci) {
+        nRows += ci->second;
+    }
+    if (rowFiltersExist()) {
+        ASKAPLOG_INFO_STR(logger, "Selected " << nRows << " rows out of " << sc.nrow()
+                << " in " << runs.size() << " contiguous runs");
+    }
+    if (nRows == 0) {
+        ASKAPLOG_WARN_STR(logger, "No rows selected, the main table will be empty");
+        return;
+    }
+    dest.addRow(nRows);
 
     // Work out how many channels are to be actual input and which output
     // and how many polarisations are involved.
@@ -543,10 +608,6 @@ void MSSplitter::splitMainTable(const casacore::MeasurementSet& source,
     uInt maxSimultaneousRows =  (128 * 1024 * 1024) / nPol / (nChanIn * inDataSize) / (nChanOut * outDataSize);
     if (maxSimultaneousRows<1) maxSimultaneousRows = 1;
 
-    // However, if there is row-based filtering only one row can be copied
-    // at a time.
-    if (rowFiltersExist()) maxSimultaneousRows = 1;
-
     // Set a 64MB maximum cache size for the large columns
     const casacore::uInt cacheSize = 64 * 1024 * 1024;
 
@@ -567,20 +628,29 @@ void MSSplitter::splitMainTable(const casacore::MeasurementSet& source,
     // Row in destination table may differ from source table if row based
     // filtering is used
     uInt dstRow = 0;
-    uInt row = 0;
-    while (row < nRows) {
+    std::vector<std::pair<uInt, uInt> >::const_iterator run = runs.begin();
+    uInt row = run->first;
+    while (dstRow < nRows) {
+        // Move to the next run once the current one has been copied
+        if (row >= run->first + run->second) {
+            ++run;
+            ASKAPDEBUGASSERT(run != runs.end());
+            row = run->first;
+        }
+
         // Number of rows to process for this iteration of the loop; either
-        // maxSimultaneousRows or the remaining rows.
-        const uInt nRowsThisIteration = min(maxSimultaneousRows, nRows - row);
+        // maxSimultaneousRows or the remaining rows of the current run.
+        const uInt nRowsThisIteration = min(maxSimultaneousRows, run->first + run->second - row);
         const Slicer srcrowslicer(IPosition(1, row), IPosition(1, nRowsThisIteration),
                 Slicer::endIsLength);
-        Slicer dstrowslicer = srcrowslicer;
+        const Slicer dstrowslicer(IPosition(1, dstRow), IPosition(1, nRowsThisIteration),
+                Slicer::endIsLength);
 
         // Report progress at intervals and on completion
         progressCounter += nRowsThisIteration;
         if (progressCounter >= PROGRESS_INTERVAL_IN_ROWS ||
-                (row >= nRows - 1)) {
-            ASKAPLOG_DEBUG_STR(logger,  "Processed row " << row + 1 << " of " << nRows);
+                (dstRow + nRowsThisIteration >= nRows)) {
+            ASKAPLOG_DEBUG_STR(logger,  "Processed row " << dstRow + nRowsThisIteration << " of " << nRows);
             progressCounter = 0;
         }
 
@@ -590,29 +660,17 @@ void MSSplitter::splitMainTable(const casacore::MeasurementSet& source,
                     << " rows this iteration");
         }
 
-        // Skip this row if it is filtered out
-        if (rowIsFiltered(sc.scanNumber()(row),
-                    sc.fieldId()(row),
-                    sc.feed1()(row),
-                    sc.feed2()(row),
-                    sc.time()(row))) {
-            row += nRowsThisIteration;
-            continue;
-        }
-
-        // Rows have been pre-added if no row based filtering is done
-        if (rowFiltersExist()) {
-            dest.addRow();
-            dstrowslicer = Slicer(IPosition(1, dstRow), IPosition(1, nRowsThisIteration),
-                    Slicer::endIsLength);
-        }
-
         // Copy over the simple cells (i.e. those not needing averaging/merging)
         dc.scanNumber().putColumnRange(dstrowslicer, sc.scanNumber().getColumnRange(srcrowslicer));
         dc.fieldId().putColumnRange(dstrowslicer, sc.fieldId().getColumnRange(srcrowslicer));
         dc.dataDescId().putColumnRange(dstrowslicer, sc.dataDescId().getColumnRange(srcrowslicer));
-        dc.time().putColumnRange(dstrowslicer, sc.time().getColumnRange(srcrowslicer));
-        dc.timeCentroid().putColumnRange(dstrowslicer, sc.timeCentroid().getColumnRange(srcrowslicer));
+        const casacore::Vector<casacore::Double> time = sc.time().getColumnRange(srcrowslicer);
+        dc.time().putColumnRange(dstrowslicer, time);
+        if (itsDeriveColumns) {
+            dc.timeCentroid().putColumnRange(dstrowslicer, time);
+        } else {
+            dc.timeCentroid().putColumnRange(dstrowslicer, sc.timeCentroid().getColumnRange(srcrowslicer));
+        }
         dc.arrayId().putColumnRange(dstrowslicer, sc.arrayId().getColumnRange(srcrowslicer));
         dc.processorId().putColumnRange(dstrowslicer, sc.processorId().getColumnRange(srcrowslicer));
         dc.exposure().putColumnRange(dstrowslicer, sc.exposure().getColumnRange(srcrowslicer));
@@ -623,9 +681,14 @@ void MSSplitter::splitMainTable(const casacore::MeasurementSet& source,
         dc.feed1().putColumnRange(dstrowslicer, sc.feed1().getColumnRange(srcrowslicer));
         dc.feed2().putColumnRange(dstrowslicer, sc.feed2().getColumnRange(srcrowslicer));
         dc.uvw().putColumnRange(dstrowslicer, sc.uvw().getColumnRange(srcrowslicer));
-        dc.flagRow().putColumnRange(dstrowslicer, sc.flagRow().getColumnRange(srcrowslicer));
-        dc.weight().putColumnRange(dstrowslicer, sc.weight().getColumnRange(srcrowslicer));
-        dc.sigma().putColumnRange(dstrowslicer, sc.sigma().getColumnRange(srcrowslicer)/sqrt(width));
+        const casacore::Matrix<casacore::Float> sigma = sc.sigma().getColumnRange(srcrowslicer)/sqrt(width);
+        dc.sigma().putColumnRange(dstrowslicer, sigma);
+        if (itsDeriveColumns) {
+            dc.weight().putColumnRange(dstrowslicer, MSLayoutHelper::weightsFromSigmas(sigma));
+        } else {
+            dc.flagRow().putColumnRange(dstrowslicer, sc.flagRow().getColumnRange(srcrowslicer));
+            dc.weight().putColumnRange(dstrowslicer, sc.weight().getColumnRange(srcrowslicer));
+        }
 
         // Set the shape of the destination arrays
         for (uInt i = dstRow; i < dstRow + nRowsThisIteration; ++i) {
@@ -645,8 +708,11 @@ void MSSplitter::splitMainTable(const casacore::MeasurementSet& source,
         if (width == 1) {
             dc.data().putColumnRange(dstrowslicer, destarrslicer,
                 sc.data().getColumnRange(srcrowslicer, srcarrslicer));
-            dc.flag().putColumnRange(dstrowslicer, destarrslicer,
-                sc.flag().getColumnRange(srcrowslicer, srcarrslicer));
+            const casacore::Cube<casacore::Bool> flag = sc.flag().getColumnRange(srcrowslicer, srcarrslicer);
+            dc.flag().putColumnRange(dstrowslicer, destarrslicer, flag);
+            if (itsDeriveColumns) {
+                dc.flagRow().putColumnRange(dstrowslicer, MSLayoutHelper::rowFlags(flag));
+            }
             if (haveInSigmaSpec && haveOutSigmaSpec) {
                 dc.sigmaSpectrum().putColumnRange(dstrowslicer, destarrslicer,
                     sc.sigmaSpectrum().getColumnRange(srcrowslicer, srcarrslicer));
@@ -716,6 +782,9 @@ void MSSplitter::splitMainTable(const casacore::MeasurementSet& source,
             // Put (write) the output data/flag
             dc.data().putColumnRange(dstrowslicer, destarrslicer, outdata);
             dc.flag().putColumnRange(dstrowslicer, destarrslicer, outflag);
+            if (itsDeriveColumns) {
+                dc.flagRow().putColumnRange(dstrowslicer, MSLayoutHelper::rowFlags(outflag));
+            }
             if (haveOutSigmaSpec) {
                 dc.sigmaSpectrum().putColumnRange(dstrowslicer, destarrslicer, outsigma);
             }
@@ -726,6 +795,24 @@ void MSSplitter::splitMainTable(const casacore::MeasurementSet& source,
     }
 }
 
+casacore::IPosition MSSplitter::chooseTileShape(const LOFAR::ParameterSet& parset,
+    casacore::uInt nCorr, casacore::uInt nChan, casacore::uInt bucketSize)
+{
+    if (parset.isDefined("stman.tilencorr") || parset.isDefined("stman.tilenchan")) {
+        const casacore::uInt tileNcorr = std::max(1u, parset.getUint32("stman.tilencorr", 4));
+        const casacore::uInt tileNchan = std::max(1u, parset.getUint32("stman.tilenchan", 1));
+        const casacore::uInt bytesPerRow = sizeof(std::complex<float>) * tileNcorr * tileNchan;
+        return IPosition(3, tileNcorr, tileNchan, std::max(1u, bucketSize / bytesPerRow));
+    }
+    // the distributed imager solves per core when imaging spectral-line cubes
+    const std::string defaultLayout = parset.getBool("solverpercore", false) ? "spectral" : "continuum";
+    const MSLayoutHelper::AccessPattern pattern =
+        MSLayoutHelper::fromString(parset.getString("stman.layout", defaultLayout));
+    const IPosition tileShape = MSLayoutHelper::dataTileShape(pattern, nCorr, nChan, bucketSize);
+    ASKAPLOG_DEBUG_STR(logger, "Using " << MSLayoutHelper::toString(pattern) << " layout, tile shape " << tileShape);
+    return tileShape;
+}
+
 int MSSplitter::split(const std::string& invis, const std::string& outvis,
                       const uint32_t startChan,
                       const uint32_t endChan,
@@ -774,11 +861,11 @@ int MSSplitter::split(const std::string& invis, const std::string& outvis,
     }
 
     const casacore::uInt bucketSize = parset.getUint32("stman.bucketsize", 64 * 1024);
-    const casacore::uInt tileNcorr = parset.getUint32("stman.tilencorr", 4);
-    const casacore::uInt tileNchan = parset.getUint32("stman.tilenchan", 1);
+    const casacore::uInt nCorr = ROScalarColumn<casacore::Int>(in.polarization(),"NUM_CORR")(0);
+    const IPosition tileShape = chooseTileShape(parset, nCorr, nChanIn / width, bucketSize);
 
     boost::shared_ptr<casacore::MeasurementSet>
-        out(create(outvis, addSigmaSpec, bucketSize, tileNcorr, tileNchan));
+        out(create(outvis, addSigmaSpec, bucketSize, tileShape));
 
     // Copy ANTENNA
     ASKAPLOG_DEBUG_STR(logger,  "Copying ANTENNA table");
@@ -31,6 +31,7 @@
 // System includes
 #include <string>
 #include <set>
+#include <vector>
 #include <utility>
 #include <stdint.h>
 
@@ -44,6 +45,7 @@
 #include "Common/ParameterSet.h"
 #include "casacore/casa/aips.h"
 #include "casacore/ms/MeasurementSets/MeasurementSet.h"
+#include "casacore/ms/MeasurementSets/MSColumns.h"
 
 namespace askap {
 namespace cp {
@@ -64,9 +66,19 @@ class MSSplitter {
 
     private:
 
+        // Creates the output measurement set. The tile shape of the DATA, FLAG and
+        // SIGMA_SPECTRUM columns is given explicitly (correlations, channels, rows),
+        // SIGMA and WEIGHT are tiled with the same number of correlations.
         static boost::shared_ptr<casacore::MeasurementSet> create(
             const std::string& filename, const casacore::Bool addSigmaSpec,
-            casacore::uInt bucketSize, casacore::uInt tileNcorr, casacore::uInt tileNchan);
+            casacore::uInt bucketSize, const casacore::IPosition& tileShape);
+
+        // Chooses the tile shape of the visibility columns. Explicitly given
+        // stman.tilencorr/stman.tilenchan take precedence, otherwise the shape is
+        // derived from the expected access pattern (stman.layout, "spectral" or
+        // "continuum"; by default spectral if the imager solves per core).
+        static casacore::IPosition chooseTileShape(const LOFAR::ParameterSet& parset,
+            casacore::uInt nCorr, casacore::uInt nChan, casacore::uInt bucketSize);
 
         static void copyAntenna(const casacore::MeasurementSet& source, casacore::MeasurementSet& dest);
 
@@ -119,10 +131,11 @@ class MSSplitter {
         // Returns true if row filtering is enabled, otherwise false.
         bool rowFiltersExist() const;
 
-        // Returns true if the the row should be filtered (i.e excluded), otherwise
-        // true.
-        bool rowIsFiltered(uint32_t scanid, uint32_t fieldid, uint32_t feed1,
-                           uint32_t feed2, double time) const;
+        // Evaluates the row filters for the whole main table and returns the
+        // selected rows as a list of contiguous runs (first row, number of rows).
+        // Without row filters a single run covering all rows is returned.
+        std::vector<std::pair<casacore::uInt, casacore::uInt> >
+            selectRowRuns(const casacore::ROMSColumns& sc) const;
 
         // Helper method for the configuration of the time range filters.
         // Parses the parset value associated with "key" (using MVTime::read()),
@@ -159,6 +172,10 @@ class MSSplitter {
         // Optional end time filter. Rows with TIME > this value will be
         // excluded
         double itsTimeEnd;
+
+        // If true, TIME_CENTROID, WEIGHT and FLAG_ROW are derived from TIME,
+        // SIGMA and FLAG rather than copied from the input
+        bool itsDeriveColumns;
     
         //Parset - this class came from the MsSplitApp - and needs a config
     LOFAR::ParameterSet& itsParset;
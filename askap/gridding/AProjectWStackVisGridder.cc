@@ -42,7 +42,7 @@ ASKAP_LOGGER(logger, ".gridding.aprojectwstackgridder");
 #include <profile/AskapProfiler.h>
 
 #include <askap/gridding/AProjectWStackVisGridder.h>
-#include <fft/FFTWrapper.h>
+#include <askap/gridding/SerialisedFFT.h>
 #include <askap/gridding/IBasicIllumination.h>
 
 #include <askap/scimath/utils/PaddingUtils.h>
@@ -273,7 +273,7 @@ void AProjectWStackVisGridder::initConvolutionFunction(const accessors::IConstDa
                         parallacticAngle);
 
                 /// Now convolve the disk with itself using an FFT
-                scimath::fft2d(pattern.pattern(), false);
+                serialisedFFT2D(pattern.pattern(), false);
 
                 double peak=0.0;
                 for (casacore::uInt ix=0; ix<nx; ++ix) {
@@ -289,7 +289,7 @@ void AProjectWStackVisGridder::initConvolutionFunction(const accessors::IConstDa
                 }
                 // The maximum will be 1.0
                 ASKAPLOG_DEBUG_STR(logger, "Max of FT of convolution function = " << casacore::max(pattern.pattern()));
-                scimath::fft2d(pattern.pattern(), true);	
+                serialisedFFT2D(pattern.pattern(), true);	
                 // Now correct for normalization of FFT
                 pattern.pattern()*=casacore::DComplex(1.0/(double(nx)*double(ny)));
                 ASKAPLOG_DEBUG_STR(logger, "Sum of convolution function before support extraction and decimation = " << casacore::sum(pattern.pattern()));
@@ -431,7 +431,7 @@ void AProjectWStackVisGridder::finaliseWeights(casacore::Array<double>& out) {
             }
 
             //	  	  ASKAPLOG_DEBUG_STR(logger, "Convolution function["<< iz << "] peak = "<< peak);
-            scimath::fft2d(thisPlane, false);
+            serialisedFFT2D(thisPlane, false);
             thisPlane*=casacore::DComplex(nx*ny);
             const double peak=real(casacore::max(casacore::abs(thisPlane)));
             // ASKAPLOG_DEBUG_STR(logger, "Transform of convolution function["<< iz << "] peak = "<< peak);
@@ -30,7 +30,7 @@
 #include <askap/AskapLogging.h>
 ASKAP_LOGGER(logger, ".gridding.awprojectvisgridder");
 #include <askap/gridding/AWProjectVisGridder.h>
-#include <askap/scimath/fft/FFTWrapper.h>
+#include <askap/gridding/SerialisedFFT.h>
 #include <askap/scimath/utils/PaddingUtils.h>
 #include <casacore/casa/Arrays/ArrayIter.h>
 #include <casacore/casa/BasicSL/Complex.h>
@@ -307,7 +307,7 @@ void AWProjectVisGridder::initConvolutionFunction(const accessors::IConstDataAcc
                                             rwSlopes()(0, feed, currentField()),
                                             rwSlopes()(1, feed, currentField()), parallacticAngle);
 
-                scimath::fft2d(pattern.pattern(), false);
+                serialisedFFT2D(pattern.pattern(), false);
 
 
                 /// Calculate the total convolution function including
@@ -352,7 +352,7 @@ void AWProjectVisGridder::initConvolutionFunction(const accessors::IConstDataAcc
 
                     // Now we have to calculate the Fourier transform to get the
                     // convolution function in uv space
-                    scimath::fft2d(thisPlane, true);
+                    serialisedFFT2D(thisPlane, true);
 
                     // Now correct for normalization of FFT
                     thisPlane *= casacore::DComplex(1.0 / (double(nx) * double(ny)));
@@ -576,7 +576,7 @@ void AWProjectVisGridder::finaliseWeights(casacore::Array<double>& out)
                 }
             }
 
-            scimath::fft2d(thisPlane, false);
+            serialisedFFT2D(thisPlane, false);
             thisPlane *= casacore::DComplex(cnx * cny);
 
             // Now we need to cut out only the part inside the field of view
@@ -654,14 +654,14 @@ void AWProjectVisGridder::correctConvolution(casacore::Array<double>& /*image*/)
               buffer(ix,iy) = ccfx(ix)*ccfy(iy);
          }
     }
-    scimath::fft2d(buffer, true);
+    serialisedFFT2D(buffer, true);
     buffer *= casacore::DComplex(1./(double(nx)*double(ny)));
     for (casacore::Int x = 0; x < nx; ++x) {
          for (casacore::Int y = 0; y < ny; ++y) {
               buffer(x,y) *= conj(buffer(x,y));
          }
     }
-    scimath::fft2d(buffer, false);
+    serialisedFFT2D(buffer, false);
     buffer *= casacore::DComplex(double(nx)*double(ny));
 
 
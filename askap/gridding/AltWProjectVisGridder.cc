@@ -36,7 +36,7 @@
 #include <casacore/casa/Arrays/Array.h>
 #include <casacore/casa/Arrays/ArrayMath.h>
 #include <casacore/casa/BasicSL/Constants.h>
-#include <fft/FFTWrapper.h>
+#include <askap/gridding/SerialisedFFT.h>
 #include <profile/AskapProfiler.h>
 //ASKAPSoft package includes
 #include <askap/gridding/WProjectVisGridder.h>
@@ -44,7 +44,6 @@
 #include <askap/scimath/utils/PaddingUtils.h>
 #include <askap/measurementequation/ImageParamsHelper.h>
 #include <askap/scimath/utils/ImageUtils.h>
-#include <fft/FFTWrapper.h>
 // Local package includes
 #include "AltWProjectVisGridder.h"
 #include <boost/lexical_cast.hpp>
@@ -166,7 +165,7 @@ void AltWProjectVisGridder::finaliseGrid(casacore::Array<double>& out) {
               scimath::saveAsCasaImage("uvcoverage.asympart.imag",buf);
               casacore::convertArray<float,double>(buf,real(scratch));
               scimath::saveAsCasaImage("uvcoverage.asympart.real",buf);
-              scimath::fft2d(scratch, false);
+              serialisedFFT2D(scratch, false);
               casacore::convertArray<float,double>(buf,real(scratch));
               scimath::saveAsCasaImage("psf.asympart.real",buf);
 
@@ -175,7 +174,7 @@ void AltWProjectVisGridder::finaliseGrid(casacore::Array<double>& out) {
 
         }
 
-        scimath::fft2d(scratch, false);
+        serialisedFFT2D(scratch, false);
         if (i==0) {
             toDouble(dBuffer, scratch);
         } else {
@@ -0,0 +1,46 @@
+/// @file SerialisedFFT.cc
+///
+/// @brief FFT calls serialised between threads of the process
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#include <askap/gridding/SerialisedFFT.h>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief mutex serialising FFTs in the whole process
+/// @details The mutex is a function static, so it is constructed before the first use
+/// irrespective of the order of static initialisation.
+/// @return reference to the process-wide mutex
+boost::mutex& fftMutex()
+{
+  static boost::mutex theirFFTMutex;
+  return theirFFTMutex;
+}
+
+} // namespace synthesis
+
+} // namespace askap
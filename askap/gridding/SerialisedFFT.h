@@ -0,0 +1,66 @@
+/// @file SerialisedFFT.h
+///
+/// @brief FFT calls serialised between threads of the process
+/// @details FFTW plans are created by the FFT wrapper on each call and plan creation
+/// is not thread safe (it updates the global FFTW state). When several imaging
+/// threads run in one rank, all FFTs of the gridders are done via this wrapper and
+/// other stages which use FFTs (e.g. solving and restoring) are run holding the same
+/// process-wide mutex. The lock is not recursive, code holding it must not call
+/// serialisedFFT2D.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#ifndef ASKAP_SYNTHESIS_SERIALISED_FFT_H
+#define ASKAP_SYNTHESIS_SERIALISED_FFT_H
+
+// other 3rd party
+#include <boost/thread/mutex.hpp>
+#include <askap/scimath/fft/FFTWrapper.h>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief mutex serialising FFTs in the whole process
+/// @return reference to the process-wide mutex
+/// @ingroup gridding
+boost::mutex& fftMutex();
+
+/// @brief 2D FFT serialised with other FFTs of the process
+/// @details This is a drop-in replacement of scimath::fft2d.
+/// @param[in,out] arr array to transform in place (first two axes are transformed)
+/// @param[in] forward true for the forward transform
+/// @ingroup gridding
+template<typename Arr>
+inline void serialisedFFT2D(Arr &arr, bool forward)
+{
+  boost::lock_guard<boost::mutex> lock(fftMutex());
+  scimath::fft2d(arr, forward);
+}
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef ASKAP_SYNTHESIS_SERIALISED_FFT_H
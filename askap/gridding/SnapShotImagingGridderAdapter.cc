@@ -48,7 +48,7 @@ ASKAP_LOGGER(logger, ".gridding.snapshotimaginggridderadapter");
 #include <askap/scimath/utils/MultiDimArrayPlaneIter.h>
 #include <askap/scimath/utils/PaddingUtils.h>
 
-#include <fft/FFTWrapper.h>
+#include <askap/gridding/SerialisedFFT.h>
 
 #include <casacore/casa/OS/Timer.h>
 #include <casacore/images/Images/ImageRegrid.h>
@@ -590,16 +590,16 @@ void SnapShotImagingGridderAdapter::pcfRegrid(casacore::ImageRegrid<double>& reg
    casacore::Array<casacore::DComplex> scratchImag(shape);
    // Copy to a complex array and transform to the uv plane
    casacore::convertArray<casacore::DComplex,double>(scratch, itsTempInImg.get());
-   scimath::fft2d(scratch, true);
+   serialisedFFT2D(scratch, true);
 
    // Regrid the real part
    casacore::convertArray<casacore::DComplex,double>(scratchReal, real(scratch));
-   scimath::fft2d(scratchReal, false);
+   serialisedFFT2D(scratchReal, false);
    itsTempInImg.put(real(scratchReal));
    regridder.regrid(itsTempOutImg, itsInterpolationMethod,
            casacore::IPosition(2,0,1), itsTempInImg, false, itsDecimationFactor);
    casacore::convertArray<casacore::DComplex,double>(scratchReal, itsTempOutImg.get());
-   scimath::fft2d(scratchReal, true);
+   serialisedFFT2D(scratchReal, true);
    casacore::convertArray<casacore::DComplex,double>(scratchReal, real(scratchReal));
 
    // Regrid the imaginary part
@@ -607,12 +607,12 @@ void SnapShotImagingGridderAdapter::pcfRegrid(casacore::ImageRegrid<double>& reg
    // symmetry to ensure that they form a real PCF image. However, we need to
    // regrid the non-negative numbers, so take the absolute values first.
    casacore::convertArray<casacore::DComplex,double>(scratchImag, abs(imag(scratch)));
-   scimath::fft2d(scratchImag, false);
+   serialisedFFT2D(scratchImag, false);
    itsTempInImg.put(real(scratchImag));
    regridder.regrid(itsTempOutImg, itsInterpolationMethod,
            casacore::IPosition(2,0,1), itsTempInImg, false, itsDecimationFactor);
    casacore::convertArray<casacore::DComplex,double>(scratchImag, itsTempOutImg.get());
-   scimath::fft2d(scratchImag, true);
+   serialisedFFT2D(scratchImag, true);
    casacore::convertArray<casacore::DComplex,double>(scratchImag, real(scratchImag));
 
    // Recombine the real and imaginary uv grids. Need to add the imaginary parts
@@ -641,7 +641,7 @@ void SnapShotImagingGridderAdapter::pcfRegrid(casacore::ImageRegrid<double>& reg
    scratch(start,end) = scratchReal(start,end) + casacore::DComplex(0,-1)*scratchImag(start,end);
 
    // Transform back to an image
-   scimath::fft2d(scratch, false);
+   serialisedFFT2D(scratch, false);
    itsTempOutImg.put(real(scratch));
 
 }
@@ -30,7 +30,7 @@ ASKAP_LOGGER(logger, ".gridding.tablevisgridder");
 
 #include <askap/AskapError.h>
 #include <askap/AskapUtil.h>
-#include <fft/FFTWrapper.h>
+#include <askap/gridding/SerialisedFFT.h>
 
 #include <casacore/casa/BasicSL/Constants.h>
 #include <casacore/casa/Arrays/ArrayIter.h>
@@ -1157,7 +1157,7 @@ void TableVisGridder::finaliseGrid(casacore::Array<double>& out) {
             scimath::saveAsCasaImage("uvcoverage.asympart.imag",buf);
             casacore::convertArray<float,double>(buf,real(scratch));
             scimath::saveAsCasaImage("uvcoverage.asympart.real",buf);
-            fft2d(scratch, false);
+            serialisedFFT2D(scratch, false);
             casacore::convertArray<float,double>(buf,real(scratch));
             scimath::saveAsCasaImage("psf.asympart.real",buf);
 
@@ -1166,7 +1166,7 @@ void TableVisGridder::finaliseGrid(casacore::Array<double>& out) {
         //
         */
 
-        fft2d(scratch, false);
+        serialisedFFT2D(scratch, false);
         if (i==0) {
             toDouble(dBuffer, scratch);
         } else {
@@ -1255,7 +1255,7 @@ void TableVisGridder::initialiseDegrid(const scimath::Axes& axes,
         correctConvolution(scratch);
         casacore::Array<casacore::DComplex> scratch2(itsGrid[0].shape());
         toComplex(scratch2, scratch);
-        fft2d(scratch2, true);
+        serialisedFFT2D(scratch2, true);
         casacore::convertArray<casacore::Complex,casacore::DComplex>(itsGrid[0],scratch2);
     } else {
         ASKAPLOG_DEBUG_STR(logger, "No need to degrid: model is empty");
@@ -36,7 +36,7 @@
 #include <casacore/casa/Arrays/Array.h>
 #include <casacore/casa/Arrays/ArrayMath.h>
 #include <casacore/casa/BasicSL/Constants.h>
-#include <fft/FFTWrapper.h>
+#include <askap/gridding/SerialisedFFT.h>
 #include <profile/AskapProfiler.h>
 
 // Local package includes
@@ -50,6 +50,7 @@ namespace synthesis {
 
 std::vector<casa::Matrix<casa::Complex> > WProjectVisGridder::theirCFCache;
 std::vector<std::pair<int,int> > WProjectVisGridder::theirConvFuncOffsets;
+boost::mutex WProjectVisGridder::theirCFCacheMutex;
 
 /// @brief a helper method for a ref copy of casa arrays held in
 /// stl vector
@@ -244,6 +245,12 @@ void WProjectVisGridder::initConvolutionFunction(const accessors::IConstDataAcce
       return;
     }
 
+    // the lock is held until the cache is filled, so other threads wait rather than compute the same CFs
+    boost::unique_lock<boost::mutex> cacheLock(theirCFCacheMutex, boost::defer_lock);
+    if (itsShareCF) {
+        cacheLock.lock();
+    }
+
     if (itsShareCF && theirCFCache.size()>0) {
         // we already have what we need
         itsSupport = 1;
@@ -361,8 +368,8 @@ void WProjectVisGridder::initConvolutionFunction(const accessors::IConstDataAcce
 
         // Now we have to calculate the Fourier transform to get the
         // convolution function in uv space
-        if (itsDoubleCF) scimath::fft2d(thisPlane, true);
-        else scimath::fft2d(thisPlaneF, true);
+        if (itsDoubleCF) serialisedFFT2D(thisPlane, true);
+        else serialisedFFT2D(thisPlaneF, true);
 
         /*
             for (uint xx=0;xx<thisPlane.nrow();++xx) {
@@ -32,6 +32,8 @@
 // ASKAPsoft includes
 #include <askap/gridding/WDependentGridderBase.h>
 
+#include <boost/thread/mutex.hpp>
+
 // Local package includes
 #include <askap/dataaccess/IConstDataAccessor.h>
 
@@ -266,6 +268,11 @@ namespace askap
                 /// @brief cached CF offsets
                 static std::vector<std::pair<int,int> > theirConvFuncOffsets;
 
+                /// @brief synchronisation of the CF cache between threads
+                /// @details The lock is held while the shared cache is filled, so gridders used
+                /// concurrently in different threads compute convolution functions only once.
+                static boost::mutex theirCFCacheMutex;
+
         };
     }
 }
@@ -34,7 +34,7 @@ ASKAP_LOGGER(logger, ".gridding.wstackgridder");
 #include <casacore/casa/Arrays/ArrayMath.h>
 
 #include <casacore/casa/BasicSL/Constants.h>
-#include <fft/FFTWrapper.h>
+#include <askap/gridding/SerialisedFFT.h>
 #include <askap/scimath/utils/PaddingUtils.h>
 #include <profile/AskapProfiler.h>
 
@@ -197,7 +197,7 @@ namespace askap
         {
           casacore::Array<casacore::DComplex> scratch(itsGrid[i].shape());
           casacore::convertArray<casacore::DComplex,casacore::Complex>(scratch,itsGrid[i]);
-          scimath::fft2d(scratch, false);
+          serialisedFFT2D(scratch, false);
           multiply(scratch, i);
 
           if (first)  {
@@ -242,7 +242,7 @@ namespace askap
           multiply(work, i);
           /// Need to conjugate to get sense of w correction correct
           work = casacore::conj(work);
-          scimath::fft2d(work, true);
+          serialisedFFT2D(work, true);
           itsGrid[i].resize(itsShape);
           casacore::convertArray<casacore::Complex,casacore::DComplex>(itsGrid[i],work);
         }
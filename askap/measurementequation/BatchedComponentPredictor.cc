@@ -0,0 +1,312 @@
+/// @file
+///
+/// @brief batched prediction of visibilities for simple components
+/// @details Point sources and Gaussians are the most common components of sky models used for
+/// calibration. Predicting them one by one through the generic component interface involves
+/// virtual calls, temporary buffers and evaluation of sine and cosine for every channel of every
+/// row. This class keeps parameters of all such components in a structure of arrays and sums their
+/// Stokes I contributions directly. For evenly spaced channels the phase term is updated by a phasor
+/// recurrence (and the Gaussian decorrelation by a similar multiplicative recurrence), so the
+/// transcendental functions are only evaluated at a small number of anchor channels. Rows are
+/// distributed between threads.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+
+#include <askap/measurementequation/BatchedComponentPredictor.h>
+#include <askap/AskapError.h>
+
+#include <casacore/casa/BasicSL/Constants.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <exception>
+
+namespace askap {
+
+namespace synthesis {
+
+namespace {
+
+/// @brief number of channels between exact evaluations of the phasor
+/// @details The recurrence accumulates rounding errors, so the phasor and the
+/// decorrelation factor are recomputed exactly at every anchor channel.
+const size_t theirAnchorInterval = 64;
+
+/// @brief largest exponent of the decorrelation factor evaluated explicitly
+/// @details Components decorrelated beyond this point give no contribution
+/// at double precision, recurrence factors are not computed for them to avoid overflows.
+const double theirMaxExponent = 700.;
+
+} // anonymous namespace
+
+/// @brief constructor
+/// @param[in] nComp number of components
+/// @param[in] nChan number of channels
+BatchedComponentPredictor::Workspace::Workspace(size_t nComp, size_t nChan) :
+   itsDelay(nComp), itsDecorr(nComp), itsPhasorRe(nComp), itsPhasorIm(nComp),
+   itsStepRe(nComp), itsStepIm(nComp), itsGain(nComp), itsGainRatio(nComp),
+   itsGainRatioStep(nComp), itsSumRe(nChan), itsSumIm(nChan) {}
+
+/// @brief add a point source
+/// @param[in] flux flux density in Jy
+/// @param[in] ra offset in right ascension w.r.t. the phase centre (in radians)
+/// @param[in] dec offset in declination w.r.t. the phase centre (in radians)
+void BatchedComponentPredictor::addPoint(double flux, double ra, double dec)
+{
+  const double n = std::sqrt(1. - (ra * ra + dec * dec));
+  itsAmplitude.push_back(flux / n);
+  itsL.push_back(ra);
+  itsM.push_back(dec);
+  itsNMinusOne.push_back(n - 1.);
+  itsUU.push_back(0.);
+  itsUV.push_back(0.);
+  itsVV.push_back(0.);
+}
+
+/// @brief add a Gaussian
+/// @param[in] flux flux density in Jy
+/// @param[in] ra offset in right ascension w.r.t. the phase centre (in radians)
+/// @param[in] dec offset in declination w.r.t. the phase centre (in radians)
+/// @param[in] bmaj major axis FWHM (in radians)
+/// @param[in] bmin minor axis FWHM (in radians)
+/// @param[in] bpa position angle (in radians)
+void BatchedComponentPredictor::addGaussian(double flux, double ra, double dec, double bmaj, double bmin, double bpa)
+{
+  // Gaussians are not scaled by 1/n (consistent with UnpolarizedGaussianSource)
+  const double n = std::sqrt(1. - (ra * ra + dec * dec));
+  itsAmplitude.push_back(flux);
+  itsL.push_back(ra);
+  itsM.push_back(dec);
+  itsNMinusOne.push_back(n - 1.);
+  // exp(-a*x^2) transforms to exp(-pi^2*u^2/a), a=4log(2)/FWHM^2. The quadratic form
+  // in rotated coordinates (u', v') is expanded into coefficients for u^2, uv and v^2
+  const double scale = casacore::C::pi * casacore::C::pi / (4. * std::log(2.)) / (casacore::C::c * casacore::C::c);
+  const double cpa = std::cos(bpa);
+  const double spa = std::sin(bpa);
+  const double maj2 = bmaj * bmaj;
+  const double min2 = bmin * bmin;
+  itsUU.push_back(scale * (maj2 * cpa * cpa + min2 * spa * spa));
+  itsUV.push_back(scale * 2. * cpa * spa * (maj2 - min2));
+  itsVV.push_back(scale * (maj2 * spa * spa + min2 * cpa * cpa));
+}
+
+/// @brief check whether channels are evenly spaced
+/// @details The spacing should be the same to a small fraction of the channel width.
+/// @param[in] freq frequencies
+/// @return true if recurrence across channels can be used
+bool BatchedComponentPredictor::evenlySpaced(const casacore::Vector<casacore::Double> &freq)
+{
+  const casacore::uInt nChan = freq.nelements();
+  if (nChan < 2) {
+      return false;
+  }
+  const double width = (freq[nChan - 1] - freq[0]) / (nChan - 1);
+  if (width == 0.) {
+      return false;
+  }
+  const double tolerance = 1e-6 * std::abs(width);
+  for (casacore::uInt chan = 1; chan + 1 < nChan; ++chan) {
+       if (std::abs(freq[chan] - freq[0] - chan * width) > tolerance) {
+           return false;
+       }
+  }
+  return true;
+}
+
+/// @brief add visibilities of all components to the cube
+/// @param[in] uvw baseline spacings, one triplet for each data row
+/// @param[in] freq frequencies (one for each spectral channel)
+/// @param[in] polFactors factor to apply to Stokes I visibility for each plane of the cube
+/// @param[in] rwVis visibility cube to add to
+/// @param[in] nThreads number of threads to use
+void BatchedComponentPredictor::predict(const casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw,
+                const casacore::Vector<casacore::Double> &freq,
+                const casacore::Vector<casacore::Complex> &polFactors,
+                casacore::Cube<casacore::Complex> &rwVis, size_t nThreads) const
+{
+  ASKAPDEBUGASSERT(rwVis.nrow() == uvw.nelements());
+  ASKAPDEBUGASSERT(rwVis.ncolumn() == freq.nelements());
+  ASKAPDEBUGASSERT(rwVis.nplane() == polFactors.nelements());
+  ASKAPCHECK(rwVis.contiguousStorage(), "Visibility cube is expected to have contiguous storage");
+  if ((size() == 0) || (rwVis.nelements() == 0)) {
+      return;
+  }
+  // plain copy, so threads don't touch reference-counted casacore arrays
+  const std::vector<casacore::Complex> factors(polFactors.begin(), polFactors.end());
+  casacore::Complex *vis = rwVis.data();
+  nThreads = std::max(size_t(1), std::min(nThreads, size_t(rwVis.nrow())));
+  std::vector<std::string> errors(nThreads);
+  if (nThreads == 1) {
+      predictRows(uvw, freq, factors, vis, 0, 1, errors[0]);
+  } else {
+      boost::thread_group threads;
+      for (size_t thread = 0; thread < nThreads; ++thread) {
+           threads.create_thread(boost::bind(&BatchedComponentPredictor::predictRows, this, boost::cref(uvw),
+                     boost::cref(freq), boost::cref(factors), vis, thread, nThreads, boost::ref(errors[thread])));
+      }
+      threads.join_all();
+  }
+  for (size_t thread = 0; thread < nThreads; ++thread) {
+       ASKAPCHECK(errors[thread].size() == 0, "Error predicting visibilities of components in thread "<<thread<<": "<<errors[thread]);
+  }
+}
+
+/// @brief process a subset of rows
+/// @details This is the main method of the threads. Rows first, first+step, ... are processed.
+/// @param[in] uvw baseline spacings
+/// @param[in] freq frequencies
+/// @param[in] polFactors polarisation factors
+/// @param[in] vis pointer to the visibility cube storage (row is the most rapidly varying index)
+/// @param[in] first first row to process
+/// @param[in] step row increment
+/// @param[out] error error message (empty string if no error)
+void BatchedComponentPredictor::predictRows(const casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw,
+                    const casacore::Vector<casacore::Double> &freq,
+                    const std::vector<casacore::Complex> &polFactors,
+                    casacore::Complex *vis, size_t first, size_t step, std::string &error) const
+{
+  try {
+     const size_t nRow = uvw.nelements();
+     const size_t nChan = freq.nelements();
+     const size_t nPol = polFactors.size();
+     const bool regular = evenlySpaced(freq);
+     Workspace ws(size(), nChan);
+     for (size_t row = first; row < nRow; row += step) {
+          predictRow(uvw[row], freq, regular, ws);
+          for (size_t pol = 0; pol < nPol; ++pol) {
+               const casacore::Complex factor = polFactors[pol];
+               if ((casacore::real(factor) == 0.) && (casacore::imag(factor) == 0.)) {
+                   continue;
+               }
+               const double factorRe = casacore::real(factor);
+               const double factorIm = casacore::imag(factor);
+               casacore::Complex *out = vis + row + pol * nRow * nChan;
+               for (size_t chan = 0; chan < nChan; ++chan, out += nRow) {
+                    const double re = ws.itsSumRe[chan] * factorRe - ws.itsSumIm[chan] * factorIm;
+                    const double im = ws.itsSumRe[chan] * factorIm + ws.itsSumIm[chan] * factorRe;
+                    *out += casacore::Complex(static_cast<float>(re), static_cast<float>(im));
+               }
+          }
+     }
+  }
+  catch (const std::exception &ex) {
+     error = ex.what();
+  }
+}
+
+/// @brief sum all components for one row
+/// @details The result is written into itsSumRe and itsSumIm of the workspace
+/// @param[in] uvw baseline spacing of the row
+/// @param[in] freq frequencies
+/// @param[in] evenlySpaced true if channels are evenly spaced (so recurrence can be used)
+/// @param[in] ws work buffers
+void BatchedComponentPredictor::predictRow(const casacore::RigidVector<casacore::Double, 3> &uvw,
+                   const casacore::Vector<casacore::Double> &freq, bool evenlySpaced,
+                   Workspace &ws) const
+{
+  const size_t nComp = size();
+  const size_t nChan = freq.nelements();
+  const double u = uvw(0);
+  const double v = uvw(1);
+  const double w = uvw(2);
+  const double phaseScale = casacore::C::_2pi / casacore::C::c;
+
+  // per component rates, this loop has no dependencies and is vectorised by the compiler
+  const double *l = &itsL[0];
+  const double *m = &itsM[0];
+  const double *nm1 = &itsNMinusOne[0];
+  const double *uu = &itsUU[0];
+  const double *uv = &itsUV[0];
+  const double *vv = &itsVV[0];
+  double *delay = &ws.itsDelay[0];
+  double *decorr = &ws.itsDecorr[0];
+  for (size_t comp = 0; comp < nComp; ++comp) {
+       delay[comp] = phaseScale * (l[comp] * u + m[comp] * v + nm1[comp] * w);
+       decorr[comp] = uu[comp] * u * u + uv[comp] * u * v + vv[comp] * v * v;
+  }
+
+  const double width = evenlySpaced ? freq[1] - freq[0] : 0.;
+  const size_t interval = evenlySpaced ? theirAnchorInterval : 1;
+  if (evenlySpaced) {
+      for (size_t comp = 0; comp < nComp; ++comp) {
+           ws.itsStepRe[comp] = std::cos(delay[comp] * width);
+           ws.itsStepIm[comp] = std::sin(delay[comp] * width);
+           ws.itsGainRatioStep[comp] = std::exp(-2. * decorr[comp] * width * width);
+      }
+  }
+
+  const double *amp = &itsAmplitude[0];
+  double *pRe = &ws.itsPhasorRe[0];
+  double *pIm = &ws.itsPhasorIm[0];
+  const double *sRe = &ws.itsStepRe[0];
+  const double *sIm = &ws.itsStepIm[0];
+  double *gain = &ws.itsGain[0];
+  double *ratio = &ws.itsGainRatio[0];
+  const double *ratioStep = &ws.itsGainRatioStep[0];
+
+  for (size_t anchor = 0; anchor < nChan; anchor += interval) {
+       // exact evaluation at the anchor channel
+       const double f0 = freq[anchor];
+       for (size_t comp = 0; comp < nComp; ++comp) {
+            const double phase = delay[comp] * f0;
+            pRe[comp] = std::cos(phase);
+            pIm[comp] = std::sin(phase);
+            const double exponent = decorr[comp] * f0 * f0;
+            if (exponent < theirMaxExponent) {
+                gain[comp] = amp[comp] * std::exp(-exponent);
+                ratio[comp] = evenlySpaced ? std::exp(-decorr[comp] * width * (2. * f0 + width)) : 1.;
+            } else {
+                gain[comp] = 0.;
+                ratio[comp] = 0.;
+            }
+       }
+       // recurrence for the following channels, the loop over components is vectorised
+       // (the sums are accumulated in a reduction)
+       const size_t last = std::min(anchor + interval, nChan);
+       for (size_t chan = anchor; chan < last; ++chan) {
+            double sumRe = 0.;
+            double sumIm = 0.;
+            #pragma omp simd reduction(+:sumRe,sumIm)
+            for (size_t comp = 0; comp < nComp; ++comp) {
+                 const double re = pRe[comp];
+                 const double im = pIm[comp];
+                 sumRe += gain[comp] * re;
+                 sumIm += gain[comp] * im;
+                 pRe[comp] = re * sRe[comp] - im * sIm[comp];
+                 pIm[comp] = re * sIm[comp] + im * sRe[comp];
+                 gain[comp] *= ratio[comp];
+                 ratio[comp] *= ratioStep[comp];
+            }
+            ws.itsSumRe[chan] = sumRe;
+            ws.itsSumIm[chan] = sumIm;
+       }
+  }
+}
+
+} // namespace synthesis
+
+} // namespace askap
@@ -0,0 +1,180 @@
+/// @file
+///
+/// @brief batched prediction of visibilities for simple components
+/// @details Point sources and Gaussians are the most common components of sky models used for
+/// calibration. Predicting them one by one through the generic component interface involves
+/// virtual calls, temporary buffers and evaluation of sine and cosine for every channel of every
+/// row. This class keeps parameters of all such components in a structure of arrays and sums their
+/// Stokes I contributions directly. For evenly spaced channels the phase term is updated by a phasor
+/// recurrence (and the Gaussian decorrelation by a similar multiplicative recurrence), so the
+/// transcendental functions are only evaluated at a small number of anchor channels. Rows are
+/// distributed between threads.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+
+
+#ifndef BATCHED_COMPONENT_PREDICTOR_H
+#define BATCHED_COMPONENT_PREDICTOR_H
+
+// casa includes
+#include <casacore/casa/BasicSL/Complex.h>
+#include <casacore/casa/Arrays/Vector.h>
+#include <casacore/casa/Arrays/Cube.h>
+#include <casacore/scimath/Mathematics/RigidVector.h>
+
+// std includes
+#include <string>
+#include <vector>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief batched prediction of visibilities for simple components
+/// @details This class sums visibilities of unpolarised point sources and Gaussians given by
+/// the same parameters as UnpolarizedPointSource and UnpolarizedGaussianSource (and gives the same
+/// result to within rounding errors). The Stokes I visibility is added to each plane of the cube
+/// with the appropriate polarisation factor. The class holds no state which changes during
+/// prediction, so the same instance can be used by a number of threads.
+/// @ingroup measurementequation
+class BatchedComponentPredictor {
+public:
+   /// @brief add a point source
+   /// @param[in] flux flux density in Jy
+   /// @param[in] ra offset in right ascension w.r.t. the phase centre (in radians)
+   /// @param[in] dec offset in declination w.r.t. the phase centre (in radians)
+   void addPoint(double flux, double ra, double dec);
+
+   /// @brief add a Gaussian
+   /// @param[in] flux flux density in Jy
+   /// @param[in] ra offset in right ascension w.r.t. the phase centre (in radians)
+   /// @param[in] dec offset in declination w.r.t. the phase centre (in radians)
+   /// @param[in] bmaj major axis FWHM (in radians)
+   /// @param[in] bmin minor axis FWHM (in radians)
+   /// @param[in] bpa position angle (in radians)
+   void addGaussian(double flux, double ra, double dec, double bmaj, double bmin, double bpa);
+
+   /// @brief number of components
+   /// @return number of components in the batch
+   inline size_t size() const { return itsAmplitude.size(); }
+
+   /// @brief add visibilities of all components to the cube
+   /// @param[in] uvw baseline spacings, one triplet for each data row
+   /// @param[in] freq frequencies (one for each spectral channel)
+   /// @param[in] polFactors factor to apply to Stokes I visibility for each plane of the cube
+   /// @param[in] rwVis visibility cube to add to
+   /// @param[in] nThreads number of threads to use
+   void predict(const casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw,
+                const casacore::Vector<casacore::Double> &freq,
+                const casacore::Vector<casacore::Complex> &polFactors,
+                casacore::Cube<casacore::Complex> &rwVis, size_t nThreads = 1) const;
+
+   /// @brief check whether channels are evenly spaced
+   /// @details The spacing should be the same to a small fraction of the channel width.
+   /// @param[in] freq frequencies
+   /// @return true if recurrence across channels can be used
+   static bool evenlySpaced(const casacore::Vector<casacore::Double> &freq);
+
+protected:
+   /// @brief work buffers of one thread
+   struct Workspace {
+      /// @brief constructor
+      /// @param[in] nComp number of components
+      /// @param[in] nChan number of channels
+      Workspace(size_t nComp, size_t nChan);
+      /// @brief phase rate (per Hz) for each component
+      std::vector<double> itsDelay;
+      /// @brief decorrelation rate (per Hz squared) for each component
+      std::vector<double> itsDecorr;
+      /// @brief current phasor (real part)
+      std::vector<double> itsPhasorRe;
+      /// @brief current phasor (imaginary part)
+      std::vector<double> itsPhasorIm;
+      /// @brief phasor increment per channel (real part)
+      std::vector<double> itsStepRe;
+      /// @brief phasor increment per channel (imaginary part)
+      std::vector<double> itsStepIm;
+      /// @brief current amplitude including decorrelation
+      std::vector<double> itsGain;
+      /// @brief current ratio of amplitudes of adjacent channels
+      std::vector<double> itsGainRatio;
+      /// @brief change of the amplitude ratio per channel
+      std::vector<double> itsGainRatioStep;
+      /// @brief sum of all components for the current row (real part)
+      std::vector<double> itsSumRe;
+      /// @brief sum of all components for the current row (imaginary part)
+      std::vector<double> itsSumIm;
+   };
+
+   /// @brief sum all components for one row
+   /// @details The result is written into itsSumRe and itsSumIm of the workspace
+   /// @param[in] uvw baseline spacing of the row
+   /// @param[in] freq frequencies
+   /// @param[in] evenlySpaced true if channels are evenly spaced (so recurrence can be used)
+   /// @param[in] ws work buffers
+   void predictRow(const casacore::RigidVector<casacore::Double, 3> &uvw,
+                   const casacore::Vector<casacore::Double> &freq, bool evenlySpaced,
+                   Workspace &ws) const;
+
+   /// @brief process a subset of rows
+   /// @details This is the main method of the threads. Rows first, first+step, ... are processed.
+   /// @param[in] uvw baseline spacings
+   /// @param[in] freq frequencies
+   /// @param[in] polFactors polarisation factors
+   /// @param[in] vis pointer to the visibility cube storage (row is the most rapidly varying index)
+   /// @param[in] first first row to process
+   /// @param[in] step row increment
+   /// @param[out] error error message (empty string if no error)
+   void predictRows(const casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw,
+                    const casacore::Vector<casacore::Double> &freq,
+                    const std::vector<casacore::Complex> &polFactors,
+                    casacore::Complex *vis, size_t first, size_t step, std::string &error) const;
+
+private:
+   /// @brief flux density divided by the n-term of the direction (points only)
+   std::vector<double> itsAmplitude;
+
+   /// @brief offset in right ascension (direction cosine l)
+   std::vector<double> itsL;
+
+   /// @brief offset in declination (direction cosine m)
+   std::vector<double> itsM;
+
+   /// @brief n - 1 term of the direction
+   std::vector<double> itsNMinusOne;
+
+   /// @brief coefficient of u^2 in the exponent of the decorrelation (per Hz squared)
+   std::vector<double> itsUU;
+
+   /// @brief coefficient of uv in the exponent of the decorrelation (per Hz squared)
+   std::vector<double> itsUV;
+
+   /// @brief coefficient of v^2 in the exponent of the decorrelation (per Hz squared)
+   std::vector<double> itsVV;
+};
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef BATCHED_COMPONENT_PREDICTOR_H
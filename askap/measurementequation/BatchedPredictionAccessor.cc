@@ -0,0 +1,359 @@
+/// @file
+/// @brief accessor combining several small chunks for a single prediction pass
+/// @details Calibration with short solution intervals results in small data chunks.
+/// Predicting model visibilities for an image-based model chunk by chunk pays the
+/// per-chunk setup cost of the gridder (index and convolution function initialisation,
+/// uvw rotation) many times. This accessor concatenates rows of several chunks sharing
+/// the same spectral and polarisation setup, so the model can be predicted in one
+/// pass. Rotated uvw's and delays can also be kept in a shared cache, because they
+/// don't change when the same data are processed again (e.g. for another channel or
+/// another calibration cycle).
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#include <askap/measurementequation/BatchedPredictionAccessor.h>
+#include <askap/utils/HashUtils.h>
+#include <askap/AskapError.h>
+
+#include <casacore/casa/Arrays/Slice.h>
+
+namespace askap {
+
+namespace synthesis {
+
+namespace {
+
+/// @brief update hash with a direction
+/// @param[in] hash current value of the hash
+/// @param[in] dir direction
+/// @return updated hash
+uint64_t hashDirection(uint64_t hash, const casacore::MVDirection &dir)
+{
+  const double lonLat[2] = {dir.getLong(), dir.getLat()};
+  return hashBytes(hash, lonLat, sizeof(lonLat));
+}
+
+/// @brief concatenate vectors
+/// @details The list of parts is cleared on exit.
+/// @param[in] parts vectors to concatenate
+/// @param[out] result concatenated vector
+/// @param[in] nRow total number of elements
+template<typename T>
+void concatenate(std::vector<casacore::Vector<T> > &parts, casacore::Vector<T> &result, casacore::uInt nRow)
+{
+  result.resize(nRow);
+  casacore::uInt offset = 0;
+  for (typename std::vector<casacore::Vector<T> >::const_iterator ci = parts.begin(); ci != parts.end(); ++ci) {
+       const casacore::uInt n = ci->nelements();
+       if (n > 0) {
+           result(casacore::Slice(offset, n)) = *ci;
+       }
+       offset += n;
+  }
+  ASKAPCHECK(offset == nRow, "Inconsistent number of rows in the appended chunks");
+  parts.clear();
+}
+
+/// @brief concatenate cubes along the row axis
+/// @details The list of parts is cleared on exit.
+/// @param[in] parts cubes to concatenate
+/// @param[out] result concatenated cube
+/// @param[in] nRow total number of rows
+template<typename T>
+void concatenate(std::vector<casacore::Cube<T> > &parts, casacore::Cube<T> &result, casacore::uInt nRow)
+{
+  ASKAPDEBUGASSERT(parts.size() > 0);
+  result.resize(nRow, parts[0].ncolumn(), parts[0].nplane());
+  casacore::uInt offset = 0;
+  for (typename std::vector<casacore::Cube<T> >::const_iterator ci = parts.begin(); ci != parts.end(); ++ci) {
+       const casacore::uInt n = ci->nrow();
+       if (n > 0) {
+           result(casacore::Slice(offset, n), casacore::Slice(), casacore::Slice()) = *ci;
+       }
+       offset += n;
+  }
+  ASKAPCHECK(offset == nRow, "Inconsistent number of rows in the appended chunks");
+  parts.clear();
+}
+
+} // anonymous namespace
+
+/// @brief constructor
+/// @param[in] maxMemory maximum memory in bytes used by the cached vectors
+RotatedUVWCache::RotatedUVWCache(size_t maxMemory) : itsMaxMemory(maxMemory), itsUsedMemory(0u),
+      itsNHits(0u), itsNMisses(0u) {}
+
+/// @brief obtain cached rotated uvw's
+/// @param[in] key hash of the data and tangent point
+/// @param[out] uvw rotated uvw's (unchanged if there is no match)
+/// @return true if the uvw's have been found
+bool RotatedUVWCache::findUVW(uint64_t key, casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw) const
+{
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  const std::map<uint64_t, casacore::Vector<casacore::RigidVector<casacore::Double, 3> > >::const_iterator ci =
+        itsUVWs.find(key);
+  if (ci == itsUVWs.end()) {
+      ++itsNMisses;
+      return false;
+  }
+  ++itsNHits;
+  uvw.assign(ci->second);
+  return true;
+}
+
+/// @brief store rotated uvw's
+/// @param[in] key hash of the data and tangent point
+/// @param[in] uvw rotated uvw's
+void RotatedUVWCache::addUVW(uint64_t key, const casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw)
+{
+  const size_t size = uvw.nelements() * sizeof(casacore::RigidVector<casacore::Double, 3>);
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  if ((itsUsedMemory + size <= itsMaxMemory) && (itsUVWs.find(key) == itsUVWs.end())) {
+      itsUVWs[key] = uvw.copy();
+      itsUsedMemory += size;
+  }
+}
+
+/// @brief obtain cached delays
+/// @param[in] key hash of the data, tangent point and image centre
+/// @param[out] delays delays (unchanged if there is no match)
+/// @return true if the delays have been found
+bool RotatedUVWCache::findDelays(uint64_t key, casacore::Vector<casacore::Double> &delays) const
+{
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  const std::map<uint64_t, casacore::Vector<casacore::Double> >::const_iterator ci = itsDelays.find(key);
+  if (ci == itsDelays.end()) {
+      ++itsNMisses;
+      return false;
+  }
+  ++itsNHits;
+  delays.assign(ci->second);
+  return true;
+}
+
+/// @brief store delays
+/// @param[in] key hash of the data, tangent point and image centre
+/// @param[in] delays delays
+void RotatedUVWCache::addDelays(uint64_t key, const casacore::Vector<casacore::Double> &delays)
+{
+  const size_t size = delays.nelements() * sizeof(casacore::Double);
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  if ((itsUsedMemory + size <= itsMaxMemory) && (itsDelays.find(key) == itsDelays.end())) {
+      itsDelays[key] = delays.copy();
+      itsUsedMemory += size;
+  }
+}
+
+/// @brief number of successful lookups
+/// @return number of lookups which found the data in the cache
+size_t RotatedUVWCache::nHits() const
+{
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  return itsNHits;
+}
+
+/// @brief number of failed lookups
+/// @return number of lookups which required the rotation to be calculated
+size_t RotatedUVWCache::nMisses() const
+{
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  return itsNMisses;
+}
+
+/// @brief constructor
+/// @param[in] cache shared cache of rotated uvw's and delays (may be empty)
+/// @param[in] cacheSize uvw-machine cache size
+/// @param[in] tolerance pointing direction tolerance in radians, exceeding
+/// which leads to initialisation of a new UVW machine and recompute of the rotated uvws/delays
+BatchedPredictionAccessor::BatchedPredictionAccessor(const boost::shared_ptr<RotatedUVWCache> &cache,
+               size_t cacheSize, double tolerance) : accessors::DataAccessorStub(false),
+               itsRotatedUVW(cacheSize, tolerance), itsCache(cache), itsGeometryHash(0u),
+               itsNAppendedRows(0u), itsNChunks(0u) {}
+
+/// @brief check whether the chunk can be added to this batch
+/// @details Chunks can be combined if they have the same frequencies and polarisation
+/// products. Any chunk is compatible with an empty batch.
+/// @param[in] acc accessor to test
+/// @return true, if the chunk can be appended
+bool BatchedPredictionAccessor::isCompatible(const accessors::IConstDataAccessor &acc) const
+{
+  if (itsNChunks == 0) {
+      return true;
+  }
+  if ((acc.nChannel() != itsFrequency.nelements()) || (acc.nPol() != itsStokes.nelements())) {
+      return false;
+  }
+  const casacore::Vector<casacore::Double> &freq = acc.frequency();
+  for (casacore::uInt chan = 0; chan < freq.nelements(); ++chan) {
+       if (freq[chan] != itsFrequency[chan]) {
+           return false;
+       }
+  }
+  const casacore::Vector<casacore::Stokes::StokesTypes> &stokes = acc.stokes();
+  for (casacore::uInt pol = 0; pol < stokes.nelements(); ++pol) {
+       if (stokes[pol] != itsStokes[pol]) {
+           return false;
+       }
+  }
+  return true;
+}
+
+/// @brief add a chunk to the batch
+/// @details All data are copied, so the accessor can be changed (e.g. by advancing the
+/// iterator) after this call. Rows become available after merge is called.
+/// @param[in] acc accessor to copy the data from
+void BatchedPredictionAccessor::append(const accessors::IConstDataAccessor &acc)
+{
+  ASKAPCHECK(itsVisibility.nrow() == 0, "Chunks can't be appended to the batch after merge");
+  ASKAPCHECK(isCompatible(acc), "Spectral or polarisation setup of the chunk doesn't match that of the batch");
+  if (itsNChunks == 0) {
+      itsTime = acc.time();
+      itsFrequency.assign(acc.frequency());
+      itsStokes.assign(acc.stokes());
+  }
+  itsPendingAntenna1.push_back(acc.antenna1().copy());
+  itsPendingAntenna2.push_back(acc.antenna2().copy());
+  itsPendingFeed1.push_back(acc.feed1().copy());
+  itsPendingFeed2.push_back(acc.feed2().copy());
+  itsPendingFeed1PA.push_back(acc.feed1PA().copy());
+  itsPendingFeed2PA.push_back(acc.feed2PA().copy());
+  itsPendingPointingDir1.push_back(acc.pointingDir1().copy());
+  itsPendingPointingDir2.push_back(acc.pointingDir2().copy());
+  itsPendingDishPointing1.push_back(acc.dishPointing1().copy());
+  itsPendingDishPointing2.push_back(acc.dishPointing2().copy());
+  itsPendingUVW.push_back(acc.uvw().copy());
+  itsPendingVisibility.push_back(acc.visibility().copy());
+  itsPendingNoise.push_back(acc.noise().copy());
+  itsPendingFlag.push_back(acc.flag().copy());
+  itsNAppendedRows += acc.nRow();
+  ++itsNChunks;
+}
+
+/// @brief combine all appended chunks
+/// @details This method has to be called after the last chunk is appended and before
+/// the accessor is used.
+void BatchedPredictionAccessor::merge()
+{
+  ASKAPCHECK(itsNChunks > 0, "No chunks have been appended to the batch");
+  ASKAPCHECK(itsVisibility.nrow() == 0, "The batch has already been merged");
+  concatenate(itsPendingAntenna1, itsAntenna1, itsNAppendedRows);
+  concatenate(itsPendingAntenna2, itsAntenna2, itsNAppendedRows);
+  concatenate(itsPendingFeed1, itsFeed1, itsNAppendedRows);
+  concatenate(itsPendingFeed2, itsFeed2, itsNAppendedRows);
+  concatenate(itsPendingFeed1PA, itsFeed1PA, itsNAppendedRows);
+  concatenate(itsPendingFeed2PA, itsFeed2PA, itsNAppendedRows);
+  concatenate(itsPendingPointingDir1, itsPointingDir1, itsNAppendedRows);
+  concatenate(itsPendingPointingDir2, itsPointingDir2, itsNAppendedRows);
+  concatenate(itsPendingDishPointing1, itsDishPointing1, itsNAppendedRows);
+  concatenate(itsPendingDishPointing2, itsDishPointing2, itsNAppendedRows);
+  concatenate(itsPendingUVW, itsUVW, itsNAppendedRows);
+  concatenate(itsPendingVisibility, itsVisibility, itsNAppendedRows);
+  concatenate(itsPendingNoise, itsNoise, itsNAppendedRows);
+  concatenate(itsPendingFlag, itsFlag, itsNAppendedRows);
+  ASKAPDEBUGASSERT(nRow() == itsNAppendedRows);
+
+  // rotation depends only on the baseline coordinates and phase centres
+  itsGeometryHash = hashBytes(fnvHashSeed, &itsNAppendedRows, sizeof(itsNAppendedRows));
+  for (casacore::uInt row = 0; row < itsNAppendedRows; ++row) {
+       const double uvw[3] = {itsUVW[row](0), itsUVW[row](1), itsUVW[row](2)};
+       itsGeometryHash = hashBytes(itsGeometryHash, uvw, sizeof(uvw));
+       itsGeometryHash = hashDirection(itsGeometryHash, itsPointingDir1[row]);
+       itsGeometryHash = hashDirection(itsGeometryHash, itsPointingDir2[row]);
+  }
+}
+
+/// @brief combine the given direction with the hash of the data
+/// @param[in] hash hash to update
+/// @param[in] dir direction
+/// @return updated hash
+uint64_t BatchedPredictionAccessor::directionHash(uint64_t hash, const casacore::MDirection &dir)
+{
+  const casacore::uInt type = dir.getRef().getType();
+  hash = hashBytes(hash, &type, sizeof(type));
+  return hashDirection(hash, dir.getValue());
+}
+
+/// @brief uvw after rotation
+/// @details The rotation is done for all rows at once. The result is taken from the
+/// shared cache, if available.
+/// @param[in] tangentPoint tangent point to rotate the coordinates to
+/// @return uvw after rotation to the new coordinate system for each row
+const casacore::Vector<casacore::RigidVector<casacore::Double, 3> >&
+                 BatchedPredictionAccessor::rotatedUVW(const casacore::MDirection &tangentPoint) const
+{
+  ASKAPCHECK(itsVisibility.nrow() == itsNAppendedRows, "The batch has to be merged before it is used");
+  if (!itsCache) {
+      return itsRotatedUVW.uvw(*this, tangentPoint);
+  }
+  const uint64_t key = directionHash(itsGeometryHash, tangentPoint);
+  std::map<uint64_t, casacore::Vector<casacore::RigidVector<casacore::Double, 3> > >::iterator it =
+        itsCachedUVWs.find(key);
+  if (it != itsCachedUVWs.end()) {
+      return it->second;
+  }
+  casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw = itsCachedUVWs[key];
+  if (!itsCache->findUVW(key, uvw)) {
+      uvw.assign(itsRotatedUVW.uvw(*this, tangentPoint));
+      itsCache->addUVW(key, uvw);
+  }
+  return uvw;
+}
+
+/// @brief delay associated with uvw rotation
+/// @details This is a companion method to rotatedUVW. The result is taken from the
+/// shared cache, if available.
+/// @param[in] tangentPoint tangent point to rotate the coordinates to
+/// @param[in] imageCentre image centre (additional translation is done if imageCentre!=tangentPoint)
+/// @return delays corresponding to the uvw rotation for each row
+const casacore::Vector<casacore::Double>& BatchedPredictionAccessor::uvwRotationDelay(
+                 const casacore::MDirection &tangentPoint, const casacore::MDirection &imageCentre) const
+{
+  ASKAPCHECK(itsVisibility.nrow() == itsNAppendedRows, "The batch has to be merged before it is used");
+  if (!itsCache) {
+      return itsRotatedUVW.delays(*this, tangentPoint, imageCentre);
+  }
+  const uint64_t key = directionHash(directionHash(itsGeometryHash, tangentPoint), imageCentre);
+  std::map<uint64_t, casacore::Vector<casacore::Double> >::iterator it = itsCachedDelays.find(key);
+  if (it != itsCachedDelays.end()) {
+      return it->second;
+  }
+  casacore::Vector<casacore::Double> &delays = itsCachedDelays[key];
+  if (!itsCache->findDelays(key, delays)) {
+      delays.assign(itsRotatedUVW.delays(*this, tangentPoint, imageCentre));
+      itsCache->addDelays(key, delays);
+  }
+  return delays;
+}
+
+/// Velocity for each channel
+/// @return a reference to vector containing velocities for each
+///         spectral channel (vector size is nChannel).
+const casacore::Vector<casacore::Double>& BatchedPredictionAccessor::velocity() const
+{
+  ASKAPTHROW(AskapError, "BatchedPredictionAccessor::velocity() has not been implemented");
+}
+
+} // namespace synthesis
+
+} // namespace askap
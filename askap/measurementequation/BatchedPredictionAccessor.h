@@ -0,0 +1,238 @@
+/// @file
+/// @brief accessor combining several small chunks for a single prediction pass
+/// @details Calibration with short solution intervals results in small data chunks.
+/// Predicting model visibilities for an image-based model chunk by chunk pays the
+/// per-chunk setup cost of the gridder (index and convolution function initialisation,
+/// uvw rotation) many times. This accessor concatenates rows of several chunks sharing
+/// the same spectral and polarisation setup, so the model can be predicted in one
+/// pass. Rotated uvw's and delays can also be kept in a shared cache, because they
+/// don't change when the same data are processed again (e.g. for another channel or
+/// another calibration cycle).
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#ifndef ASKAP_SYNTHESIS_BATCHED_PREDICTION_ACCESSOR_H
+#define ASKAP_SYNTHESIS_BATCHED_PREDICTION_ACCESSOR_H
+
+#include <askap/dataaccess/DataAccessorStub.h>
+#include <askap/dataaccess/IConstDataAccessor.h>
+#include <askap/dataaccess/UVWRotationHandler.h>
+
+#include <casacore/casa/Arrays/Vector.h>
+#include <casacore/casa/Arrays/Cube.h>
+#include <casacore/measures/Measures/MDirection.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <map>
+#include <vector>
+#include <stdint.h>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief cache of rotated uvw's and delays
+/// @details Entries are keyed by a hash of the baseline coordinates, phase centres and
+/// the directions used for the rotation. The cache is shared between all batched
+/// accessors created by the same calibrator and can be used from several threads.
+/// New entries are not added once the memory limit is reached.
+/// @ingroup measurementequation
+class RotatedUVWCache {
+public:
+   /// @brief constructor
+   /// @param[in] maxMemory maximum memory in bytes used by the cached vectors
+   explicit RotatedUVWCache(size_t maxMemory);
+
+   /// @brief obtain cached rotated uvw's
+   /// @param[in] key hash of the data and tangent point
+   /// @param[out] uvw rotated uvw's (unchanged if there is no match)
+   /// @return true if the uvw's have been found
+   bool findUVW(uint64_t key, casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw) const;
+
+   /// @brief store rotated uvw's
+   /// @param[in] key hash of the data and tangent point
+   /// @param[in] uvw rotated uvw's
+   void addUVW(uint64_t key, const casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw);
+
+   /// @brief obtain cached delays
+   /// @param[in] key hash of the data, tangent point and image centre
+   /// @param[out] delays delays (unchanged if there is no match)
+   /// @return true if the delays have been found
+   bool findDelays(uint64_t key, casacore::Vector<casacore::Double> &delays) const;
+
+   /// @brief store delays
+   /// @param[in] key hash of the data, tangent point and image centre
+   /// @param[in] delays delays
+   void addDelays(uint64_t key, const casacore::Vector<casacore::Double> &delays);
+
+   /// @brief number of successful lookups
+   /// @return number of lookups which found the data in the cache
+   size_t nHits() const;
+
+   /// @brief number of failed lookups
+   /// @return number of lookups which required the rotation to be calculated
+   size_t nMisses() const;
+
+private:
+   /// @brief cached rotated uvw's
+   std::map<uint64_t, casacore::Vector<casacore::RigidVector<casacore::Double, 3> > > itsUVWs;
+
+   /// @brief cached delays
+   std::map<uint64_t, casacore::Vector<casacore::Double> > itsDelays;
+
+   /// @brief maximum memory in bytes
+   size_t itsMaxMemory;
+
+   /// @brief memory in bytes currently used by the cache
+   size_t itsUsedMemory;
+
+   /// @brief number of successful lookups
+   mutable size_t itsNHits;
+
+   /// @brief number of failed lookups
+   mutable size_t itsNMisses;
+
+   /// @brief synchronisation between threads
+   mutable boost::mutex itsMutex;
+};
+
+/// @brief accessor combining several small chunks for a single prediction pass
+/// @details Chunks are appended with the append method and combined into a single
+/// set of rows by the merge method. Only chunks with the same frequencies and
+/// polarisation products can be combined. The time reported by this accessor is that
+/// of the first chunk. Rotated uvw's and delays are computed on request for all rows
+/// at once and, if a cache is given, shared with other accessors which happen
+/// to contain the same data.
+/// @ingroup measurementequation
+class BatchedPredictionAccessor : public accessors::DataAccessorStub {
+public:
+   /// @brief constructor
+   /// @param[in] cache shared cache of rotated uvw's and delays (may be empty)
+   /// @param[in] cacheSize uvw-machine cache size
+   /// @param[in] tolerance pointing direction tolerance in radians, exceeding
+   /// which leads to initialisation of a new UVW machine and recompute of the rotated uvws/delays
+   explicit BatchedPredictionAccessor(const boost::shared_ptr<RotatedUVWCache> &cache =
+                  boost::shared_ptr<RotatedUVWCache>(), size_t cacheSize = 1, double tolerance = 1e-6);
+
+   /// @brief check whether the chunk can be added to this batch
+   /// @details Chunks can be combined if they have the same frequencies and polarisation
+   /// products. Any chunk is compatible with an empty batch.
+   /// @param[in] acc accessor to test
+   /// @return true, if the chunk can be appended
+   bool isCompatible(const accessors::IConstDataAccessor &acc) const;
+
+   /// @brief add a chunk to the batch
+   /// @details All data are copied, so the accessor can be changed (e.g. by advancing the
+   /// iterator) after this call. Rows become available after merge is called.
+   /// @param[in] acc accessor to copy the data from
+   void append(const accessors::IConstDataAccessor &acc);
+
+   /// @brief number of rows in all chunks appended so far
+   /// @return number of rows
+   inline casacore::uInt nAppendedRows() const { return itsNAppendedRows; }
+
+   /// @brief number of chunks appended so far
+   /// @return number of chunks
+   inline size_t nChunks() const { return itsNChunks; }
+
+   /// @brief combine all appended chunks
+   /// @details This method has to be called after the last chunk is appended and before
+   /// the accessor is used.
+   void merge();
+
+   /// @brief uvw after rotation
+   /// @details The rotation is done for all rows at once. The result is taken from the
+   /// shared cache, if available.
+   /// @param[in] tangentPoint tangent point to rotate the coordinates to
+   /// @return uvw after rotation to the new coordinate system for each row
+   virtual const casacore::Vector<casacore::RigidVector<casacore::Double, 3> >&
+                 rotatedUVW(const casacore::MDirection &tangentPoint) const;
+
+   /// @brief delay associated with uvw rotation
+   /// @details This is a companion method to rotatedUVW. The result is taken from the
+   /// shared cache, if available.
+   /// @param[in] tangentPoint tangent point to rotate the coordinates to
+   /// @param[in] imageCentre image centre (additional translation is done if imageCentre!=tangentPoint)
+   /// @return delays corresponding to the uvw rotation for each row
+   virtual const casacore::Vector<casacore::Double>& uvwRotationDelay(
+                 const casacore::MDirection &tangentPoint, const casacore::MDirection &imageCentre) const;
+
+   /// Velocity for each channel
+   /// @return a reference to vector containing velocities for each
+   ///         spectral channel (vector size is nChannel).
+   virtual const casacore::Vector<casacore::Double>& velocity() const;
+
+private:
+   /// @brief combine the given direction with the hash of the data
+   /// @param[in] hash hash to update
+   /// @param[in] dir direction
+   /// @return updated hash
+   static uint64_t directionHash(uint64_t hash, const casacore::MDirection &dir);
+
+   /// @brief handler of uvw rotations
+   accessors::UVWRotationHandler itsRotatedUVW;
+
+   /// @brief shared cache of rotated uvw's and delays
+   boost::shared_ptr<RotatedUVWCache> itsCache;
+
+   /// @brief hash of uvw's and phase centres of all rows (set by merge)
+   uint64_t itsGeometryHash;
+
+   /// @brief rotated uvw's obtained from the cache keyed by tangent point hash
+   mutable std::map<uint64_t, casacore::Vector<casacore::RigidVector<casacore::Double, 3> > > itsCachedUVWs;
+
+   /// @brief delays obtained from the cache keyed by direction hash
+   mutable std::map<uint64_t, casacore::Vector<casacore::Double> > itsCachedDelays;
+
+   /// @brief number of rows appended so far
+   casacore::uInt itsNAppendedRows;
+
+   /// @brief number of chunks appended so far
+   size_t itsNChunks;
+
+   // copies of the appended chunks waiting to be merged
+
+   std::vector<casacore::Vector<casacore::uInt> > itsPendingAntenna1;
+   std::vector<casacore::Vector<casacore::uInt> > itsPendingAntenna2;
+   std::vector<casacore::Vector<casacore::uInt> > itsPendingFeed1;
+   std::vector<casacore::Vector<casacore::uInt> > itsPendingFeed2;
+   std::vector<casacore::Vector<casacore::Float> > itsPendingFeed1PA;
+   std::vector<casacore::Vector<casacore::Float> > itsPendingFeed2PA;
+   std::vector<casacore::Vector<casacore::MVDirection> > itsPendingPointingDir1;
+   std::vector<casacore::Vector<casacore::MVDirection> > itsPendingPointingDir2;
+   std::vector<casacore::Vector<casacore::MVDirection> > itsPendingDishPointing1;
+   std::vector<casacore::Vector<casacore::MVDirection> > itsPendingDishPointing2;
+   std::vector<casacore::Vector<casacore::RigidVector<casacore::Double, 3> > > itsPendingUVW;
+   std::vector<casacore::Cube<casacore::Complex> > itsPendingVisibility;
+   std::vector<casacore::Cube<casacore::Complex> > itsPendingNoise;
+   std::vector<casacore::Cube<casacore::Bool> > itsPendingFlag;
+};
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef ASKAP_SYNTHESIS_BATCHED_PREDICTION_ACCESSOR_H
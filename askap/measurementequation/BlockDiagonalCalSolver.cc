@@ -0,0 +1,333 @@
+/// @file
+///
+/// @brief solver for calibration normal equations with block-diagonal structure
+/// @details Calibration normal equations decompose into independent blocks: unknowns
+/// of different beams are not coupled (unless beam-independent effects are solved for)
+/// and neither are unknowns of different spectral channels in the bandpass case.
+/// This solver groups free parameters into such blocks, copies each block of the normal
+/// matrix into preallocated dense storage and solves the blocks independently (and
+/// concurrently, if requested). Each block is solved directly for the damped least
+/// squares problem LSQR solves iteratively: min |N x - b|^2 + alpha^2 |x|^2, where
+/// N is the normal matrix block and b is the data vector. The cost therefore grows
+/// linearly with the number of beams and channels.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+
+#include <askap/measurementequation/BlockDiagonalCalSolver.h>
+#include <askap/calibaccess/CalParamNameHelper.h>
+#include <askap/AskapError.h>
+#include <askap/AskapLogging.h>
+ASKAP_LOGGER(logger, ".measurementequation.blockdiagonalcalsolver");
+
+// boost includes
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+// std includes
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <set>
+#include <sstream>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief constructor
+/// @param[in] alpha damping factor (as for LSQR), zero means minimal regularisation
+/// sufficient to handle degeneracies (e.g. the absolute phase)
+/// @param[in] nThreads number of threads used to solve the blocks
+BlockDiagonalCalSolver::BlockDiagonalCalSolver(double alpha, casacore::uInt nThreads) :
+     itsAlpha(alpha), itsNThreads(nThreads)
+{
+  ASKAPCHECK(itsAlpha >= 0., "Damping factor is supposed to be non-negative, you have "<<itsAlpha);
+  ASKAPCHECK(itsNThreads > 0, "Number of threads is supposed to be a positive number");
+}
+
+/// @brief initialise the solver
+/// @details Normal equations are reset.
+void BlockDiagonalCalSolver::init()
+{
+  resetNormalEquations();
+}
+
+/// @brief clone the solver
+/// @return shared pointer to a copy of this solver
+scimath::Solver::ShPtr BlockDiagonalCalSolver::clone() const
+{
+  return scimath::Solver::ShPtr(new BlockDiagonalCalSolver(*this));
+}
+
+/// @brief obtain the key of the block a parameter belongs to
+/// @details The key is the beam index and the channel (zero for frequency-independent
+/// parameters).
+/// @param[in] name parameter name
+/// @return pair of beam and channel
+std::pair<casacore::uInt, casacore::uInt> BlockDiagonalCalSolver::blockKey(const std::string &name)
+{
+  std::string baseName = name;
+  casacore::uInt chan = 0;
+  if (accessors::CalParamNameHelper::bpParam(baseName)) {
+      const std::pair<casacore::uInt, std::string> chanInfo = accessors::CalParamNameHelper::extractChannelInfo(baseName);
+      chan = chanInfo.first;
+      baseName = chanInfo.second;
+  }
+  const casacore::uInt beam = accessors::CalParamNameHelper::parseParam(baseName).first.beam();
+  return std::make_pair(beam, chan);
+}
+
+/// @brief setup block layout for the given free parameters
+/// @details Storage is reused if the layout has not changed.
+/// @param[in] params model
+/// @param[in] names free parameters
+void BlockDiagonalCalSolver::setupBlocks(const scimath::Params &params, const std::vector<std::string> &names)
+{
+  if (names == itsLayoutNames) {
+      return;
+  }
+  std::map<std::pair<casacore::uInt, casacore::uInt>, size_t> blockIndices;
+  itsBlocks.clear();
+  for (std::vector<std::string>::const_iterator ci = names.begin(); ci != names.end(); ++ci) {
+       const std::pair<casacore::uInt, casacore::uInt> key = blockKey(*ci);
+       std::map<std::pair<casacore::uInt, casacore::uInt>, size_t>::const_iterator it = blockIndices.find(key);
+       size_t index = itsBlocks.size();
+       if (it == blockIndices.end()) {
+           blockIndices[key] = index;
+           itsBlocks.push_back(Block());
+           itsBlocks.back().itsSize = 0;
+           itsBlocks.back().itsCond = 0.;
+       } else {
+           index = it->second;
+       }
+       Block &block = itsBlocks[index];
+       block.itsNames.push_back(*ci);
+       block.itsOffsets.push_back(block.itsSize);
+       block.itsSize += params.value(*ci).nelements();
+  }
+  for (std::vector<Block>::iterator it = itsBlocks.begin(); it != itsBlocks.end(); ++it) {
+       const size_t n = it->itsSize;
+       it->itsMatrix.resize(n * n);
+       it->itsFactor.resize(n * n);
+       it->itsData.resize(n);
+       it->itsSolution.resize(n);
+  }
+  itsLayoutNames = names;
+  ASKAPLOG_DEBUG_STR(logger, "Set up "<<itsBlocks.size()<<" blocks for "<<names.size()<<" free parameters");
+}
+
+/// @brief fill and solve one block
+/// @param[in] block block to work with
+/// @param[in] ne normal equations
+void BlockDiagonalCalSolver::solveBlock(Block &block, const scimath::INormalEquations &ne) const
+{
+  const size_t n = block.itsSize;
+  const size_t nParams = block.itsNames.size();
+  double *matrix = n > 0 ? &block.itsMatrix[0] : 0;
+  double *factor = n > 0 ? &block.itsFactor[0] : 0;
+  double *data = n > 0 ? &block.itsData[0] : 0;
+  double *solution = n > 0 ? &block.itsSolution[0] : 0;
+  std::fill(block.itsMatrix.begin(), block.itsMatrix.end(), 0.);
+  std::fill(block.itsData.begin(), block.itsData.end(), 0.);
+
+  // copy the block of the normal equations into dense storage, parameters without data stay zero
+  ASKAPDEBUGASSERT(block.itsHasData.size() == nParams);
+  for (size_t p1 = 0; p1 < nParams; ++p1) {
+       if (!block.itsHasData[p1]) {
+           continue;
+       }
+       const casacore::Vector<double> &dv = ne.dataVector(block.itsNames[p1]);
+       const size_t offset1 = block.itsOffsets[p1];
+       for (size_t i = 0; i < dv.nelements(); ++i) {
+            data[offset1 + i] = dv[i];
+       }
+       for (size_t p2 = 0; p2 < nParams; ++p2) {
+            if (!block.itsHasData[p2]) {
+                continue;
+            }
+            const casacore::Matrix<double> &nm = ne.normalMatrix(block.itsNames[p1], block.itsNames[p2]);
+            const size_t offset2 = block.itsOffsets[p2];
+            for (size_t row = 0; row < nm.nrow(); ++row) {
+                 for (size_t col = 0; col < nm.ncolumn(); ++col) {
+                      matrix[(offset1 + row) * n + offset2 + col] = nm(row, col);
+                 }
+            }
+       }
+  }
+
+  // damped least squares: (N^T N + alpha^2 I) x = N^T b, N is symmetric
+  double maxDiag = 0.;
+  for (size_t i = 0; i < n; ++i) {
+       for (size_t j = 0; j <= i; ++j) {
+            double sum = 0.;
+            for (size_t k = 0; k < n; ++k) {
+                 sum += matrix[k * n + i] * matrix[k * n + j];
+            }
+            factor[i * n + j] = sum;
+       }
+       double rhs = 0.;
+       for (size_t k = 0; k < n; ++k) {
+            rhs += matrix[k * n + i] * data[k];
+       }
+       solution[i] = rhs;
+       maxDiag = std::max(maxDiag, factor[i * n + i]);
+  }
+  block.itsCond = 0.;
+  if (maxDiag <= 0.) {
+      // no data for this block, nothing to update
+      std::fill(block.itsSolution.begin(), block.itsSolution.end(), 0.);
+      return;
+  }
+  // without damping, use a tiny ridge to deal with degeneracies, e.g. the absolute phase
+  const double ridge = itsAlpha > 0. ? itsAlpha * itsAlpha : 1e-12 * maxDiag;
+  for (size_t i = 0; i < n; ++i) {
+       factor[i * n + i] += ridge;
+  }
+
+  // in-place Cholesky decomposition (lower triangle)
+  double minPivot = -1., maxPivot = 0.;
+  for (size_t j = 0; j < n; ++j) {
+       double sum = factor[j * n + j];
+       for (size_t k = 0; k < j; ++k) {
+            sum -= factor[j * n + k] * factor[j * n + k];
+       }
+       ASKAPCHECK(sum > 0., "Cholesky decomposition failed for the block containing "<<block.itsNames[0]);
+       const double pivot = sqrt(sum);
+       factor[j * n + j] = pivot;
+       minPivot = (minPivot < 0.) ? pivot : std::min(minPivot, pivot);
+       maxPivot = std::max(maxPivot, pivot);
+       for (size_t i = j + 1; i < n; ++i) {
+            double val = factor[i * n + j];
+            for (size_t k = 0; k < j; ++k) {
+                 val -= factor[i * n + k] * factor[j * n + k];
+            }
+            factor[i * n + j] = val / pivot;
+       }
+  }
+  block.itsCond = (maxPivot / minPivot) * (maxPivot / minPivot);
+
+  // forward and back substitution
+  for (size_t i = 0; i < n; ++i) {
+       double val = solution[i];
+       for (size_t k = 0; k < i; ++k) {
+            val -= factor[i * n + k] * solution[k];
+       }
+       solution[i] = val / factor[i * n + i];
+  }
+  for (size_t i = n; i > 0; --i) {
+       const size_t row = i - 1;
+       double val = solution[row];
+       for (size_t k = row + 1; k < n; ++k) {
+            val -= factor[k * n + row] * solution[k];
+       }
+       solution[row] = val / factor[row * n + row];
+  }
+}
+
+/// @brief solve a subset of blocks (runs in a thread)
+/// @details Every step'th block starting from first is processed. Any exception is
+/// caught and its message is returned via error.
+/// @param[in] first index of the first block to process
+/// @param[in] step increment of the block index
+/// @param[out] error error message, empty if no error occurred
+void BlockDiagonalCalSolver::solveBlocks(const size_t first, const size_t step, std::string &error)
+{
+  ASKAPDEBUGASSERT(step > 0);
+  try {
+     const scimath::INormalEquations &ne = normalEquations();
+     for (size_t i = first; i < itsBlocks.size(); i += step) {
+          solveBlock(itsBlocks[i], ne);
+     }
+  }
+  catch (const std::exception &ex) {
+     error = ex.what();
+  }
+}
+
+/// @brief solve for parameters
+/// @details The solution (increments) is added to the free parameters of the model.
+/// @param[in] params model to update
+/// @param[out] quality solution quality information
+/// @return true, if successful
+bool BlockDiagonalCalSolver::solveNormalEquations(scimath::Params& params, scimath::Quality& quality)
+{
+  const std::vector<std::string> names(params.freeNames());
+  if (names.size() == 0) {
+      return true;
+  }
+  setupBlocks(params, names);
+  // the set of parameters with data can change even if the layout does not
+  const std::vector<std::string> unknowns = normalEquations().unknowns();
+  const std::set<std::string> known(unknowns.begin(), unknowns.end());
+  for (std::vector<Block>::iterator it = itsBlocks.begin(); it != itsBlocks.end(); ++it) {
+       it->itsHasData.resize(it->itsNames.size());
+       for (size_t p = 0; p < it->itsNames.size(); ++p) {
+            it->itsHasData[p] = (known.find(it->itsNames[p]) != known.end());
+       }
+  }
+
+  const size_t nThreads = std::min(static_cast<size_t>(itsNThreads), itsBlocks.size());
+  std::vector<std::string> errors(nThreads);
+  if (nThreads == 1) {
+      solveBlocks(0, 1, errors[0]);
+  } else {
+      boost::thread_group threads;
+      for (size_t thread = 0; thread < nThreads; ++thread) {
+           threads.create_thread(boost::bind(&BlockDiagonalCalSolver::solveBlocks, this, thread, nThreads,
+                     boost::ref(errors[thread])));
+      }
+      threads.join_all();
+  }
+  for (size_t thread = 0; thread < nThreads; ++thread) {
+       ASKAPCHECK(errors[thread].size() == 0, "Block-diagonal solution failed: "<<errors[thread]);
+  }
+
+  // update the model
+  size_t nUnknowns = 0;
+  double maxCond = 0.;
+  for (std::vector<Block>::const_iterator it = itsBlocks.begin(); it != itsBlocks.end(); ++it) {
+       for (size_t p = 0; p < it->itsNames.size(); ++p) {
+            casacore::Array<double> value = params.value(it->itsNames[p]).copy();
+            double *valuePtr = value.data();
+            for (size_t i = 0; i < value.nelements(); ++i) {
+                 valuePtr[i] += it->itsSolution[it->itsOffsets[p] + i];
+            }
+            params.update(it->itsNames[p], value);
+       }
+       nUnknowns += it->itsSize;
+       maxCond = std::max(maxCond, it->itsCond);
+  }
+  quality.setDOF(nUnknowns);
+  quality.setRank(nUnknowns);
+  quality.setCond(maxCond);
+  std::ostringstream os;
+  os<<"Block-diagonal damped least squares with "<<itsBlocks.size()<<" blocks, alpha="<<itsAlpha;
+  quality.setInfo(os.str());
+  return true;
+}
+
+} // namespace synthesis
+
+} // namespace askap
+
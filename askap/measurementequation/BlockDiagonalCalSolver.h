@@ -0,0 +1,156 @@
+/// @file
+///
+/// @brief solver for calibration normal equations with block-diagonal structure
+/// @details Calibration normal equations decompose into independent blocks: unknowns
+/// of different beams are not coupled (unless beam-independent effects are solved for)
+/// and neither are unknowns of different spectral channels in the bandpass case.
+/// This solver groups free parameters into such blocks, copies each block of the normal
+/// matrix into preallocated dense storage and solves the blocks independently (and
+/// concurrently, if requested). Each block is solved directly for the damped least
+/// squares problem LSQR solves iteratively: min |N x - b|^2 + alpha^2 |x|^2, where
+/// N is the normal matrix block and b is the data vector. The cost therefore grows
+/// linearly with the number of beams and channels.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+
+#ifndef BLOCK_DIAGONAL_CAL_SOLVER_H
+#define BLOCK_DIAGONAL_CAL_SOLVER_H
+
+// own includes
+#include <askap/scimath/fitting/Solver.h>
+#include <askap/scimath/fitting/Params.h>
+#include <askap/scimath/fitting/Quality.h>
+#include <askap/scimath/fitting/INormalEquations.h>
+
+// casa includes
+#include <casacore/casa/aips.h>
+
+// std includes
+#include <string>
+#include <vector>
+#include <utility>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief solver for calibration normal equations with block-diagonal structure
+/// @details Free parameters are grouped by beam and, for bandpass parameters, by
+/// spectral channel. The normal matrix is assumed to have no cross terms between
+/// the groups (cross terms, if present, are ignored). Each block is solved directly
+/// via Cholesky decomposition of N^T N + alpha^2 I, which gives the same solution as
+/// LSQR with damping alpha converges to. The block layout and storage are kept between
+/// calls as long as the set of free parameters does not change.
+/// @ingroup measurementequation
+class BlockDiagonalCalSolver : public scimath::Solver {
+public:
+  /// @brief constructor
+  /// @param[in] alpha damping factor (as for LSQR), zero means minimal regularisation
+  /// sufficient to handle degeneracies (e.g. the absolute phase)
+  /// @param[in] nThreads number of threads used to solve the blocks
+  explicit BlockDiagonalCalSolver(double alpha = 0.01, casacore::uInt nThreads = 1);
+
+  /// @brief initialise the solver
+  /// @details Normal equations are reset.
+  virtual void init();
+
+  /// @brief solve for parameters
+  /// @details The solution (increments) is added to the free parameters of the model.
+  /// @param[in] params model to update
+  /// @param[out] quality solution quality information
+  /// @return true, if successful
+  virtual bool solveNormalEquations(scimath::Params& params, scimath::Quality& quality);
+
+  /// @brief clone the solver
+  /// @return shared pointer to a copy of this solver
+  virtual scimath::Solver::ShPtr clone() const;
+
+  /// @brief obtain the key of the block a parameter belongs to
+  /// @details The key is the beam index and the channel (zero for frequency-independent
+  /// parameters).
+  /// @param[in] name parameter name
+  /// @return pair of beam and channel
+  static std::pair<casacore::uInt, casacore::uInt> blockKey(const std::string &name);
+
+private:
+
+  /// @brief one block of unknowns
+  struct Block {
+     /// @brief names of parameters in the block
+     std::vector<std::string> itsNames;
+     /// @brief offset of each parameter in the vector of unknowns of the block
+     std::vector<size_t> itsOffsets;
+     /// @brief true for parameters present in the normal equations
+     std::vector<bool> itsHasData;
+     /// @brief number of unknowns in the block
+     size_t itsSize;
+     /// @brief normal matrix block (row-major)
+     std::vector<double> itsMatrix;
+     /// @brief matrix of the damped least squares problem and its Cholesky factor (row-major)
+     std::vector<double> itsFactor;
+     /// @brief data vector block
+     std::vector<double> itsData;
+     /// @brief right hand side of the damped problem, then solution
+     std::vector<double> itsSolution;
+     /// @brief ratio of the largest and smallest diagonal elements of the factor, squared
+     double itsCond;
+  };
+
+  /// @brief setup block layout for the given free parameters
+  /// @details Storage is reused if the layout has not changed.
+  /// @param[in] params model
+  /// @param[in] names free parameters
+  void setupBlocks(const scimath::Params &params, const std::vector<std::string> &names);
+
+  /// @brief solve a subset of blocks (runs in a thread)
+  /// @details Every step'th block starting from first is processed. Any exception is
+  /// caught and its message is returned via error.
+  /// @param[in] first index of the first block to process
+  /// @param[in] step increment of the block index
+  /// @param[out] error error message, empty if no error occurred
+  void solveBlocks(const size_t first, const size_t step, std::string &error);
+
+  /// @brief fill and solve one block
+  /// @param[in] block block to work with
+  /// @param[in] ne normal equations
+  void solveBlock(Block &block, const scimath::INormalEquations &ne) const;
+
+  /// @brief damping factor
+  double itsAlpha;
+
+  /// @brief number of threads
+  casacore::uInt itsNThreads;
+
+  /// @brief free parameters corresponding to the current block layout
+  std::vector<std::string> itsLayoutNames;
+
+  /// @brief blocks of unknowns
+  std::vector<Block> itsBlocks;
+};
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef BLOCK_DIAGONAL_CAL_SOLVER_H
+
@@ -0,0 +1,214 @@
+/// @file
+///
+/// @brief in-memory cache of calibration solutions shared between threads
+/// @details Calibration solution sources are queried per chunk of data. For table-based
+/// sources this means a search in the table every time the time changes and re-reading of
+/// the solution when the solution ID changes. This class wraps an arbitrary solution source
+/// and keeps all solutions obtained from it in memory. Solution IDs are cached per time
+/// interval and looked up with a binary search, Jones matrices are stored in contiguous
+/// per antenna/beam arrays (indexed by channel). One instance of this class can be shared
+/// between all calibration applicators of a process, all methods are thread safe.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+
+#include <askap/measurementequation/CalSolutionCache.h>
+#include <askap/AskapError.h>
+
+#include <algorithm>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief construct the cache for the given solution source
+/// @param[in] src solution source to wrap
+/// @param[in] ioMutex optional mutex locked while the underlying source is accessed. It can be
+/// shared with other threads doing table access (casacore is not thread safe)
+CalSolutionCache::CalSolutionCache(const boost::shared_ptr<accessors::ICalSolutionConstSource> &src,
+                                   const boost::shared_ptr<boost::mutex> &ioMutex) :
+     itsSource(src), itsIOMutex(ioMutex)
+{
+  ASKAPCHECK(itsSource, "An attempt to initialise CalSolutionCache with a void calibration solution source shared pointer");
+}
+
+/// @brief obtain ID for the most recent solution
+/// @return ID for the most recent solution
+long CalSolutionCache::mostRecentSolution() const
+{
+  boost::mutex::scoped_lock lock(itsMutex);
+  boost::unique_lock<boost::mutex> ioLock;
+  if (itsIOMutex) {
+      ioLock = boost::unique_lock<boost::mutex>(*itsIOMutex);
+  }
+  return itsSource->mostRecentSolution();
+}
+
+/// @brief helper predicate for the binary search of intervals
+/// @param[in] time time stamp
+/// @param[in] interval interval to compare with
+/// @return true, if the interval starts after the given time
+bool CalSolutionCache::startsAfter(const double time, const Interval &interval)
+{
+  return time < interval.itsStart;
+}
+
+/// @brief obtain solution ID for a given time
+/// @details The intervals of time with known solution ID are searched first,
+/// the underlying source is only queried if the given time is outside of
+/// these intervals.
+/// @param[in] time time stamp in seconds since MJD of 0.
+/// @return solution ID
+long CalSolutionCache::solutionID(const double time) const
+{
+  boost::mutex::scoped_lock lock(itsMutex);
+  // first interval which starts after the given time
+  std::vector<Interval>::iterator next = std::upper_bound(itsIntervals.begin(), itsIntervals.end(), time,
+                                                          CalSolutionCache::startsAfter);
+  if ((next != itsIntervals.begin()) && (time <= (next - 1)->itsEnd)) {
+      return (next - 1)->itsID;
+  }
+
+  long id = 0;
+  {
+    boost::unique_lock<boost::mutex> ioLock;
+    if (itsIOMutex) {
+        ioLock = boost::unique_lock<boost::mutex>(*itsIOMutex);
+    }
+    id = itsSource->solutionID(time);
+  }
+  // extend or join neighbouring intervals with the same ID, IDs are assumed to be non-decreasing with time
+  bool merged = false;
+  if ((next != itsIntervals.begin()) && ((next - 1)->itsID == id)) {
+      (next - 1)->itsEnd = time;
+      merged = true;
+  }
+  if ((next != itsIntervals.end()) && (next->itsID == id)) {
+      if (merged) {
+          (next - 1)->itsEnd = next->itsEnd;
+          itsIntervals.erase(next);
+      } else {
+          next->itsStart = time;
+          merged = true;
+      }
+  }
+  if (!merged) {
+      Interval interval;
+      interval.itsStart = time;
+      interval.itsEnd = time;
+      interval.itsID = id;
+      itsIntervals.insert(next, interval);
+  }
+  return id;
+}
+
+/// @brief obtain cached solution for the given ID
+/// @details The mutex should be locked before calling this method
+/// @param[in] id solution ID
+/// @return reference to the cached solution
+CalSolutionCache::CachedSolution& CalSolutionCache::cachedSolution(const long id) const
+{
+  CachedSolution &sol = itsSolutions[id];
+  if (!sol.itsAccessor) {
+      boost::unique_lock<boost::mutex> ioLock;
+      if (itsIOMutex) {
+          ioLock = boost::unique_lock<boost::mutex>(*itsIOMutex);
+      }
+      sol.itsAccessor = itsSource->roSolution(id);
+      ASKAPCHECK(sol.itsAccessor, "Solution source returned a void accessor for solution ID = "<<id);
+  }
+  return sol;
+}
+
+/// @brief obtain read-only accessor for a given solution ID
+/// @details The accessor is obtained from the underlying source once per ID.
+/// @param[in] id solution ID to read
+/// @return shared pointer to an accessor object
+boost::shared_ptr<accessors::ICalSolutionConstAccessor> CalSolutionCache::roSolution(const long id) const
+{
+  boost::mutex::scoped_lock lock(itsMutex);
+  return cachedSolution(id).itsAccessor;
+}
+
+/// @brief obtain Jones matrix and its validity flag
+/// @details This is the equivalent of jonesAndValidity method of the solution accessor
+/// for the given solution ID, but the result is served from the cache.
+/// @param[in] id solution ID
+/// @param[in] ant antenna index
+/// @param[in] beam beam index
+/// @param[in] chan spectral channel
+/// @return pair of the Jones matrix and the validity flag
+std::pair<casacore::SquareMatrix<casacore::Complex, 2>, bool> CalSolutionCache::jonesAndValidity(const long id,
+             const casacore::uInt ant, const casacore::uInt beam, const casacore::uInt chan) const
+{
+  boost::mutex::scoped_lock lock(itsMutex);
+  CachedSolution &sol = cachedSolution(id);
+  std::vector<CachedJones> &channels = sol.itsJones[std::make_pair(ant, beam)];
+  if (channels.size() <= chan) {
+      // read all channels up to the requested one, so the array is always contiguous
+      boost::unique_lock<boost::mutex> ioLock;
+      if (itsIOMutex) {
+          ioLock = boost::unique_lock<boost::mutex>(*itsIOMutex);
+      }
+      channels.reserve(chan + 1);
+      for (casacore::uInt ch = channels.size(); ch <= chan; ++ch) {
+           const std::pair<casacore::SquareMatrix<casacore::Complex, 2>, bool> jv =
+                 sol.itsAccessor->jonesAndValidity(ant, beam, ch);
+           CachedJones entry;
+           entry.itsValid = jv.second;
+           const casacore::SquareMatrix<casacore::Complex, 2> &jones = jv.first;
+           entry.itsJones[0] = jones(0,0);
+           entry.itsJones[1] = jones(0,1);
+           entry.itsJones[2] = jones(1,0);
+           entry.itsJones[3] = jones(1,1);
+           channels.push_back(entry);
+      }
+  }
+  const CachedJones &entry = channels[chan];
+  casacore::SquareMatrix<casacore::Complex, 2> jones(casacore::SquareMatrix<casacore::Complex, 2>::General);
+  jones(0,0) = entry.itsJones[0];
+  jones(0,1) = entry.itsJones[1];
+  jones(1,0) = entry.itsJones[2];
+  jones(1,1) = entry.itsJones[3];
+  return std::pair<casacore::SquareMatrix<casacore::Complex, 2>, bool>(jones, entry.itsValid);
+}
+
+/// @brief number of solutions held in memory
+/// @return number of solutions (for diagnostics and tests)
+size_t CalSolutionCache::nSolutions() const
+{
+  boost::mutex::scoped_lock lock(itsMutex);
+  return itsSolutions.size();
+}
+
+/// @brief number of intervals with known solution ID
+/// @return number of intervals (for diagnostics and tests)
+size_t CalSolutionCache::nIntervals() const
+{
+  boost::mutex::scoped_lock lock(itsMutex);
+  return itsIntervals.size();
+}
+
+} // namespace synthesis
+
+} // namespace askap
+
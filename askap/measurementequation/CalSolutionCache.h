@@ -0,0 +1,176 @@
+/// @file
+///
+/// @brief in-memory cache of calibration solutions shared between threads
+/// @details Calibration solution sources are queried per chunk of data. For table-based
+/// sources this means a search in the table every time the time changes and re-reading of
+/// the solution when the solution ID changes. This class wraps an arbitrary solution source
+/// and keeps all solutions obtained from it in memory. Solution IDs are cached per time
+/// interval and looked up with a binary search, Jones matrices are stored in contiguous
+/// per antenna/beam arrays (indexed by channel). One instance of this class can be shared
+/// between all calibration applicators of a process, all methods are thread safe.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+
+#ifndef CAL_SOLUTION_CACHE_H
+#define CAL_SOLUTION_CACHE_H
+
+// own includes
+#include <askap/calibaccess/ICalSolutionConstSource.h>
+#include <askap/calibaccess/ICalSolutionConstAccessor.h>
+
+// casa includes
+#include <casacore/casa/BasicSL/Complex.h>
+#include <casacore/scimath/Mathematics/SquareMatrix.h>
+
+// boost includes
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+// std includes
+#include <map>
+#include <vector>
+#include <utility>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief in-memory cache of calibration solutions shared between threads
+/// @details This class is a decorator of an arbitrary solution source. Apart from
+/// the standard source interface (results are cached), it provides direct access to
+/// Jones matrices for a given solution ID which is used by CalibrationSolutionHandler
+/// (and therefore all calibration applicators) if the solution source is of this type.
+/// The lookup of solution IDs assumes that the ID of the underlying source is a
+/// non-decreasing step function of time (true for table and parset-based sources),
+/// so all times between two queries which gave the same ID are mapped to this ID
+/// without querying the underlying source. Jones matrices are read from the underlying
+/// accessor once per antenna, beam and channel.
+/// @ingroup measurementequation
+class CalSolutionCache : public accessors::ICalSolutionConstSource {
+public:
+  /// @brief construct the cache for the given solution source
+  /// @param[in] src solution source to wrap
+  /// @param[in] ioMutex optional mutex locked while the underlying source is accessed. It can be
+  /// shared with other threads doing table access (casacore is not thread safe)
+  explicit CalSolutionCache(const boost::shared_ptr<accessors::ICalSolutionConstSource> &src,
+                            const boost::shared_ptr<boost::mutex> &ioMutex = boost::shared_ptr<boost::mutex>());
+
+  /// @brief obtain ID for the most recent solution
+  /// @return ID for the most recent solution
+  virtual long mostRecentSolution() const;
+
+  /// @brief obtain solution ID for a given time
+  /// @details The intervals of time with known solution ID are searched first,
+  /// the underlying source is only queried if the given time is outside of
+  /// these intervals.
+  /// @param[in] time time stamp in seconds since MJD of 0.
+  /// @return solution ID
+  virtual long solutionID(const double time) const;
+
+  /// @brief obtain read-only accessor for a given solution ID
+  /// @details The accessor is obtained from the underlying source once per ID.
+  /// @param[in] id solution ID to read
+  /// @return shared pointer to an accessor object
+  virtual boost::shared_ptr<accessors::ICalSolutionConstAccessor> roSolution(const long id) const;
+
+  /// @brief obtain Jones matrix and its validity flag
+  /// @details This is the equivalent of jonesAndValidity method of the solution accessor
+  /// for the given solution ID, but the result is served from the cache.
+  /// @param[in] id solution ID
+  /// @param[in] ant antenna index
+  /// @param[in] beam beam index
+  /// @param[in] chan spectral channel
+  /// @return pair of the Jones matrix and the validity flag
+  std::pair<casacore::SquareMatrix<casacore::Complex, 2>, bool> jonesAndValidity(const long id,
+             const casacore::uInt ant, const casacore::uInt beam, const casacore::uInt chan) const;
+
+  /// @brief number of solutions held in memory
+  /// @return number of solutions (for diagnostics and tests)
+  size_t nSolutions() const;
+
+  /// @brief number of intervals with known solution ID
+  /// @return number of intervals (for diagnostics and tests)
+  size_t nIntervals() const;
+
+private:
+
+  /// @brief time interval with known solution ID
+  struct Interval {
+     /// @brief start of the interval (inclusive)
+     double itsStart;
+     /// @brief end of the interval (inclusive)
+     double itsEnd;
+     /// @brief solution ID valid for all times in the interval
+     long itsID;
+  };
+
+  /// @brief Jones matrix and its validity flag for one antenna, beam and channel
+  struct CachedJones {
+     /// @brief elements of the Jones matrix (row-major order)
+     casacore::Complex itsJones[4];
+     /// @brief validity flag
+     bool itsValid;
+  };
+
+  /// @brief all cached information for one solution ID
+  struct CachedSolution {
+     /// @brief accessor of the underlying source
+     boost::shared_ptr<accessors::ICalSolutionConstAccessor> itsAccessor;
+     /// @brief Jones matrices for each antenna/beam pair indexed by channel
+     std::map<std::pair<casacore::uInt, casacore::uInt>, std::vector<CachedJones> > itsJones;
+  };
+
+  /// @brief helper predicate for the binary search of intervals
+  /// @param[in] time time stamp
+  /// @param[in] interval interval to compare with
+  /// @return true, if the interval starts after the given time
+  static bool startsAfter(const double time, const Interval &interval);
+
+  /// @brief obtain cached solution for the given ID
+  /// @details The mutex should be locked before calling this method
+  /// @param[in] id solution ID
+  /// @return reference to the cached solution
+  CachedSolution& cachedSolution(const long id) const;
+
+  /// @brief underlying solution source
+  boost::shared_ptr<accessors::ICalSolutionConstSource> itsSource;
+
+  /// @brief time intervals with known solution IDs sorted by the start time
+  mutable std::vector<Interval> itsIntervals;
+
+  /// @brief solutions obtained so far
+  mutable std::map<long, CachedSolution> itsSolutions;
+
+  /// @brief mutex protecting the cache and the underlying source
+  mutable boost::mutex itsMutex;
+
+  /// @brief optional mutex serialising access to the underlying source with other table access
+  boost::shared_ptr<boost::mutex> itsIOMutex;
+};
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef CAL_SOLUTION_CACHE_H
+
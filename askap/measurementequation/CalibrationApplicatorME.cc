@@ -49,6 +49,12 @@
 ASKAP_LOGGER(logger, ".measurementequation");
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+#include <algorithm>
+#include <exception>
 
 namespace askap {
 
@@ -59,7 +65,7 @@ namespace synthesis {
 /// @param[in] src calibration solution source to work with
 CalibrationApplicatorME::CalibrationApplicatorME(const boost::shared_ptr<accessors::ICalSolutionConstSource> &src) :
      CalibrationSolutionHandler(src), itsScaleNoise(false), itsFlagAllowed(false), itsBeamIndependent(false),
-     itsChannelIndependent(false)
+     itsChannelIndependent(false), itsNThreads(1u), itsTableNAnt(0u), itsTableNBeam(0u), itsTableNChan(0u)
 {}
 
 /// @brief correct model visibilities for one accessor (chunk).
@@ -134,19 +140,19 @@ void CalibrationApplicatorME::correct(accessors::IDataAccessor &chunk) const
                 solutionAccessorNeedsTime = false;
                 updateAccessor(chunk.time());
             }
-            const bool validSolution =  calSolution().jonesValid(antenna1[row],
-                     itsBeamIndependent ? 0 : beam1[row], chan) && 
-                     calSolution().jonesValid(antenna2[row], itsBeamIndependent ? 0 : beam2[row], chan);
+            const std::pair<casacore::SquareMatrix<casacore::Complex, 2>, bool> jv1 =
+                     jonesAndValidity(antenna1[row], itsBeamIndependent ? 0 : beam1[row], chan);
+            const std::pair<casacore::SquareMatrix<casacore::Complex, 2>, bool> jv2 =
+                     jonesAndValidity(antenna2[row], itsBeamIndependent ? 0 : beam2[row], chan);
+            const bool validSolution = jv1.second && jv2.second;
 
             //ASKAPLOG_DEBUG_STR(logger, "row = "<<row<<" chan = "<<chan<<" ant1 = "<<antenna1[row]<<" ant2 = "<<antenna2[row]<<
             //            " beam = "<<beam1[row]<<" allFlagged: "<<allFlagged<<" needFlag: "<<needFlag<<" validSolution: "<<validSolution);
             casacore::Complex det = 0.;
  
             if (validSolution) {
-                casacore::SquareMatrix<casacore::Complex, 2> jones1 = calSolution().jones(antenna1[row],
-                                  itsBeamIndependent ? 0 : beam1[row], chan);
-                casacore::SquareMatrix<casacore::Complex, 2> jones2 = calSolution().jones(antenna2[row],
-                                  itsBeamIndependent ? 0 : beam2[row], chan);
+                const casacore::SquareMatrix<casacore::Complex, 2> &jones1 = jv1.first;
+                const casacore::SquareMatrix<casacore::Complex, 2> &jones2 = jv2.first;
                 for (casacore::uInt i = 0; i < nPol; ++i) {
                      for (casacore::uInt j = 0; j < nPol; ++j) {
                           const casacore::uInt index1 = indices(i);
@@ -212,21 +218,19 @@ void CalibrationApplicatorME::correct(accessors::IDataAccessor &chunk) const
 /// (accessed via rwVisibility) for the calibration errors
 /// represented by this measurement equation (i.e. an inversion of
 /// the matrix has been performed).
-/// This is an optimized version for data with exactly 4 polarizations
+/// This is an optimized version for data with exactly 4 polarizations.
+/// Inverse Jones matrices are taken from the table updated once per solution interval
+/// and rows are optionally split between several threads.
 /// @param[in] chunk a read-write accessor to work with
 void CalibrationApplicatorME::correct4(accessors::IDataAccessor &chunk) const
 {
-  const casacore::uInt nPol = chunk.nPol();
-  ASKAPDEBUGASSERT(nPol == 4);
+  ASKAPDEBUGASSERT(chunk.nPol() == 4);
 
+  // get all references in this thread, accessors are not thread safe
   casacore::Cube<casacore::Complex>& rwVis = chunk.rwVisibility();
-  casacore::Cube<casacore::Bool> rwFlag;
   ASKAPDEBUGASSERT(rwVis.nelements());
-  bool solutionAccessorNeedsTime = true;
-  const casa::Vector<casa::uInt>& antenna1 = chunk.antenna1();
-  const casa::Vector<casa::uInt>& antenna2 = chunk.antenna2();
-  const casa::Vector<casa::uInt>& beam1 = chunk.feed1();
-  const casa::Vector<casa::uInt>& beam2 = chunk.feed2();
+  casacore::Cube<casacore::Bool> rwFlag;
+  casacore::Cube<casacore::Complex> rwNoise;
 
   boost::shared_ptr<accessors::IFlagAndNoiseDataAccessor> noiseAndFlagDA;
   // attempt to cast interface only if we need it
@@ -234,119 +238,231 @@ void CalibrationApplicatorME::correct4(accessors::IDataAccessor &chunk) const
       boost::shared_ptr<accessors::IDataAccessor> chunkPtr(&chunk, utility::NullDeleter());
       ASKAPDEBUGASSERT(chunkPtr);
       noiseAndFlagDA = boost::dynamic_pointer_cast<accessors::IFlagAndNoiseDataAccessor>(chunkPtr);
-      rwFlag.reference(noiseAndFlagDA->rwFlag());
+      if (itsFlagAllowed) {
+          ASKAPCHECK(noiseAndFlagDA, "Accessor type passed to CalibrationApplicatorME does not support change of flags");
+          rwFlag.reference(noiseAndFlagDA->rwFlag());
+      }
+      if (itsScaleNoise) {
+          ASKAPCHECK(noiseAndFlagDA, "Accessor type passed to CalibrationApplicatorME does not support change of the noise estimate");
+          rwNoise.reference(noiseAndFlagDA->rwNoise());
+      }
   }
   // MV: we can do something more clever, but accessing original read-only flags is not too bad
   // it will be the same as rwFlag above by reference
   const casacore::Cube<casacore::Bool> &flag = chunk.flag();
 
-  casa::SquareMatrix<casa::Complex, 4> mueller;
-  const float detThreshold = 1e-25;
-
-  casa::uInt nChan = chunk.nChannel();
-  casa::uInt nRow = chunk.nRow();
-  casa::RigidVector<casa::Complex,4> vis;
-
-  for (casa::uInt row = 0; row < nRow; ++row) {
-    bool needMueller = true;
-    bool validSolution = false;
-    casa::Float det = 0.;
-    for (casa::uInt chan = 0; chan < nChan; ++chan) {
-        bool allFlagged = true;
-        // we don't really support partial polarisation flagging, but to avoid nasty surprises it is better to flag such samples completely.
-        bool needFlag = false;
-        //ASKAPDEBUGASSERT(thisRowFlag.ncolumn() == nPol);
-        for (casa::uInt pol = 0; pol < nPol; ++pol) {
-             if (flag(row,chan,pol)) {
-                 needFlag = true;
-             } else {
-                 allFlagged = false;
-             }
-        }
-        // don't bother with the rest of processing if the sample is flagged anyway in its entirety
-        if (allFlagged) {
-            continue;
-        }
-
-        if (!itsChannelIndependent || needMueller) {
-            // we only need to fill the mueller matrix once in the non bandpass case
-            needMueller = false;
-            const int b1 = itsBeamIndependent ? 0 : beam1[row];
-            const int b2 = itsBeamIndependent ? 0 : beam2[row];
-            if (solutionAccessorNeedsTime) {
-                solutionAccessorNeedsTime = false;
-                updateAccessor(chunk.time());
-            }
-            std::pair<casa::SquareMatrix<casa::Complex, 2>, bool> jv1 =
-                calSolution().jonesAndValidity(antenna1[row], b1, chan);
-            std::pair<casa::SquareMatrix<casa::Complex, 2>, bool> jv2 =
-                calSolution().jonesAndValidity(antenna2[row], b2, chan);
-            validSolution = jv1.second && jv2.second;
-            if (validSolution) {
-                const casa::SquareMatrix<casa::Complex, 2>& j1 = jv1.first;
-                const casa::SquareMatrix<casa::Complex, 2>& j2 = jv2.first;
-                const casa::Complex det1 = j1(0,0)*j1(1,1)-j1(0,1)*j1(1,0);
-                const casa::Complex det2 = j2(0,0)*j2(1,1)-j2(0,1)*j2(1,0);
-                det = casa::real(det1*conj(det1))*casa::real(det2*conj(det2));
-                // Inverse of 4x4 mueller is directProduct of 2x2 jones inverses
-                if (det > detThreshold) {
-                    directProduct(mueller, j1.inverse(),conj(j2).inverse());
-                }
-            }
-        }
-        if (validSolution) {
-            for (casa::uInt pol = 0; pol < nPol; ++pol) {
-                vis(pol) = rwVis(row,chan,pol);
-            }
-        }
-
-        if (itsFlagAllowed) {
-            if (det <= detThreshold || !validSolution || needFlag) {
-                ASKAPCHECK(noiseAndFlagDA, "Accessor type passed to CalibrationApplicatorME does not support change of flags");
-                for (casa::uInt pol = 0; pol < nPol; ++pol) {
-                    rwFlag(row,chan,pol)=true;
-                    rwVis(row,chan,pol)=0.;
-                }
+  // don't bother with the solution if everything is flagged anyway
+  if (casacore::allTrue(flag)) {
+      return;
+  }
+  updateAccessor(chunk.time());
+  updateInverseJonesTable(chunk);
+
+  const casacore::uInt nRow = chunk.nRow();
+  const casacore::uInt nThreads = std::max(1u, std::min(itsNThreads, nRow));
+  std::vector<std::string> errors(nThreads);
+  if (nThreads == 1) {
+      correctRows(chunk, rwVis, flag, rwFlag, rwNoise, 0, nRow, errors[0]);
+  } else {
+      boost::thread_group threads;
+      for (casacore::uInt thread = 0; thread < nThreads; ++thread) {
+           const casacore::uInt startRow = static_cast<casacore::uInt>(static_cast<size_t>(nRow) * thread / nThreads);
+           const casacore::uInt endRow = static_cast<casacore::uInt>(static_cast<size_t>(nRow) * (thread + 1) / nThreads);
+           threads.create_thread(boost::bind(&CalibrationApplicatorME::correctRows, this, boost::cref(chunk),
+                  boost::ref(rwVis), boost::cref(flag), boost::ref(rwFlag), boost::ref(rwNoise), startRow, endRow,
+                  boost::ref(errors[thread])));
+      }
+      threads.join_all();
+  }
+  for (casacore::uInt thread = 0; thread < nThreads; ++thread) {
+       if (errors[thread].size() > 0) {
+           ASKAPTHROW(AskapError, errors[thread]);
+       }
+  }
+}
+
+/// @brief update the table of inverse Jones matrices
+/// @details The table covers all antennas, beams and channels (one channel if
+/// the channel-independent mode is used) found in the given chunk. It is rebuilt
+/// if the solution accessor has been changed or the shape of the data requires a bigger
+/// table. Entries are filled for every antenna/beam pair used in the chunk (if not done yet).
+/// The solution accessor should be updated for the time of the chunk before this method is called.
+/// @param[in] chunk accessor with the data to be corrected
+void CalibrationApplicatorME::updateInverseJonesTable(const accessors::IConstDataAccessor &chunk) const
+{
+  const casa::Vector<casa::uInt>& antenna1 = chunk.antenna1();
+  const casa::Vector<casa::uInt>& antenna2 = chunk.antenna2();
+  const casa::Vector<casa::uInt>& beam1 = chunk.feed1();
+  const casa::Vector<casa::uInt>& beam2 = chunk.feed2();
+
+  const casacore::uInt nChan = itsChannelIndependent ? 1u : chunk.nChannel();
+  casacore::uInt nAnt = 0;
+  casacore::uInt nBeam = 1;
+  for (casacore::uInt row = 0; row < chunk.nRow(); ++row) {
+       nAnt = std::max(nAnt, std::max(antenna1[row], antenna2[row]) + 1);
+       if (!itsBeamIndependent) {
+           nBeam = std::max(nBeam, std::max(beam1[row], beam2[row]) + 1);
+       }
+  }
+
+  const bool solutionChanged = (itsTableChangeMonitor != changeMonitor());
+  if (solutionChanged || (nChan != itsTableNChan) || (nAnt > itsTableNAnt) || (nBeam > itsTableNBeam)) {
+      // grow rather than shrink to avoid reallocations if chunks have different subsets of antennas/beams
+      if (!solutionChanged && (nChan == itsTableNChan)) {
+          nAnt = std::max(nAnt, itsTableNAnt);
+          nBeam = std::max(nBeam, itsTableNBeam);
+      }
+      itsTableNAnt = nAnt;
+      itsTableNBeam = nBeam;
+      itsTableNChan = nChan;
+      itsInverseJones.resize(static_cast<size_t>(nAnt) * nBeam * nChan);
+      itsTableFilled.assign(static_cast<size_t>(nAnt) * nBeam, false);
+      itsTableChangeMonitor = changeMonitor();
+  }
+
+  for (casacore::uInt row = 0; row < chunk.nRow(); ++row) {
+       for (int side = 0; side < 2; ++side) {
+            const casacore::uInt ant = side == 0 ? antenna1[row] : antenna2[row];
+            const casacore::uInt beam = itsBeamIndependent ? 0u : (side == 0 ? beam1[row] : beam2[row]);
+            const size_t slot = static_cast<size_t>(beam) * itsTableNAnt + ant;
+            ASKAPDEBUGASSERT(slot < itsTableFilled.size());
+            if (itsTableFilled[slot]) {
                 continue;
             }
-        } else {
-          ASKAPCHECK(validSolution && !needFlag, "Encountered unflagged data and invalid solution, but flagging samples has not been allowed");
-          ASKAPCHECK(det>detThreshold, "Unable to apply calibration for (antenna1,beam1)=("<<antenna1[row]<<","<<beam1[row]<<") and (antenna2,beam2)=("<<antenna2[row]<<
-                           ","<<beam2[row]<<"), time="<<chunk.time()/86400.-55000<<" determinant is too close to 0. D="<<det<<" matrix="<<mueller.matrix()
-                   //<<" jones1="<<jones1.matrix()<<" jones2="<<jones2.matrix()
-                   <<" dir="<<askap::printDirection(chunk.pointingDir1()[row]));
-        }
-
-        // do the actual calibration
-        vis*=mueller;
-
-        // write back to chunk
-        for (casacore::uInt pol = 0; pol < nPol; ++pol) {
-            rwVis(row,chan,pol) = vis(pol);
-        }
-
-        if (itsScaleNoise) {
-            ASKAPCHECK(noiseAndFlagDA, "Accessor type passed to CalibrationApplicatorME does not support change of the noise estimate");
-            casacore::Vector<casacore::Complex> thisChanNoise = noiseAndFlagDA->rwNoise().yzPlane(row).row(chan);
-            ASKAPDEBUGASSERT(thisChanNoise.nelements() == nPol);
-            // propagating noise estimate through the matrix multiplication
-            casa::RigidVector<casa::Complex,4> noise = thisChanNoise;
-            // Somehow the indexing below calls the non const version and throws
-            // an exception for a diagonal matrix. Avoid this with explicitly const version
-            const casa::SquareMatrix<casa::Complex,4>& cmueller = mueller;
-
-            for (casacore::uInt pol = 0; pol < nPol; ++pol) {
-                float tempRe = 0., tempIm = 0.;
-                for (casa::uInt k = 0; k < nPol; ++k) {
-                    tempRe += casa::square(casa::real(cmueller(pol,k)) * casa::real(noise(k))) +
-                              casa::square(casa::imag(cmueller(pol,k)) * casa::imag(noise(k)));
-                    tempIm += casa::square(casa::real(cmueller(pol,k)) * casa::imag(noise(k))) +
-                              casa::square(casa::imag(cmueller(pol,k)) * casa::real(noise(k)));
-                }
-                thisChanNoise(pol) = casacore::Complex(sqrt(tempRe),sqrt(tempIm));
+            itsTableFilled[slot] = true;
+            for (casacore::uInt chan = 0; chan < itsTableNChan; ++chan) {
+                 InverseJones &entry = itsInverseJones[slot * itsTableNChan + chan];
+                 const std::pair<casa::SquareMatrix<casa::Complex, 2>, bool> jv = jonesAndValidity(ant, beam, chan);
+                 entry.itsValid = jv.second;
+                 entry.itsDetSquared = 0.;
+                 if (entry.itsValid) {
+                     const casa::SquareMatrix<casa::Complex, 2>& j = jv.first;
+                     const casa::Complex det = j(0,0)*j(1,1)-j(0,1)*j(1,0);
+                     entry.itsDetSquared = casa::real(det*conj(det));
+                     if (entry.itsDetSquared > 0.) {
+                         const casa::Complex reciprocal = casa::Complex(1.,0.) / det;
+                         entry.itsMatrix[0] = j(1,1) * reciprocal;
+                         entry.itsMatrix[1] = -j(0,1) * reciprocal;
+                         entry.itsMatrix[2] = -j(1,0) * reciprocal;
+                         entry.itsMatrix[3] = j(0,0) * reciprocal;
+                     }
+                 }
             }
-        }
-    }
+       }
+  }
+}
+
+/// @brief correct a range of rows using the table of inverse Jones matrices
+/// @details This is the kernel of correct4 which is executed for a subset of rows,
+/// possibly in a separate thread. All references to the data are obtained before the
+/// call, so nothing is read from the accessor here. Any exception is caught and its
+/// message is returned via error.
+/// @param[in] chunk accessor (only used for metadata and error messages)
+/// @param[in] vis visibility cube to correct
+/// @param[in] flag flags (read-only)
+/// @param[in] rwFlag flags to update (only used if flagging is allowed)
+/// @param[in] rwNoise noise to update (only used if the noise is scaled)
+/// @param[in] startRow first row to process
+/// @param[in] endRow row after the last one to process
+/// @param[out] error error message, empty if no error occurred
+void CalibrationApplicatorME::correctRows(const accessors::IDataAccessor &chunk, casacore::Cube<casacore::Complex> &vis,
+                   const casacore::Cube<casacore::Bool> &flag, casacore::Cube<casacore::Bool> &rwFlag,
+                   casacore::Cube<casacore::Complex> &rwNoise, casacore::uInt startRow, casacore::uInt endRow,
+                   std::string &error) const
+{
+  try {
+     const casacore::uInt nPol = 4;
+     const float detThreshold = 1e-25;
+     const casacore::uInt nChan = chunk.nChannel();
+     const casa::Vector<casa::uInt>& antenna1 = chunk.antenna1();
+     const casa::Vector<casa::uInt>& antenna2 = chunk.antenna2();
+     const casa::Vector<casa::uInt>& beam1 = chunk.feed1();
+     const casa::Vector<casa::uInt>& beam2 = chunk.feed2();
+
+     // scratch space: inverse Mueller matrix (direct product of the inverse Jones matrices)
+     casacore::Complex mueller[nPol][nPol];
+     casacore::Complex in[nPol];
+
+     for (casacore::uInt row = startRow; row < endRow; ++row) {
+          const casacore::uInt b1 = itsBeamIndependent ? 0u : beam1[row];
+          const casacore::uInt b2 = itsBeamIndependent ? 0u : beam2[row];
+          for (casacore::uInt chan = 0; chan < nChan; ++chan) {
+               bool allFlagged = true;
+               // we don't really support partial polarisation flagging, but to avoid nasty surprises it is better to flag such samples completely.
+               bool needFlag = false;
+               for (casacore::uInt pol = 0; pol < nPol; ++pol) {
+                    if (flag(row,chan,pol)) {
+                        needFlag = true;
+                    } else {
+                        allFlagged = false;
+                    }
+               }
+               // don't bother with the rest of processing if the sample is flagged anyway in its entirety
+               if (allFlagged) {
+                   continue;
+               }
+               const casacore::uInt tableChan = itsChannelIndependent ? 0u : chan;
+               const InverseJones &j1 = inverseJones(antenna1[row], b1, tableChan);
+               const InverseJones &j2 = inverseJones(antenna2[row], b2, tableChan);
+               const bool validSolution = j1.itsValid && j2.itsValid;
+               const float det = j1.itsDetSquared * j2.itsDetSquared;
+
+               if (itsFlagAllowed) {
+                   if (det <= detThreshold || !validSolution || needFlag) {
+                       for (casacore::uInt pol = 0; pol < nPol; ++pol) {
+                            rwFlag(row,chan,pol) = true;
+                            vis(row,chan,pol) = 0.;
+                       }
+                       continue;
+                   }
+               } else {
+                 ASKAPCHECK(validSolution && !needFlag, "Encountered unflagged data and invalid solution, but flagging samples has not been allowed");
+                 ASKAPCHECK(det>detThreshold, "Unable to apply calibration for (antenna1,beam1)=("<<antenna1[row]<<","<<beam1[row]<<") and (antenna2,beam2)=("<<antenna2[row]<<
+                                  ","<<beam2[row]<<"), time="<<chunk.time()/86400.-55000<<" determinant is too close to 0. D="<<det);
+               }
+
+               // Inverse of 4x4 mueller is directProduct of 2x2 jones inverses (the second one is conjugated),
+               // polarisation index is 2*i+k for the element (i,k) of the coherency matrix
+               for (casacore::uInt i = 0; i < 2; ++i) {
+                    for (casacore::uInt k = 0; k < 2; ++k) {
+                         for (casacore::uInt j = 0; j < 2; ++j) {
+                              for (casacore::uInt l = 0; l < 2; ++l) {
+                                   mueller[2 * i + k][2 * j + l] = j1.itsMatrix[2 * i + j] * conj(j2.itsMatrix[2 * k + l]);
+                              }
+                         }
+                    }
+               }
+
+               // do the actual calibration
+               for (casacore::uInt pol = 0; pol < nPol; ++pol) {
+                    in[pol] = vis(row,chan,pol);
+               }
+               for (casacore::uInt pol = 0; pol < nPol; ++pol) {
+                    vis(row,chan,pol) = mueller[pol][0] * in[0] + mueller[pol][1] * in[1] +
+                                        mueller[pol][2] * in[2] + mueller[pol][3] * in[3];
+               }
+
+               if (itsScaleNoise) {
+                   // propagating noise estimate through the matrix multiplication
+                   for (casacore::uInt pol = 0; pol < nPol; ++pol) {
+                        in[pol] = rwNoise(row,chan,pol);
+                   }
+                   for (casacore::uInt pol = 0; pol < nPol; ++pol) {
+                        float tempRe = 0., tempIm = 0.;
+                        for (casacore::uInt k = 0; k < nPol; ++k) {
+                             tempRe += casa::square(casa::real(mueller[pol][k]) * casa::real(in[k])) +
+                                       casa::square(casa::imag(mueller[pol][k]) * casa::imag(in[k]));
+                             tempIm += casa::square(casa::real(mueller[pol][k]) * casa::imag(in[k])) +
+                                       casa::square(casa::imag(mueller[pol][k]) * casa::real(in[k]));
+                        }
+                        rwNoise(row,chan,pol) = casacore::Complex(sqrt(tempRe),sqrt(tempIm));
+                   }
+               }
+          }
+     }
+  }
+  catch (const std::exception &ex) {
+     error = ex.what();
   }
 }
 
@@ -388,6 +504,8 @@ void CalibrationApplicatorME::allowFlag(bool flag)
 void CalibrationApplicatorME::beamIndependent(bool flag)
 {
   itsBeamIndependent = flag;
+  // force the table of inverse Jones matrices to be rebuilt
+  itsTableNChan = 0u;
   if (itsBeamIndependent) {
       ASKAPLOG_INFO_STR(logger, "CalibrationApplicatorME will apply beam=0 calibration solutions to all beams encountered");
   } else {
@@ -401,6 +519,8 @@ void CalibrationApplicatorME::beamIndependent(bool flag)
 void CalibrationApplicatorME::channelIndependent(bool flag)
 {
   itsChannelIndependent = flag;
+  // force the table of inverse Jones matrices to be rebuilt
+  itsTableNChan = 0u;
   if (itsChannelIndependent) {
       ASKAPLOG_INFO_STR(logger, "CalibrationApplicatorME will apply the same gain calibration solutions to all channels");
   } else {
@@ -408,6 +528,17 @@ void CalibrationApplicatorME::channelIndependent(bool flag)
   }
 }
 
+/// @brief set the number of threads used to correct one chunk
+/// @details The rows of each chunk with 4 polarisation products are split between
+/// the given number of threads. Other chunks are always processed serially.
+/// @param[in] nThreads number of threads, 1 means serial processing
+void CalibrationApplicatorME::numberOfThreads(casacore::uInt nThreads)
+{
+  ASKAPCHECK(nThreads > 0, "Number of threads is supposed to be a positive number");
+  itsNThreads = nThreads;
+  ASKAPLOG_INFO_STR(logger, "CalibrationApplicatorME will use "<<itsNThreads<<" thread(s) to correct each chunk of data");
+}
+
 } // namespace synthesis
 
 } // namespace askap
@@ -42,10 +42,15 @@
 #include <askap/calibaccess/ICalSolutionConstAccessor.h>
 #include <askap/measurementequation/CalibrationSolutionHandler.h>
 #include <askap/dataaccess/IDataAccessor.h>
+#include <askap/scimath/utils/ChangeMonitor.h>
 
 // boost includes
 #include <boost/shared_ptr.hpp>
 
+// std includes
+#include <vector>
+#include <string>
+
 namespace askap {
 
 namespace synthesis {
@@ -104,7 +109,62 @@ public:
   /// @param[in] flag if true, channel=0 calibration is applied to all channels
   virtual void channelIndependent(bool flag);
 
+  /// @brief set the number of threads used to correct one chunk
+  /// @details The rows of each chunk with 4 polarisation products are split between
+  /// the given number of threads. Other chunks are always processed serially.
+  /// @param[in] nThreads number of threads, 1 means serial processing
+  virtual void numberOfThreads(casacore::uInt nThreads);
+
 private:
+  /// @brief inverse of the Jones matrix for one antenna, beam and channel
+  /// @details The inverse of the 4x4 Mueller matrix is the direct product of
+  /// the inverses of the 2x2 Jones matrices. This structure caches the inverse
+  /// Jones matrix and the determinant, so they're computed once per solution
+  /// interval rather than for every visibility.
+  struct InverseJones {
+     /// @brief elements of the inverse matrix in the order (0,0), (0,1), (1,0), (1,1)
+     casacore::Complex itsMatrix[4];
+     /// @brief squared amplitude of the determinant of the original matrix
+     casacore::Float itsDetSquared;
+     /// @brief true, if the solution is valid
+     bool itsValid;
+  };
+
+  /// @brief update the table of inverse Jones matrices
+  /// @details The table covers all antennas, beams and channels (one channel if
+  /// the channel-independent mode is used) found in the given chunk. It is rebuilt
+  /// if the solution accessor has been changed or the shape of the data requires a bigger
+  /// table. Entries are filled for every antenna/beam pair used in the chunk (if not done yet).
+  /// The solution accessor should be updated for the time of the chunk before this method is called.
+  /// @param[in] chunk accessor with the data to be corrected
+  void updateInverseJonesTable(const accessors::IConstDataAccessor &chunk) const;
+
+  /// @brief obtain the table element for the given antenna, beam and channel
+  /// @param[in] ant antenna index
+  /// @param[in] beam beam index (already zero in the beam-independent mode)
+  /// @param[in] chan channel index (already zero in the channel-independent mode)
+  /// @return a const reference to the cached inverse Jones matrix
+  inline const InverseJones& inverseJones(casacore::uInt ant, casacore::uInt beam, casacore::uInt chan) const
+     { return itsInverseJones[(static_cast<size_t>(beam) * itsTableNAnt + ant) * itsTableNChan + chan]; }
+
+  /// @brief correct a range of rows using the table of inverse Jones matrices
+  /// @details This is the kernel of correct4 which is executed for a subset of rows,
+  /// possibly in a separate thread. All references to the data are obtained before the
+  /// call, so nothing is read from the accessor here. Any exception is caught and its
+  /// message is returned via error.
+  /// @param[in] chunk accessor (only used for metadata and error messages)
+  /// @param[in] vis visibility cube to correct
+  /// @param[in] flag flags (read-only)
+  /// @param[in] rwFlag flags to update (only used if flagging is allowed)
+  /// @param[in] rwNoise noise to update (only used if the noise is scaled)
+  /// @param[in] startRow first row to process
+  /// @param[in] endRow row after the last one to process
+  /// @param[out] error error message, empty if no error occurred
+  void correctRows(const accessors::IDataAccessor &chunk, casacore::Cube<casacore::Complex> &vis,
+                   const casacore::Cube<casacore::Bool> &flag, casacore::Cube<casacore::Bool> &rwFlag,
+                   casacore::Cube<casacore::Complex> &rwNoise, casacore::uInt startRow, casacore::uInt endRow,
+                   std::string &error) const;
+
   /// @brief correct model visibilities for one accessor
   /// @details This method corrects the data in the given accessor
   /// (accessed via rwVisibility) for the calibration errors
@@ -124,6 +184,28 @@ private:
   bool itsBeamIndependent;
   /// @brief true, if channel index can be ignored and channel=0 corrections applied to all channels
   bool itsChannelIndependent;
+
+  /// @brief number of threads used to correct one chunk
+  casacore::uInt itsNThreads;
+
+  /// @brief cached inverse Jones matrices
+  /// @details The index is (beam * itsTableNAnt + antenna) * itsTableNChan + channel
+  mutable std::vector<InverseJones> itsInverseJones;
+
+  /// @brief true for antenna/beam pairs which have been filled in the table
+  mutable std::vector<bool> itsTableFilled;
+
+  /// @brief number of antennas covered by the table
+  mutable casacore::uInt itsTableNAnt;
+
+  /// @brief number of beams covered by the table
+  mutable casacore::uInt itsTableNBeam;
+
+  /// @brief number of channels covered by the table
+  mutable casacore::uInt itsTableNChan;
+
+  /// @brief change monitor of the solution accessor used to fill the table
+  mutable scimath::ChangeMonitor itsTableChangeMonitor;
 };
 
 } // namespace synthesis
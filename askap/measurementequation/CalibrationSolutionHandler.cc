@@ -45,7 +45,7 @@ CalibrationSolutionHandler::CalibrationSolutionHandler() : itsCurrentSolutionID(
 /// @details
 /// @param[in] css shared pointer to solution source
 CalibrationSolutionHandler::CalibrationSolutionHandler(const boost::shared_ptr<accessors::ICalSolutionConstSource> &css) :
-     itsCalSolutionSource(css), itsCurrentSolutionID(-1) 
+     itsCalSolutionSource(css), itsCache(boost::dynamic_pointer_cast<CalSolutionCache>(css)), itsCurrentSolutionID(-1) 
 {
   ASKAPCHECK(itsCalSolutionSource, 
       "An attempt to initialise CalibrationSolutionHandler with a void calibration solution source shared pointer");
@@ -59,6 +59,7 @@ void CalibrationSolutionHandler::setCalSolutionSource(const boost::shared_ptr<ac
   ASKAPCHECK(css, 
       "An attempt to initialise CalibrationSolutionHandler with a void calibration solution source shared pointer");  
   itsCalSolutionSource = css;
+  itsCache = boost::dynamic_pointer_cast<CalSolutionCache>(css);
   itsCalSolutionAccessor.reset();
   itsCurrentSolutionID = -1;
   itsChangeMonitor.notifyOfChanges();    
@@ -91,6 +92,24 @@ const accessors::ICalSolutionConstAccessor& CalibrationSolutionHandler::calSolut
   return *itsCalSolutionAccessor;
 }
 
+/// @brief obtain Jones matrix and its validity flag for the current solution
+/// @details This is equivalent to calSolution().jonesAndValidity(...), but if
+/// the solution source is a CalSolutionCache, the matrix is taken from the cache
+/// (which is shared between threads) rather than from the accessor.
+/// @param[in] ant antenna index
+/// @param[in] beam beam index
+/// @param[in] chan spectral channel
+/// @return pair of the Jones matrix and the validity flag
+std::pair<casacore::SquareMatrix<casacore::Complex, 2>, bool> CalibrationSolutionHandler::jonesAndValidity(const casacore::uInt ant,
+             const casacore::uInt beam, const casacore::uInt chan) const
+{
+  if (itsCache) {
+      ASKAPASSERT(itsCalSolutionAccessor);
+      return itsCache->jonesAndValidity(itsCurrentSolutionID, ant, beam, chan);
+  }
+  return calSolution().jonesAndValidity(ant, beam, chan);
+}
+
 
 } // namespace synthesis
 
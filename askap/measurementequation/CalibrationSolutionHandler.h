@@ -36,10 +36,18 @@
 #include <askap/calibaccess/ICalSolutionConstSource.h>
 #include <askap/calibaccess/ICalSolutionConstAccessor.h>
 #include <askap/scimath/utils/ChangeMonitor.h>
+#include <askap/measurementequation/CalSolutionCache.h>
+
+// casa includes
+#include <casacore/casa/BasicSL/Complex.h>
+#include <casacore/scimath/Mathematics/SquareMatrix.h>
 
 // boost includes
 #include <boost/shared_ptr.hpp>
 
+// std includes
+#include <utility>
+
 namespace askap {
 
 namespace synthesis {
@@ -78,6 +86,17 @@ public:
   /// (this shouldn't happen if updateAccessor is called first)
   /// @return a const reference to the calibration solution accessor
   const accessors::ICalSolutionConstAccessor& calSolution() const;
+
+  /// @brief obtain Jones matrix and its validity flag for the current solution
+  /// @details This is equivalent to calSolution().jonesAndValidity(...), but if
+  /// the solution source is a CalSolutionCache, the matrix is taken from the cache
+  /// (which is shared between threads) rather than from the accessor.
+  /// @param[in] ant antenna index
+  /// @param[in] beam beam index
+  /// @param[in] chan spectral channel
+  /// @return pair of the Jones matrix and the validity flag
+  std::pair<casacore::SquareMatrix<casacore::Complex, 2>, bool> jonesAndValidity(const casacore::uInt ant,
+             const casacore::uInt beam, const casacore::uInt chan) const;
   
   /// @brief obtain change monitor
   /// @details This class is handy if one wants to track changes in the
@@ -90,6 +109,10 @@ public:
 private:
   /// @brief solution source to work with
   boost::shared_ptr<accessors::ICalSolutionConstSource> itsCalSolutionSource;
+
+  /// @brief solution source cast to the cache type
+  /// @details It is uninitialised if the solution source is not a CalSolutionCache
+  boost::shared_ptr<CalSolutionCache> itsCache;
   
   /// @brief shared pointer to the current solution accessor 
   /// @details It is updated every time the time changes.
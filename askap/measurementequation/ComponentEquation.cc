@@ -58,14 +58,14 @@ namespace askap
     ComponentEquation::ComponentEquation(const askap::scimath::Params& ip,
           const accessors::IDataSharedIter& idi) :  scimath::Equation(ip), MultiChunkEquation(idi),  
            askap::scimath::GenericEquation(ip), GenericMultiChunkEquation(idi),
-           itsAllComponentsUnpolarised(false)
+           itsAllComponentsUnpolarised(false), itsNThreads(1)
     {
       init();
     };
 
     ComponentEquation::ComponentEquation(const accessors::IDataSharedIter& idi) :
            MultiChunkEquation(idi), GenericMultiChunkEquation(idi),
-           itsAllComponentsUnpolarised(false) 
+           itsAllComponentsUnpolarised(false), itsNThreads(1)
     {
       setParameters(defaultParameters());
       init();
@@ -98,6 +98,8 @@ void ComponentEquation::fillComponentCache(
   const std::vector<std::string> completions(parameters().completions("flux.i"));
   const std::vector<std::string> calCompletions(parameters().completions("calibrator."));
   in.resize(completions.size() + calCompletions.size());
+  itsBatch.reset(new BatchedComponentPredictor);
+  itsUnbatchedComponents.clear();
   if (!in.size()) {
      return;
   }
@@ -127,9 +129,11 @@ void ComponentEquation::fillComponentCache(
              // this is a gaussian
              compIt->reset(new UnpolarizedGaussianSource(cur,fluxi,ra,dec,bmaj,
                             bmin,bpa));
+             itsBatch->addGaussian(fluxi,ra,dec,bmaj,bmin,bpa);
           } else {
              // this is a point source
              compIt->reset(new UnpolarizedPointSource(cur,fluxi,ra,dec));
+             itsBatch->addPoint(fluxi,ra,dec);
           }
   }
   
@@ -138,6 +142,7 @@ void ComponentEquation::fillComponentCache(
         it!=calCompletions.end();++it,++compIt)  {
         ASKAPCHECK(*it == "1934-638", "Only 1934-638 is currently supported, you requested "<<*it);
         compIt->reset(new Calibrator1934());
+        itsUnbatchedComponents.push_back(*compIt);
   }
 }   
 
@@ -270,8 +275,8 @@ casacore::uInt ComponentEquation::polIndex(casacore::Stokes::StokesTypes pol) co
 /// @param chunk a read-write accessor to work with
 void ComponentEquation::predict(accessors::IDataAccessor &chunk) const
 {
-  const std::vector<IParameterizedComponentPtr> &compList = 
-         itsComponents.value(*this,&ComponentEquation::fillComponentCache);
+  // make sure the component cache (and the batch filled with it) is up to date
+  itsComponents.value(*this,&ComponentEquation::fillComponentCache);
   
   const casacore::Vector<casacore::Double>& freq = chunk.frequency();
   const casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw = chunk.uvw();
@@ -287,9 +292,26 @@ void ComponentEquation::predict(accessors::IDataAccessor &chunk) const
       itsPolConverter = scimath::PolConverter(scimath::PolConverter::canonicStokes(), chunk.stokes(), true);    
   }
          
-  // loop over components
+  // point sources and Gaussians are predicted together, only Stokes I contributes
+  ASKAPDEBUGASSERT(itsBatch);
+  if (itsBatch->size() > 0) {
+      const std::map<casacore::Stokes::StokesTypes, casacore::Complex> sparseTransform = 
+            itsPolConverter.getSparseTransform(casacore::Stokes::I);
+      const casacore::Vector<casacore::Stokes::StokesTypes> outFrame = itsPolConverter.outputPolFrame();
+      casacore::Vector<casacore::Complex> polFactors(outFrame.nelements(), casacore::Complex(0.,0.));
+      for (casacore::uInt pol = 0; pol < outFrame.nelements(); ++pol) {
+           const std::map<casacore::Stokes::StokesTypes, casacore::Complex>::const_iterator ci = 
+                 sparseTransform.find(outFrame[pol]);
+           if (ci != sparseTransform.end()) {
+               polFactors[pol] = ci->second;
+           }
+      }
+      itsBatch->predict(uvw, freq, polFactors, rwVis, itsNThreads);
+  }
+
+  // loop over remaining components
   for (std::vector<IParameterizedComponentPtr>::const_iterator compIt = 
-       compList.begin(); compIt!=compList.end();++compIt) {
+       itsUnbatchedComponents.begin(); compIt!=itsUnbatchedComponents.end();++compIt) {
        
        ASKAPDEBUGASSERT(*compIt); 
        // current component
@@ -495,6 +517,16 @@ ComponentEquation::ShPtr ComponentEquation::clone() const
   return ComponentEquation::ShPtr(new ComponentEquation(*this));
 }
 
+/// @brief set the number of threads used for prediction
+/// @details Rows of each chunk are split between threads when visibilities of
+/// point sources and Gaussians are predicted.
+/// @param[in] nThreads number of threads (should be positive)
+void ComponentEquation::numberOfThreads(size_t nThreads)
+{
+  ASKAPCHECK(nThreads > 0, "Number of threads should be positive");
+  itsNThreads = nThreads;
+}
+
 
 } // namespace synthesis
 
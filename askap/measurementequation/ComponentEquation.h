@@ -41,6 +41,7 @@
 #include <askap/measurementequation/IParameterizedComponent.h>
 #include <askap/measurementequation/IUnpolarizedComponent.h>
 #include <askap/measurementequation/GenericMultiChunkEquation.h>
+#include <askap/measurementequation/BatchedComponentPredictor.h>
 #include <utils/PolConverter.h>
 
 // casa includes
@@ -50,6 +51,9 @@
 #include <casacore/casa/Arrays/Matrix.h>
 #include <casacore/casa/Arrays/Cube.h>
 
+// boost includes
+#include <boost/shared_ptr.hpp>
+
 namespace askap
 {
   namespace synthesis
@@ -111,6 +115,12 @@ namespace askap
         /// Clone this into a shared pointer
         /// @return shared pointer to a copy
         virtual ComponentEquation::ShPtr clone() const;
+
+        /// @brief set the number of threads used for prediction
+        /// @details Rows of each chunk are split between threads when visibilities of
+        /// point sources and Gaussians are predicted.
+        /// @param[in] nThreads number of threads (should be positive)
+        void numberOfThreads(size_t nThreads);
         
       private:
         /// Initialize this object
@@ -204,6 +214,18 @@ namespace askap
         
         /// @brief True if all components are unpolarised
         mutable bool itsAllComponentsUnpolarised;
+
+        /// @brief point sources and Gaussians in the form suitable for batched prediction
+        /// @details It is filled together with the component cache. A new object is created
+        /// every time, so it can be shared between copies of this equation.
+        mutable boost::shared_ptr<BatchedComponentPredictor> itsBatch;
+
+        /// @brief components which are not part of the batch
+        /// @details They are predicted one by one via the generic interface.
+        mutable std::vector<IParameterizedComponentPtr> itsUnbatchedComponents;
+
+        /// @brief number of threads used for prediction
+        size_t itsNThreads;
         
         /// @brief polarisation converter to be used with this component equation
         /// @details Components are defined in the Stokes frame, this class converts them
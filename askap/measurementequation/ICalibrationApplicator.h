@@ -96,6 +96,12 @@ struct ICalibrationApplicator {
   /// @param[in] flag if true, leakage free calibration is applied
   virtual void leakageFree(bool flag) {};
 
+  /// @brief set the number of threads used to correct one chunk
+  /// @details Implementations may split the rows of a chunk between the given
+  /// number of threads. Serial processing is done by default.
+  /// @param[in] nThreads number of threads, 1 means serial processing
+  virtual void numberOfThreads(casacore::uInt nThreads) {};
+
 };
 
 } // namespace synthesis
@@ -40,6 +40,8 @@
 #include <askap/dataaccess/MemBufferDataAccessor.h>
 #include <askap/scimath/utils/PolConverter.h>
 
+#include <algorithm>
+
 
 using namespace askap;
 using namespace askap::synthesis;
@@ -47,7 +49,8 @@ using namespace askap::synthesis;
 /// @brief default constructor
 /// @details preaveraging is initialised based on the first encountered accessor
 PreAvgCalBuffer::PreAvgCalBuffer() : itsPolXProducts(0), // set nPol = 0 for now as a proper initialisation is pending
-    itsVisTypeIgnored(0), itsNoMatchIgnored(0), itsFlagIgnored(0), itsBeamIndependent(false) {}
+    itsVisTypeIgnored(0), itsNoMatchIgnored(0), itsFlagIgnored(0), itsBeamIndependent(false),
+    itsIndexNAnt(0), itsIndexNBeam(0) {}
    
 /// @brief constructor with explicit averaging parameters
 /// @details This version of the constructor explicitly defines the number of 
@@ -60,7 +63,8 @@ PreAvgCalBuffer::PreAvgCalBuffer(casacore::uInt nAnt, casacore::uInt nBeam, casa
       itsAntenna2(nBeam*nAnt*(nAnt-1)/2), itsBeam(nBeam*nAnt*(nAnt-1)/2), itsFlag(nBeam*nAnt*(nAnt-1)/2,casacore::Int(nChan),4),
       // npol=4
       itsStokes(4), itsPolXProducts(4,casacore::IPosition(2,int(nBeam*nAnt*(nAnt-1)/2),casacore::Int(nChan))),
-      itsVisTypeIgnored(0), itsNoMatchIgnored(0), itsFlagIgnored(0), itsBeamIndependent(false)
+      itsVisTypeIgnored(0), itsNoMatchIgnored(0), itsFlagIgnored(0), itsBeamIndependent(false),
+      itsIndexNAnt(0), itsIndexNBeam(0)
 {
   initialise(nAnt,nBeam,nChan);
 }  
@@ -75,7 +79,8 @@ PreAvgCalBuffer::PreAvgCalBuffer(casacore::uInt nAnt) : itsAntenna1(nAnt*(nAnt-1
       itsAntenna2(nAnt*(nAnt-1)/2), itsBeam(nAnt*(nAnt-1)/2), itsFlag(nAnt*(nAnt-1)/2,1,4),
       // npol=4
       itsStokes(4), itsPolXProducts(4,casacore::IPosition(2,int(nAnt*(nAnt-1)/2),1)),
-      itsVisTypeIgnored(0), itsNoMatchIgnored(0), itsFlagIgnored(0), itsBeamIndependent(true)
+      itsVisTypeIgnored(0), itsNoMatchIgnored(0), itsFlagIgnored(0), itsBeamIndependent(true),
+      itsIndexNAnt(0), itsIndexNBeam(0)
 {
   initialise(nAnt, 1, 1);
 }
@@ -130,6 +135,8 @@ void PreAvgCalBuffer::initialise(const IConstDataAccessor &acc, const bool fdp)
   // all elements are flagged until at least something is averaged in
   itsFlag.set(true); 
   itsPolXProducts.reset();
+  // rows marked with the unused beam id should never match, unless this id coincides with a valid beam 
+  buildRowIndex(unusedBeamId > 0 ? static_cast<int>(unusedBeamId) : -1);
   // initialise stats
   itsVisTypeIgnored = 0;
   itsNoMatchIgnored = 0;
@@ -172,6 +179,7 @@ void PreAvgCalBuffer::initialise(casacore::uInt nAnt, casacore::uInt nBeam, casa
             }
        }
   }
+  buildRowIndex();
   
   // we don't track polarisation at this stage leaving this up to the user of this class
   // just fill the vector with Linear Stokes
@@ -184,7 +192,59 @@ void PreAvgCalBuffer::initialise(casacore::uInt nAnt, casacore::uInt nBeam, casa
   itsNoMatchIgnored = 0;
   itsFlagIgnored = 0;
 }
-   
+
+/// @brief initialise with one channel of another buffer
+/// @details This method resets the buffer and copies metadata, flags and cross-products
+/// corresponding to the given channel of the frequency-dependent buffer. The result is
+/// a single channel buffer suitable for the frequency-independent measurement equation.
+/// It allows us to iterate over the data once, accumulate all channels and then solve for
+/// each channel separately.
+/// @param[in] src source buffer
+/// @param[in] chan channel of the source buffer to copy
+void PreAvgCalBuffer::initialise(const PreAvgCalBuffer &src, casacore::uInt chan)
+{
+  ASKAPCHECK(chan < src.nChannel(), "Requested channel "<<chan<<" is outside the source buffer with "<<
+             src.nChannel()<<" channels");
+  const casacore::uInt numberOfRows = src.nRow();
+  const casacore::uInt numberOfPol = src.nPol();
+  if (itsFlag.shape() != casacore::IPosition(3,numberOfRows, 1, numberOfPol)) {
+      // resizing buffers
+      itsAntenna1.resize(numberOfRows);
+      itsAntenna2.resize(numberOfRows);
+      itsBeam.resize(numberOfRows);
+      itsFlag.resize(numberOfRows, 1, numberOfPol);
+      itsPolXProducts.resize(numberOfPol,casacore::IPosition(2,casacore::Int(numberOfRows), 1),false);
+      itsStokes.resize(numberOfPol);
+  }
+  itsAntenna1 = src.itsAntenna1;
+  itsAntenna2 = src.itsAntenna2;
+  itsBeam = src.itsBeam;
+  itsStokes = src.itsStokes;
+  itsBeamIndependent = src.itsBeamIndependent;
+  itsRowIndex = src.itsRowIndex;
+  itsIndexNAnt = src.itsIndexNAnt;
+  itsIndexNBeam = src.itsIndexNBeam;
+  itsPolXProducts.reset();
+  for (casacore::uInt row = 0; row < numberOfRows; ++row) {
+       for (casacore::uInt pol = 0; pol < numberOfPol; ++pol) {
+            itsFlag(row, 0, pol) = src.itsFlag(row, chan, pol);
+       }
+       scimath::PolXProducts pxpSlice = itsPolXProducts.slice(row, 0);
+       for (casacore::uInt pol = 0; pol < numberOfPol; ++pol) {
+            for (casacore::uInt pol2 = 0; pol2 < numberOfPol; ++pol2) {
+                 pxpSlice.addModelMeasProduct(pol, pol2, src.itsPolXProducts.getModelMeasProduct(row, chan, pol, pol2));
+                 if (pol2 <= pol) {
+                     pxpSlice.addModelProduct(pol, pol2, src.itsPolXProducts.getModelProduct(row, chan, pol, pol2));
+                 }
+            }
+       }
+  }
+  // statistics are not split between channels
+  itsVisTypeIgnored = 0;
+  itsNoMatchIgnored = 0;
+  itsFlagIgnored = 0;
+}
+
 // implemented accessor methods
    
 /// The number of rows in this chunk
@@ -258,26 +318,58 @@ const casacore::Vector<casacore::Stokes::StokesTypes>& PreAvgCalBuffer::stokes()
   return itsStokes;
 }
 
+/// @brief build the index used by findMatch
+/// @details The index is a dense table of row numbers addressed by (beam, ant1, ant2)
+/// covering all antenna and beam indices present in the buffer. It has to be rebuilt
+/// every time the metadata change (i.e. in all initialise methods). If the same
+/// indices are present in more than one row, the first row is used.
+/// @param[in] excludedBeam rows with this beam index are not indexed (i.e. they will
+/// never match), negative value means all rows are indexed
+void PreAvgCalBuffer::buildRowIndex(const int excludedBeam)
+{
+  ASKAPDEBUGASSERT(itsAntenna1.nelements() == itsAntenna2.nelements());
+  ASKAPDEBUGASSERT(itsAntenna1.nelements() == itsBeam.nelements());
+  const casacore::uInt numberOfRows = itsBeam.nelements();
+  itsIndexNAnt = 0;
+  itsIndexNBeam = 0;
+  for (casacore::uInt row = 0; row < numberOfRows; ++row) {
+       if ((excludedBeam >= 0) && (itsBeam[row] == static_cast<casacore::uInt>(excludedBeam))) {
+           continue;
+       }
+       itsIndexNAnt = std::max(itsIndexNAnt, std::max(itsAntenna1[row], itsAntenna2[row]) + 1);
+       itsIndexNBeam = std::max(itsIndexNBeam, itsBeam[row] + 1);
+  }
+  itsRowIndex.assign(static_cast<size_t>(itsIndexNBeam) * itsIndexNAnt * itsIndexNAnt, -1);
+  for (casacore::uInt row = 0; row < numberOfRows; ++row) {
+       if ((excludedBeam >= 0) && (itsBeam[row] == static_cast<casacore::uInt>(excludedBeam))) {
+           continue;
+       }
+       const size_t index = (static_cast<size_t>(itsBeam[row]) * itsIndexNAnt + itsAntenna1[row]) * itsIndexNAnt +
+                            itsAntenna2[row];
+       ASKAPDEBUGASSERT(index < itsRowIndex.size());
+       if (itsRowIndex[index] < 0) {
+           itsRowIndex[index] = static_cast<int>(row);
+       }
+  }
+}
+
 /// @brief helper method to find a match row in the buffer
-/// @details It goes over antenna and beam indices and finds a buffer row which 
-/// corresponds to the given indices.
+/// @details It looks up the buffer row which corresponds to the given indices
+/// in the index built by buildRowIndex.
 /// @param[in] ant1 index of the first antenna
 /// @param[in] ant2 index of the second antenna
 /// @param[in] beam beam index
 /// @return row number in the buffer corresponding to the given (ant1,ant2,beam) or -1 if 
 /// there is no match
-int PreAvgCalBuffer::findMatch(casacore::uInt ant1, casacore::uInt ant2, casacore::uInt beam)
+int PreAvgCalBuffer::findMatch(casacore::uInt ant1, casacore::uInt ant2, casacore::uInt beam) const
 {
-  ASKAPDEBUGASSERT(itsAntenna1.nelements() == itsAntenna2.nelements());
-  ASKAPDEBUGASSERT(itsAntenna1.nelements() == itsBeam.nelements());
-  // we can probably implement a more clever search algorithm here because the 
-  // metadata are almost always ordered
-  for (casacore::uInt row=0; row<itsAntenna1.nelements(); ++row) {
-       if ((itsAntenna1[row] == ant1) && (itsAntenna2[row] == ant2) && (itsBeam[row] == (itsBeamIndependent ? 0 : beam))) {
-           return int(row);
-       }
-  } 
-  return -1;
+  const casacore::uInt effectiveBeam = itsBeamIndependent ? 0 : beam;
+  if ((ant1 >= itsIndexNAnt) || (ant2 >= itsIndexNAnt) || (effectiveBeam >= itsIndexNBeam)) {
+      return -1;
+  }
+  const size_t index = (static_cast<size_t>(effectiveBeam) * itsIndexNAnt + ant1) * itsIndexNAnt + ant2;
+  ASKAPDEBUGASSERT(index < itsRowIndex.size());
+  return itsRowIndex[index];
 }
 
 /// @brief process one accessor
@@ -330,6 +422,17 @@ void PreAvgCalBuffer::accumulate(const IConstDataAccessor &acc, const boost::sha
   
   ASKAPCHECK(fdp || (nChannel() == 1), 
      "Only single spectral channel is supported by the pre-averaging calibration buffer in the frequency-independent mode");
+
+  // at most 4 polarisation products are supported, so small fixed size arrays are used as a scratch space
+  const casacore::uInt nPolToProcess = acc.nPol();
+  ASKAPCHECK(nPolToProcess <= 4, "Pre-averaging calibration buffer supports up to 4 polarisation products, accessor has "<<
+             nPolToProcess);
+  const casacore::uInt nBufferedPol = std::min(nPolToProcess, bufferNPol);
+  casacore::Complex model[4];
+  casacore::Complex measured[4];
+  casacore::Complex weightedConjModel[4];
+  casacore::Complex modelMeasProducts[4];
+  casacore::Complex modelProducts[4];
   for (casacore::uInt row = 0; row<acc.nRow(); ++row) {
        if ((beam1[row] != beam2[row]) || (antenna1[row] == antenna2[row])) {
            // cross-beam correlations and auto-correlations are not supported
@@ -351,58 +454,51 @@ void PreAvgCalBuffer::accumulate(const IConstDataAccessor &acc, const boost::sha
        // the code below works with this 1D slice
        for (casacore::uInt chan = 0; chan<acc.nChannel(); ++chan) {
             const casacore::uInt bufChan = fdp ? chan : 0;
-            if (fdp && (chan > 0)) {
-                // update the slice to point to the correct channel of the buffer
-                pxpSlice = itsPolXProducts.slice(bufRow,chan);
-            }
 
+            // gather all polarisations of this sample into small contiguous arrays, this avoids
+            // repeated indexing of the cubes and lets the compiler vectorise the loops below
             // if any polarisations are flagged, ignore this visibility
             casacore::Bool JonesFlag = casacore::False;
-            for (casacore::uInt pol = 0; pol<acc.nPol(); ++pol) {
-                if (measuredFlag(row,chan,pol)) {
-                    JonesFlag = casacore::True;
-                    break;
-                }
+            for (casacore::uInt pol = 0; pol<nPolToProcess; ++pol) {
+                 if (measuredFlag(row,chan,pol)) {
+                     JonesFlag = casacore::True;
+                     break;
+                 }
+                 const float visNoise = casacore::square(casacore::real(measuredNoise(row,chan,pol)));
+                 const float weight = (visNoise > 0.) ? 1./visNoise : 0.;
+                 model[pol] = modelVis(row,chan,pol);
+                 measured[pol] = measuredVis(row,chan,pol);
+                 weightedConjModel[pol] = weight * std::conj(model[pol]);
             }
             if (JonesFlag) {
                 itsFlagIgnored += acc.nPol();
                 continue;
             }
 
-            for (casacore::uInt pol = 0; pol<acc.nPol(); ++pol) {
-                 if (pol < bufferNPol) {
-                     const casacore::Complex model = modelVis(row,chan,pol);
-                     const float visNoise =
-                         casacore::square(casacore::real(measuredNoise(row,chan,pol)));
-                     const float weight = (visNoise > 0.) ? 1./visNoise : 0.;
-                     for (casacore::uInt pol2 = 0; pol2<acc.nPol(); ++pol2) {
-                          /*
-                          // temporary hack
-                          if (((pol != 0) && (pol != 3)) ||
-                              ((pol2 != 0) && (pol2 != 3))) {
-                              continue;
-                          }
-                          //
-                          */
-                          // different polarisations can have different weight?
-                          // ignoring for now
-                          pxpSlice.addModelMeasProduct(pol,pol2,
-                              weight * std::conj(model) * measuredVis(row,chan,pol2));
-                          //pxpSlice.addModelMeasProduct(pol,pol2,weight * std::conj(model) *
-                          //    (pol == pol2 ? measuredVis(row,chan,pol2) : casacore::Complex(0.,0.)));
-                          if (pol2<=pol) {
-                              pxpSlice.addModelProduct(pol,pol2,
-                                  weight * std::conj(model) * modelVis(row,chan,pol2));
-                          }
-                     }
-                     //std::cout<<"accumulated ("<<bufRow<<","<<pol<<"): "<<model<<
-                     //    " "<<measuredVis(row,chan,pol)<<std::endl;
-                     // unflag this row because it now has some data
-                     itsFlag(bufRow,bufChan,pol) = false;
-                 } else {
-                     ++itsFlagIgnored;
+            if (fdp && (chan > 0)) {
+                // update the slice to point to the correct channel of the buffer
+                pxpSlice = itsPolXProducts.slice(bufRow,chan);
+            }
+
+            // different polarisations can have different weight? ignoring for now
+            for (casacore::uInt pol = 0; pol<nBufferedPol; ++pol) {
+                 for (casacore::uInt pol2 = 0; pol2<nPolToProcess; ++pol2) {
+                      modelMeasProducts[pol2] = weightedConjModel[pol] * measured[pol2];
+                 }
+                 for (casacore::uInt pol2 = 0; pol2<=pol; ++pol2) {
+                      modelProducts[pol2] = weightedConjModel[pol] * model[pol2];
+                 }
+                 for (casacore::uInt pol2 = 0; pol2<nPolToProcess; ++pol2) {
+                      pxpSlice.addModelMeasProduct(pol,pol2,modelMeasProducts[pol2]);
+                      if (pol2<=pol) {
+                          pxpSlice.addModelProduct(pol,pol2,modelProducts[pol2]);
+                      }
                  }
+                 // unflag this row because it now has some data
+                 itsFlag(bufRow,bufChan,pol) = false;
             }
+            // polarisations not managed by the buffer
+            itsFlagIgnored += acc.nPol() - nBufferedPol;
        }
   }
 }
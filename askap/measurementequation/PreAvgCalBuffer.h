@@ -45,6 +45,8 @@
 
 #include <boost/shared_ptr.hpp>
 
+#include <vector>
+
 namespace askap {
 
 namespace synthesis {
@@ -107,7 +109,17 @@ public:
    /// @param[in] nChan number of channels to buffer, 1 (default) is a special case
    /// assuming that measurement equation is frequency-independent
    void initialise(casacore::uInt nAnt, casacore::uInt nBeam, casacore::uInt nChan = 1);
-   
+
+   /// @brief initialise with one channel of another buffer
+   /// @details This method resets the buffer and copies metadata, flags and cross-products
+   /// corresponding to the given channel of the frequency-dependent buffer. The result is
+   /// a single channel buffer suitable for the frequency-independent measurement equation.
+   /// It allows us to iterate over the data once, accumulate all channels and then solve for
+   /// each channel separately.
+   /// @param[in] src source buffer
+   /// @param[in] chan channel of the source buffer to copy
+   void initialise(const PreAvgCalBuffer &src, casacore::uInt chan);
+
    // implemented accessor methods
    
    /// The number of rows in this chunk
@@ -202,16 +214,26 @@ public:
     
 protected:
    /// @brief helper method to find a match row in the buffer
-   /// @details It goes over antenna and beam indices and finds a buffer row which 
-   /// corresponds to the given indices.
+   /// @details It looks up the buffer row which corresponds to the given indices
+   /// in the index built by buildRowIndex.
    /// @param[in] ant1 index of the first antenna
    /// @param[in] ant2 index of the second antenna
    /// @param[in] beam beam index
    /// @return row number in the buffer corresponding to the given (ant1,ant2,beam) or -1 if 
    /// there is no match
-   int findMatch(casacore::uInt ant1, casacore::uInt ant2, casacore::uInt beam); 
+   int findMatch(casacore::uInt ant1, casacore::uInt ant2, casacore::uInt beam) const; 
       
 private:
+   /// @brief build the index used by findMatch
+   /// @details The index is a dense table of row numbers addressed by (beam, ant1, ant2)
+   /// covering all antenna and beam indices present in the buffer. It has to be rebuilt
+   /// every time the metadata change (i.e. in all initialise methods). If the same
+   /// indices are present in more than one row, the first row is used.
+   /// @param[in] excludedBeam rows with this beam index are not indexed (i.e. they will
+   /// never match), negative value means all rows are indexed
+   void buildRowIndex(const int excludedBeam = -1);
+   
+
    /// @brief indices of the first antenna for all rows
    casacore::Vector<casacore::uInt> itsAntenna1;   
    
@@ -251,6 +273,16 @@ private:
    
    /// @brief if true, beam index is ignored
    bool itsBeamIndependent;
+
+   /// @brief row numbers for all (beam, ant1, ant2) combinations, -1 means no match
+   /// @details see buildRowIndex
+   std::vector<int> itsRowIndex;
+
+   /// @brief number of antenna indices covered by itsRowIndex
+   casacore::uInt itsIndexNAnt;
+
+   /// @brief number of beam indices covered by itsRowIndex
+   casacore::uInt itsIndexNBeam;
 };
 
 } // namespace synthesis
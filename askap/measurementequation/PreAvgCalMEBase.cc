@@ -56,7 +56,8 @@ using namespace askap::synthesis;
 /// @brief constructor setting up only parameters
 /// @param[in] ip Parameters
 PreAvgCalMEBase::PreAvgCalMEBase(const askap::scimath::Params& ip) :
-    scimath::GenericEquation(ip), itsNoDataProcessedFlag(true), itsMinTime(0.), itsMaxTime(0.)
+    scimath::GenericEquation(ip), itsNoDataProcessedFlag(true), itsMinTime(0.), itsMaxTime(0.),
+    itsMaxBatchRows(0u)
      {}
 
 /// @brief Standard constructor using the parameters and the
@@ -69,7 +70,7 @@ PreAvgCalMEBase::PreAvgCalMEBase(const askap::scimath::Params& ip,
         const accessors::IDataSharedIter& idi, 
         const boost::shared_ptr<IMeasurementEquation const> &ime) :
         scimath::GenericEquation(ip), itsNoDataProcessedFlag(true), 
-        itsMinTime(0.), itsMaxTime(0.)
+        itsMinTime(0.), itsMaxTime(0.), itsMaxBatchRows(0u)
 {
   accumulate(idi,ime);
 }
@@ -85,6 +86,20 @@ void PreAvgCalMEBase::beamIndependent(const bool flag)
   itsBuffer.beamIndependent(flag);
 }
 
+/// @brief configure batched prediction
+/// @details If enabled, the iterator-based accumulate method combines consecutive
+/// chunks with the same spectral and polarisation setup into batches of up to the given
+/// number of rows and predicts model visibilities for the whole batch at once. This
+/// amortises the per-chunk setup cost of the model prediction (most notably for
+/// image-based models) when chunks are small.
+/// @param[in] maxRows maximum number of rows in one batch, 0 disables batching
+/// @param[in] cache optional shared cache of rotated uvw's and delays
+void PreAvgCalMEBase::batchPrediction(size_t maxRows, const boost::shared_ptr<RotatedUVWCache> &cache)
+{
+  itsMaxBatchRows = maxRows;
+  itsRotatedUVWCache = cache;
+}
+
           
 /// @brief accumulate one accessor
 /// @details This method processes one accessor and accumulates the data.
@@ -108,11 +123,43 @@ void PreAvgCalMEBase::accumulate(const accessors::IDataSharedIter& idi,
 {
   const bool fdp = isFrequencyDependent();
   accessors::IDataSharedIter iter(idi);
+  if (itsMaxBatchRows == 0) {
+      for (; iter.hasMore(); iter.next()) {
+           itsBuffer.accumulate(*iter,ime,fdp);
+           accumulateStats(*iter);
+      }
+      return;
+  }
+  boost::shared_ptr<BatchedPredictionAccessor> batch;
   for (; iter.hasMore(); iter.next()) {
-       itsBuffer.accumulate(*iter,ime,fdp);
+       if (iter->nRow() == 0) {
+           continue;
+       }
+       if (batch && (!batch->isCompatible(*iter) || (batch->nAppendedRows() + iter->nRow() > itsMaxBatchRows))) {
+           accumulateBatch(*batch, ime);
+           batch.reset();
+       }
+       if (!batch) {
+           batch.reset(new BatchedPredictionAccessor(itsRotatedUVWCache));
+       }
+       batch->append(*iter);
        accumulateStats(*iter);
   }
+  if (batch) {
+      accumulateBatch(*batch, ime);
+  }
 }        
+
+/// @brief predict and accumulate one batch of chunks
+/// @param[in] batch accessor with appended chunks (merged by this method)
+/// @param[in] ime measurement equation describing perfect visibilities
+void PreAvgCalMEBase::accumulateBatch(BatchedPredictionAccessor &batch,
+        const boost::shared_ptr<IMeasurementEquation const> &ime)
+{
+  batch.merge();
+  ASKAPLOG_DEBUG_STR(logger, "Predicting "<<batch.nRow()<<" rows of "<<batch.nChunks()<<" chunks in one batch");
+  itsBuffer.accumulate(batch, ime, isFrequencyDependent());
+}
                     
 /// @brief Predict model visibilities for one accessor (chunk).
 /// @details This class cannot be used for prediction 
@@ -255,6 +302,22 @@ void PreAvgCalMEBase::initialise(casacore::uInt nAnt, casacore::uInt nBeam, casa
   itsMaxTime = 0.;
 }
 
+/// @brief initialise with one channel accumulated by another equation
+/// @details Data accumulated by the frequency-dependent equation for the given
+/// channel are copied into the buffer of this equation, which is expected to be 
+/// frequency-independent. This allows us to solve for each channel separately 
+/// after a single pass over the data.
+/// @param[in] src frequency-dependent equation with accumulated data
+/// @param[in] chan channel index in the buffer of src
+void PreAvgCalMEBase::initialise(const PreAvgCalMEBase &src, casacore::uInt chan)
+{
+  ASKAPCHECK(!isFrequencyDependent(), "Only frequency-independent equation can be initialised from a single channel");
+  itsBuffer.initialise(src.itsBuffer, chan);
+  itsNoDataProcessedFlag = src.itsNoDataProcessedFlag;
+  itsMinTime = src.itsMinTime;
+  itsMaxTime = src.itsMaxTime;
+}
+
 /// @brief destructor 
 /// @details This method just prints statistics on the number of
 /// visibilities not accumulated due to various reasons
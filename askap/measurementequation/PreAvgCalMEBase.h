@@ -36,6 +36,7 @@
 #define PRE_AVG_CAL_ME_BASE_H
 
 #include <askap/measurementequation/PreAvgCalBuffer.h>
+#include <askap/measurementequation/BatchedPredictionAccessor.h>
 #include <askap/dataaccess/IDataAccessor.h>
 #include <askap/dataaccess/SharedIter.h>
 #include <askap/scimath/fitting/GenericEquation.h>
@@ -113,6 +114,15 @@ public:
   /// frequency-independent buffering
   void initialise(casacore::uInt nAnt, casacore::uInt nBeam, casacore::uInt nChan = 1);
 
+  /// @brief initialise with one channel accumulated by another equation
+  /// @details Data accumulated by the frequency-dependent equation for the given
+  /// channel are copied into the buffer of this equation, which is expected to be 
+  /// frequency-independent. This allows us to solve for each channel separately 
+  /// after a single pass over the data.
+  /// @param[in] src frequency-dependent equation with accumulated data
+  /// @param[in] chan channel index in the buffer of src
+  void initialise(const PreAvgCalMEBase &src, casacore::uInt chan);
+
   /// @brief destructor 
   /// @details This method just prints statistics on the number of
   /// visibilities not accumulated due to various reasons
@@ -125,6 +135,17 @@ public:
   /// beam-independent case as well)
   /// @param[in] flag if true, the ME is assumed to be beam-independent
   void beamIndependent(const bool flag);
+
+  /// @brief configure batched prediction
+  /// @details If enabled, the iterator-based accumulate method combines consecutive
+  /// chunks with the same spectral and polarisation setup into batches of up to the given
+  /// number of rows and predicts model visibilities for the whole batch at once. This
+  /// amortises the per-chunk setup cost of the model prediction (most notably for
+  /// image-based models) when chunks are small.
+  /// @param[in] maxRows maximum number of rows in one batch, 0 disables batching
+  /// @param[in] cache optional shared cache of rotated uvw's and delays
+  void batchPrediction(size_t maxRows, const boost::shared_ptr<RotatedUVWCache> &cache =
+                       boost::shared_ptr<RotatedUVWCache>());
   
   /// @brief check whether the measurement equation is frequency-dependent
   /// @details For frequency-dependent effects the buildComplexDiffMatrix method returns block matrix with 
@@ -184,6 +205,12 @@ private:
   /// @param[in] ne normal equations
   void initIndexedNormalMatrixAndParameterIndex(scimath::GenericNormalEquations &ne) const;
 
+  /// @brief predict and accumulate one batch of chunks
+  /// @param[in] batch accessor with appended chunks (merged by this method)
+  /// @param[in] ime measurement equation describing perfect visibilities
+  void accumulateBatch(BatchedPredictionAccessor &batch,
+          const boost::shared_ptr<IMeasurementEquation const> &ime);
+
   /// @brief buffer with partial sums
   PreAvgCalBuffer itsBuffer;    
   
@@ -203,6 +230,12 @@ private:
   /// @details (the units are the same as returned by time() method of the data accessor)
   /// This data field is undefined if itsNoDataProcessedFlag is true.
   double itsMaxTime;   
+
+  /// @brief maximum number of rows predicted together, 0 means no batching
+  size_t itsMaxBatchRows;
+
+  /// @brief shared cache of rotated uvw's and delays used for batched prediction
+  boost::shared_ptr<RotatedUVWCache> itsRotatedUVWCache;
 };
 
 } // namespace synthesis
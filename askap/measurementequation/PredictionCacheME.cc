@@ -0,0 +1,339 @@
+/// @file
+///
+/// @brief cache of model visibilities predicted by a measurement equation
+/// @details Calibration predicts visibilities corresponding to the sky model on every
+/// iteration and every pass over the data, although the model itself doesn't change.
+/// This class is a decorator of the measurement equation which stores predicted
+/// visibilities keyed by a hash of the model and a hash of the chunk metadata
+/// (time, baselines, beams, frequencies and uvw's). The cache is held in memory (up to
+/// a given size) and, optionally, in a directory on disk, so it can be reused by
+/// subsequent runs with the same model and data selection.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+
+
+#include <askap/measurementequation/PredictionCacheME.h>
+#include <askap/scimath/fitting/Axes.h>
+#include <askap/utils/HashUtils.h>
+#include <askap/askap_synthesis.h>
+#include <askap/AskapError.h>
+#include <askap/AskapLogging.h>
+
+#include <casacore/casa/Arrays/Vector.h>
+#include <casacore/scimath/Mathematics/RigidVector.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <typeinfo>
+#include <vector>
+
+ASKAP_LOGGER(logger, ".measurementequation.predictioncacheme");
+
+namespace askap {
+
+namespace synthesis {
+
+namespace {
+
+/// @brief signature at the start of each cache file
+const char theirFileSignature[8] = {'A', 'S', 'K', 'A', 'P', 'M', 'V', '1'};
+
+/// @brief version of the cache key, change it if the way visibilities are predicted changes
+const char theirKeyVersion[] = "PredictionCacheME.key.v2";
+
+/// @brief update hash with all elements of a vector
+/// @param[in] hash current value of the hash
+/// @param[in] vec vector
+/// @return updated hash
+template<typename T>
+uint64_t hashVector(uint64_t hash, const casacore::Vector<T> &vec)
+{
+  hash = hashValue(hash, vec.nelements());
+  for (casacore::uInt i = 0; i < vec.nelements(); ++i) {
+       hash = hashValue(hash, vec[i]);
+  }
+  return hash;
+}
+
+/// @brief update hash with a string
+/// @param[in] hash current value of the hash
+/// @param[in] str string
+/// @return updated hash
+uint64_t hashString(uint64_t hash, const std::string &str)
+{
+  hash = hashValue(hash, str.size());
+  return hashBytes(hash, str.data(), str.size());
+}
+
+} // anonymous namespace
+
+/// @brief constructor
+/// @param[in] me measurement equation to wrap
+/// @param[in] model model used by the wrapped equation (only used to compute the hash)
+/// @param[in] directory directory to store cached visibilities, empty string means memory only
+/// @param[in] maxMemory maximum size of the cache held in memory (in bytes)
+/// @param[in] settings description of the prediction settings (e.g. gridder parameters), it is
+/// combined with the model hash, so visibilities predicted with other settings are not reused
+PredictionCacheME::PredictionCacheME(const boost::shared_ptr<IMeasurementEquation const> &me,
+                     const scimath::Params &model, const std::string &directory, size_t maxMemory,
+                     const std::string &settings) :
+       itsME(me), itsModelHash(hashString(hashString(modelHash(model), theirKeyVersion), settings)),
+       itsDirectory(directory), itsMaxMemory(maxMemory),
+       itsMemoryUsed(0), itsHits(0), itsMisses(0)
+{
+  ASKAPCHECK(itsME, "Measurement equation to cache is not defined");
+  ASKAPLOG_DEBUG_STR(logger, "Model hash: "<<std::hex<<itsModelHash<<std::dec);
+}
+
+/// @brief wrap the measurement equation into the cache, if requested in the parset
+/// @details The following parameters are recognised: modelcache (bool, false by default),
+/// modelcache.directory (string, empty by default) and modelcache.memory (size in MB, 1024
+/// by default). The equation is returned unchanged if the cache is not requested. The type of
+/// the equation, all gridder parameters and the version of the cache format are included
+/// in the cache key together with the model.
+/// @param[in] parset parset with parameters
+/// @param[in] me measurement equation to wrap
+/// @param[in] model model used by the wrapped equation
+/// @return measurement equation to use
+boost::shared_ptr<IMeasurementEquation const> PredictionCacheME::create(const LOFAR::ParameterSet &parset,
+                     const boost::shared_ptr<IMeasurementEquation const> &me, const scimath::Params &model)
+{
+  if (!parset.getBool("modelcache", false)) {
+      return me;
+  }
+  const std::string directory = parset.getString("modelcache.directory", "");
+  const size_t maxMemory = static_cast<size_t>(parset.getUint32("modelcache.memory", 1024u)) * 1048576u;
+  ASKAPLOG_INFO_STR(logger, "Model visibilities will be cached, up to "<<maxMemory / 1048576u<<" MB in memory"<<
+                    (directory.size() ? ", all chunks in "+directory : std::string()));
+  ASKAPCHECK(me, "Measurement equation to cache is not defined");
+  // the parset subset is printed in the order of keys, so the description is reproducible
+  std::ostringstream settings;
+  settings<<"equation = "<<typeid(*me).name()<<std::endl<<parset.makeSubset("gridder");
+  return boost::shared_ptr<IMeasurementEquation const>(new PredictionCacheME(me, model, directory, maxMemory,
+                                                       settings.str()));
+}
+
+/// @brief Predict model visibilities for one accessor (chunk).
+/// @details Visibilities are taken from the cache if they are available, otherwise the
+/// wrapped equation is used and the result is stored in the cache.
+/// @param[in] chunk a read-write accessor to work with
+void PredictionCacheME::predict(accessors::IDataAccessor &chunk) const
+{
+  const uint64_t key = hashValue(chunkHash(chunk), itsModelHash);
+  casacore::Cube<casacore::Complex> &rwVis = chunk.rwVisibility();
+  const casacore::IPosition shape(3, chunk.nRow(), chunk.nChannel(), chunk.nPol());
+  ASKAPDEBUGASSERT(rwVis.shape() == shape);
+  {
+    boost::lock_guard<boost::mutex> lock(itsMutex);
+    const std::map<uint64_t, casacore::Cube<casacore::Complex> >::const_iterator ci = itsCache.find(key);
+    if ((ci != itsCache.end()) && (ci->second.shape() == shape)) {
+        rwVis = ci->second;
+        ++itsHits;
+        return;
+    }
+  }
+  const bool fromDisk = (itsDirectory.size() > 0) && readFromDisk(key, rwVis);
+  if (!fromDisk) {
+      itsME->predict(chunk);
+      if (itsDirectory.size() > 0) {
+          writeToDisk(key, rwVis);
+      }
+  }
+
+  const size_t size = rwVis.nelements() * sizeof(casacore::Complex);
+  boost::lock_guard<boost::mutex> lock(itsMutex);
+  if (fromDisk) {
+      ++itsHits;
+  } else {
+      ++itsMisses;
+  }
+  if ((itsMemoryUsed + size <= itsMaxMemory) && (itsCache.find(key) == itsCache.end())) {
+      itsCache[key] = rwVis.copy();
+      itsMemoryUsed += size;
+  }
+}
+
+/// @brief Calculate the normal equation for one accessor (chunk).
+/// @details This method is passed to the wrapped equation.
+/// @param[in] chunk a read-write accessor to work with
+/// @param[in] ne Normal equations
+void PredictionCacheME::calcEquations(const accessors::IConstDataAccessor &chunk,
+                          askap::scimath::INormalEquations& ne) const
+{
+  itsME->calcEquations(chunk, ne);
+}
+
+/// @brief hash of the model
+/// @details Names, values and axes of all parameters are taken into account.
+/// @param[in] model model parameters
+/// @return 64-bit hash
+uint64_t PredictionCacheME::modelHash(const scimath::Params &model)
+{
+  uint64_t hash = fnvHashSeed;
+  const std::vector<std::string> names = model.names();
+  for (std::vector<std::string>::const_iterator ci = names.begin(); ci != names.end(); ++ci) {
+       hash = hashString(hash, *ci);
+       const casacore::Array<double> &value = model.value(*ci);
+       hash = hashValue(hash, value.nelements());
+       bool deleteIt = false;
+       const double *data = value.getStorage(deleteIt);
+       hash = hashBytes(hash, data, value.nelements() * sizeof(double));
+       value.freeStorage(data, deleteIt);
+       const scimath::Axes &axes = model.axes(*ci);
+       const std::vector<std::string> &axesNames = axes.names();
+       for (std::vector<std::string>::const_iterator axIt = axesNames.begin(); axIt != axesNames.end(); ++axIt) {
+            hash = hashString(hash, *axIt);
+            hash = hashValue(hash, axes.start(*axIt));
+            hash = hashValue(hash, axes.end(*axIt));
+       }
+  }
+  return hash;
+}
+
+/// @brief hash of the chunk metadata
+/// @details Time, shape, antennas, beams, frequencies, polarisation products and uvw's are
+/// taken into account.
+/// @param[in] chunk accessor
+/// @return 64-bit hash
+uint64_t PredictionCacheME::chunkHash(const accessors::IConstDataAccessor &chunk)
+{
+  uint64_t hash = fnvHashSeed;
+  hash = hashValue(hash, chunk.time());
+  hash = hashValue(hash, chunk.nRow());
+  hash = hashValue(hash, chunk.nChannel());
+  hash = hashValue(hash, chunk.nPol());
+  hash = hashVector(hash, chunk.antenna1());
+  hash = hashVector(hash, chunk.antenna2());
+  hash = hashVector(hash, chunk.feed1());
+  hash = hashVector(hash, chunk.feed2());
+  hash = hashVector(hash, chunk.frequency());
+  const casacore::Vector<casacore::Stokes::StokesTypes> &stokes = chunk.stokes();
+  for (casacore::uInt pol = 0; pol < stokes.nelements(); ++pol) {
+       hash = hashValue(hash, static_cast<int>(stokes[pol]));
+  }
+  const casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw = chunk.uvw();
+  for (casacore::uInt row = 0; row < uvw.nelements(); ++row) {
+       for (casacore::uInt dim = 0; dim < 3; ++dim) {
+            hash = hashValue(hash, uvw[row](dim));
+       }
+  }
+  return hash;
+}
+
+/// @brief number of predictions served from the cache
+/// @return number of cache hits
+size_t PredictionCacheME::nHits() const
+{
+  boost::lock_guard<boost::mutex> lock(itsMutex);
+  return itsHits;
+}
+
+/// @brief number of predictions done by the wrapped equation
+/// @return number of cache misses
+size_t PredictionCacheME::nMisses() const
+{
+  boost::lock_guard<boost::mutex> lock(itsMutex);
+  return itsMisses;
+}
+
+/// @brief file name for the given key
+/// @param[in] key cache key
+/// @return full file name
+std::string PredictionCacheME::fileName(uint64_t key) const
+{
+  std::ostringstream os;
+  os<<itsDirectory<<"/"<<std::hex<<std::setw(16)<<std::setfill('0')<<key<<".vis";
+  return os.str();
+}
+
+/// @brief read cached visibilities from disk
+/// @param[in] key cache key
+/// @param[out] vis visibility cube, must have the expected shape
+/// @return true if the file exists and has the expected content
+bool PredictionCacheME::readFromDisk(uint64_t key, casacore::Cube<casacore::Complex> &vis) const
+{
+  std::ifstream is(fileName(key).c_str(), std::ios::binary);
+  if (!is) {
+      return false;
+  }
+  char signature[sizeof(theirFileSignature)];
+  uint64_t storedKey = 0;
+  uint32_t shape[3] = {0, 0, 0};
+  is.read(signature, sizeof(signature));
+  is.read(reinterpret_cast<char*>(&storedKey), sizeof(storedKey));
+  is.read(reinterpret_cast<char*>(shape), sizeof(shape));
+  if (!is || !std::equal(signature, signature + sizeof(signature), theirFileSignature) || (storedKey != key) ||
+      (shape[0] != vis.nrow()) || (shape[1] != vis.ncolumn()) || (shape[2] != vis.nplane())) {
+      ASKAPLOG_WARN_STR(logger, "Cache file "<<fileName(key)<<" doesn't match the data, ignoring it");
+      return false;
+  }
+  bool deleteIt = false;
+  casacore::Complex *data = vis.getStorage(deleteIt);
+  is.read(reinterpret_cast<char*>(data), vis.nelements() * sizeof(casacore::Complex));
+  const bool success = static_cast<bool>(is);
+  vis.putStorage(data, deleteIt);
+  if (!success) {
+      ASKAPLOG_WARN_STR(logger, "Cache file "<<fileName(key)<<" is truncated, ignoring it");
+  }
+  return success;
+}
+
+/// @brief write visibilities to disk
+/// @details The file is written under a temporary name and then renamed, so other processes
+/// never see an incomplete file. Errors are reported as warnings.
+/// @param[in] key cache key
+/// @param[in] vis visibility cube
+void PredictionCacheME::writeToDisk(uint64_t key, const casacore::Cube<casacore::Complex> &vis) const
+{
+  const std::string name = fileName(key);
+  std::ostringstream tmpName;
+  tmpName<<name<<".tmp"<<this;
+  {
+    std::ofstream os(tmpName.str().c_str(), std::ios::binary);
+    const uint32_t shape[3] = {static_cast<uint32_t>(vis.nrow()), static_cast<uint32_t>(vis.ncolumn()),
+                               static_cast<uint32_t>(vis.nplane())};
+    os.write(theirFileSignature, sizeof(theirFileSignature));
+    os.write(reinterpret_cast<const char*>(&key), sizeof(key));
+    os.write(reinterpret_cast<const char*>(shape), sizeof(shape));
+    bool deleteIt = false;
+    const casacore::Complex *data = vis.getStorage(deleteIt);
+    os.write(reinterpret_cast<const char*>(data), vis.nelements() * sizeof(casacore::Complex));
+    vis.freeStorage(data, deleteIt);
+    if (!os) {
+        ASKAPLOG_WARN_STR(logger, "Unable to write cache file "<<tmpName.str());
+        std::remove(tmpName.str().c_str());
+        return;
+    }
+  }
+  if (std::rename(tmpName.str().c_str(), name.c_str()) != 0) {
+      ASKAPLOG_WARN_STR(logger, "Unable to rename "<<tmpName.str()<<" into "<<name);
+      std::remove(tmpName.str().c_str());
+  }
+}
+
+} // namespace synthesis
+
+} // namespace askap
@@ -0,0 +1,181 @@
+/// @file
+///
+/// @brief cache of model visibilities predicted by a measurement equation
+/// @details Calibration predicts visibilities corresponding to the sky model on every
+/// iteration and every pass over the data, although the model itself doesn't change.
+/// This class is a decorator of the measurement equation which stores predicted
+/// visibilities keyed by a hash of the model and a hash of the chunk metadata
+/// (time, baselines, beams, frequencies and uvw's). The cache is held in memory (up to
+/// a given size) and, optionally, in a directory on disk, so it can be reused by
+/// subsequent runs with the same model and data selection.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+
+
+#ifndef PREDICTION_CACHE_ME_H
+#define PREDICTION_CACHE_ME_H
+
+// own includes
+#include <askap/measurementequation/IMeasurementEquation.h>
+#include <askap/scimath/fitting/Params.h>
+#include <Common/ParameterSet.h>
+
+// casa includes
+#include <casacore/casa/Arrays/Cube.h>
+#include <casacore/casa/BasicSL/Complex.h>
+
+// boost includes
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+// std includes
+#include <map>
+#include <string>
+#include <stdint.h>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief cache of model visibilities predicted by a measurement equation
+/// @details Only the predict method is cached, normal equations are calculated by the
+/// wrapped equation. The model hash is computed at construction, so the model is assumed
+/// to stay unchanged for the lifetime of this object (as it is the case for the uncorrupted
+/// model used in calibration). Chunks are not evicted from memory, once the memory limit is
+/// reached new chunks are only stored on disk (if the directory is given). This works best for
+/// repeated passes over the same data where an LRU policy would evict every chunk before reuse.
+/// All methods are thread safe, prediction itself is done without holding the lock.
+/// @ingroup measurementequation
+class PredictionCacheME : virtual public IMeasurementEquation {
+public:
+   /// @brief constructor
+   /// @param[in] me measurement equation to wrap
+   /// @param[in] model model used by the wrapped equation (only used to compute the hash)
+   /// @param[in] directory directory to store cached visibilities, empty string means memory only
+   /// @param[in] maxMemory maximum size of the cache held in memory (in bytes)
+   /// @param[in] settings description of the prediction settings (e.g. gridder parameters), it is
+   /// combined with the model hash, so visibilities predicted with other settings are not reused
+   PredictionCacheME(const boost::shared_ptr<IMeasurementEquation const> &me, const scimath::Params &model,
+                     const std::string &directory = "", size_t maxMemory = 1073741824u,
+                     const std::string &settings = "");
+
+   /// @brief wrap the measurement equation into the cache, if requested in the parset
+   /// @details The following parameters are recognised: modelcache (bool, false by default),
+   /// modelcache.directory (string, empty by default) and modelcache.memory (size in MB, 1024
+   /// by default). The equation is returned unchanged if the cache is not requested. The type of
+   /// the equation, all gridder parameters and the version of the cache format are included
+   /// in the cache key together with the model.
+   /// @param[in] parset parset with parameters
+   /// @param[in] me measurement equation to wrap
+   /// @param[in] model model used by the wrapped equation
+   /// @return measurement equation to use
+   static boost::shared_ptr<IMeasurementEquation const> create(const LOFAR::ParameterSet &parset,
+                     const boost::shared_ptr<IMeasurementEquation const> &me, const scimath::Params &model);
+
+   /// @brief Predict model visibilities for one accessor (chunk).
+   /// @details Visibilities are taken from the cache if they are available, otherwise the
+   /// wrapped equation is used and the result is stored in the cache.
+   /// @param[in] chunk a read-write accessor to work with
+   virtual void predict(accessors::IDataAccessor &chunk) const;
+
+   /// @brief Calculate the normal equation for one accessor (chunk).
+   /// @details This method is passed to the wrapped equation.
+   /// @param[in] chunk a read-write accessor to work with
+   /// @param[in] ne Normal equations
+   virtual void calcEquations(const accessors::IConstDataAccessor &chunk,
+                          askap::scimath::INormalEquations& ne) const;
+
+   /// @brief hash of the model
+   /// @details Names, values and axes of all parameters are taken into account.
+   /// @param[in] model model parameters
+   /// @return 64-bit hash
+   static uint64_t modelHash(const scimath::Params &model);
+
+   /// @brief hash of the chunk metadata
+   /// @details Time, shape, antennas, beams, frequencies, polarisation products and uvw's are
+   /// taken into account.
+   /// @param[in] chunk accessor
+   /// @return 64-bit hash
+   static uint64_t chunkHash(const accessors::IConstDataAccessor &chunk);
+
+   /// @brief number of predictions served from the cache
+   /// @return number of cache hits
+   size_t nHits() const;
+
+   /// @brief number of predictions done by the wrapped equation
+   /// @return number of cache misses
+   size_t nMisses() const;
+
+protected:
+   /// @brief read cached visibilities from disk
+   /// @param[in] key cache key
+   /// @param[out] vis visibility cube, must have the expected shape
+   /// @return true if the file exists and has the expected content
+   bool readFromDisk(uint64_t key, casacore::Cube<casacore::Complex> &vis) const;
+
+   /// @brief write visibilities to disk
+   /// @details The file is written under a temporary name and then renamed, so other processes
+   /// never see an incomplete file. Errors are reported as warnings.
+   /// @param[in] key cache key
+   /// @param[in] vis visibility cube
+   void writeToDisk(uint64_t key, const casacore::Cube<casacore::Complex> &vis) const;
+
+   /// @brief file name for the given key
+   /// @param[in] key cache key
+   /// @return full file name
+   std::string fileName(uint64_t key) const;
+
+private:
+   /// @brief wrapped measurement equation
+   boost::shared_ptr<IMeasurementEquation const> itsME;
+
+   /// @brief hash of the model
+   uint64_t itsModelHash;
+
+   /// @brief directory for cached data (empty string means memory only)
+   std::string itsDirectory;
+
+   /// @brief maximum size of the memory cache in bytes
+   size_t itsMaxMemory;
+
+   /// @brief cached visibilities indexed by key
+   mutable std::map<uint64_t, casacore::Cube<casacore::Complex> > itsCache;
+
+   /// @brief current size of the memory cache in bytes
+   mutable size_t itsMemoryUsed;
+
+   /// @brief number of cache hits
+   mutable size_t itsHits;
+
+   /// @brief number of cache misses
+   mutable size_t itsMisses;
+
+   /// @brief synchronisation of the cache
+   mutable boost::mutex itsMutex;
+};
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef PREDICTION_CACHE_ME_H
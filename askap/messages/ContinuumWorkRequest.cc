@@ -45,12 +45,14 @@
 
 // Using
 using namespace askap::cp;
+using askap::synthesis::CompressedBlobCodec;
 
 const unsigned int ContinuumWorkRequest::CHANNEL_UNINITIALISED
     = std::numeric_limits<unsigned int>::max();
 
 ContinuumWorkRequest::ContinuumWorkRequest()
-    : itsGlobalChannel(CHANNEL_UNINITIALISED)
+    : itsGlobalChannel(CHANNEL_UNINITIALISED),
+      itsCompression(CompressedBlobCodec::SHUFFLED_ZERO_RUNS)
 {
 }
 
@@ -76,6 +78,11 @@ void ContinuumWorkRequest::set_params(askap::scimath::Params::ShPtr params)
     itsParams = params;
 }
 
+void ContinuumWorkRequest::set_compression(CompressedBlobCodec::Mode mode)
+{
+    itsCompression = mode;
+}
+
 /////////////////////////////////////////////////////////////////////
 // Getters
 /////////////////////////////////////////////////////////////////////
@@ -131,12 +138,16 @@ void ContinuumWorkRequest::sendRequest(int master, askapparallel::AskapParallel&
 
     int messageType = this->getMessageType();
 
+    // images are mostly zeros (model) or single precision values held as doubles
+    std::vector<int8_t> encoded;
+    CompressedBlobCodec::encode(&buf[0], buf.size(), itsCompression, encoded);
+
     // First send the size of the buffer
-    const unsigned long size = buf.size();
+    const unsigned long size = encoded.size();
     comm.send(&size,sizeof(long),master,messageType,communicator);
 
     // Now send the actual byte stream
-    comm.send(&buf[0], size * sizeof(int8_t), master, messageType,communicator);
+    comm.send(&encoded[0], size * sizeof(int8_t), master, messageType,communicator);
 
 
 }
@@ -157,7 +168,9 @@ void ContinuumWorkRequest::receiveRequest(int& id, askapparallel::AskapParallel&
     comm.receive(&buf[0], size * sizeof(char), id, this->getMessageType(), communicator);
 
     // Decode
-    LOFAR::BlobIBufVector<int8_t> bv(buf);
+    std::vector<int8_t> decoded;
+    CompressedBlobCodec::decode(&buf[0], buf.size(), decoded);
+    LOFAR::BlobIBufVector<int8_t> bv(decoded);
     LOFAR::BlobIStream in(bv);
     int version = in.getStart("Message");
     ASKAPASSERT(version == 1);
@@ -33,6 +33,7 @@
 #include <Blob/BlobIStream.h>
 #include <askap/scimath/fitting/Params.h>
 #include <askapparallel/AskapParallel.h>
+#include <askap/parallel/CompressedBlobCodec.h>
 
 namespace askap {
     namespace cp {
@@ -63,6 +64,13 @@ namespace askap {
                 void set_globalChannel(unsigned int chan);
                 void set_params(askap::scimath::Params::ShPtr params);
 
+                /// @brief set the encoding used by sendRequest
+                /// @details The images are compressed with the byte shuffle and
+                /// run-length encoding of zeros by default. The receiver takes the
+                /// mode from the message, so only the sender needs to know it.
+                /// @param[in] mode encoding mode (NONE to send the serialised stream as is)
+                void set_compression(askap::synthesis::CompressedBlobCodec::Mode mode);
+
                 // Getters
                 unsigned int get_globalChannel(void) const;
                 askap::scimath::Params::ShPtr get_params(void);
@@ -92,6 +100,7 @@ namespace askap {
 
                 unsigned int itsGlobalChannel;
                 askap::scimath::Params::ShPtr itsParams;
+                askap::synthesis::CompressedBlobCodec::Mode itsCompression;
 
 
             };
@@ -74,6 +74,7 @@ ASKAP_LOGGER(logger, ".parallel");
 #include <askap/measurementequation/CalibrationME.h>
 #include <askap/measurementequation/PreAvgCalMEBase.h>
 #include <askap/measurementequation/ComponentEquation.h>
+#include <askap/measurementequation/PredictionCacheME.h>
 #include <askap/measurementequation/NoXPolGain.h>
 #include <askap/measurementequation/NoXPolFreqDependentGain.h>
 #include <askap/measurementequation/NoXPolBeamIndependentGain.h>
@@ -95,7 +96,14 @@ ASKAP_LOGGER(logger, ".parallel");
 #include <casacore/casa/aips.h>
 #include <casacore/casa/OS/Timer.h>
 
+// boost includes
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
 #include <algorithm>
+#include <map>
+#include <exception>
 
 
 namespace askap {
@@ -111,9 +119,20 @@ using askap::operator<<;
 /// @param[in] parset ParameterSet for inputs
 BPCalibratorParallel::BPCalibratorParallel(askap::askapparallel::AskapParallel& comms,
           const LOFAR::ParameterSet& parset) : MEParallelApp(comms,emptyDatasetKeyword(parset)),
-      itsPerfectModel(new scimath::Params()), itsRefAntenna(-1), itsSolutionID(-1), itsSolutionIDValid(false)
+      itsPerfectModel(new scimath::Params()), itsRefAntenna(-1), itsSolutionID(-1), itsSolutionIDValid(false),
+      itsSinglePass(parset.getBool("singlepass", false)), itsNThreads(parset.getUint32("nthreads", 1u)),
+      itsPredictionBatchRows(parset.getUint32("predictbatch", 0u))
 {
   ASKAPLOG_INFO_STR(logger, "Bandpass will be solved for using a specialised pipeline");
+  if (itsPredictionBatchRows > 0) {
+      // memory in MB
+      const casacore::uInt cacheMemory = parset.getUint32("predictbatch.uvwcache", 256u);
+      ASKAPLOG_INFO_STR(logger, "Uncorrupted model will be predicted for up to "<<itsPredictionBatchRows<<
+                        " rows at once, up to "<<cacheMemory<<" MB will be used to cache rotated uvw's");
+      if (cacheMemory > 0) {
+          itsRotatedUVWCache.reset(new RotatedUVWCache(static_cast<size_t>(cacheMemory) * 1024 * 1024));
+      }
+  }
   if (itsComms.isMaster()) {
       // setup solution source (or sink to be exact, because we're writing the solution here)
       itsSolutionSource = accessors::CalibAccessFactory::rwCalSolutionSource(parset);
@@ -159,6 +178,11 @@ BPCalibratorParallel::BPCalibratorParallel(askap::askapparallel::AskapParallel&
       } else {
           ASKAPLOG_INFO_STR(logger, "No phase rotation will be done between iterations");
       }
+      ASKAPCHECK(itsNThreads > 0, "Number of threads is supposed to be a positive number");
+      if (itsSinglePass) {
+          ASKAPLOG_INFO_STR(logger, "All channels of each beam will be accumulated in one pass over the data, "<<
+                            itsNThreads<<" thread(s) will be used to solve for individual channels");
+      }
 
       // load sky model, populate itsPerfectModel
       readModels();
@@ -233,51 +257,55 @@ void BPCalibratorParallel::run()
       const int nCycles = parset().getInt32("ncycles", 1);
       ASKAPCHECK(nCycles >= 0, " Number of calibration iterations should be a non-negative number, you have " <<
                        nCycles);
-      for (itsWorkUnitIterator.origin(); itsWorkUnitIterator.hasMore(); itsWorkUnitIterator.next()) {
-           // this will force creation of the new measurement equation for this beam/channel pair
-           itsEquation.reset();
-
-           const std::pair<casacore::uInt, casacore::uInt> indices = currentBeamAndChannel();
-
-           ASKAPLOG_INFO_STR(logger, "Initialise bandpass (unknowns) for "<<nAnt()<<" antennas for beam="<<indices.first<<
-                             " and channel="<<indices.second);
-           itsModel->reset();
-           for (casacore::uInt ant = 0; ant<nAnt(); ++ant) {
-                itsModel->add(accessors::CalParamNameHelper::paramName(ant, indices.first, casacore::Stokes::XX), casacore::Complex(1.,0.));
-                itsModel->add(accessors::CalParamNameHelper::paramName(ant, indices.first, casacore::Stokes::YY), casacore::Complex(1.,0.));
-           }
+      if (itsSinglePass) {
+          runSinglePass(nCycles);
+      } else {
+          for (itsWorkUnitIterator.origin(); itsWorkUnitIterator.hasMore(); itsWorkUnitIterator.next()) {
+               // this will force creation of the new measurement equation for this beam/channel pair
+               itsEquation.reset();
+
+               const std::pair<casacore::uInt, casacore::uInt> indices = currentBeamAndChannel();
+
+               ASKAPLOG_INFO_STR(logger, "Initialise bandpass (unknowns) for "<<nAnt()<<" antennas for beam="<<indices.first<<
+                                 " and channel="<<indices.second);
+               itsModel->reset();
+               for (casacore::uInt ant = 0; ant<nAnt(); ++ant) {
+                    itsModel->add(accessors::CalParamNameHelper::paramName(ant, indices.first, casacore::Stokes::XX), casacore::Complex(1.,0.));
+                    itsModel->add(accessors::CalParamNameHelper::paramName(ant, indices.first, casacore::Stokes::YY), casacore::Complex(1.,0.));
+               }
 
-           // setup reference gain, if needed
-           if (itsRefAntenna >= 0) {
-               //itsRefGain = accessors::CalParamNameHelper::paramName(itsRefAntenna, indices.first, casacore::Stokes::XX);
-	       //wasim was here
-               itsRefGainXX = accessors::CalParamNameHelper::paramName(itsRefAntenna, indices.first, casacore::Stokes::XX);
-               itsRefGainYY = accessors::CalParamNameHelper::paramName(itsRefAntenna, indices.first, casacore::Stokes::YY);
-           } else {
-               itsRefGainXX = "";
-               itsRefGainYY = "";
-           }
+               // setup reference gain, if needed
+               if (itsRefAntenna >= 0) {
+                   //itsRefGain = accessors::CalParamNameHelper::paramName(itsRefAntenna, indices.first, casacore::Stokes::XX);
+    	       //wasim was here
+                   itsRefGainXX = accessors::CalParamNameHelper::paramName(itsRefAntenna, indices.first, casacore::Stokes::XX);
+                   itsRefGainYY = accessors::CalParamNameHelper::paramName(itsRefAntenna, indices.first, casacore::Stokes::YY);
+               } else {
+                   itsRefGainXX = "";
+                   itsRefGainYY = "";
+               }
 
-           for (int cycle = 0; (cycle < nCycles) && validSolution(); ++cycle) {
-                ASKAPLOG_INFO_STR(logger, "*** Starting calibration iteration " << cycle + 1 << " for beam="<<
-                              indices.first<<" and channel="<<indices.second<<" ***");
-                // iterator is used to access the current work unit inside calcNE
-                calcNE();
-                solveNE();
-           }
-           if (itsComms.isParallel()) {
-               // send the model to the master, add beam and channel tags first
-               itsModel->add("beam",static_cast<double>(indices.first));
-               itsModel->add("channel",static_cast<double>(indices.second));
-               itsModel->fix("beam");
-               itsModel->fix("channel");
-               sendModelToMaster();
-           } else {
-               // serial operation, just write the result
-               if (validSolution()) {
-                   writeModel();
+               for (int cycle = 0; (cycle < nCycles) && validSolution(); ++cycle) {
+                    ASKAPLOG_INFO_STR(logger, "*** Starting calibration iteration " << cycle + 1 << " for beam="<<
+                                  indices.first<<" and channel="<<indices.second<<" ***");
+                    // iterator is used to access the current work unit inside calcNE
+                    calcNE();
+                    solveNE();
                }
-           }
+               if (itsComms.isParallel()) {
+                   // send the model to the master, add beam and channel tags first
+                   itsModel->add("beam",static_cast<double>(indices.first));
+                   itsModel->add("channel",static_cast<double>(indices.second));
+                   itsModel->fix("beam");
+                   itsModel->fix("channel");
+                   sendModelToMaster();
+               } else {
+                   // serial operation, just write the result
+                   if (validSolution()) {
+                       writeModel();
+                   }
+               }
+          }
       }
   }
   if (itsComms.isMaster() && itsComms.isParallel()) {
@@ -413,8 +441,14 @@ void BPCalibratorParallel::calcNE()
 /// @brief helper method to invalidate curremt solution
 void BPCalibratorParallel::invalidateSolution() {
    ASKAPDEBUGASSERT(itsModel);
-   itsModel->add("invalid",1.);
-   itsModel->fix("invalid");
+   invalidateSolution(*itsModel);
+}
+
+/// @brief helper method to invalidate the solution stored in the given model
+/// @param[in] model model to update
+void BPCalibratorParallel::invalidateSolution(scimath::Params &model) {
+   model.add("invalid",1.);
+   model.fix("invalid");
 }
 
 
@@ -423,71 +457,86 @@ void BPCalibratorParallel::invalidateSolution() {
 void BPCalibratorParallel::solveNE()
 {
   if (itsComms.isWorker()) {
-      ASKAPLOG_INFO_STR(logger, "Solving normal equations");
       ASKAPDEBUGASSERT(itsNe);
-      const std::vector<std::string> unknowns = itsNe->unknowns();
-      if (unknowns.size() == 0) {
-          ASKAPLOG_WARN_STR(logger, "Normal equations are empty - no valid data found, flagging the solution as bad");
-          invalidateSolution();
-          return;
-      }
-      casacore::Timer timer;
-      timer.mark();
-      scimath::Quality q;
       ASKAPDEBUGASSERT(itsSolver);
       ASKAPDEBUGASSERT(itsModel);
-      // if additional selectors are used, the shape of the MS may be such that some antennas/beams are not present at all
-      // this class uses automatic resizing of buffers and therefore may attempt solving for parameter which is not in the
-      // normal equations. The code below fixes such parameters.
-      const std::vector<std::string> freeNames = itsModel->freeNames();
-      for (std::vector<std::string>::const_iterator ci = freeNames.begin(); ci != freeNames.end(); ++ci) {
-           if (std::find(unknowns.begin(), unknowns.end(), *ci) == unknowns.end()) {
-               ASKAPLOG_INFO_STR(logger, "Parameter "<<*ci<<" is missing in the normal equations - no data");
-               itsModel->fix(*ci);
-           }
-      }
-      // now all missing parameters should be fixed
+      solveNormalEquations(*itsSolver, *itsNe, *itsModel, itsRefGainXX, itsRefGainYY);
+  }
+}
 
-      itsSolver->init();
-      itsSolver->addNormalEquations(*itsNe);
+/// @brief solve the given normal equations and update the model
+/// @details This method encapsulates the actual work of solveNE, so it can be used
+/// in parallel threads with their own solvers and models. If the solution fails,
+/// the model is marked invalid.
+/// @param[in] solver solver to use
+/// @param[in] ne normal equations
+/// @param[in] model model to update
+/// @param[in] refGainXX name of the XX reference gain, empty string means no phase rotation
+/// @param[in] refGainYY name of the YY reference gain
+void BPCalibratorParallel::solveNormalEquations(scimath::Solver &solver, const scimath::INormalEquations &ne,
+                  scimath::Params &model, const std::string &refGainXX, const std::string &refGainYY) const
+{
+  ASKAPLOG_INFO_STR(logger, "Solving normal equations");
+  const std::vector<std::string> unknowns = ne.unknowns();
+  if (unknowns.size() == 0) {
+      ASKAPLOG_WARN_STR(logger, "Normal equations are empty - no valid data found, flagging the solution as bad");
+      invalidateSolution(model);
+      return;
+  }
+  casacore::Timer timer;
+  timer.mark();
+  scimath::Quality q;
+  // if additional selectors are used, the shape of the MS may be such that some antennas/beams are not present at all
+  // this class uses automatic resizing of buffers and therefore may attempt solving for parameter which is not in the
+  // normal equations. The code below fixes such parameters.
+  const std::vector<std::string> freeNames = model.freeNames();
+  for (std::vector<std::string>::const_iterator ci = freeNames.begin(); ci != freeNames.end(); ++ci) {
+       if (std::find(unknowns.begin(), unknowns.end(), *ci) == unknowns.end()) {
+           ASKAPLOG_INFO_STR(logger, "Parameter "<<*ci<<" is missing in the normal equations - no data");
+           model.fix(*ci);
+       }
+  }
+  // now all missing parameters should be fixed
 
-      const std::string solverType = parset().getString("solver", "SVD");
-      itsSolver->setAlgorithm(solverType);
+  solver.init();
+  solver.addNormalEquations(ne);
 
-      if (solverType == "LSQR") {
-          std::map<std::string, std::string> params = CalibratorParallel::getLSQRSolverParameters(parset());
-          itsSolver->setParameters(params);
-      }
+  const std::string solverType = parset().getString("solver", "SVD");
+  solver.setAlgorithm(solverType);
 
-      itsSolver->solveNormalEquations(*itsModel,q);
-      ASKAPLOG_INFO_STR(logger, "Solved normal equations in "<< timer.real() << " seconds ");
-      ASKAPLOG_INFO_STR(logger, "Solution quality: "<<q);
+  if (solverType == "LSQR") {
+      std::map<std::string, std::string> params = CalibratorParallel::getLSQRSolverParameters(parset());
+      solver.setParameters(params);
+  }
 
-      const unsigned int minRank = parset().getUint32("minrank",15u);
-      if (q.rank() < minRank) {
-          ASKAPLOG_WARN_STR(logger, "Solution failed - minimum rank is "<<minRank<<", normal matrix has rank = "<<q.rank());
-          invalidateSolution();
-          return;
-      }
+  solver.solveNormalEquations(model,q);
+  ASKAPLOG_INFO_STR(logger, "Solved normal equations in "<< timer.real() << " seconds ");
+  ASKAPLOG_INFO_STR(logger, "Solution quality: "<<q);
 
-      //wasim was here
-      /*
-      if (itsRefGain != "") {
-          ASKAPLOG_INFO_STR(logger, "Rotating phases to have that of "<<itsRefGain<<" equal to 0");
-          rotatePhases();
-      }
-      */
-      if (itsRefGainXX != "") {
-	      if (itsRefGainXX == itsRefGainYY){
-		       ASKAPLOG_INFO_STR(logger, "Rotating both XX and YY phases to have that of "<<
-                  itsRefGainXX<<" equal to 0");
-	      } else{
-		       ASKAPLOG_INFO_STR(logger, "Rotating XX phases to have that of "<<
-                  itsRefGainXX<<" equal to 0 and YY phases to have that of "<<
-                  itsRefGainYY<<" equal to 0");
-	      }
-          rotatePhases();
+  const unsigned int minRank = parset().getUint32("minrank",15u);
+  if (q.rank() < minRank) {
+      ASKAPLOG_WARN_STR(logger, "Solution failed - minimum rank is "<<minRank<<", normal matrix has rank = "<<q.rank());
+      invalidateSolution(model);
+      return;
+  }
+
+  //wasim was here
+  /*
+  if (itsRefGain != "") {
+      ASKAPLOG_INFO_STR(logger, "Rotating phases to have that of "<<itsRefGain<<" equal to 0");
+      rotatePhases();
+  }
+  */
+  if (refGainXX != "") {
+      if (refGainXX == refGainYY){
+          ASKAPLOG_INFO_STR(logger, "Rotating both XX and YY phases to have that of "<<
+              refGainXX<<" equal to 0");
+      } else{
+          ASKAPLOG_INFO_STR(logger, "Rotating XX phases to have that of "<<
+              refGainXX<<" equal to 0 and YY phases to have that of "<<
+              refGainYY<<" equal to 0");
       }
+      rotatePhases(model, refGainXX, refGainYY);
   }
 }
 
@@ -495,9 +544,15 @@ void BPCalibratorParallel::solveNE()
 /// @details The solution (calibration parameters) is reported via solution accessor
 void BPCalibratorParallel::writeModel(const std::string &)
 {
-  ASKAPDEBUGASSERT(itsComms.isMaster());
+  storeSolution(currentBeamAndChannel());
+}
 
-  const std::pair<casacore::uInt, casacore::uInt> indices = currentBeamAndChannel();
+/// @brief store the solution held in itsModel
+/// @details This method is used by writeModel and does the actual work.
+/// @param[in] indices beam (first) and channel (second) of the solution
+void BPCalibratorParallel::storeSolution(const std::pair<casacore::uInt, casacore::uInt> &indices)
+{
+  ASKAPDEBUGASSERT(itsComms.isMaster());
 
   ASKAPLOG_DEBUG_STR(logger, "Writing results of the calibration for beam="<<indices.first<<" channel="<<indices.second);
 
@@ -542,13 +597,26 @@ void BPCalibratorParallel::createCalibrationME(const accessors::IDataSharedIter
    ASKAPDEBUGASSERT(preAvgME);
 
    ASKAPDEBUGASSERT(dsi.hasMore());
+   preAvgME->batchPrediction(itsPredictionBatchRows, itsRotatedUVWCache);
    preAvgME->accumulate(dsi,perfectME);
    itsEquation = preAvgME;
+   // go through parameters and fix them if there is no data
+   fixParametersWithoutData(*itsModel, *preAvgME);
+
+   // this is just because we bypass setting the model for the first major cycle
+   // in the case without pre-averaging
+   itsEquation->setParameters(*itsModel);
+}
+
+/// @brief fix parameters which have no data accumulated
+/// @param[in] model model to update
+/// @param[in] preAvgME equation with accumulated data
+void BPCalibratorParallel::fixParametersWithoutData(scimath::Params &model, PreAvgCalMEBase &preAvgME)
+{
    // after a call to accumulate the buffer will be setup appropriately, so we can query the stokes vector
-   const casa::Vector<casa::Stokes::StokesTypes> stokes = preAvgME->stokes();
+   const casa::Vector<casa::Stokes::StokesTypes> stokes = preAvgME.stokes();
 
-   // go through parameters and fix them if there is no data
-   const std::vector<std::string> params(itsModel->freeNames());
+   const std::vector<std::string> params(model.freeNames());
    for (std::vector<std::string>::const_iterator ci = params.begin(); ci != params.end(); ++ci) {
         const std::pair<accessors::JonesIndex, casa::Stokes::StokesTypes> parsed = accessors::CalParamNameHelper::parseParam(*ci);
         casa::uInt pol = 0; 
@@ -558,18 +626,13 @@ void BPCalibratorParallel::createCalibrationME(const accessors::IDataSharedIter
              }
         }
         if (pol < stokes.nelements()) {
-            if (preAvgME->hasDataAccumulated(parsed.first.antenna(), parsed.first.beam(), pol)) {
+            if (preAvgME.hasDataAccumulated(parsed.first.antenna(), parsed.first.beam(), pol)) {
                 continue;
             }
         }
         // no data for the given parameter - fix it
-        itsModel->fix(*ci);
+        model.fix(*ci);
    }
-   //
-
-   // this is just because we bypass setting the model for the first major cycle
-   // in the case without pre-averaging
-   itsEquation->setParameters(*itsModel);
 }
 
 /// @brief helper method to rotate all phases
@@ -585,19 +648,32 @@ void BPCalibratorParallel::rotatePhases()
   // the intention is to rotate phases in worker (for this class)
   ASKAPDEBUGASSERT(itsComms.isWorker());
   ASKAPDEBUGASSERT(itsModel);
+  rotatePhases(*itsModel, itsRefGainXX, itsRefGainYY);
+}
+
+/// @brief helper method to rotate all phases of the given model
+/// @details This is the actual implementation of the phase rotation which can be
+/// used for any model (e.g. in a thread solving for one of the channels). XX and YY
+/// gains are rotated separately, so the phase of the reference gain is exactly 0.
+/// @param[in] model model to update
+/// @param[in] refGainXX name of the XX reference gain parameter
+/// @param[in] refGainYY name of the YY reference gain parameter
+void BPCalibratorParallel::rotatePhases(scimath::Params &model, const std::string &refGainXX,
+                                        const std::string &refGainYY)
+{
   //wasim was here
  /*
   ASKAPCHECK(itsModel->has(itsRefGain), "phase rotation to `"<<itsRefGain<<
              "` is impossible because this parameter is not present in the model");
   casacore::Complex  refPhaseTerm = casacore::polar(1.f,-arg(itsModel->complexValue(itsRefGain)));
  */
-  ASKAPCHECK(itsModel->has(itsRefGainXX), "phase rotation to `"<<itsRefGainXX<<
+  ASKAPCHECK(model.has(refGainXX), "phase rotation to `"<<refGainXX<<
              "` is impossible because this parameter is not present in the model");
-  ASKAPCHECK(itsModel->has(itsRefGainYY), "phase rotation to `"<<itsRefGainYY<<
+  ASKAPCHECK(model.has(refGainYY), "phase rotation to `"<<refGainYY<<
              "` is impossible because this parameter is not present in the model");
-  casacore::Complex  refPhaseTermXX = casacore::polar(1.f,-arg(itsModel->complexValue(itsRefGainXX)));
-  casacore::Complex  refPhaseTermYY = casacore::polar(1.f,-arg(itsModel->complexValue(itsRefGainYY)));
-  std::vector<std::string> names(itsModel->freeNames());
+  casacore::Complex  refPhaseTermXX = casacore::polar(1.f,-arg(model.complexValue(refGainXX)));
+  casacore::Complex  refPhaseTermYY = casacore::polar(1.f,-arg(model.complexValue(refGainYY)));
+  std::vector<std::string> names(model.freeNames());
   for (std::vector<std::string>::const_iterator it=names.begin(); it!=names.end();++it)  {
        const std::string parname = *it;
        //wasim was here
@@ -605,10 +681,10 @@ void BPCalibratorParallel::rotatePhases()
            itsModel->update(parname, itsModel->complexValue(parname) * refPhaseTerm);
        } */
        if (parname.find("gain.g11") != std::string::npos) {
-           itsModel->update(parname, itsModel->complexValue(parname) * refPhaseTermXX);
+           model.update(parname, model.complexValue(parname) * refPhaseTermXX);
        }
        else if (parname.find("gain.g22") != std::string::npos) {
-           itsModel->update(parname, itsModel->complexValue(parname) * refPhaseTermYY);
+           model.update(parname, model.complexValue(parname) * refPhaseTermYY);
        }
   }
 }
@@ -651,42 +727,12 @@ void BPCalibratorParallel::calcOne(const std::string& ms, const casacore::uInt c
   // First time around we need to generate the equation
   if (!itsEquation) {
       ASKAPLOG_INFO_STR(logger, "Creating measurement equation" );
-      accessors::TableDataSource ds(ms, accessors::TableDataSource::DEFAULT, dataColumn());
-      ds.configureUVWMachineCache(uvwMachineCacheSize(),uvwMachineCacheTolerance());
-      accessors::IDataSelectorPtr sel=ds.createSelector();
-      sel << parset();
-      sel->chooseChannels(1,chan);
-      sel->chooseFeed(beam);
-      accessors::IDataConverterPtr conv=ds.createConverter();
-      conv->setFrequencyFrame(getFreqRefFrame(), "Hz");
-      conv->setDirectionFrame(casacore::MDirection::Ref(casacore::MDirection::J2000));
-      // ensure that time is counted in seconds since 0 MJD
-      conv->setEpochFrame();
-      accessors::IDataSharedIter it=ds.createIterator(sel, conv);
+      accessors::IDataSharedIter it = createIterator(ms, beam, 1, chan);
       ASKAPCHECK(it.hasMore(), "No data seem to be available for channel "<<chan<<" and beam "<<beam);
 
       ASKAPCHECK(itsModel, "Initial assumption of parameters is not defined");
 
-      if (!itsPerfectME) {
-          ASKAPLOG_INFO_STR(logger, "Constructing measurement equation corresponding to the uncorrupted model");
-          ASKAPCHECK(itsPerfectModel, "Uncorrupted model not defined");
-          if (SynthesisParamsHelper::hasImage(itsPerfectModel)) {
-              ASKAPCHECK(!SynthesisParamsHelper::hasComponent(itsPerfectModel),
-                         "Image + component case has not yet been implemented");
-              // have to create an image-specific equation
-              boost::shared_ptr<ImagingEquationAdapter> ieAdapter(new ImagingEquationAdapter);
-              ASKAPCHECK(gridder(), "Gridder not defined");
-              ieAdapter->assign<ImageFFTEquation>(*itsPerfectModel, gridder());
-              itsPerfectME = ieAdapter;
-          } else {
-              // model is a number of components, don't need an adapter here
-
-              // it doesn't matter which iterator is passed below. It is not used
-              boost::shared_ptr<ComponentEquation>
-                  compEq(new ComponentEquation(*itsPerfectModel,it));
-              itsPerfectME = compEq;
-          }
-      }
+      initPerfectME(it);
       // now we could've used class data members directly instead of passing them to createCalibrationME
       createCalibrationME(it,itsPerfectME);
       ASKAPCHECK(itsEquation, "Equation is not defined");
@@ -704,6 +750,210 @@ void BPCalibratorParallel::calcOne(const std::string& ms, const casacore::uInt c
                      << " seconds ");
 }
 
+/// @brief construct the measurement equation corresponding to the perfect model
+/// @details This method initialises itsPerfectME, if it has not been done before.
+/// @param[in] it data iterator (only used for component models and not iterated)
+void BPCalibratorParallel::initPerfectME(const accessors::IDataSharedIter &it)
+{
+  if (!itsPerfectME) {
+      ASKAPLOG_INFO_STR(logger, "Constructing measurement equation corresponding to the uncorrupted model");
+      ASKAPCHECK(itsPerfectModel, "Uncorrupted model not defined");
+      if (SynthesisParamsHelper::hasImage(itsPerfectModel)) {
+          ASKAPCHECK(!SynthesisParamsHelper::hasComponent(itsPerfectModel),
+                     "Image + component case has not yet been implemented");
+          // have to create an image-specific equation
+          boost::shared_ptr<ImagingEquationAdapter> ieAdapter(new ImagingEquationAdapter);
+          ASKAPCHECK(gridder(), "Gridder not defined");
+          ieAdapter->assign<ImageFFTEquation>(*itsPerfectModel, gridder());
+          itsPerfectME = ieAdapter;
+      } else {
+          // model is a number of components, don't need an adapter here
+
+          // it doesn't matter which iterator is passed below. It is not used
+          boost::shared_ptr<ComponentEquation>
+              compEq(new ComponentEquation(*itsPerfectModel,it));
+          compEq->numberOfThreads(itsNThreads);
+          itsPerfectME = compEq;
+      }
+      // the uncorrupted model doesn't change, so predicted visibilities can be reused between iterations
+      itsPerfectME = PredictionCacheME::create(parset(), itsPerfectME, *itsPerfectModel);
+  }
+}
+
+/// @brief create the data iterator for the given beam and channels
+/// @param[in] ms name of the measurement set
+/// @param[in] beam beam to select
+/// @param[in] nChanToRead number of channels to select
+/// @param[in] startChan first channel to select
+/// @return shared iterator
+accessors::IDataSharedIter BPCalibratorParallel::createIterator(const std::string &ms, const casacore::uInt beam,
+                  const casacore::uInt nChanToRead, const casacore::uInt startChan) const
+{
+  accessors::TableDataSource ds(ms, accessors::TableDataSource::DEFAULT, dataColumn());
+  ds.configureUVWMachineCache(uvwMachineCacheSize(),uvwMachineCacheTolerance());
+  accessors::IDataSelectorPtr sel=ds.createSelector();
+  sel << parset();
+  sel->chooseChannels(nChanToRead,startChan);
+  sel->chooseFeed(beam);
+  accessors::IDataConverterPtr conv=ds.createConverter();
+  conv->setFrequencyFrame(getFreqRefFrame(), "Hz");
+  conv->setDirectionFrame(casacore::MDirection::Ref(casacore::MDirection::J2000));
+  // ensure that time is counted in seconds since 0 MJD
+  conv->setEpochFrame();
+  return ds.createIterator(sel, conv);
+}
+
+/// @brief make the initial model for the given beam
+/// @details All gains are set to 1.
+/// @param[in] beam beam index
+/// @return shared pointer to the new model
+scimath::Params::ShPtr BPCalibratorParallel::initialModel(const casacore::uInt beam) const
+{
+  scimath::Params::ShPtr model(new scimath::Params);
+  for (casacore::uInt ant = 0; ant<nAnt(); ++ant) {
+       model->add(accessors::CalParamNameHelper::paramName(ant, beam, casacore::Stokes::XX), casacore::Complex(1.,0.));
+       model->add(accessors::CalParamNameHelper::paramName(ant, beam, casacore::Stokes::YY), casacore::Complex(1.,0.));
+  }
+  return model;
+}
+
+/// @brief process all work units of this rank with one pass over the data per beam
+/// @details The data for all channels assigned to this rank are read at once for each
+/// beam and accumulated in the frequency-dependent pre-averaging buffer. Each channel is
+/// then solved for from memory in its own equation, with channels distributed between
+/// threads. Results are sent to the master (or written in the serial mode) as for the
+/// normal mode of operation.
+/// @param[in] nCycles number of calibration cycles
+void BPCalibratorParallel::runSinglePass(const int nCycles)
+{
+  ASKAPDEBUGASSERT(itsComms.isWorker());
+  // group work units by beam, beams change fastest in the work domain, so channels assigned
+  // to this rank form a contiguous range for every beam
+  std::map<casacore::uInt, std::vector<casacore::uInt> > channelsPerBeam;
+  for (itsWorkUnitIterator.origin(); itsWorkUnitIterator.hasMore(); itsWorkUnitIterator.next()) {
+       const std::pair<casacore::uInt, casacore::uInt> indices = currentBeamAndChannel();
+       channelsPerBeam[indices.first].push_back(indices.second);
+  }
+
+  for (std::map<casacore::uInt, std::vector<casacore::uInt> >::const_iterator ci = channelsPerBeam.begin();
+       ci != channelsPerBeam.end(); ++ci) {
+       const casacore::uInt beam = ci->first;
+       const std::vector<casacore::uInt> &channels = ci->second;
+       ASKAPDEBUGASSERT(channels.size() > 0);
+       const casacore::uInt startChan = *std::min_element(channels.begin(), channels.end());
+       const casacore::uInt nChanToRead = *std::max_element(channels.begin(), channels.end()) - startChan + 1;
+       ASKAPDEBUGASSERT((measurementSets().size() == 1) || (beam < measurementSets().size()));
+       const std::string ms = (measurementSets().size() == 1 ? measurementSets()[0] : measurementSets()[beam]);
+
+       casacore::Timer timer;
+       timer.mark();
+       ASKAPLOG_INFO_STR(logger, "Accumulating data for "<<ms<<" beam "<<beam<<" channels from "<<startChan<<
+                         " to "<<startChan + nChanToRead - 1);
+       accessors::IDataSharedIter it = createIterator(ms, beam, nChanToRead, startChan);
+       ASKAPCHECK(it.hasMore(), "No data seem to be available for channels "<<startChan<<" to "<<
+                  startChan + nChanToRead - 1<<" and beam "<<beam);
+       initPerfectME(it);
+       // frequency-dependent equation is only used to accumulate all channels in one pass
+       boost::shared_ptr<PreAvgCalMEBase> accumulated(new CalibrationME<NoXPolFreqDependentGain, PreAvgCalMEBase>());
+       accumulated->batchPrediction(itsPredictionBatchRows, itsRotatedUVWCache);
+       accumulated->accumulate(it, itsPerfectME);
+       ASKAPLOG_INFO_STR(logger, "Accumulated data for beam "<<beam<<" in "<<timer.real()<<" seconds");
+
+       // split the buffer into single-channel equations, solution is done as for normal gains
+       // like in createCalibrationME
+       std::vector<boost::shared_ptr<PreAvgCalMEBase> > equations(channels.size());
+       std::vector<scimath::Params::ShPtr> models(channels.size());
+       for (size_t i = 0; i < channels.size(); ++i) {
+            models[i] = initialModel(beam);
+            equations[i].reset(new CalibrationME<NoXPolGain, PreAvgCalMEBase>());
+            equations[i]->initialise(*accumulated, channels[i] - startChan);
+            fixParametersWithoutData(*models[i], *equations[i]);
+       }
+       accumulated.reset();
+
+       std::string refGainXX;
+       std::string refGainYY;
+       if (itsRefAntenna >= 0) {
+           refGainXX = accessors::CalParamNameHelper::paramName(itsRefAntenna, beam, casacore::Stokes::XX);
+           refGainYY = accessors::CalParamNameHelper::paramName(itsRefAntenna, beam, casacore::Stokes::YY);
+       }
+
+       // solve for channels, each thread has its own solver and deals with its own subset of channels
+       timer.mark();
+       const size_t nThreads = std::min(static_cast<size_t>(itsNThreads), channels.size());
+       std::vector<std::string> errors(nThreads);
+       if (nThreads == 1) {
+           solveChannels(equations, models, 0, 1, nCycles, refGainXX, refGainYY, errors[0]);
+       } else {
+           boost::thread_group threads;
+           for (size_t thread = 0; thread < nThreads; ++thread) {
+                threads.create_thread(boost::bind(&BPCalibratorParallel::solveChannels, this, boost::cref(equations),
+                         boost::cref(models), thread, nThreads, nCycles, boost::cref(refGainXX), boost::cref(refGainYY),
+                         boost::ref(errors[thread])));
+           }
+           threads.join_all();
+       }
+       for (size_t thread = 0; thread < nThreads; ++thread) {
+            ASKAPCHECK(errors[thread].size() == 0, "Bandpass solution for beam "<<beam<<" failed: "<<errors[thread]);
+       }
+       ASKAPLOG_INFO_STR(logger, "Solved for "<<channels.size()<<" channels of beam "<<beam<<" in "<<timer.real()<<
+                         " seconds using "<<nThreads<<" thread(s)");
+
+       for (size_t i = 0; i < channels.size(); ++i) {
+            itsModel = models[i];
+            if (itsComms.isParallel()) {
+                // send the model to the master, add beam and channel tags first
+                itsModel->add("beam",static_cast<double>(beam));
+                itsModel->add("channel",static_cast<double>(channels[i]));
+                itsModel->fix("beam");
+                itsModel->fix("channel");
+                sendModelToMaster();
+            } else {
+                // serial operation, just write the result
+                if (validSolution()) {
+                    storeSolution(std::make_pair(beam, channels[i]));
+                }
+            }
+       }
+  }
+}
+
+/// @brief solve for a subset of channels (runs in a thread)
+/// @details Every step'th equation starting from first is processed. Any exception is
+/// caught and its message is returned via error.
+/// @param[in] equations single-channel equations with accumulated data
+/// @param[in] models models to solve for, one per equation
+/// @param[in] first index of the first equation to process
+/// @param[in] step increment of the equation index
+/// @param[in] nCycles number of calibration cycles
+/// @param[in] refGainXX name of the XX reference gain, empty string means no phase rotation
+/// @param[in] refGainYY name of the YY reference gain
+/// @param[out] error error message, empty if no error occurred
+void BPCalibratorParallel::solveChannels(const std::vector<boost::shared_ptr<PreAvgCalMEBase> > &equations,
+                  const std::vector<scimath::Params::ShPtr> &models, const size_t first, const size_t step,
+                  const int nCycles, const std::string &refGainXX, const std::string &refGainYY,
+                  std::string &error) const
+{
+  ASKAPDEBUGASSERT(equations.size() == models.size());
+  ASKAPDEBUGASSERT(step > 0);
+  try {
+     scimath::LinearSolver solver(1e3);
+     for (size_t i = first; i < equations.size(); i += step) {
+          ASKAPDEBUGASSERT(equations[i] && models[i]);
+          // all cycles use the data accumulated in memory
+          for (int cycle = 0; (cycle < nCycles) && !models[i]->has("invalid"); ++cycle) {
+               scimath::GenericNormalEquations ne;
+               equations[i]->setParameters(*models[i]);
+               equations[i]->calcEquations(ne);
+               solveNormalEquations(solver, ne, *models[i], refGainXX, refGainYY);
+          }
+     }
+  }
+  catch (const std::exception &ex) {
+     error = ex.what();
+  }
+}
+
 
 } // namespace synthesis
 
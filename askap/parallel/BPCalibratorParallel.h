@@ -49,14 +49,19 @@
 #include <Common/ParameterSet.h>
 #include <askap/gridding/IVisGridder.h>
 #include <askap/measurementequation/IMeasurementEquation.h>
+#include <askap/measurementequation/PreAvgCalMEBase.h>
 #include <askap/dataaccess/SharedIter.h>
 #include <askap/calibaccess/ICalSolutionSource.h>
 #include <askap/scimath/utils/MultiDimPosIter.h>
 #include <askap/IndexConverter.h>
+#include <askap/scimath/fitting/Solver.h>
+#include <askap/scimath/fitting/INormalEquations.h>
 
 
 // std includes
 #include <utility>
+#include <string>
+#include <vector>
 
 // boost includes
 #include <boost/shared_ptr.hpp>
@@ -140,6 +145,16 @@ namespace askap
       /// @note The method throws exception if itsRefGain is not among
       /// the parameters of itsModel
       void rotatePhases();
+
+      /// @brief helper method to rotate all phases of the given model
+      /// @details This is the actual implementation of the phase rotation which can be
+      /// used for any model (e.g. in a thread solving for one of the channels). XX and YY
+      /// gains are rotated separately, so the phase of the reference gain is exactly 0.
+      /// @param[in] model model to update
+      /// @param[in] refGainXX name of the XX reference gain parameter
+      /// @param[in] refGainYY name of the YY reference gain parameter
+      static void rotatePhases(scimath::Params &model, const std::string &refGainXX,
+                               const std::string &refGainYY);
       
       /// @brief helper method to extract solution time from NE.
       /// @details To be able to time tag the calibration solutions we add
@@ -191,6 +206,77 @@ namespace askap
       /// @brief helper method to invalidate curremt solution
       void invalidateSolution(); 
 
+      /// @brief helper method to invalidate the solution stored in the given model
+      /// @param[in] model model to update
+      static void invalidateSolution(scimath::Params &model);
+
+      /// @brief solve the given normal equations and update the model
+      /// @details This method encapsulates the actual work of solveNE, so it can be used
+      /// in parallel threads with their own solvers and models. If the solution fails,
+      /// the model is marked invalid.
+      /// @param[in] solver solver to use
+      /// @param[in] ne normal equations
+      /// @param[in] model model to update
+      /// @param[in] refGainXX name of the XX reference gain, empty string means no phase rotation
+      /// @param[in] refGainYY name of the YY reference gain
+      void solveNormalEquations(scimath::Solver &solver, const scimath::INormalEquations &ne,
+                  scimath::Params &model, const std::string &refGainXX, const std::string &refGainYY) const;
+
+      /// @brief make the initial model for the given beam
+      /// @details All gains are set to 1.
+      /// @param[in] beam beam index
+      /// @return shared pointer to the new model
+      scimath::Params::ShPtr initialModel(const casacore::uInt beam) const;
+
+      /// @brief fix parameters which have no data accumulated
+      /// @param[in] model model to update
+      /// @param[in] preAvgME equation with accumulated data
+      static void fixParametersWithoutData(scimath::Params &model, PreAvgCalMEBase &preAvgME);
+
+      /// @brief construct the measurement equation corresponding to the perfect model
+      /// @details This method initialises itsPerfectME, if it has not been done before.
+      /// @param[in] it data iterator (only used for component models and not iterated)
+      void initPerfectME(const accessors::IDataSharedIter &it);
+
+      /// @brief create the data iterator for the given beam and channels
+      /// @param[in] ms name of the measurement set
+      /// @param[in] beam beam to select
+      /// @param[in] nChanToRead number of channels to select
+      /// @param[in] startChan first channel to select
+      /// @return shared iterator
+      accessors::IDataSharedIter createIterator(const std::string &ms, const casacore::uInt beam,
+                  const casacore::uInt nChanToRead, const casacore::uInt startChan) const;
+
+      /// @brief process all work units of this rank with one pass over the data per beam
+      /// @details The data for all channels assigned to this rank are read at once for each
+      /// beam and accumulated in the frequency-dependent pre-averaging buffer. Each channel is
+      /// then solved for from memory in its own equation, with channels distributed between
+      /// threads. Results are sent to the master (or written in the serial mode) as for the
+      /// normal mode of operation.
+      /// @param[in] nCycles number of calibration cycles
+      void runSinglePass(const int nCycles);
+
+      /// @brief solve for a subset of channels (runs in a thread)
+      /// @details Every step'th equation starting from first is processed. Any exception is
+      /// caught and its message is returned via error.
+      /// @param[in] equations single-channel equations with accumulated data
+      /// @param[in] models models to solve for, one per equation
+      /// @param[in] first index of the first equation to process
+      /// @param[in] step increment of the equation index
+      /// @param[in] nCycles number of calibration cycles
+      /// @param[in] refGainXX name of the XX reference gain, empty string means no phase rotation
+      /// @param[in] refGainYY name of the YY reference gain
+      /// @param[out] error error message, empty if no error occurred
+      void solveChannels(const std::vector<boost::shared_ptr<PreAvgCalMEBase> > &equations,
+                  const std::vector<scimath::Params::ShPtr> &models, const size_t first, const size_t step,
+                  const int nCycles, const std::string &refGainXX, const std::string &refGainYY,
+                  std::string &error) const;
+
+      /// @brief store the solution held in itsModel
+      /// @details This method is used by writeModel and does the actual work.
+      /// @param[in] indices beam (first) and channel (second) of the solution
+      void storeSolution(const std::pair<casacore::uInt, casacore::uInt> &indices);
+
       /// @brief verify that the current solution is valid
       /// @details We use a special keywork 'invalid' in the model to 
       /// signal that a particular solution failed. for whatever reason. 
@@ -263,6 +349,21 @@ namespace askap
       /// This map provides such an optional index conversion. It is setup from "beamindices" parset keyword,
       /// if present. Otherwise, it passes the index without conversion and it spans 0..nBeam()-1 space.
       utility::IndexConverter itsBeamIndexConverter;
+
+      /// @brief true if all channels of a beam are accumulated with one pass over the data
+      /// @details This mode is enabled by the "singlepass" parset keyword.
+      bool itsSinglePass;
+
+      /// @brief number of threads used to solve for channels in the single pass mode
+      casacore::uInt itsNThreads;
+
+      /// @brief maximum number of rows for which the uncorrupted model is predicted at once
+      /// @details Zero means that visibilities are predicted chunk by chunk (default).
+      casacore::uInt itsPredictionBatchRows;
+
+      /// @brief cache of rotated uvw's and delays shared by all batches (may be empty)
+      /// @details The same uvw's are rotated for every channel and every calibration cycle.
+      boost::shared_ptr<RotatedUVWCache> itsRotatedUVWCache;
     };
 
   }
@@ -0,0 +1,82 @@
+/// @file
+/// @brief multi-threaded application of calibration to a dataset
+/// @details Calibration is applied in three stages working in parallel: a reader thread
+/// copies chunks of data into memory, a number of worker threads correct them and a writer
+/// thread puts the corrected visibilities (and, optionally, flags) back into the dataset.
+/// Stages are connected by bounded queues, so the memory footprint doesn't depend on the
+/// size of the dataset. Disk access (which is not thread safe in casacore) is serialised,
+/// but overlaps with the calculation done by the workers.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#ifndef ASKAP_SYNTHESIS_CAL_APPLY_PIPELINE_H
+#define ASKAP_SYNTHESIS_CAL_APPLY_PIPELINE_H
+
+#include <askap/parallel/VisProcessingPipeline.h>
+#include <askap/measurementequation/ICalibrationApplicator.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief multi-threaded application of calibration to a dataset
+/// @details The threading is done by the base class (see VisProcessingPipeline). Each worker
+/// thread has its own calibration applicator because applicators are not thread safe. They
+/// can share the solution source, if it is thread safe (e.g. CalSolutionCache).
+/// @ingroup parallel
+class CalApplyPipeline : public VisProcessingPipeline {
+public:
+   /// @brief constructor
+   /// @param[in] applicators calibration applicators, one per worker thread
+   /// @param[in] depth maximum number of chunks waiting in each queue (should be positive)
+   /// @param[in] updateFlags if true, flags are written back together with visibilities
+   /// (the flags are passed to applicators via the on-demand flag and noise adapter)
+   /// @param[in] ioMutex optional mutex serialising the table access, it can be shared with
+   /// other code accessing tables from the worker threads (e.g. the calibration solution source).
+   /// A new mutex is created if this parameter is empty.
+   CalApplyPipeline(const std::vector<boost::shared_ptr<ICalibrationApplicator> > &applicators,
+                    size_t depth, bool updateFlags = false,
+                    const boost::shared_ptr<boost::mutex> &ioMutex = boost::shared_ptr<boost::mutex>());
+
+protected:
+   /// @brief correct one chunk
+   /// @param[in] worker index of the worker thread
+   /// @param[in] chunk chunk to correct
+   virtual void processChunk(size_t worker, Chunk &chunk) const;
+
+private:
+   /// @brief calibration applicators, one per worker
+   std::vector<boost::shared_ptr<ICalibrationApplicator> > itsApplicators;
+};
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef ASKAP_SYNTHESIS_CAL_APPLY_PIPELINE_H
@@ -77,6 +77,7 @@ ASKAP_LOGGER(logger, ".parallel");
 #include <askap/measurementequation/CalibrationME.h>
 #include <askap/measurementequation/PreAvgCalMEBase.h>
 #include <askap/measurementequation/ComponentEquation.h>
+#include <askap/measurementequation/PredictionCacheME.h>
 #include <askap/measurementequation/NoXPolGain.h>
 #include <askap/measurementequation/NoXPolFreqDependentGain.h>
 #include <askap/measurementequation/NoXPolBeamIndependentGain.h>
@@ -84,6 +85,7 @@ ASKAP_LOGGER(logger, ".parallel");
 #include <askap/measurementequation/BeamIndependentLeakageTerm.h>
 #include <askap/measurementequation/Product.h>
 #include <askap/measurementequation/ImagingEquationAdapter.h>
+#include <askap/measurementequation/BlockDiagonalCalSolver.h>
 #include <askap/gridding/VisGridderFactory.h>
 #include <askap/askapparallel/AskapParallel.h>
 #include <Common/ParameterSet.h>
@@ -97,6 +99,14 @@ ASKAP_LOGGER(logger, ".parallel");
 #endif
 
 
+// boost includes
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+// std includes
+#include <algorithm>
+#include <map>
+
 // casa includes
 #include <casacore/casa/aips.h>
 #include <casacore/casa/OS/Timer.h>
@@ -123,8 +133,24 @@ CalibratorParallel::CalibratorParallel(askap::askapparallel::AskapParallel& comm
       itsSolveBandpass(false), itsChannelsPerWorker(0), itsStartChan(0),
       itsBeamIndependentGains(false), itsBeamIndependentLeakages(false), itsNormaliseGains(false), itsSolutionInterval(-1.),
       itsMaxNAntForPreAvg(0u), itsMaxNBeamForPreAvg(0u), itsMaxNChanForPreAvg(1u),
-      itsMatrixIsParallel(false), itsMajorLoopIterationNumber(0)
+      itsMatrixIsParallel(false), itsMajorLoopIterationNumber(0), itsNThreads(parset.getUint32("nthreads", 1)),
+      itsBlockDiagonalSolver(false), itsPredictionBatchRows(parset.getUint32("predictbatch", 0u))
 {
+  ASKAPCHECK(itsNThreads > 0, "Number of threads is supposed to be a positive number");
+  if (itsNThreads > 1) {
+      ASKAPLOG_INFO_STR(logger, "Up to "<<itsNThreads<<" threads will be used to solve for independent beams, "
+                        "the next solution interval will be accumulated while the current one is solved for, "
+                        "visibilities of components will be predicted in parallel");
+  }
+  if (itsPredictionBatchRows > 0) {
+      // memory in MB
+      const casacore::uInt cacheMemory = parset.getUint32("predictbatch.uvwcache", 256u);
+      ASKAPLOG_INFO_STR(logger, "Uncorrupted model will be predicted for up to "<<itsPredictionBatchRows<<
+                        " rows at once, up to "<<cacheMemory<<" MB will be used to cache rotated uvw's");
+      if (cacheMemory > 0) {
+          itsRotatedUVWCache.reset(new RotatedUVWCache(static_cast<size_t>(cacheMemory) * 1024 * 1024));
+      }
+  }
   const std::string what2solve = parset.getString("solve","gains");
   if (what2solve.find("gains") != std::string::npos) {
       ASKAPLOG_INFO_STR(logger, "Gains will be solved for (solve='"<<what2solve<<"')");
@@ -168,7 +194,17 @@ CalibratorParallel::CalibratorParallel(askap::askapparallel::AskapParallel& comm
       itsMatrixIsParallel = true;
   }
 
-  if (useLinearSolver()) {
+  if (useLinearSolver() && (parset.getString("solver", "SVD") == "LSQR") &&
+      parset.getBool("solver.LSQR.blockdiagonal", false)) {
+      // the normal matrix is solved block by block, one block per beam (and channel for bandpass)
+      ASKAPCHECK(!itsMatrixIsParallel, "Block-diagonal solver is not compatible with the parallel matrix scheme");
+      ASKAPCHECK(!parset.getBool("solver.LSQR.smoothing", false),
+                 "Smoothing constraints couple spectral channels and are not supported by the block-diagonal solver");
+      const double alpha = parset.getDouble("solver.LSQR.alpha", 0.01);
+      ASKAPLOG_INFO_STR(logger, "Using block-diagonal damped least squares solver, alpha = "<<alpha);
+      itsSolver.reset(new BlockDiagonalCalSolver(alpha, itsNThreads));
+      itsBlockDiagonalSolver = true;
+  } else if (useLinearSolver()) {
       // Create the solver.
       itsSolver.reset(new LinearSolver);
       ASKAPCHECK(itsSolver, "Solver not defined correctly");
@@ -292,6 +328,13 @@ CalibratorParallel::CalibratorParallel(askap::askapparallel::AskapParallel& comm
   }
 }
 
+/// @brief destructor
+/// @details It waits for the background accumulation of the next solution
+/// interval (if any) to finish.
+CalibratorParallel::~CalibratorParallel()
+{
+}
+
 /// @brief helper method to update maximal expected numbers for pre-averaging
 /// @details This method updates global maxima based on the current local values. It is handy to
 /// avoid code dublication as well as for the case if we ever decide to trim the pre-aveaging buffer
@@ -440,7 +483,8 @@ void CalibratorParallel::calcOne(const std::string& ms, bool discard)
           // ensure that time is counted in seconds since 0 MJD
           conv->setEpochFrame();
           //IDataSharedIter it=ds.createIterator(sel, conv);
-          itsIteratorAdapter.reset(new accessors::TimeChunkIteratorAdapter(ds.createIterator(sel, conv), itsSolutionInterval));
+          itsIteratorAdapter.reset(new accessors::TimeChunkIteratorAdapter(prefetchIfRequested(ds.createIterator(sel, conv)),
+                                    itsSolutionInterval));
           if (itsSolutionInterval >= 0) {
               ASKAPLOG_INFO_STR(logger, "Iterator has been created, solution interval = "<<itsSolutionInterval<<" s");
           } else {
@@ -471,8 +515,11 @@ void CalibratorParallel::calcOne(const std::string& ms, bool discard)
               // it doesn't matter which iterator is passed below. It is not used
               boost::shared_ptr<ComponentEquation>
                   compEq(new ComponentEquation(*itsPerfectModel,it));
+              compEq->numberOfThreads(itsNThreads);
               itsPerfectME = compEq;
           }
+          // the uncorrupted model doesn't change, so predicted visibilities can be reused between iterations
+          itsPerfectME = PredictionCacheME::create(parset(), itsPerfectME, *itsPerfectModel);
       }
       // now we could've used class data members directly instead of passing them to createCalibrationME
       createCalibrationME(it,itsPerfectME);
@@ -547,48 +594,12 @@ void CalibratorParallel::createCalibrationME(const IDataSharedIter &dsi,
   } else {
 
    // code with pre-averaging
-   // it is handy to have a shared pointer to the base type because it is
-   // not templated
-   boost::shared_ptr<PreAvgCalMEBase> preAvgME;
-   if (itsSolveGains && !itsSolveLeakage) {
-       if (itsBeamIndependentGains) {
-          preAvgME.reset(new CalibrationME<NoXPolBeamIndependentGain, PreAvgCalMEBase>());
-       } else {
-          preAvgME.reset(new CalibrationME<NoXPolGain, PreAvgCalMEBase>());
-       }
-   } else if (itsSolveLeakage && !itsSolveGains) {
-       if (itsBeamIndependentLeakages) {
-          preAvgME.reset(new CalibrationME<BeamIndependentLeakageTerm, PreAvgCalMEBase>());
-       } else {
-          preAvgME.reset(new CalibrationME<LeakageTerm, PreAvgCalMEBase>());
-       }
-   } else if (itsSolveLeakage && itsSolveGains) {
-   // TODO deal with Beam indep Leakage for this case?
-       if (itsBeamIndependentGains) {
-          preAvgME.reset(new CalibrationME<Product<NoXPolBeamIndependentGain,LeakageTerm>, PreAvgCalMEBase>());
-       } else {
-          preAvgME.reset(new CalibrationME<Product<NoXPolGain,LeakageTerm>, PreAvgCalMEBase>());
-       }
-   } else if (itsSolveBandpass) {
-       preAvgME.reset(new CalibrationME<NoXPolFreqDependentGain, PreAvgCalMEBase>());
-   } else {
-       ASKAPTHROW(AskapError, "Unsupported combination of itsSolveGains and itsSolveLeakage. This shouldn't happen. Verify solve parameter");
-   }
-   ASKAPDEBUGASSERT(preAvgME);
-   // without the following lines of code, the buffer initialisation will be performed based on the first sighted
-   // data chunk. This is however problematic if the shape of data may change from iteration to iteration
-   ASKAPDEBUGASSERT(itsMaxNAntForPreAvg > 0);
-   ASKAPDEBUGASSERT(itsMaxNBeamForPreAvg > 0);
-   ASKAPDEBUGASSERT(itsMaxNChanForPreAvg > 0);
-   if ((itsMaxNChanForPreAvg > 1) && !preAvgME->isFrequencyDependent()) {
-       ASKAPLOG_WARN_STR(logger, "Pre-averaging calibration buffer size estimate ("<<itsMaxNChanForPreAvg<<
-              " channels) doesn't seem to be aligned with the frequency dependence property of selected calibration effects");
+   // the data for this interval may have already been accumulated in the background
+   boost::shared_ptr<PreAvgCalMEBase> preAvgME = waitForNextInterval();
+   if (!preAvgME) {
+       preAvgME = makePreAvgME();
+       preAvgME->accumulate(dsi,perfectME);
    }
-   preAvgME->initialise(itsMaxNAntForPreAvg, itsMaxNBeamForPreAvg, itsMaxNChanForPreAvg);
-
-   // this is just an optimisation, should work without this line
-   preAvgME->beamIndependent(itsBeamIndependentGains||itsBeamIndependentLeakages);
-   preAvgME->accumulate(dsi,perfectME);
    // fix model parameters for which we don't have data
    const casa::Vector<casa::Stokes::StokesTypes> stokes = preAvgME->stokes();
    const std::vector<std::string> params(itsModel->freeNames());
@@ -637,10 +648,84 @@ void CalibratorParallel::createCalibrationME(const IDataSharedIter &dsi,
    // in the case without pre-averaging
    itsEquation->setParameters(*itsModel);
    // set the next chunk flag, if necessary (time-dependent solution is supported only with pre-averaging)
-   setNextChunkFlag(nextChunk());
+   const bool moreData = nextChunk();
+   setNextChunkFlag(moreData);
+   if (moreData && (itsNThreads > 1)) {
+       // the equation is reused for all cycles of this interval without accessing the data,
+       // so the next interval can be read in the meantime
+       ASKAPLOG_INFO_STR(logger, "Starting to accumulate the next solution interval in the background");
+       itsNextInterval.start(makePreAvgME(), dsi, perfectME);
+   }
   }
 }
 
+/// @brief create an empty pre-averaging measurement equation
+/// @details The type of the equation is chosen according to the internal flags
+/// (i.e. polarisation calibration or just antenna-based gains), the buffer is
+/// initialised to the expected size.
+/// @return shared pointer to the new equation
+boost::shared_ptr<PreAvgCalMEBase> CalibratorParallel::makePreAvgME() const
+{
+   // it is handy to have a shared pointer to the base type because it is
+   // not templated
+   boost::shared_ptr<PreAvgCalMEBase> preAvgME;
+   if (itsSolveGains && !itsSolveLeakage) {
+       if (itsBeamIndependentGains) {
+          preAvgME.reset(new CalibrationME<NoXPolBeamIndependentGain, PreAvgCalMEBase>());
+       } else {
+          preAvgME.reset(new CalibrationME<NoXPolGain, PreAvgCalMEBase>());
+       }
+   } else if (itsSolveLeakage && !itsSolveGains) {
+       if (itsBeamIndependentLeakages) {
+          preAvgME.reset(new CalibrationME<BeamIndependentLeakageTerm, PreAvgCalMEBase>());
+       } else {
+          preAvgME.reset(new CalibrationME<LeakageTerm, PreAvgCalMEBase>());
+       }
+   } else if (itsSolveLeakage && itsSolveGains) {
+   // TODO deal with Beam indep Leakage for this case?
+       if (itsBeamIndependentGains) {
+          preAvgME.reset(new CalibrationME<Product<NoXPolBeamIndependentGain,LeakageTerm>, PreAvgCalMEBase>());
+       } else {
+          preAvgME.reset(new CalibrationME<Product<NoXPolGain,LeakageTerm>, PreAvgCalMEBase>());
+       }
+   } else if (itsSolveBandpass) {
+       preAvgME.reset(new CalibrationME<NoXPolFreqDependentGain, PreAvgCalMEBase>());
+   } else {
+       ASKAPTHROW(AskapError, "Unsupported combination of itsSolveGains and itsSolveLeakage. This shouldn't happen. Verify solve parameter");
+   }
+   ASKAPDEBUGASSERT(preAvgME);
+   // without the following lines of code, the buffer initialisation will be performed based on the first sighted
+   // data chunk. This is however problematic if the shape of data may change from iteration to iteration
+   ASKAPDEBUGASSERT(itsMaxNAntForPreAvg > 0);
+   ASKAPDEBUGASSERT(itsMaxNBeamForPreAvg > 0);
+   ASKAPDEBUGASSERT(itsMaxNChanForPreAvg > 0);
+   if ((itsMaxNChanForPreAvg > 1) && !preAvgME->isFrequencyDependent()) {
+       ASKAPLOG_WARN_STR(logger, "Pre-averaging calibration buffer size estimate ("<<itsMaxNChanForPreAvg<<
+              " channels) doesn't seem to be aligned with the frequency dependence property of selected calibration effects");
+   }
+   preAvgME->initialise(itsMaxNAntForPreAvg, itsMaxNBeamForPreAvg, itsMaxNChanForPreAvg);
+
+   // this is just an optimisation, should work without this line
+   preAvgME->beamIndependent(itsBeamIndependentGains||itsBeamIndependentLeakages);
+   preAvgME->batchPrediction(itsPredictionBatchRows, itsRotatedUVWCache);
+   return preAvgME;
+}
+
+/// @brief wait for the background accumulation of the next interval
+/// @return equation with the accumulated data (empty shared pointer if
+/// nothing has been accumulated in the background)
+boost::shared_ptr<PreAvgCalMEBase> CalibratorParallel::waitForNextInterval()
+{
+  boost::shared_ptr<PreAvgCalMEBase> result;
+  if (itsNextInterval.isStarted()) {
+      casacore::Timer timer;
+      timer.mark();
+      result = itsNextInterval.wait();
+      ASKAPLOG_INFO_STR(logger, "Using data accumulated in the background, waited "<<timer.real()<<" seconds");
+  }
+  return result;
+}
+
 /// @brief helper method to update channel offset
 /// @details To be able to process a subset of channels we specify the offset
 /// in the model. However, this offset needs to be reset per worker in the
@@ -713,7 +798,7 @@ void CalibratorParallel::solveNE()
   if (useLinearSolver()) {
       if (itsSolver) {
           boost::shared_ptr<LinearSolver> linearSolver = boost::dynamic_pointer_cast<LinearSolver>(itsSolver);
-          ASKAPCHECK(linearSolver, "Failed to obtain a Linear solver!");
+          ASKAPCHECK(linearSolver || itsBlockDiagonalSolver, "Failed to obtain a Linear solver!");
 
           if (linearSolver) {
               // Passing major loop iteration number to the linear solver.
@@ -736,7 +821,11 @@ void CalibratorParallel::solveNE()
       timer.mark();
       Quality q;
 
-      itsSolver->solveNormalEquations(*itsModel, q);
+      if (canSolveBeamsConcurrently()) {
+          solveBeamsConcurrently(itsSolver, *itsModel, itsNThreads, q);
+      } else {
+          itsSolver->solveNormalEquations(*itsModel, q);
+      }
 
       ASKAPLOG_INFO_STR(logger, "Solved normal equations in " << timer.real() << " seconds");
       ASKAPLOG_INFO_STR(logger, "Solution quality: " << q);
@@ -804,6 +893,121 @@ void CalibratorParallel::solveNE()
   }
 }
 
+/// @brief check whether normal equations can be solved per beam
+/// @details Beams are independent if neither gains nor leakages are beam-independent
+/// and the bandpass is not solved for (and more than one thread is requested).
+/// @return true, if the beams can be solved for concurrently
+bool CalibratorParallel::canSolveBeamsConcurrently() const
+{
+  // the block-diagonal solver handles beams on its own
+  return (itsNThreads > 1) && !itsBlockDiagonalSolver && !itsSolveBandpass && !itsBeamIndependentGains &&
+         !itsBeamIndependentLeakages;
+}
+
+/// @brief solve normal equations for each beam concurrently
+/// @details Free parameters of the model are grouped by beam and each group
+/// is solved using a copy of the solver. Beams are distributed between threads.
+/// The quality of the combined solution has the total number of degrees of freedom
+/// and the total rank of all beams, the condition number is the worst one.
+/// @param[in] solver solver with normal equations (not modified, copies are used)
+/// @param[in] model model to update, free parameters should be beam-dependent
+/// calibration parameters
+/// @param[in] nThreads number of threads to use
+/// @param[out] quality solution quality (for all beams together)
+void CalibratorParallel::solveBeamsConcurrently(const scimath::Solver::ShPtr &solver, scimath::Params &model,
+                size_t nThreads, scimath::Quality &quality)
+{
+  ASKAPCHECK(solver, "Solver is not defined");
+  ASKAPCHECK(nThreads > 0, "Number of threads should be positive");
+  // the normal matrix is block-diagonal with one block per beam, group free parameters accordingly
+  std::map<casacore::uInt, std::vector<std::string> > beamParams;
+  const std::vector<std::string> names(model.freeNames());
+  for (std::vector<std::string>::const_iterator ci = names.begin(); ci != names.end(); ++ci) {
+       const casacore::uInt beam = accessors::CalParamNameHelper::parseParam(*ci).first.beam();
+       beamParams[beam].push_back(*ci);
+  }
+  if (beamParams.size() < 2) {
+      solver->solveNormalEquations(model, quality);
+      return;
+  }
+
+  std::vector<scimath::Params> models(beamParams.size());
+  std::vector<scimath::Quality> qualities(beamParams.size());
+  size_t index = 0;
+  for (std::map<casacore::uInt, std::vector<std::string> >::const_iterator ci = beamParams.begin();
+       ci != beamParams.end(); ++ci, ++index) {
+       for (std::vector<std::string>::const_iterator nameIt = ci->second.begin(); nameIt != ci->second.end(); ++nameIt) {
+            models[index].add(*nameIt, model.complexValue(*nameIt));
+       }
+  }
+
+  const size_t nUsedThreads = std::min(nThreads, models.size());
+  std::vector<std::string> errors(nUsedThreads);
+  // solvers share the normal equations which are only read during the solution
+  std::vector<scimath::Solver::ShPtr> solvers(nUsedThreads);
+  boost::thread_group threads;
+  for (size_t thread = 0; thread < nUsedThreads; ++thread) {
+       solvers[thread] = solver->clone();
+       ASKAPDEBUGASSERT(solvers[thread]);
+       threads.create_thread(boost::bind(&CalibratorParallel::solveBeams, boost::cref(solvers[thread]), boost::ref(models),
+                 boost::ref(qualities), thread, nUsedThreads, boost::ref(errors[thread])));
+  }
+  threads.join_all();
+  for (size_t thread = 0; thread < nUsedThreads; ++thread) {
+       ASKAPCHECK(errors[thread].size() == 0, "Solution for a subset of beams failed: "<<errors[thread]);
+  }
+
+  index = 0;
+  for (std::map<casacore::uInt, std::vector<std::string> >::const_iterator ci = beamParams.begin();
+       ci != beamParams.end(); ++ci, ++index) {
+       for (std::vector<std::string>::const_iterator nameIt = ci->second.begin(); nameIt != ci->second.end(); ++nameIt) {
+            model.update(*nameIt, models[index].complexValue(*nameIt));
+       }
+       ASKAPLOG_DEBUG_STR(logger, "Solution quality for beam "<<ci->first<<": "<<qualities[index]);
+  }
+
+  // the beams form independent blocks of one matrix, so degrees of freedom and ranks add up
+  casacore::uInt nDoF = 0;
+  casacore::uInt rank = 0;
+  double cond = 0.;
+  for (std::vector<scimath::Quality>::const_iterator ci = qualities.begin(); ci != qualities.end(); ++ci) {
+       nDoF += ci->DOF();
+       rank += ci->rank();
+       cond = std::max(cond, ci->cond());
+  }
+  quality.setDOF(nDoF);
+  quality.setRank(rank);
+  quality.setCond(cond);
+  std::ostringstream os;
+  os<<qualities[0].info()<<" (solved separately for "<<qualities.size()<<" beams, worst condition number is shown)";
+  quality.setInfo(os.str());
+  ASKAPLOG_INFO_STR(logger, "Solved for "<<models.size()<<" beams using "<<nUsedThreads<<" thread(s)");
+}
+
+/// @brief solve for a subset of beams (runs in a thread)
+/// @details Every step'th model starting from first is processed. Any exception is
+/// caught and its message is returned via error.
+/// @param[in] solver solver with normal equations to use (not shared with other threads)
+/// @param[in] models models with free parameters of a single beam each
+/// @param[in] qualities solution quality for each model
+/// @param[in] first index of the first model to process
+/// @param[in] step increment of the model index
+/// @param[out] error error message, empty if no error occurred
+void CalibratorParallel::solveBeams(const scimath::Solver::ShPtr &solver, std::vector<scimath::Params> &models,
+                std::vector<scimath::Quality> &qualities, const size_t first, const size_t step, std::string &error)
+{
+  ASKAPDEBUGASSERT(models.size() == qualities.size());
+  ASKAPDEBUGASSERT(step > 0);
+  try {
+     for (size_t i = first; i < models.size(); i += step) {
+          solver->solveNormalEquations(models[i], qualities[i]);
+     }
+  }
+  catch (const std::exception &ex) {
+     error = ex.what();
+  }
+}
+
 void CalibratorParallel::doPhaseReferencing()
 {
     if (itsComms.isMaster()) {
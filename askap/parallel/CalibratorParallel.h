@@ -41,6 +41,9 @@
 #include <askap/measurementequation/IMeasurementEquation.h>
 #include <askap/dataaccess/SharedIter.h>
 #include <askap/scimath/fitting/Solver.h>
+#include <askap/scimath/fitting/Quality.h>
+#include <askap/measurementequation/PreAvgCalMEBase.h>
+#include <askap/parallel/IntervalAccumulator.h>
 #include <askap/calibaccess/ICalSolutionSource.h>
 #include <askap/dataaccess/TimeChunkIteratorAdapter.h>
 
@@ -51,6 +54,7 @@
 
 // boost includes
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
 namespace askap
 {
@@ -92,6 +96,11 @@ namespace askap
       CalibratorParallel(askap::askapparallel::AskapParallel& comms,
           const LOFAR::ParameterSet& parset);
 
+      /// @brief destructor
+      /// @details It waits for the background accumulation of the next solution
+      /// interval (if any) to finish.
+      virtual ~CalibratorParallel();
+
       /// @brief Calculate the normal equations (runs in the prediffers)
       /// @details ImageFFTEquation and the specified gridder (set in the parset
       /// file) are used in conjunction with CalibrationME to calculate
@@ -139,6 +148,19 @@ namespace askap
       /// @note To be called after all cycles completed in the major loop.
       void doPhaseReferencing();
 
+      /// @brief solve normal equations for each beam concurrently
+      /// @details Free parameters of the model are grouped by beam and each group
+      /// is solved using a copy of the solver. Beams are distributed between threads.
+      /// The quality of the combined solution has the total number of degrees of freedom
+      /// and the total rank of all beams, the condition number is the worst one.
+      /// @param[in] solver solver with normal equations (not modified, copies are used)
+      /// @param[in] model model to update, free parameters should be beam-dependent
+      /// calibration parameters
+      /// @param[in] nThreads number of threads to use
+      /// @param[out] quality solution quality (for all beams together)
+      static void solveBeamsConcurrently(const scimath::Solver::ShPtr &solver, scimath::Params &model,
+                size_t nThreads, scimath::Quality &quality);
+
   protected:
       /// @brief initialise the class to iterate over next portion of data
       /// @details This method signals to the iterator adapter to switch to the
@@ -171,6 +193,36 @@ namespace askap
       void createCalibrationME(const accessors::IDataSharedIter &dsi,
                 const boost::shared_ptr<IMeasurementEquation const> &perfectME);
 
+      /// @brief create an empty pre-averaging measurement equation
+      /// @details The type of the equation is chosen according to the internal flags
+      /// (i.e. polarisation calibration or just antenna-based gains), the buffer is
+      /// initialised to the expected size.
+      /// @return shared pointer to the new equation
+      boost::shared_ptr<PreAvgCalMEBase> makePreAvgME() const;
+
+      /// @brief wait for the background accumulation of the next interval
+      /// @return equation with the accumulated data (empty shared pointer if
+      /// nothing has been accumulated in the background)
+      boost::shared_ptr<PreAvgCalMEBase> waitForNextInterval();
+
+      /// @brief check whether normal equations can be solved per beam
+      /// @details Beams are independent if neither gains nor leakages are beam-independent
+      /// and the bandpass is not solved for (and more than one thread is requested).
+      /// @return true, if the beams can be solved for concurrently
+      bool canSolveBeamsConcurrently() const;
+
+      /// @brief solve for a subset of beams (runs in a thread)
+      /// @details Every step'th model starting from first is processed. Any exception is
+      /// caught and its message is returned via error.
+      /// @param[in] solver solver with normal equations to use (not shared with other threads)
+      /// @param[in] models models with free parameters of a single beam each
+      /// @param[in] qualities solution quality for each model
+      /// @param[in] first index of the first model to process
+      /// @param[in] step increment of the model index
+      /// @param[out] error error message, empty if no error occurred
+      static void solveBeams(const scimath::Solver::ShPtr &solver, std::vector<scimath::Params> &models,
+                std::vector<scimath::Quality> &qualities, const size_t first, const size_t step, std::string &error);
+
       /// @brief helper method to rotate all phases
       /// @details This method rotates the phases of all gains in itsModel
       /// to have the phase of itsRefGain exactly 0. This operation does
@@ -302,6 +354,24 @@ namespace askap
       /// @brief flag to solve normal equation in parallel (on the matrix level).
       bool itsMatrixIsParallel;
 
+      /// @brief number of threads
+      /// @details If more than one, beams are solved for concurrently on the master and
+      /// the next solution interval is accumulated in the background on the workers.
+      casacore::uInt itsNThreads;
+
+      /// @brief true if the block-diagonal solver is used instead of the linear solver
+      bool itsBlockDiagonalSolver;
+
+      /// @brief maximum number of rows for which the uncorrupted model is predicted at once
+      /// @details Zero means that visibilities are predicted chunk by chunk (default).
+      casacore::uInt itsPredictionBatchRows;
+
+      /// @brief cache of rotated uvw's and delays shared by all batches (may be empty)
+      boost::shared_ptr<RotatedUVWCache> itsRotatedUVWCache;
+
+      /// @brief accumulation of the next solution interval in the background
+      IntervalAccumulator itsNextInterval;
+
       // Iteration number in the major loop (for LSQR solver with constraints).
       size_t itsMajorLoopIterationNumber;
 
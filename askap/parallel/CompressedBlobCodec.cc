@@ -0,0 +1,330 @@
+/// @file
+/// @brief compact encoding of serialised messages
+/// @details Models and images passed between ranks are serialised into blob streams
+/// of the whole scimath::Params object. Early in the clean, model images are mostly
+/// zeros and even dense images stored as doubles often hold values converted from
+/// single precision (with zero low-order mantissa bytes). This class encodes a byte
+/// buffer with run-length encoding of zero bytes, optionally preceded by a byte shuffle
+/// which groups the same byte of each 8-byte word together. Both transformations are
+/// lossless. The encoded buffer starts with a small header, so the decoder does not need
+/// to know the mode used for encoding.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#include <askap/parallel/CompressedBlobCodec.h>
+#include <askap/AskapError.h>
+
+#include <cstring>
+
+namespace askap {
+
+namespace synthesis {
+
+namespace {
+
+/// @brief word size used for the byte shuffle (double precision)
+const size_t theirShuffleWordSize = sizeof(double);
+
+/// @brief minimal number of zero bytes encoded as a run
+/// @details Shorter sequences of zeros are stored as literals because each run costs
+/// at least two bytes of encoding overhead.
+const size_t theirMinZeroRun = 4;
+
+/// @brief size of the header (mode followed by the size of the original data)
+const size_t theirHeaderSize = 1 + sizeof(uint64_t);
+
+/// @brief maximum size of the variable length representation of a 64-bit integer
+const size_t theirMaxVarintSize = 10;
+
+/// @brief append variable length unsigned integer (7 bits per byte)
+/// @param[in] value value to append
+/// @param[in] out output buffer
+/// @param[in,out] pos current position in the output buffer, advanced past the value
+void putVarint(uint64_t value, uint8_t *out, size_t &pos)
+{
+  while (value >= 0x80) {
+         out[pos++] = static_cast<uint8_t>((value & 0x7f) | 0x80);
+         value >>= 7;
+  }
+  out[pos++] = static_cast<uint8_t>(value);
+}
+
+/// @brief extract variable length unsigned integer
+/// @param[in] data encoded buffer
+/// @param[in] size size of the encoded buffer
+/// @param[in,out] pos current position in the buffer, advanced past the value
+/// @return decoded value
+uint64_t getVarint(const uint8_t *data, size_t size, size_t &pos)
+{
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+       ASKAPCHECK(pos < size, "Encoded buffer is truncated");
+       const uint8_t byte = data[pos++];
+       value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+       if ((byte & 0x80) == 0) {
+           return value;
+       }
+  }
+  ASKAPTHROW(AskapError, "Malformed variable length integer in the encoded buffer");
+}
+
+/// @brief group the same byte of each word together
+/// @details Bytes which don't form a complete word are copied unchanged at the end.
+/// @param[in] in input buffer
+/// @param[in] size size of the input buffer
+/// @param[out] out output buffer, must be at least size bytes long
+void shuffle(const uint8_t *in, size_t size, uint8_t *out)
+{
+  const size_t nWords = size / theirShuffleWordSize;
+  for (size_t byte = 0; byte < theirShuffleWordSize; ++byte) {
+       uint8_t *plane = out + byte * nWords;
+       const uint8_t *src = in + byte;
+       for (size_t word = 0; word < nWords; ++word, src += theirShuffleWordSize) {
+            plane[word] = *src;
+       }
+  }
+  const size_t done = nWords * theirShuffleWordSize;
+  std::memcpy(out + done, in + done, size - done);
+}
+
+/// @brief reverse operation to shuffle
+/// @param[in] in input buffer
+/// @param[in] size size of the input buffer
+/// @param[out] out output buffer, must be at least size bytes long
+void unshuffle(const uint8_t *in, size_t size, uint8_t *out)
+{
+  const size_t nWords = size / theirShuffleWordSize;
+  for (size_t byte = 0; byte < theirShuffleWordSize; ++byte) {
+       const uint8_t *plane = in + byte * nWords;
+       uint8_t *dest = out + byte;
+       for (size_t word = 0; word < nWords; ++word, dest += theirShuffleWordSize) {
+            *dest = plane[word];
+       }
+  }
+  const size_t done = nWords * theirShuffleWordSize;
+  std::memcpy(out + done, in + done, size - done);
+}
+
+/// @brief run-length encoding of zero bytes
+/// @details The output is a sequence of pairs: the number of literal bytes followed by
+/// these bytes, and the number of zero bytes which follow the literals.
+/// @param[in] in input buffer
+/// @param[in] size size of the input buffer
+/// @param[in] out output buffer, must be large enough for the worst case
+/// @return number of bytes written to the output buffer
+size_t encodeZeroRuns(const uint8_t *in, size_t size, uint8_t *out)
+{
+  size_t outPos = 0;
+  for (size_t pos = 0; pos < size;) {
+       // search for the next sufficiently long run of zeros
+       size_t zeroStart = size;
+       size_t zeroLength = 0;
+       for (size_t i = pos; i < size;) {
+            if (in[i] != 0) {
+                ++i;
+                continue;
+            }
+            size_t end = i;
+            while ((end < size) && (in[end] == 0)) {
+                   ++end;
+            }
+            if ((end - i >= theirMinZeroRun) || (end == size)) {
+                zeroStart = i;
+                zeroLength = end - i;
+                break;
+            }
+            i = end;
+       }
+       putVarint(zeroStart - pos, out, outPos);
+       std::memcpy(out + outPos, in + pos, zeroStart - pos);
+       outPos += zeroStart - pos;
+       putVarint(zeroLength, out, outPos);
+       pos = zeroStart + zeroLength;
+  }
+  return outPos;
+}
+
+/// @brief decoding of zero runs
+/// @param[in] data encoded buffer (without header)
+/// @param[in] size size of the encoded buffer
+/// @param[out] out decoded buffer, must be exactly the size of the original data
+/// @param[in] outSize size of the original data
+void decodeZeroRuns(const uint8_t *data, size_t size, uint8_t *out, size_t outSize)
+{
+  size_t outPos = 0;
+  for (size_t pos = 0; pos < size;) {
+       const uint64_t nLiterals = getVarint(data, size, pos);
+       ASKAPCHECK((pos + nLiterals <= size) && (outPos + nLiterals <= outSize),
+                  "Encoded buffer is inconsistent with the size of the original data");
+       std::memcpy(out + outPos, data + pos, nLiterals);
+       pos += nLiterals;
+       outPos += nLiterals;
+       const uint64_t nZeros = getVarint(data, size, pos);
+       ASKAPCHECK(outPos + nZeros <= outSize, "Encoded buffer is inconsistent with the size of the original data");
+       std::memset(out + outPos, 0, nZeros);
+       outPos += nZeros;
+  }
+  ASKAPCHECK(outPos == outSize, "Encoded buffer is truncated, decoded "<<outPos<<" bytes out of "<<outSize);
+}
+
+} // anonymous namespace
+
+/// @brief encode the buffer
+/// @param[in] data pointer to the data to encode
+/// @param[in] size size of the data in bytes
+/// @param[in] mode encoding mode
+/// @param[out] out encoded buffer (resized as necessary)
+void CompressedBlobCodec::encode(const void *data, size_t size, Mode mode, std::vector<int8_t> &out)
+{
+  out.resize(maxEncodedSize(size));
+  out.resize(encode(data, size, mode, &out[0]));
+}
+
+/// @brief encode the buffer into preallocated memory
+/// @details This version allows the caller to encode directly into the buffer which is
+/// going to be sent (e.g. a blob string), avoiding an intermediate copy.
+/// @param[in] data pointer to the data to encode
+/// @param[in] size size of the data in bytes
+/// @param[in] mode encoding mode
+/// @param[out] out output buffer, at least maxEncodedSize(size) bytes long
+/// @return size of the encoded data in bytes
+size_t CompressedBlobCodec::encode(const void *data, size_t size, Mode mode, void *out)
+{
+  ASKAPDEBUGASSERT((data != NULL) || (size == 0));
+  ASKAPDEBUGASSERT(out != NULL);
+  const uint8_t *in = static_cast<const uint8_t*>(data);
+  uint8_t *dest = static_cast<uint8_t*>(out);
+  dest[0] = static_cast<uint8_t>(mode);
+  const uint64_t originalSize = size;
+  std::memcpy(dest + 1, &originalSize, sizeof(uint64_t));
+  dest += theirHeaderSize;
+
+  switch (mode) {
+     case NONE:
+          if (size > 0) {
+              std::memcpy(dest, in, size);
+          }
+          return theirHeaderSize + size;
+     case ZERO_RUNS:
+          return theirHeaderSize + encodeZeroRuns(in, size, dest);
+     case SHUFFLED_ZERO_RUNS:
+          if (size > 0) {
+              std::vector<uint8_t> buffer(size);
+              shuffle(in, size, &buffer[0]);
+              return theirHeaderSize + encodeZeroRuns(&buffer[0], size, dest);
+          }
+          return theirHeaderSize;
+     default:
+          ASKAPTHROW(AskapError, "Unknown encoding mode "<<int(mode));
+  }
+}
+
+/// @brief upper bound of the encoded size
+/// @details Literal bytes are copied as is. Every zero run replaces at least theirMinZeroRun
+/// bytes and, together with the count of preceding literals, costs less than the bytes it
+/// replaces unless the literal count is long. Therefore, the overhead is bounded by a
+/// fraction of the data size plus the cost of the final pair of counts.
+/// @param[in] size size of the data in bytes
+/// @return maximum size of the encoded buffer in bytes for any mode
+size_t CompressedBlobCodec::maxEncodedSize(size_t size)
+{
+  return theirHeaderSize + size + size / 64 + 2 * theirMaxVarintSize;
+}
+
+/// @brief decode the buffer
+/// @details The mode is taken from the header of the encoded buffer.
+/// @param[in] data pointer to the encoded buffer
+/// @param[in] size size of the encoded buffer in bytes
+/// @param[out] out decoded data (resized as necessary)
+void CompressedBlobCodec::decode(const void *data, size_t size, std::vector<int8_t> &out)
+{
+  ASKAPCHECK(size >= theirHeaderSize, "Encoded buffer is too short ("<<size<<" bytes) to have a valid header");
+  const uint8_t *in = static_cast<const uint8_t*>(data);
+  const Mode mode = static_cast<Mode>(in[0]);
+  uint64_t originalSize = 0;
+  std::memcpy(&originalSize, in + 1, sizeof(uint64_t));
+  in += theirHeaderSize;
+  size -= theirHeaderSize;
+
+  out.resize(originalSize);
+  if (originalSize == 0) {
+      return;
+  }
+  uint8_t *dest = reinterpret_cast<uint8_t*>(&out[0]);
+  switch (mode) {
+     case NONE:
+          ASKAPCHECK(size == originalSize, "Encoded buffer is inconsistent with the size of the original data");
+          std::memcpy(dest, in, size);
+          break;
+     case ZERO_RUNS:
+          decodeZeroRuns(in, size, dest, originalSize);
+          break;
+     case SHUFFLED_ZERO_RUNS:
+          {
+            std::vector<uint8_t> buffer(originalSize);
+            decodeZeroRuns(in, size, &buffer[0], originalSize);
+            unshuffle(&buffer[0], originalSize, dest);
+          }
+          break;
+     default:
+          ASKAPTHROW(AskapError, "Unknown encoding mode "<<int(mode)<<" in the header of encoded buffer");
+  }
+}
+
+/// @brief convert string into mode
+/// @details Recognised values are "none", "rle" and "shuffle" (case sensitive).
+/// @param[in] name string representation of the mode
+/// @return mode
+CompressedBlobCodec::Mode CompressedBlobCodec::modeFromString(const std::string &name)
+{
+  if (name == "none") {
+      return NONE;
+  } else if (name == "rle") {
+      return ZERO_RUNS;
+  } else if (name == "shuffle") {
+      return SHUFFLED_ZERO_RUNS;
+  }
+  ASKAPTHROW(AskapError, "Unknown compression mode "<<name<<", supported modes are none, rle and shuffle");
+}
+
+/// @brief convert mode into string
+/// @param[in] mode mode to convert
+/// @return string representation of the mode
+std::string CompressedBlobCodec::toString(Mode mode)
+{
+  switch (mode) {
+     case NONE:
+          return "none";
+     case ZERO_RUNS:
+          return "rle";
+     case SHUFFLED_ZERO_RUNS:
+          return "shuffle";
+     default:
+          ASKAPTHROW(AskapError, "Unknown encoding mode "<<int(mode));
+  }
+}
+
+} // namespace synthesis
+
+} // namespace askap
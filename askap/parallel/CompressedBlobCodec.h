@@ -0,0 +1,109 @@
+/// @file
+/// @brief compact encoding of serialised messages
+/// @details Models and images passed between ranks are serialised into blob streams
+/// of the whole scimath::Params object. Early in the clean, model images are mostly
+/// zeros and even dense images stored as doubles often hold values converted from
+/// single precision (with zero low-order mantissa bytes). This class encodes a byte
+/// buffer with run-length encoding of zero bytes, optionally preceded by a byte shuffle
+/// which groups the same byte of each 8-byte word together. Both transformations are
+/// lossless. The encoded buffer starts with a small header, so the decoder does not need
+/// to know the mode used for encoding.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#ifndef ASKAP_SYNTHESIS_COMPRESSED_BLOB_CODEC_H
+#define ASKAP_SYNTHESIS_COMPRESSED_BLOB_CODEC_H
+
+#include <vector>
+#include <string>
+#include <cstddef>
+
+#include <stdint.h>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief compact encoding of serialised messages
+/// @details The encoding is intended for buffers which are sent between ranks of
+/// the same job (i.e. the byte order is the same on both sides). All methods are static.
+/// @ingroup parallel
+struct CompressedBlobCodec {
+
+   /// @brief encoding modes
+   enum Mode {
+      /// @brief no compression, the data are just copied
+      NONE = 0,
+      /// @brief run-length encoding of zero bytes
+      ZERO_RUNS,
+      /// @brief byte shuffle followed by the run-length encoding of zero bytes
+      SHUFFLED_ZERO_RUNS
+   };
+
+   /// @brief encode the buffer
+   /// @param[in] data pointer to the data to encode
+   /// @param[in] size size of the data in bytes
+   /// @param[in] mode encoding mode
+   /// @param[out] out encoded buffer (resized as necessary)
+   static void encode(const void *data, size_t size, Mode mode, std::vector<int8_t> &out);
+
+   /// @brief encode the buffer into preallocated memory
+   /// @details This version allows the caller to encode directly into the buffer which is
+   /// going to be sent (e.g. a blob string), avoiding an intermediate copy.
+   /// @param[in] data pointer to the data to encode
+   /// @param[in] size size of the data in bytes
+   /// @param[in] mode encoding mode
+   /// @param[out] out output buffer, at least maxEncodedSize(size) bytes long
+   /// @return size of the encoded data in bytes
+   static size_t encode(const void *data, size_t size, Mode mode, void *out);
+
+   /// @brief upper bound of the encoded size
+   /// @param[in] size size of the data in bytes
+   /// @return maximum size of the encoded buffer in bytes for any mode
+   static size_t maxEncodedSize(size_t size);
+
+   /// @brief decode the buffer
+   /// @details The mode is taken from the header of the encoded buffer.
+   /// @param[in] data pointer to the encoded buffer
+   /// @param[in] size size of the encoded buffer in bytes
+   /// @param[out] out decoded data (resized as necessary)
+   static void decode(const void *data, size_t size, std::vector<int8_t> &out);
+
+   /// @brief convert string into mode
+   /// @details Recognised values are "none", "rle" and "shuffle" (case sensitive).
+   /// @param[in] name string representation of the mode
+   /// @return mode
+   static Mode modeFromString(const std::string &name);
+
+   /// @brief convert mode into string
+   /// @param[in] mode mode to convert
+   /// @return string representation of the mode
+   static std::string toString(Mode mode);
+};
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef ASKAP_SYNTHESIS_COMPRESSED_BLOB_CODEC_H
@@ -41,6 +41,7 @@
 #include <askap/measurementequation/ImagingEquationAdapter.h>
 #include <askap/AskapError.h>
 #include <askap/measurementequation/SynthesisParamsHelper.h>
+#include <askap/utils/MSUtils.h>
 
 
 // logging stuff
@@ -49,6 +50,7 @@
 ASKAP_LOGGER(logger, ".parallel");
 
 #include <casacore/casa/OS/Timer.h>
+#include <casacore/casa/Arrays/ArrayMath.h>
 
 
 using namespace askap;
@@ -70,6 +72,13 @@ ContSubtractParallel::ContSubtractParallel(askap::askapparallel::AskapParallel&
   itsNe.reset(new scimath::NormalEquationsStub);
   
   itsModelReadByMaster = parset.getBool("modelReadByMaster", true);  
+
+  itsSplitBeams = itsComms.isParallel() ? parset.getBool("splitbeams", false) : false;
+  itsUsePipeline = parset.getBool("pipeline", false);
+  itsNPipelineWorkers = parset.getUint32("pipeline.nworkers", 2);
+  itsPipelineDepth = parset.getUint32("pipeline.depth", 2 * itsNPipelineWorkers);
+  ASKAPCHECK(itsNPipelineWorkers > 0, "pipeline.nworkers should be positive");
+  ASKAPCHECK(itsPipelineDepth > 0, "pipeline.depth should be positive");
 }
 
 /// @brief Initialise continuum subtractor
@@ -97,6 +106,15 @@ void ContSubtractParallel::init()
 /// @brief initialise measurement equation
 /// @details This method initialises measurement equation
 void ContSubtractParallel::initMeasurementEquation()
+{
+   itsEquation = createMeasurementEquation();
+}
+
+/// @brief create measurement equation for the current model
+/// @details The equation is built for image-based, component-based or composite models.
+/// It is always accessor-based, i.e. it can be cast to IMeasurementEquation.
+/// @return shared pointer to the new equation
+scimath::Equation::ShPtr ContSubtractParallel::createMeasurementEquation() const
 {
    ASKAPLOG_INFO_STR(logger, "Creating measurement equation" );
    
@@ -127,16 +145,18 @@ void ContSubtractParallel::initMeasurementEquation()
        compEquation.reset(new ComponentEquation(*itsModel, stubIter));
    }
 
+   scimath::Equation::ShPtr equation;
+
    if (imgEquation && !compEquation) {
        ASKAPLOG_INFO_STR(logger, "Pure image-based model (no components defined)");
-       itsEquation = imgEquation;
+       equation = imgEquation;
    } else if (compEquation && !imgEquation) {
        ASKAPLOG_INFO_STR(logger, "Pure component-based model (no images defined)");
-       itsEquation = compEquation;
+       equation = compEquation;
    } else if (imgEquation && compEquation) {
        ASKAPLOG_INFO_STR(logger, "Making a sum of image-based and component-based equations");
-       itsEquation = imgEquation;
-       SimParallel::addEquation(itsEquation, compEquation, stubIter);
+       equation = imgEquation;
+       SimParallel::addEquation(equation, compEquation, stubIter);
    } else {
        ASKAPTHROW(AskapError, "No sky models are defined");
    }
@@ -146,18 +166,56 @@ void ContSubtractParallel::initMeasurementEquation()
    // additional fiddling  is needed
    
    boost::shared_ptr<IMeasurementEquation> accessorBasedEquation =
-        boost::dynamic_pointer_cast<IMeasurementEquation>(itsEquation);
+        boost::dynamic_pointer_cast<IMeasurementEquation>(equation);
    
    if (!accessorBasedEquation) {
         // form a replacement equation first
         const boost::shared_ptr<ImagingEquationAdapter> new_equation(new ImagingEquationAdapter);
-        // the actual equation (from itsEquation) will be locked inside ImagingEquationAdapter
-        // in a shared pointer. We can change itsEquation after the following line
-        new_equation->assign(itsEquation);
+        // the actual equation will be locked inside ImagingEquationAdapter
+        // in a shared pointer. We can change the equation after the following line
+        new_equation->assign(equation);
         // replacing the original equation with an accessor-based adapter
-        itsEquation = new_equation;
+        equation = new_equation;
    }
-   
+   return equation;
+}
+
+/// @brief initialise the pipeline
+/// @details The pipeline and the measurement equations of its workers are created once and
+/// reused for all datasets and beams. The first worker shares the equation with the serial code.
+void ContSubtractParallel::initPipeline()
+{
+   if (!itsEquation) {
+       initMeasurementEquation();
+   }
+   // equations cache gridded models and are not thread safe, each worker needs its own
+   std::vector<boost::shared_ptr<IMeasurementEquation> > equations(itsNPipelineWorkers);
+   for (size_t worker = 0; worker < equations.size(); ++worker) {
+        const scimath::Equation::ShPtr equation = worker == 0 ? itsEquation : createMeasurementEquation();
+        equations[worker] = boost::dynamic_pointer_cast<IMeasurementEquation>(equation);
+        ASKAPDEBUGASSERT(equations[worker]);
+   }
+   itsPipeline.reset(new ContSubtractPipeline(equations, itsPipelineDepth, uvwMachineCacheSize(),
+                     uvwMachineCacheTolerance()));
+}
+
+/// @brief create data iterator for the given dataset
+/// @param[in] ms measurement set name
+/// @param[in] beam beam to select, a negative value means all beams
+/// @return shared iterator with write permission
+IDataSharedIter ContSubtractParallel::createIterator(const std::string &ms, int beam) const
+{
+   TableDataSource ds(ms, TableDataSource::WRITE_PERMITTED, dataColumn());
+   ds.configureUVWMachineCache(uvwMachineCacheSize(),uvwMachineCacheTolerance());      
+   IDataSelectorPtr sel=ds.createSelector();
+   sel << parset();
+   if (beam >= 0) {
+       sel->chooseFeed(static_cast<casacore::uInt>(beam));
+   }
+   IDataConverterPtr conv=ds.createConverter();
+   conv->setFrequencyFrame(getFreqRefFrame(), "Hz");
+   conv->setDirectionFrame(casacore::MDirection::Ref(casacore::MDirection::J2000));
+   return ds.createIterator(sel, conv);
 }
 
 /// @brief perform the subtraction for the given dataset
@@ -165,12 +223,34 @@ void ContSubtractParallel::initMeasurementEquation()
 /// model and subtracts these model visibilities from the original visibilities in the dataset.
 /// This is the core operation of the doSubtraction method, which manages the parallel aspect of it.
 /// All actual calculations are done inside this helper method.
+/// The data are processed either chunk by chunk or, if the pipeline is enabled, by separate
+/// reader, prediction and writer threads.
 /// @param[in] ms measurement set name
-void ContSubtractParallel::calcOne(const std::string &ms)
+/// @param[in] beam beam to select, a negative value means all beams
+void ContSubtractParallel::calcOne(const std::string &ms, int beam)
 {
    casacore::Timer timer;
    timer.mark();
-   ASKAPLOG_INFO_STR(logger, "Performing continuum model subtraction for " << ms );
+   if (beam >= 0) {
+       ASKAPLOG_INFO_STR(logger, "Performing continuum model subtraction for " << ms << " beam "<< beam);
+   } else {
+       ASKAPLOG_INFO_STR(logger, "Performing continuum model subtraction for " << ms );
+   }
+
+   if (itsUsePipeline) {
+       if (!itsPipeline) {
+           initPipeline();
+       } else {
+           ASKAPLOG_INFO_STR(logger, "Reusing measurement equations of the pipeline" );
+       }
+       ASKAPDEBUGASSERT(itsPipeline);
+       // the second iterator over the same data is used to write the result back
+       itsPipeline->run(createIterator(ms, beam), createIterator(ms, beam));
+       ASKAPLOG_INFO_STR(logger, "Finished continuum subtraction for "<< ms << " in "<< timer.real()
+                   << " seconds, "<<itsPipeline->nChunks()<<" chunks processed, time spent in calculation by all workers: "<<
+                   itsPipeline->calculationTime()<<" seconds");
+       return;
+   }
 
    if (!itsEquation) {
        initMeasurementEquation();
@@ -183,14 +263,7 @@ void ContSubtractParallel::calcOne(const std::string &ms)
         boost::dynamic_pointer_cast<IMeasurementEquation>(itsEquation);
    ASKAPDEBUGASSERT(accessorBasedEquation);
  
-   TableDataSource ds(ms, TableDataSource::WRITE_PERMITTED, dataColumn());
-   ds.configureUVWMachineCache(uvwMachineCacheSize(),uvwMachineCacheTolerance());      
-   IDataSelectorPtr sel=ds.createSelector();
-   sel << parset();
-   IDataConverterPtr conv=ds.createConverter();
-   conv->setFrequencyFrame(getFreqRefFrame(), "Hz");
-   conv->setDirectionFrame(casacore::MDirection::Ref(casacore::MDirection::J2000));
-   IDataSharedIter it=ds.createIterator(sel, conv);
+   IDataSharedIter it=createIterator(ms, beam);
    for (; it.hasMore(); it.next()) {
         // iteration over the dataset
         MemBufferDataAccessor acc(*it);
@@ -212,11 +285,26 @@ void ContSubtractParallel::calcOne(const std::string &ms)
 /// @brief perform the subtraction
 /// @details This method iterates over one or more datasets, predicts visibilities according to 
 /// the model and subtracts these model visibilities from the original visibilities in the
-/// dataset. The intention is to call this method in a worker.
+/// dataset. The intention is to call this method in a worker. If beams are split between
+/// ranks, every worker processes its share of beams in all datasets, otherwise each worker
+/// processes its own dataset.
 void ContSubtractParallel::doSubtraction()
 {
   if (itsComms.isWorker()) {        
-      if (itsComms.isParallel()) {
+      if (itsSplitBeams) {
+          // names are taken without substitution, all workers share the same datasets
+          const std::vector<std::string> datasets = parset().getStringVector("dataset");
+          const casacore::uInt nWorkers = static_cast<casacore::uInt>(itsComms.nProcs() - 1);
+          for (size_t iMs=0; iMs<datasets.size(); ++iMs) {
+               const casacore::uInt nBeams = nBeamsInDataset(datasets[iMs]);
+               ASKAPLOG_INFO_STR(logger, nBeams<<" beams of "<<datasets[iMs]<<" will be split between "<<
+                                 nWorkers<<" workers");
+               for (casacore::uInt beam = static_cast<casacore::uInt>(itsComms.rank() - 1); beam < nBeams;
+                    beam += nWorkers) {
+                    calcOne(datasets[iMs], static_cast<int>(beam));
+               }
+          }
+      } else if (itsComms.isParallel()) {
           calcOne(measurementSets()[itsComms.rank()-1]);
       } else {
           for (size_t iMs=0; iMs<measurementSets().size(); ++iMs) {
@@ -33,6 +33,17 @@
 // ASKAPsoft includes
 #include <Common/ParameterSet.h>
 #include <askap/parallel/MEParallelApp.h>
+#include <askap/parallel/ContSubtractPipeline.h>
+#include <askap/measurementequation/IMeasurementEquation.h>
+#include <askap/dataaccess/SharedIter.h>
+#include <askap/dataaccess/IDataIterator.h>
+
+// boost includes
+#include <boost/shared_ptr.hpp>
+
+// std includes
+#include <string>
+#include <vector>
 
 namespace askap {
 
@@ -64,7 +75,9 @@ public:
    /// @brief perform the subtraction
    /// @details This method iterates over one or more datasets, predicts visibilities according to 
    /// the model and subtracts these model visibilities from the original visibilities in the
-   /// dataset. The intention is to call this method in a worker.
+   /// dataset. The intention is to call this method in a worker. If beams are split between
+   /// ranks, every worker processes its share of beams in all datasets, otherwise each worker
+   /// processes its own dataset.
    void doSubtraction();
  
  protected:
@@ -74,14 +87,34 @@ public:
    /// @brief initialise measurement equation
    /// @details This method initialises measurement equation
    void initMeasurementEquation();
-   
+
+   /// @brief create measurement equation for the current model
+   /// @details The equation is built for image-based, component-based or composite models.
+   /// It is always accessor-based, i.e. it can be cast to IMeasurementEquation.
+   /// @return shared pointer to the new equation
+   scimath::Equation::ShPtr createMeasurementEquation() const;
+
+   /// @brief initialise the pipeline
+   /// @details The pipeline and the measurement equations of its workers are created once and
+   /// reused for all datasets and beams. The first worker shares the equation with the serial code.
+   void initPipeline();
+
+   /// @brief create data iterator for the given dataset
+   /// @param[in] ms measurement set name
+   /// @param[in] beam beam to select, a negative value means all beams
+   /// @return shared iterator with write permission
+   accessors::IDataSharedIter createIterator(const std::string &ms, int beam = -1) const;
+
    /// @brief perform the subtraction for the given dataset
    /// @details This method iterates over the given dataset, predicts visibilities according to the
    /// model and subtracts these model visibilities from the original visibilities in the dataset.
    /// This is the core operation of the doSubtraction method, which manages the parallel aspect of it.
    /// All actual calculations are done inside this helper method.
+   /// The data are processed either chunk by chunk or, if the pipeline is enabled, by separate
+   /// reader, prediction and writer threads.
    /// @param[in] ms measurement set name
-   void calcOne(const std::string &ms);
+   /// @param[in] beam beam to select, a negative value means all beams
+   void calcOne(const std::string &ms, int beam = -1);
       
    // stubs for pure virtual methods which we don't use
    /// @brief calculate normal equations
@@ -99,6 +132,23 @@ public:
    /// can either be read in the master and distributed across the workers or read
    /// by workers directly. This data member is true, if the model is read by the master
    bool itsModelReadByMaster;    
+
+   /// @brief true, if beams are split between worker ranks
+   /// @details In this mode all workers read and write all datasets in place (relying on
+   /// table locking), each one selecting the beams assigned to it in a round-robin fashion.
+   bool itsSplitBeams;
+
+   /// @brief true, if the threaded pipeline is used
+   bool itsUsePipeline;
+
+   /// @brief number of worker threads in the pipeline
+   casacore::uInt itsNPipelineWorkers;
+
+   /// @brief maximum number of chunks waiting in each queue of the pipeline
+   casacore::uInt itsPipelineDepth;
+
+   /// @brief threaded pipeline (created on demand)
+   boost::shared_ptr<ContSubtractPipeline> itsPipeline;
 };
 
 } // namespace synthesis
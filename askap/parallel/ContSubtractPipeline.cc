@@ -0,0 +1,80 @@
+/// @file
+/// @brief multi-threaded continuum subtraction for a dataset
+/// @details The continuum model is subtracted in three stages working in parallel: a reader
+/// thread copies chunks of data into memory, a number of worker threads predict model
+/// visibilities and subtract them from the copy and a writer thread puts the result back into
+/// the dataset. Stages are connected by bounded queues, so the prediction for the next chunks
+/// overlaps with the read-modify-write of the current one. Disk access (which is not thread
+/// safe in casacore) is serialised.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+
+#include <askap/parallel/ContSubtractPipeline.h>
+#include <askap/askap_synthesis.h>
+#include <askap/AskapError.h>
+#include <askap/dataaccess/MemBufferDataAccessor.h>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief constructor
+/// @param[in] equations accessor-based measurement equations, one per worker thread
+/// @param[in] depth maximum number of chunks waiting in each queue (should be positive)
+/// @param[in] cacheSize uvw-machine cache size
+/// @param[in] tolerance pointing direction tolerance in radians, exceeding
+/// which leads to initialisation of a new UVW machine and recompute of the rotated uvws/delays
+ContSubtractPipeline::ContSubtractPipeline(const std::vector<boost::shared_ptr<IMeasurementEquation> > &equations,
+                                           size_t depth, size_t cacheSize, double tolerance) :
+   VisProcessingPipeline(equations.size(), depth, false, boost::shared_ptr<boost::mutex>(), cacheSize, tolerance),
+   itsEquations(equations)
+{
+  for (size_t worker = 0; worker < itsEquations.size(); ++worker) {
+       ASKAPCHECK(itsEquations[worker], "Measurement equation for worker "<<worker<<" is not defined");
+  }
+}
+
+/// @brief subtract the model from one chunk
+/// @param[in] worker index of the worker thread
+/// @param[in] chunk chunk to process
+void ContSubtractPipeline::processChunk(size_t worker, Chunk &chunk) const
+{
+  ASKAPDEBUGASSERT(worker < itsEquations.size());
+  ASKAPDEBUGASSERT(chunk.itsData);
+  // the model is predicted into a buffer, metadata (including rotated uvw's) come from the copy.
+  // Gridder FFTs are serialised between workers (see serialisedFFT2D) and the rotations not
+  // done by the reader are computed with the I/O mutex locked (see PrefetchAccessor)
+  accessors::MemBufferDataAccessor acc(*chunk.itsData);
+  acc.rwVisibility().set(0.);
+  itsEquations[worker]->predict(acc);
+  const casacore::Cube<casacore::Complex> &model = acc.visibility();
+  casacore::Cube<casacore::Complex> &vis = chunk.itsData->rwVisibility();
+  ASKAPDEBUGASSERT(model.shape() == vis.shape());
+  vis -= model;
+}
+
+} // namespace synthesis
+
+} // namespace askap
@@ -44,6 +44,8 @@ ASKAP_LOGGER(logger, ".parallel");
 #include <askap/AskapUtil.h>
 
 #include <askapparallel/AskapParallel.h>
+#include <askapparallel/BlobIBufMW.h>
+#include <askapparallel/BlobOBufMW.h>
 #include <askap/dataaccess/DataAccessError.h>
 #include <askap/dataaccess/TableDataSource.h>
 #include <askap/dataaccess/ParsetInterface.h>
@@ -62,14 +64,19 @@ ASKAP_LOGGER(logger, ".parallel");
 #include <askap/measurementequation/ImageCleaningSolver.h>
 #include <askap/calibaccess/CalibAccessFactory.h>
 #include <askap/measurementequation/CalibrationApplicatorME.h>
+#include <askap/measurementequation/CalSolutionCache.h>
 #include <profile/AskapProfiler.h>
 #include <askap/parallel/GroupVisAggregator.h>
 #include <askap/parallel/AdviseParallel.h>
+#include <askap/parallel/CompressedBlobCodec.h>
 
 #include <casacore/casa/aips.h>
 #include <casacore/casa/OS/Timer.h>
 
 #include <Common/ParameterSet.h>
+#include <Blob/BlobIStream.h>
+#include <Blob/BlobOStream.h>
+#include <Blob/BlobArray.h>
 
 #include <stdexcept>
 #include <iostream>
@@ -91,8 +98,15 @@ namespace askap
     ImagerParallel::ImagerParallel(askap::askapparallel::AskapParallel& comms,
         const LOFAR::ParameterSet& parset) :
       MEParallelApp(comms,parset),
-      itsExportSensitivityImage(false), itsExpSensitivityCutoff(0.)
+      itsExportSensitivityImage(false), itsExpSensitivityCutoff(0.),
+      itsDistributedFacets(parset.getBool("distributedfacets", false)),
+      itsFacetPSFWidth(parset.getInt32("distributedfacets.psfwidth", 0))
     {
+      if (itsDistributedFacets && itsComms.isParallel()) {
+          ASKAPCHECK(itsComms.nGroups() == 1, "Distributed facets are not supported with groups of workers");
+          ASKAPCHECK(itsFacetPSFWidth >= 0, "distributedfacets.psfwidth should not be negative, you have "<<itsFacetPSFWidth);
+          ASKAPLOG_INFO_STR(logger, "Normal equations for each facet will be reduced to and solved by the worker owning this facet");
+      }
       if (itsComms.isMaster())
       {
         itsRestore=parset.getBool("restore", false);
@@ -132,6 +146,11 @@ namespace askap
       }
       if (itsComms.isWorker())
       {
+        if (itsDistributedFacets) {
+            // workers solve for their own facets in this mode
+            itsSolver = ImageSolverFactory::make(parset);
+            ASKAPCHECK(itsSolver, "Solver not defined correctly");
+        }
         bool doCalib = parset.getBool("calibrate",false);
         if (doCalib) {
             ASKAPCHECK(!parset.isDefined("gainsfile"), "Deprecated 'gainsfile' keyword is found together with calibrate=true, please remove it");
@@ -153,6 +172,11 @@ namespace askap
             ASKAPASSERT(itsSolutionSource);
         }
         if (itsSolutionSource) {
+            if (parset.getBool("calibrate.cache", false)) {
+                // one cache is shared by all calibration applicators created by this object
+                ASKAPLOG_INFO_STR(logger, "Calibration solutions will be cached in memory");
+                itsSolutionSource.reset(new CalSolutionCache(itsSolutionSource));
+            }
             ASKAPLOG_INFO_STR(logger, "Data will be calibrated before imaging");
         } else {
             ASKAPLOG_INFO_STR(logger, "No calibration will be performed");
@@ -470,7 +494,7 @@ namespace askap
         // ensure that time is counted in seconds since 0 MJD
         conv->setEpochFrame();
 
-        IDataSharedIter it=ds.createIterator(sel, conv);
+        IDataSharedIter it=prefetchIfRequested(ds.createIterator(sel, conv));
         ASKAPCHECK(itsModel, "Model not defined");
         ASKAPCHECK(gridder(), "Gridder not defined");
         if (!itsSolutionSource) {
@@ -526,6 +550,7 @@ namespace askap
 
         if (itsComms.isParallel())
         {
+          ASKAPCHECK(!itsDistributedFacets, "Distributed facets are only supported by the imager application");
           calcOne(measurementSets()[itsComms.rank()-1]);
           sendNE();
         }
@@ -571,6 +596,11 @@ namespace askap
       ASKAPTRACE("ImagerParallel::solveNE");
       if (itsComms.isMaster())
       {
+        if (itsDistributedFacets && itsComms.isParallel()) {
+            // workers have solved for their facets already
+            receiveFacetSolutions();
+            return;
+        }
         // Receive the normal equations
         if (itsComms.isParallel())
         {
@@ -618,6 +648,495 @@ namespace askap
       SynthesisParamsHelper::zeroAllModelImages(itsModel);
     }
 
+    /// @brief solve for the facets owned by this worker
+    /// @details This method is the worker side of the distributed faceted solve and is
+    /// used instead of sendNE. The normal equations for each facet are reduced to the
+    /// worker owning this facet (see reduceFacets), so only the part of the normal equations
+    /// for the facets owned is kept in memory. The owned facets are then solved locally and
+    /// sent to the master together with the peak residual. All workers have to call this
+    /// method at the same time as the master calls solveNE.
+    void ImagerParallel::solveFacetsInWorkers()
+    {
+      ASKAPTRACE("ImagerParallel::solveFacetsInWorkers");
+      ASKAPCHECK(itsSolver, "Solver not defined correctly");
+      std::map<std::string, int> owners;
+      const std::set<std::string> ownedNames = reduceFacets(owners);
+
+      // peak residuals for other facets are received from the master with the model, they will
+      // be recalculated by the worker owning these facets
+      const std::vector<std::string> oldPeakParams = itsModel->completions("peak_residual.", true);
+      for (std::vector<std::string>::const_iterator ci = oldPeakParams.begin(); ci != oldPeakParams.end(); ++ci) {
+           itsModel->remove("peak_residual." + *ci);
+      }
+
+      ASKAPLOG_INFO_STR(logger, "Solving normal equations for the owned facets");
+      casacore::Timer timer;
+      timer.mark();
+      // only the owned facets are left free for the solver
+      std::vector<std::string> fixedNames;
+      for (std::map<std::string, int>::const_iterator ci = owners.begin(); ci != owners.end(); ++ci) {
+           if (ci->second != itsComms.rank()) {
+               itsModel->fix(ci->first);
+               fixedNames.push_back(ci->first);
+           }
+      }
+      itsSolver->init();
+      itsSolver->addNormalEquations(*itsNe);
+      Quality q;
+      itsSolver->solveNormalEquations(*itsModel, q);
+      for (std::vector<std::string>::const_iterator ci = fixedNames.begin(); ci != fixedNames.end(); ++ci) {
+           itsModel->free(*ci);
+      }
+      ASKAPLOG_INFO_STR(logger, "Solved normal equations for the owned facets in "<< timer.real() << " seconds");
+
+      const std::vector<std::string> peakParams = itsModel->completions("peak_residual.", true);
+      double peak = peakParams.size() == 0 ? getPeakResidual() : -1.;
+      for (std::vector<std::string>::const_iterator ci = peakParams.begin(); ci != peakParams.end(); ++ci) {
+           const double tempval = std::abs(itsModel->scalarValue("peak_residual." + *ci));
+           if (tempval > peak) {
+               peak = tempval;
+           }
+      }
+
+      // send the owned facets to the master
+      Params solved;
+      for (std::set<std::string>::const_iterator ci = ownedNames.begin(); ci != ownedNames.end(); ++ci) {
+           solved.add(*ci, itsModel->value(*ci), itsModel->axes(*ci));
+      }
+      timer.mark();
+      BlobOBufMW bobmw(itsComms, 0);
+      LOFAR::BlobOStream out(bobmw);
+      out.putStart("facets", 1);
+      out << itsComms.rank() << peak << solved;
+      out.putEnd();
+      bobmw.flush();
+      ASKAPLOG_INFO_STR(logger, "Sent solved facets to the master in "<<timer.real()<<" seconds");
+    }
+
+    /// @brief send the normal equations to the master facet by facet
+    /// @details This method is used instead of sendNE after the last major cycle in the
+    /// distributed faceted mode. The normal equations are reduced to the facet owners first
+    /// (see reduceFacets), then each worker sends only its own facets to the master. The master
+    /// has to call receiveFacetsFromWorkers at the same time.
+    void ImagerParallel::sendFacetsToMaster()
+    {
+      ASKAPTRACE("ImagerParallel::sendFacetsToMaster");
+      std::map<std::string, int> owners;
+      reduceFacets(owners);
+      boost::shared_ptr<ImagingNormalEquations> ine =
+                    boost::dynamic_pointer_cast<ImagingNormalEquations>(itsNe);
+      ASKAPDEBUGASSERT(ine);
+      sendCompressedNE(*ine, 0);
+    }
+
+    /// @brief receive the normal equations from workers facet by facet
+    /// @details This is the master side of sendFacetsToMaster used instead of receiveNE. The
+    /// facets of each worker are added to the solver as they arrive, so the master holds the
+    /// normal equations once (as required to write the residuals and restore) plus the facets
+    /// of one worker, rather than two full copies and a full-size message.
+    void ImagerParallel::receiveFacetsFromWorkers()
+    {
+      ASKAPTRACE("ImagerParallel::receiveFacetsFromWorkers");
+      ASKAPCHECK(itsDistributedFacets, "An attempt to receive facets from workers, but distributedfacets is false");
+      ASKAPCHECK(itsComms.isParallel() && itsComms.isMaster(), "Facets can only be received by the master of a parallel job");
+      ASKAPCHECK(itsSolver, "Solver not yet defined");
+      ASKAPLOG_INFO_STR(logger, "Initialising solver");
+      itsSolver->init();
+      casacore::Timer timer;
+      timer.mark();
+      for (int worker = 1; worker < itsComms.nProcs(); ++worker) {
+           itsSolver->addNormalEquations(*receiveCompressedNE(worker));
+      }
+      ASKAPLOG_INFO_STR(logger, "Received facets of the normal equations from all workers in "
+                        << timer.real() << " seconds");
+    }
+
+    /// @brief reduce the normal equations for each facet to the worker owning it
+    /// @details In each step of the exchange every worker sends the facets owned by another
+    /// worker and receives its own. Only the PSF of the central (reference) facet of each image
+    /// is reduced, the PSFs of other facets are zeroed before the exchange and compress to
+    /// nothing in transit. The owner of the reference facet then sends the centre patch of the
+    /// reduced PSF (distributedfacets.psfwidth pixels, the whole facet by default) to all
+    /// workers, which put it into the PSF slices of their facets. The full normal equations
+    /// produced by gridding are released before the last receive, after that only the owned
+    /// facets are kept (and stored in itsNe).
+    /// @param[out] owners map of the parameter name into the rank of the worker owning it
+    /// @return names of the parameters owned by this worker
+    std::set<std::string> ImagerParallel::reduceFacets(std::map<std::string, int> &owners)
+    {
+      ASKAPTRACE("ImagerParallel::reduceFacets");
+      ASKAPCHECK(itsDistributedFacets, "An attempt to reduce facets in workers, but distributedfacets is false");
+      ASKAPCHECK(itsComms.isParallel() && itsComms.isWorker(), "Facets can only be reduced by workers of a parallel job");
+      ASKAPCHECK(itsModel, "Model not defined");
+      boost::shared_ptr<ImagingNormalEquations> ine =
+                    boost::dynamic_pointer_cast<ImagingNormalEquations>(itsNe);
+      ASKAPCHECK(ine, "Distributed facets require imaging-specific normal equations");
+
+      casacore::Timer timer;
+      timer.mark();
+      const int nWorkers = itsComms.nProcs() - 1;
+      const int myIndex = itsComms.rank() - 1;
+      owners = facetOwners();
+      std::vector<std::set<std::string> > ownedBy(nWorkers);
+      for (std::map<std::string, int>::const_iterator ci = owners.begin(); ci != owners.end(); ++ci) {
+           ownedBy[ci->second - 1].insert(ci->first);
+      }
+      ASKAPLOG_INFO_STR(logger, "This worker owns "<<ownedBy[myIndex].size()<<" out of "<<owners.size()<<
+                        " image parameters");
+
+      // only the reference PSFs are reduced, the slices are shared with ine (reference semantics)
+      const std::map<std::string, std::string> refNames = psfReferenceNames(owners);
+      for (std::map<std::string, std::string>::const_iterator ci = refNames.begin(); ci != refNames.end(); ++ci) {
+           const std::map<std::string, casacore::Vector<double> >::const_iterator sliceIt =
+                       ine->normalMatrixSlice().find(ci->first);
+           if ((ci->first != ci->second) && (sliceIt != ine->normalMatrixSlice().end())) {
+               casacore::Vector<double> psf(sliceIt->second);
+               psf.set(0.);
+           }
+      }
+
+      // exchange normal equations, in each step every worker sends the facets owned by the worker
+      // shift ranks ahead and receives its own facets from the worker shift ranks behind. The ranks
+      // form cycles of nWorkers / gcd(nWorkers, shift) members. The first worker of each cycle receives
+      // before sending and all others send first, so the blocking point-to-point calls can't deadlock.
+      ImagingNormalEquations::ShPtr owned = extractNormalEquations(*ine, ownedBy[myIndex]);
+      for (int shift = 1; shift < nWorkers; ++shift) {
+           const int dest = (myIndex + shift) % nWorkers;
+           const int source = (myIndex + nWorkers - shift) % nWorkers;
+           int nCycles = nWorkers;
+           for (int rem = shift; rem != 0;) {
+                const int temp = nCycles % rem;
+                nCycles = rem;
+                rem = temp;
+           }
+           const ImagingNormalEquations::ShPtr outgoing = extractNormalEquations(*ine, ownedBy[dest]);
+           if (shift + 1 == nWorkers) {
+               // nothing else is extracted, the full normal equations can go before the last receive
+               ine.reset();
+               itsNe.reset();
+           }
+           if (myIndex < nCycles) {
+               owned->merge(*receiveCompressedNE(source + 1));
+               sendCompressedNE(*outgoing, dest + 1);
+           } else {
+               sendCompressedNE(*outgoing, dest + 1);
+               owned->merge(*receiveCompressedNE(source + 1));
+           }
+      }
+      // from now on only the owned part of the normal equations is kept
+      ine.reset();
+      itsNe = owned;
+      ASKAPLOG_INFO_STR(logger, "Exchanged normal equations between workers in "<<timer.real()<<" seconds");
+
+      replicatePSFCentre(*owned, owners, refNames);
+      return ownedBy[myIndex];
+    }
+
+    /// @brief names of the reference facets used for the PSF
+    /// @details The reference facet is the central facet of the same image and Taylor term.
+    /// @param[in] owners map of the parameter name into the rank of the worker owning it
+    /// @return map of the parameter name into the name of its reference facet
+    std::map<std::string, std::string> ImagerParallel::psfReferenceNames(const std::map<std::string, int> &owners)
+    {
+      int nFacets = 0;
+      for (std::map<std::string, int>::const_iterator ci = owners.begin(); ci != owners.end(); ++ci) {
+           const ImageParamsHelper iph(ci->first);
+           if (iph.isFacet()) {
+               nFacets = std::max(nFacets, std::max(iph.facetX(), iph.facetY()) + 1);
+           }
+      }
+      std::map<std::string, std::string> result;
+      for (std::map<std::string, int>::const_iterator ci = owners.begin(); ci != owners.end(); ++ci) {
+           ImageParamsHelper iph(ci->first);
+           if (iph.isFacet()) {
+               iph.makeFacet(nFacets / 2, nFacets / 2);
+               ASKAPCHECK(owners.find(iph.paramName()) != owners.end(), "Reference facet "<<iph.paramName()<<
+                          " for the PSF of "<<ci->first<<" is not a free parameter");
+           }
+           result[ci->first] = iph.paramName();
+      }
+      return result;
+    }
+
+    /// @brief region of the PSF centre replicated to the facet owners
+    /// @param[in] shape shape of the facet
+    /// @param[in] width width of the region in pixels (0 means the whole facet)
+    /// @param[out] blc bottom left corner of the region
+    /// @param[out] trc top right corner of the region (inclusive)
+    static void psfCentreBox(const casacore::IPosition &shape, int width, casacore::IPosition &blc,
+                             casacore::IPosition &trc)
+    {
+      ASKAPCHECK(shape.nelements() >= 2, "Facet is expected to be at least 2-dimensional, shape = "<<shape);
+      blc = casacore::IPosition(shape.nelements(), 0);
+      trc = shape - 1;
+      for (casacore::uInt axis = 0; axis < 2; ++axis) {
+           if ((width > 0) && (width < shape(axis))) {
+               blc(axis) = shape(axis) / 2 - width / 2;
+               trc(axis) = blc(axis) + width - 1;
+           }
+      }
+    }
+
+    /// @brief replicate the centre of the reference PSFs to the facet owners
+    /// @details This is a part of reduceFacets, all workers have to call it at the same time.
+    /// @param[in] ne normal equations with the owned facets (PSF slices are updated in situ)
+    /// @param[in] owners map of the parameter name into the rank of the worker owning it
+    /// @param[in] refNames map of the parameter name into the name of its reference facet
+    void ImagerParallel::replicatePSFCentre(const ImagingNormalEquations &ne, const std::map<std::string, int> &owners,
+                                            const std::map<std::string, std::string> &refNames) const
+    {
+      // reference facets grouped by the worker owning them
+      std::map<int, std::set<std::string> > refsByOwner;
+      for (std::map<std::string, std::string>::const_iterator ci = refNames.begin(); ci != refNames.end(); ++ci) {
+           const std::map<std::string, int>::const_iterator ownerIt = owners.find(ci->second);
+           ASKAPDEBUGASSERT(ownerIt != owners.end());
+           refsByOwner[ownerIt->second].insert(ci->second);
+      }
+
+      // each owner of reference facets sends their centre to all other workers in turn
+      std::map<std::string, casacore::Array<double> > patches;
+      for (std::map<int, std::set<std::string> >::const_iterator ci = refsByOwner.begin(); ci != refsByOwner.end(); ++ci) {
+           if (ci->first == itsComms.rank()) {
+               LOFAR::BlobString bs;
+               bs.resize(0);
+               LOFAR::BlobOBufString bob(bs);
+               LOFAR::BlobOStream out(bob);
+               out.putStart("psfcentre", 1);
+               out << static_cast<int>(ci->second.size());
+               for (std::set<std::string>::const_iterator nameIt = ci->second.begin(); nameIt != ci->second.end(); ++nameIt) {
+                    const std::map<std::string, casacore::Vector<double> >::const_iterator sliceIt =
+                                ne.normalMatrixSlice().find(*nameIt);
+                    const std::map<std::string, casacore::IPosition>::const_iterator shapeIt = ne.shape().find(*nameIt);
+                    ASKAPCHECK((sliceIt != ne.normalMatrixSlice().end()) && (shapeIt != ne.shape().end()),
+                               "PSF for the reference facet "<<*nameIt<<" is missing");
+                    casacore::IPosition blc, trc;
+                    psfCentreBox(shapeIt->second, itsFacetPSFWidth, blc, trc);
+                    const casacore::Array<double> psf(sliceIt->second.reform(shapeIt->second));
+                    patches[*nameIt] = psf(blc, trc).copy();
+                    out << *nameIt << patches[*nameIt];
+               }
+               out.putEnd();
+               LOFAR::BlobString encodedBS;
+               encodedBS.resize(CompressedBlobCodec::maxEncodedSize(bs.size()));
+               encodedBS.resize(CompressedBlobCodec::encode(bs.data(), bs.size(), modelCompression(), encodedBS.data()));
+               for (int worker = 1; worker < itsComms.nProcs(); ++worker) {
+                    if (worker != itsComms.rank()) {
+                        itsComms.sendBlob(encodedBS, worker);
+                    }
+               }
+           } else {
+               LOFAR::BlobString bs;
+               bs.resize(0);
+               itsComms.receiveBlob(bs, ci->first);
+               std::vector<int8_t> decoded;
+               CompressedBlobCodec::decode(bs.data(), bs.size(), decoded);
+               LOFAR::BlobIBufVector<int8_t> bib(decoded);
+               LOFAR::BlobIStream in(bib);
+               const int version = in.getStart("psfcentre");
+               ASKAPASSERT(version == 1);
+               int nPatches;
+               in >> nPatches;
+               for (int patch = 0; patch < nPatches; ++patch) {
+                    std::string name;
+                    casacore::Array<double> buf;
+                    in >> name >> buf;
+                    patches[name].reference(buf);
+               }
+               in.getEnd();
+           }
+      }
+
+      // the PSF of each owned facet is replaced by the centre of the reference PSF
+      for (std::map<std::string, std::string>::const_iterator ci = refNames.begin(); ci != refNames.end(); ++ci) {
+           const std::map<std::string, casacore::Vector<double> >::const_iterator sliceIt =
+                       ne.normalMatrixSlice().find(ci->first);
+           if ((owners.find(ci->first)->second != itsComms.rank()) || (sliceIt == ne.normalMatrixSlice().end())) {
+               continue;
+           }
+           const std::map<std::string, casacore::IPosition>::const_iterator shapeIt = ne.shape().find(ci->first);
+           ASKAPDEBUGASSERT(shapeIt != ne.shape().end());
+           const std::map<std::string, casacore::Array<double> >::const_iterator patchIt = patches.find(ci->second);
+           ASKAPDEBUGASSERT(patchIt != patches.end());
+           casacore::IPosition blc, trc;
+           psfCentreBox(shapeIt->second, itsFacetPSFWidth, blc, trc);
+           ASKAPCHECK(patchIt->second.shape() == trc - blc + 1, "Facet "<<ci->first<<
+                      " has a different shape from the reference facet "<<ci->second);
+           // reference semantics, the slice of the normal equations is updated
+           casacore::Vector<double> slice(sliceIt->second);
+           casacore::Array<double> psf(slice.reform(shapeIt->second));
+           psf.set(0.);
+           psf(blc, trc) = patchIt->second;
+      }
+    }
+
+    /// @brief send normal equations to another rank as a compressed blob
+    /// @details The encoding is the same as for the model (modelcompression).
+    /// @param[in] ne normal equations to send
+    /// @param[in] dest rank to send the normal equations to
+    void ImagerParallel::sendCompressedNE(const ImagingNormalEquations &ne, int dest) const
+    {
+      ASKAPDEBUGTRACE("ImagerParallel::sendCompressedNE");
+      casacore::Timer timer;
+      timer.mark();
+      LOFAR::BlobString bs;
+      bs.resize(0);
+      LOFAR::BlobOBufString bob(bs);
+      LOFAR::BlobOStream out(bob);
+      out.putStart("ne", 1);
+      out << itsComms.rank() << ne;
+      out.putEnd();
+      LOFAR::BlobString encodedBS;
+      encodedBS.resize(CompressedBlobCodec::maxEncodedSize(bs.size()));
+      encodedBS.resize(CompressedBlobCodec::encode(bs.data(), bs.size(), modelCompression(), encodedBS.data()));
+      itsComms.sendBlob(encodedBS, dest);
+      ASKAPLOG_INFO_STR(logger, "Sent normal equations to rank " << dest << " ("<<encodedBS.size()<<
+                        " bytes encoded from "<<bs.size()<<") in " << timer.real() << " seconds ");
+    }
+
+    /// @brief receive normal equations sent by sendCompressedNE
+    /// @param[in] source rank to receive the normal equations from
+    /// @return normal equations received
+    ImagingNormalEquations::ShPtr ImagerParallel::receiveCompressedNE(int source) const
+    {
+      ASKAPDEBUGTRACE("ImagerParallel::receiveCompressedNE");
+      casacore::Timer timer;
+      timer.mark();
+      ImagingNormalEquations::ShPtr ne(new ImagingNormalEquations());
+      std::vector<int8_t> decoded;
+      {
+        LOFAR::BlobString bs;
+        bs.resize(0);
+        itsComms.receiveBlob(bs, source);
+        CompressedBlobCodec::decode(bs.data(), bs.size(), decoded);
+      }
+      LOFAR::BlobIBufVector<int8_t> bib(decoded);
+      LOFAR::BlobIStream in(bib);
+      const int version = in.getStart("ne");
+      ASKAPASSERT(version == 1);
+      int rank;
+      in >> rank >> *ne;
+      in.getEnd();
+      ASKAPCHECK(rank == source, "Received normal equations are from an unexpected source");
+      ASKAPLOG_INFO_STR(logger, "Received normal equations from rank " << source
+                        << " after " << timer.real() << " seconds");
+      return ne;
+    }
+
+    /// @brief receive facets solved by workers
+    /// @details This is the master side of the distributed faceted solve (see
+    /// solveFacetsInWorkers). The model is updated with the facets received and
+    /// the peak residual is set to the largest value reported by workers.
+    void ImagerParallel::receiveFacetSolutions()
+    {
+      ASKAPTRACE("ImagerParallel::receiveFacetSolutions");
+      ASKAPDEBUGASSERT(itsModel);
+      ASKAPLOG_INFO_STR(logger, "Waiting for facets solved by workers");
+      casacore::Timer timer;
+      timer.mark();
+      double peak = -1.;
+      for (int worker = 1; worker < itsComms.nProcs(); ++worker) {
+           BlobIBufMW bibmw(itsComms, worker);
+           LOFAR::BlobIStream in(bibmw);
+           const int version = in.getStart("facets");
+           ASKAPASSERT(version == 1);
+           int rank;
+           double workerPeak;
+           Params solved;
+           in >> rank >> workerPeak >> solved;
+           in.getEnd();
+           ASKAPCHECK(rank == worker, "Received facets are from an unexpected source");
+           const std::vector<std::string> names = solved.names();
+           for (std::vector<std::string>::const_iterator ci = names.begin(); ci != names.end(); ++ci) {
+                ASKAPCHECK(itsModel->has(*ci), "Worker "<<worker<<" sent unknown parameter "<<*ci);
+                itsModel->update(*ci, solved.value(*ci));
+           }
+           ASKAPLOG_INFO_STR(logger, "Peak residual for "<<names.size()<<" parameters solved by rank "<<
+                             worker<<" is "<<workerPeak);
+           if (workerPeak > peak) {
+               peak = workerPeak;
+           }
+      }
+      ASKAPLOG_INFO_STR(logger, "Received facets from all workers in "<<timer.real()<<" seconds");
+
+      if (itsModel->has("peak_residual")) {
+          itsModel->update("peak_residual",peak);
+      } else {
+          itsModel->add("peak_residual",peak);
+      }
+      itsModel->fix("peak_residual");
+    }
+
+    /// @brief assign free image parameters to workers
+    /// @details All Taylor terms of the same facet are assigned to the same worker as
+    /// they are solved together. Facets are assigned in a round-robin fashion. The
+    /// result only depends on the model, so it is the same for all ranks. An exception
+    /// is thrown if there are fewer facets than workers.
+    /// @return map of the parameter name into the rank of the worker owning it
+    std::map<std::string, int> ImagerParallel::facetOwners() const
+    {
+      ASKAPDEBUGASSERT(itsModel);
+      const int nWorkers = itsComms.nProcs() - 1;
+      ASKAPCHECK(nWorkers > 0, "At least one worker is required to own facets");
+      const std::vector<std::string> names = itsModel->freeNames();
+      std::map<std::string, int> facetIndex;
+      for (std::vector<std::string>::const_iterator ci = names.begin(); ci != names.end(); ++ci) {
+           if (ci->find("image") == 0) {
+               facetIndex.insert(std::make_pair(ImageParamsHelper(*ci).facetName(), 0));
+           }
+      }
+      // with fewer facets some workers would be idle and one would do the whole solve (e.g. nfacets=1)
+      ASKAPCHECK(int(facetIndex.size()) >= nWorkers, "Distributed facets require at least as many facets as workers, you have "<<
+                 facetIndex.size()<<" facet(s) and "<<nWorkers<<" workers. Increase Images.nfacets");
+      int index = 0;
+      for (std::map<std::string, int>::iterator it = facetIndex.begin(); it != facetIndex.end(); ++it, ++index) {
+           it->second = index;
+      }
+      std::map<std::string, int> result;
+      for (std::vector<std::string>::const_iterator ci = names.begin(); ci != names.end(); ++ci) {
+           if (ci->find("image") == 0) {
+               result[*ci] = facetIndex[ImageParamsHelper(*ci).facetName()] % nWorkers + 1;
+           }
+      }
+      return result;
+    }
+
+    /// @brief extract a subset of imaging normal equations
+    /// @details The weight type and state are copied, so the subset is merged and solved
+    /// with the same weighting as the original normal equations (e.g. with updatedirection).
+    /// @param[in] ne normal equations to extract the subset from
+    /// @param[in] names names of the parameters to extract
+    /// @return new normal equations containing only the given parameters
+    ImagingNormalEquations::ShPtr ImagerParallel::extractNormalEquations(const ImagingNormalEquations &ne,
+                    const std::set<std::string> &names)
+    {
+      ImagingNormalEquations::ShPtr result(new ImagingNormalEquations);
+      result->weightType(ne.weightType());
+      result->weightState(ne.weightState());
+      for (std::set<std::string>::const_iterator ci = names.begin(); ci != names.end(); ++ci) {
+           const std::map<std::string, casacore::Vector<double> >::const_iterator dataIt = ne.dataVector().find(*ci);
+           if (dataIt == ne.dataVector().end()) {
+               // this worker has no contribution for this parameter
+               continue;
+           }
+           const std::map<std::string, casacore::Vector<double> >::const_iterator sliceIt =
+                       ne.normalMatrixSlice().find(*ci);
+           const std::map<std::string, casacore::Vector<double> >::const_iterator diagIt =
+                       ne.normalMatrixDiagonal().find(*ci);
+           const std::map<std::string, casacore::Vector<double> >::const_iterator pcfIt =
+                       ne.preconditionerSlice().find(*ci);
+           const std::map<std::string, casacore::IPosition>::const_iterator shapeIt = ne.shape().find(*ci);
+           const std::map<std::string, casacore::IPosition>::const_iterator refIt = ne.reference().find(*ci);
+           const std::map<std::string, casacore::CoordinateSystem>::const_iterator csIt = ne.coordSys().find(*ci);
+           ASKAPCHECK((sliceIt != ne.normalMatrixSlice().end()) && (diagIt != ne.normalMatrixDiagonal().end()) &&
+                      (pcfIt != ne.preconditionerSlice().end()) && (shapeIt != ne.shape().end()) &&
+                      (refIt != ne.reference().end()) && (csIt != ne.coordSys().end()),
+                      "Normal equations are incomplete for parameter "<<*ci);
+           result->addSlice(*ci, sliceIt->second, diagIt->second, pcfIt->second, dataIt->second,
+                            shapeIt->second, refIt->second, csIt->second);
+      }
+      return result;
+    }
+
 
     /// @brief a helper method to extract peak residual
     /// @details This object actually manipulates with the normal equations. We need
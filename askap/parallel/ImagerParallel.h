@@ -33,6 +33,7 @@
 // ASKAPsoft includes
 #include <askapparallel/AskapParallel.h>
 #include <askap/scimath/fitting/Solver.h>
+#include <askap/scimath/fitting/ImagingNormalEquations.h>
 #include <Common/ParameterSet.h>
 
 // Local package includes
@@ -41,6 +42,11 @@
 #include <askap/measurementequation/IMeasurementEquation.h>
 #include <askap/calibaccess/ICalSolutionConstSource.h>
 
+// std includes
+#include <map>
+#include <set>
+#include <string>
+
 namespace askap
 {
   namespace synthesis
@@ -144,6 +150,38 @@ namespace askap
       /// (which is crucial for faceting) will be wrong.
       void zeroAllModelImages() const;
 
+      /// @brief check whether image-domain normal equations are distributed between workers
+      /// @details In this mode (distributedfacets = true), each facet of the model is owned
+      /// by one of the workers. Workers exchange the parts of the normal equations corresponding
+      /// to the facets they don't own, solve for their own facets and send the result to the
+      /// master (see solveFacetsInWorkers). The master assembles the model in solveNE instead
+      /// of receiving and solving the full normal equations.
+      /// @return true, if the normal equations are distributed between workers
+      inline bool distributedFacets() const { return itsDistributedFacets; }
+
+      /// @brief solve for the facets owned by this worker
+      /// @details This method is the worker side of the distributed faceted solve and is
+      /// used instead of sendNE. The normal equations for each facet are reduced to the
+      /// worker owning this facet (see reduceFacets), so only the part of the normal equations
+      /// for the facets owned is kept in memory. The owned facets are then solved locally and
+      /// sent to the master together with the peak residual. All workers have to call this
+      /// method at the same time as the master calls solveNE.
+      void solveFacetsInWorkers();
+
+      /// @brief send the normal equations to the master facet by facet
+      /// @details This method is used instead of sendNE after the last major cycle in the
+      /// distributed faceted mode. The normal equations are reduced to the facet owners first
+      /// (see reduceFacets), then each worker sends only its own facets to the master. The master
+      /// has to call receiveFacetsFromWorkers at the same time.
+      void sendFacetsToMaster();
+
+      /// @brief receive the normal equations from workers facet by facet
+      /// @details This is the master side of sendFacetsToMaster used instead of receiveNE. The
+      /// facets of each worker are added to the solver as they arrive, so the master holds the
+      /// normal equations once (as required to write the residuals and restore) plus the facets
+      /// of one worker, rather than two full copies and a full-size message.
+      void receiveFacetsFromWorkers();
+
   protected:
 
       /// @brief a helper method to extract peak residual
@@ -201,6 +239,68 @@ namespace askap
       /// @return if advice is needed, returns the name of the gridder. Otherwise, returns an empty string.
       static string wMaxAdviceNeeded(LOFAR::ParameterSet &parset);
 
+      /// @brief assign free image parameters to workers
+      /// @details All Taylor terms of the same facet are assigned to the same worker as
+      /// they are solved together. Facets are assigned in a round-robin fashion. The
+      /// result only depends on the model, so it is the same for all ranks. An exception
+      /// is thrown if there are fewer facets than workers.
+      /// @return map of the parameter name into the rank of the worker owning it
+      std::map<std::string, int> facetOwners() const;
+
+      /// @brief reduce the normal equations for each facet to the worker owning it
+      /// @details In each step of the exchange every worker sends the facets owned by another
+      /// worker and receives its own. Only the PSF of the central (reference) facet of each image
+      /// is reduced, the PSFs of other facets are zeroed before the exchange and compress to
+      /// nothing in transit. The owner of the reference facet then sends the centre patch of the
+      /// reduced PSF (distributedfacets.psfwidth pixels, the whole facet by default) to all
+      /// workers, which put it into the PSF slices of their facets. The full normal equations
+      /// produced by gridding are released before the last receive, after that only the owned
+      /// facets are kept (and stored in itsNe).
+      /// @param[out] owners map of the parameter name into the rank of the worker owning it
+      /// @return names of the parameters owned by this worker
+      std::set<std::string> reduceFacets(std::map<std::string, int> &owners);
+
+      /// @brief names of the reference facets used for the PSF
+      /// @details The reference facet is the central facet of the same image and Taylor term.
+      /// @param[in] owners map of the parameter name into the rank of the worker owning it
+      /// @return map of the parameter name into the name of its reference facet
+      static std::map<std::string, std::string> psfReferenceNames(const std::map<std::string, int> &owners);
+
+      /// @brief replicate the centre of the reference PSFs to the facet owners
+      /// @details This is a part of reduceFacets, all workers have to call it at the same time.
+      /// @param[in] ne normal equations with the owned facets (PSF slices are updated in situ)
+      /// @param[in] owners map of the parameter name into the rank of the worker owning it
+      /// @param[in] refNames map of the parameter name into the name of its reference facet
+      void replicatePSFCentre(const scimath::ImagingNormalEquations &ne, const std::map<std::string, int> &owners,
+                              const std::map<std::string, std::string> &refNames) const;
+
+      /// @brief send normal equations to another rank as a compressed blob
+      /// @details The encoding is the same as for the model (modelcompression).
+      /// @param[in] ne normal equations to send
+      /// @param[in] dest rank to send the normal equations to
+      void sendCompressedNE(const scimath::ImagingNormalEquations &ne, int dest) const;
+
+      /// @brief receive normal equations sent by sendCompressedNE
+      /// @param[in] source rank to receive the normal equations from
+      /// @return normal equations received
+      scimath::ImagingNormalEquations::ShPtr receiveCompressedNE(int source) const;
+
+      /// @brief extract a subset of imaging normal equations
+      /// @details The weight type and state are copied, so the subset is merged and solved
+      /// with the same weighting as the original normal equations (e.g. with updatedirection).
+      /// @param[in] ne normal equations to extract the subset from
+      /// @param[in] names names of the parameters to extract
+      /// @return new normal equations containing only the given parameters
+      static scimath::ImagingNormalEquations::ShPtr extractNormalEquations(
+                  const scimath::ImagingNormalEquations &ne, const std::set<std::string> &names);
+
+      /// @brief receive facets solved by workers
+      /// @details This is the master side of the distributed faceted solve (see
+      /// solveFacetsInWorkers). The model is updated with the facets received and
+      /// the peak residual is set to the largest value reported by workers.
+      void receiveFacetSolutions();
+
+
       /// Calculate normal equations for one data set
       /// @param ms Name of data set
       /// @param discard Discard old equation?
@@ -236,6 +336,13 @@ namespace askap
       /// sensitivity images. This field gives the fraction of the maximum weight
       /// below which the sensitivity image will be set to 0.
       double itsExpSensitivityCutoff;
+
+      /// @brief true, if facets are solved by workers owning them
+      bool itsDistributedFacets;
+
+      /// @brief width in pixels of the PSF centre replicated to the facet owners
+      /// @details Zero means the whole facet.
+      int itsFacetPSFWidth;
     };
 
   }
@@ -0,0 +1,106 @@
+/// @file
+/// @brief accumulation of a calibration solution interval in a background thread
+/// @details With pre-averaging, the normal equations for all major cycles of one solution
+/// interval are built from the buffer filled by a single pass over the data. Therefore, the
+/// data of the next interval can be read while the current one is being solved for. This class
+/// runs such an accumulation in a separate thread and hands the filled equation over when
+/// it is needed.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#include <askap/parallel/IntervalAccumulator.h>
+#include <askap/askap_synthesis.h>
+#include <askap/AskapError.h>
+
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+#include <exception>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief destructor, waits for the background thread
+IntervalAccumulator::~IntervalAccumulator()
+{
+  if (itsThread) {
+      itsThread->join();
+  }
+}
+
+/// @brief start the accumulation
+/// @details The data are accumulated from the current position of the iterator until the
+/// end of the data (or of the current interval, if the iterator is an adapter).
+/// @param[in] me pre-averaging measurement equation to fill
+/// @param[in] dsi data shared iterator
+/// @param[in] perfectME uncorrupted measurement equation
+void IntervalAccumulator::start(const boost::shared_ptr<PreAvgCalMEBase> &me, const accessors::IDataSharedIter &dsi,
+                                const boost::shared_ptr<IMeasurementEquation const> &perfectME)
+{
+  ASKAPCHECK(!itsThread, "Accumulation of the previous solution interval is still in progress");
+  ASKAPCHECK(me, "Measurement equation to accumulate the data is not defined");
+  itsME = me;
+  itsError.clear();
+  itsThread.reset(new boost::thread(boost::bind(&IntervalAccumulator::accumulate, me, dsi, perfectME,
+                  boost::ref(itsError))));
+}
+
+/// @brief wait for the accumulation to finish
+/// @details An error in the background thread is rethrown as AskapError.
+/// @return equation with the accumulated data (empty shared pointer if
+/// nothing has been started)
+boost::shared_ptr<PreAvgCalMEBase> IntervalAccumulator::wait()
+{
+  boost::shared_ptr<PreAvgCalMEBase> result;
+  if (itsThread) {
+      itsThread->join();
+      itsThread.reset();
+      result = itsME;
+      itsME.reset();
+      ASKAPCHECK(itsError.size() == 0, "Accumulation of the next solution interval failed: "<<itsError);
+  }
+  return result;
+}
+
+/// @brief main method of the background thread
+/// @details Any exception is caught and its message is returned via error.
+/// @param[in] me pre-averaging measurement equation to fill
+/// @param[in] dsi data shared iterator
+/// @param[in] perfectME uncorrupted measurement equation
+/// @param[out] error error message, empty if no error occurred
+void IntervalAccumulator::accumulate(const boost::shared_ptr<PreAvgCalMEBase> &me, const accessors::IDataSharedIter &dsi,
+                                     const boost::shared_ptr<IMeasurementEquation const> &perfectME, std::string &error)
+{
+  try {
+     me->accumulate(dsi, perfectME);
+  }
+  catch (const std::exception &ex) {
+     error = ex.what();
+  }
+}
+
+} // namespace synthesis
+
+} // namespace askap
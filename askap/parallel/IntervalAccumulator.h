@@ -0,0 +1,102 @@
+/// @file
+/// @brief accumulation of a calibration solution interval in a background thread
+/// @details With pre-averaging, the normal equations for all major cycles of one solution
+/// interval are built from the buffer filled by a single pass over the data. Therefore, the
+/// data of the next interval can be read while the current one is being solved for. This class
+/// runs such an accumulation in a separate thread and hands the filled equation over when
+/// it is needed.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#ifndef ASKAP_SYNTHESIS_INTERVAL_ACCUMULATOR_H
+#define ASKAP_SYNTHESIS_INTERVAL_ACCUMULATOR_H
+
+#include <askap/measurementequation/PreAvgCalMEBase.h>
+#include <askap/measurementequation/IMeasurementEquation.h>
+#include <askap/dataaccess/SharedIter.h>
+#include <askap/dataaccess/IDataIterator.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <string>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief accumulation of a calibration solution interval in a background thread
+/// @details At most one accumulation is in progress at any time. The iterator is used by the
+/// background thread until wait returns, so the caller shouldn't touch it in the meantime.
+/// The destructor waits for the thread to finish (ignoring errors).
+/// @ingroup parallel
+class IntervalAccumulator {
+public:
+   /// @brief destructor, waits for the background thread
+   ~IntervalAccumulator();
+
+   /// @brief start the accumulation
+   /// @details The data are accumulated from the current position of the iterator until the
+   /// end of the data (or of the current interval, if the iterator is an adapter).
+   /// @param[in] me pre-averaging measurement equation to fill
+   /// @param[in] dsi data shared iterator
+   /// @param[in] perfectME uncorrupted measurement equation
+   void start(const boost::shared_ptr<PreAvgCalMEBase> &me, const accessors::IDataSharedIter &dsi,
+              const boost::shared_ptr<IMeasurementEquation const> &perfectME);
+
+   /// @brief wait for the accumulation to finish
+   /// @details An error in the background thread is rethrown as AskapError.
+   /// @return equation with the accumulated data (empty shared pointer if
+   /// nothing has been started)
+   boost::shared_ptr<PreAvgCalMEBase> wait();
+
+   /// @brief check whether the accumulation has been started
+   /// @return true, if start has been called, but wait has not
+   inline bool isStarted() const { return static_cast<bool>(itsThread); }
+
+private:
+   /// @brief main method of the background thread
+   /// @details Any exception is caught and its message is returned via error.
+   /// @param[in] me pre-averaging measurement equation to fill
+   /// @param[in] dsi data shared iterator
+   /// @param[in] perfectME uncorrupted measurement equation
+   /// @param[out] error error message, empty if no error occurred
+   static void accumulate(const boost::shared_ptr<PreAvgCalMEBase> &me, const accessors::IDataSharedIter &dsi,
+                          const boost::shared_ptr<IMeasurementEquation const> &perfectME, std::string &error);
+
+   /// @brief background thread
+   boost::shared_ptr<boost::thread> itsThread;
+
+   /// @brief equation filled by the background thread
+   boost::shared_ptr<PreAvgCalMEBase> itsME;
+
+   /// @brief error message of the background thread
+   std::string itsError;
+};
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef ASKAP_SYNTHESIS_INTERVAL_ACCUMULATOR_H
@@ -39,6 +39,7 @@ ASKAP_LOGGER(logger, ".parallel");
 #include <askap/AskapError.h>
 #include <askap/AskapUtil.h>
 #include <askap/parallel/MEParallelApp.h>
+#include <askap/parallel/PrefetchIterator.h>
 #include <askap/measurementequation/SynthesisParamsHelper.h>
 #include <askap/gridding/VisGridderFactory.h>
 #include <askap/gridding/TableVisGridder.h>
@@ -53,7 +54,8 @@ using namespace askap::synthesis;
 /// @param[in] parset parameter set
 MEParallelApp::MEParallelApp(askap::askapparallel::AskapParallel& comms, const LOFAR::ParameterSet& parset) :
    MEParallel(comms,parset),
-   itsUVWMachineCacheSize(1), itsUVWMachineCacheTolerance(1e-6)
+   itsUVWMachineCacheSize(1), itsUVWMachineCacheTolerance(1e-6),
+   itsPrefetchDepth(0)
 {
    // set up image handler, needed for both master and worker
    SynthesisParamsHelper::setUpImageHandler(parset);
@@ -109,8 +111,39 @@ MEParallelApp::MEParallelApp(askap::askapparallel::AskapParallel& comms, const L
        ASKAPLOG_DEBUG_STR(logger, "Tolerance on the directions is "<<
            itsUVWMachineCacheTolerance/casacore::C::pi*180.*3600.<<" arcsec");
 
+       // number of data chunks read ahead in a separate thread (0 means no prefetching)
+       const int prefetchDepth = parset.getInt32("prefetchDepth",0);
+       ASKAPCHECK(prefetchDepth >= 0,
+           "Prefetch depth is supposed to be a non-negative number, you have "<<prefetchDepth);
+       itsPrefetchDepth = size_t(prefetchDepth);
+       if (itsPrefetchDepth > 0) {
+           ASKAPLOG_INFO_STR(logger, "Up to "<<itsPrefetchDepth<<
+               " chunks of data will be read ahead in a separate thread");
+       }
+
        // Create the gridder using a factory acting on a parameterset
        itsGridder = createGridder(comms, parset);
        ASKAPCHECK(itsGridder, "Gridder is not defined correctly");
    }
 }
+
+/// @brief wrap iterator into the prefetching adapter, if requested
+/// @details If prefetching is enabled in the parset (prefetchDepth > 0), the given
+/// iterator is wrapped into PrefetchIterator which reads data ahead in a separate
+/// thread. Otherwise, the original iterator is returned. The prefetching iterator
+/// doesn't write data back, so it should only be used for read-only passes.
+/// If the I/O mutex is given, the iterator is always wrapped (reading at least
+/// one chunk ahead), so the tables are only accessed with this mutex locked.
+/// @param[in] it iterator to wrap
+/// @param[in] ioMutex optional mutex shared by all threads reading tables
+/// @return iterator to use
+accessors::IDataSharedIter MEParallelApp::prefetchIfRequested(const accessors::IDataSharedIter &it,
+                        const boost::shared_ptr<boost::mutex> &ioMutex) const
+{
+   if ((itsPrefetchDepth == 0) && !ioMutex) {
+       return it;
+   }
+   const size_t depth = itsPrefetchDepth > 0 ? itsPrefetchDepth : 1;
+   return accessors::IDataSharedIter(new PrefetchIterator(it, depth,
+                                     itsUVWMachineCacheSize, itsUVWMachineCacheTolerance, ioMutex));
+}
@@ -38,6 +38,12 @@
 #include <Common/ParameterSet.h>
 #include <askap/parallel/MEParallel.h>
 #include <askap/gridding/IVisGridder.h>
+#include <askap/dataaccess/SharedIter.h>
+#include <askap/dataaccess/IDataIterator.h>
+
+// boost includes
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 
 // std includes
@@ -88,6 +94,24 @@ protected:
    /// @details to be used in derived classes
    /// @return shared pointer to the gridder template
    inline IVisGridder::ShPtr gridder() const { return itsGridder; }
+
+   /// @brief obtain the number of data chunks to read ahead
+   /// @details to be used in derived classes
+   /// @return queue depth of the prefetching iterator, zero means no prefetching
+   inline size_t prefetchDepth() const { return itsPrefetchDepth; }
+
+   /// @brief wrap iterator into the prefetching adapter, if requested
+   /// @details If prefetching is enabled in the parset (prefetchDepth > 0), the given
+   /// iterator is wrapped into PrefetchIterator which reads data ahead in a separate
+   /// thread. Otherwise, the original iterator is returned. The prefetching iterator
+   /// doesn't write data back, so it should only be used for read-only passes.
+   /// If the I/O mutex is given, the iterator is always wrapped (reading at least
+   /// one chunk ahead), so the tables are only accessed with this mutex locked.
+   /// @param[in] it iterator to wrap
+   /// @param[in] ioMutex optional mutex shared by all threads reading tables
+   /// @return iterator to use
+   accessors::IDataSharedIter prefetchIfRequested(const accessors::IDataSharedIter &it,
+            const boost::shared_ptr<boost::mutex> &ioMutex = boost::shared_ptr<boost::mutex>()) const;
    
 
 protected:
@@ -113,6 +137,9 @@ private:
    /// @brief direction tolerance (in radians) for uvw machine cache
    double itsUVWMachineCacheTolerance;
 
+   /// @brief number of data chunks to read ahead in a separate thread (0 - no prefetching)
+   size_t itsPrefetchDepth;
+
    /// @brief gridder to be used
    IVisGridder::ShPtr itsGridder;		    			  	
 }; 
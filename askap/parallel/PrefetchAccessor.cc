@@ -0,0 +1,185 @@
+/// @file
+/// @brief accessor returned by the prefetching iterator
+/// @details This accessor holds a complete copy of one chunk of data read by the
+/// background thread of the prefetching iterator. It extends the accessor used
+/// by the parallel write iterator (which already provides cached rotated uvw and delays)
+/// and keeps track of the tangent points requested by the gridders. The prefetching
+/// thread uses this information to compute rotated uvw's and delays for the chunks
+/// which are not yet processed.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#include <askap/parallel/PrefetchAccessor.h>
+#include <askap/AskapError.h>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief register tangent point used for uvw rotation
+/// @details Nothing is done if the same tangent point is already known.
+/// @param[in] tangentPoint tangent point
+void UVWRotationHints::addTangentPoint(const casacore::MDirection &tangentPoint)
+{
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  for (std::vector<casacore::MDirection>::const_iterator ci = itsTangentPoints.begin();
+       ci != itsTangentPoints.end(); ++ci) {
+       if (ci->getValue().near(tangentPoint.getValue())) {
+           return;
+       }
+  }
+  itsTangentPoints.push_back(tangentPoint);
+}
+
+/// @brief register tangent point and image centre used for delays
+/// @details Nothing is done if the same pair of directions is already known.
+/// @param[in] tangentPoint tangent point
+/// @param[in] imageCentre image centre
+void UVWRotationHints::addDelayDirections(const casacore::MDirection &tangentPoint,
+                                          const casacore::MDirection &imageCentre)
+{
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  for (std::vector<std::pair<casacore::MDirection, casacore::MDirection> >::const_iterator ci = itsDelayDirections.begin();
+       ci != itsDelayDirections.end(); ++ci) {
+       if (ci->first.getValue().near(tangentPoint.getValue()) && ci->second.getValue().near(imageCentre.getValue())) {
+           return;
+       }
+  }
+  itsDelayDirections.push_back(std::make_pair(tangentPoint, imageCentre));
+}
+
+/// @brief obtain a copy of all known tangent points
+/// @return vector of tangent points
+std::vector<casacore::MDirection> UVWRotationHints::tangentPoints() const
+{
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  return itsTangentPoints;
+}
+
+/// @brief obtain a copy of all known pairs of directions used for delays
+/// @return vector of pairs of tangent point and image centre
+std::vector<std::pair<casacore::MDirection, casacore::MDirection> > UVWRotationHints::delayDirections() const
+{
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  return itsDelayDirections;
+}
+
+/// @brief constructor
+/// @param[in] hints shared list of directions to be filled with requested tangent points
+/// @param[in] cacheSize uvw-machine cache size
+/// @param[in] tolerance pointing direction tolerance in radians, exceeding
+/// which leads to initialisation of a new UVW machine and recompute of the rotated uvws/delays
+/// @param[in] ioMutex optional mutex serialising the reads, it is locked while rotated uvw's
+/// and delays are computed on request
+PrefetchAccessor::PrefetchAccessor(const boost::shared_ptr<UVWRotationHints> &hints, size_t cacheSize,
+               double tolerance, const boost::shared_ptr<boost::mutex> &ioMutex) :
+               ParallelAccessor(cacheSize, tolerance), itsHints(hints), itsIOMutex(ioMutex)
+{
+  ASKAPDEBUGASSERT(itsHints);
+}
+
+/// @brief copy all data from the given accessor
+/// @details This method is intended to be called from the prefetching thread. It
+/// reads all the data and metadata which may be required by the measurement equations
+/// and computes rotated uvw's and delays for all directions requested so far.
+/// @param[in] acc accessor to copy the data from
+void PrefetchAccessor::fill(const accessors::IConstDataAccessor &acc)
+{
+  itsAntenna1.assign(acc.antenna1());
+  itsAntenna2.assign(acc.antenna2());
+  itsFeed1.assign(acc.feed1());
+  itsFeed2.assign(acc.feed2());
+  itsFeed1PA.assign(acc.feed1PA());
+  itsFeed2PA.assign(acc.feed2PA());
+  itsPointingDir1.assign(acc.pointingDir1());
+  itsPointingDir2.assign(acc.pointingDir2());
+  itsDishPointing1.assign(acc.dishPointing1());
+  itsDishPointing2.assign(acc.dishPointing2());
+  itsUVW.assign(acc.uvw());
+  itsTime = acc.time();
+  itsFrequency.assign(acc.frequency());
+  itsStokes.assign(acc.stokes());
+  itsVisibility.assign(acc.visibility());
+  itsFlag.assign(acc.flag());
+  itsNoise.assign(acc.noise());
+
+  // consistency checks
+  ASKAPASSERT(nRow() == itsVisibility.nrow());
+  ASKAPASSERT(nChannel() == itsVisibility.ncolumn());
+  ASKAPASSERT(nPol() == itsVisibility.nplane());
+  ASKAPASSERT(itsUVW.nelements() == itsVisibility.nrow());
+
+  // uvw rotation for the directions requested by gridders while the previous chunks were processed
+  const std::vector<casacore::MDirection> tangentPoints = itsHints->tangentPoints();
+  for (std::vector<casacore::MDirection>::const_iterator ci = tangentPoints.begin();
+       ci != tangentPoints.end(); ++ci) {
+       ParallelAccessor::rotatedUVW(*ci);
+  }
+  const std::vector<std::pair<casacore::MDirection, casacore::MDirection> > delayDirs = itsHints->delayDirections();
+  for (std::vector<std::pair<casacore::MDirection, casacore::MDirection> >::const_iterator ci = delayDirs.begin();
+       ci != delayDirs.end(); ++ci) {
+       ParallelAccessor::uvwRotationDelay(ci->first, ci->second);
+  }
+}
+
+/// @brief uvw after rotation
+/// @details The tangent point is stored in the list of hints, the
+/// actual job is done by the base class with the I/O mutex locked.
+/// @param[in] tangentPoint tangent point to rotate the coordinates to
+/// @return uvw after rotation to the new coordinate system for each row
+const casacore::Vector<casacore::RigidVector<casacore::Double, 3> >&
+                 PrefetchAccessor::rotatedUVW(const casacore::MDirection &tangentPoint) const
+{
+  itsHints->addTangentPoint(tangentPoint);
+  boost::unique_lock<boost::mutex> ioLock = lockIO();
+  return ParallelAccessor::rotatedUVW(tangentPoint);
+}
+
+/// @brief delay associated with uvw rotation
+/// @details Both directions are stored in the list of hints, the actual job is
+/// done by the base class with the I/O mutex locked.
+/// @param[in] tangentPoint tangent point to rotate the coordinates to
+/// @param[in] imageCentre image centre (additional translation is done if imageCentre!=tangentPoint)
+/// @return delays corresponding to the uvw rotation for each row
+const casacore::Vector<casacore::Double>& PrefetchAccessor::uvwRotationDelay(
+                 const casacore::MDirection &tangentPoint, const casacore::MDirection &imageCentre) const
+{
+  itsHints->addDelayDirections(tangentPoint, imageCentre);
+  boost::unique_lock<boost::mutex> ioLock = lockIO();
+  return ParallelAccessor::uvwRotationDelay(tangentPoint, imageCentre);
+}
+
+/// @brief lock the I/O mutex, if any
+/// @return lock object (doesn't own a mutex if no I/O mutex is set)
+boost::unique_lock<boost::mutex> PrefetchAccessor::lockIO() const
+{
+  if (itsIOMutex) {
+      return boost::unique_lock<boost::mutex>(*itsIOMutex);
+  }
+  return boost::unique_lock<boost::mutex>();
+}
+
+} // namespace synthesis
+
+} // namespace askap
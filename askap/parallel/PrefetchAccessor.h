@@ -0,0 +1,151 @@
+/// @file
+/// @brief accessor returned by the prefetching iterator
+/// @details This accessor holds a complete copy of one chunk of data read by the
+/// background thread of the prefetching iterator. It extends the accessor used
+/// by the parallel write iterator (which already provides cached rotated uvw and delays)
+/// and keeps track of the tangent points requested by the gridders. The prefetching
+/// thread uses this information to compute rotated uvw's and delays for the chunks
+/// which are not yet processed.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#ifndef ASKAP_SYNTHESIS_PREFETCH_ACCESSOR_H
+#define ASKAP_SYNTHESIS_PREFETCH_ACCESSOR_H
+
+#include <askap/parallel/ParallelAccessor.h>
+#include <askap/dataaccess/IConstDataAccessor.h>
+
+#include <casacore/measures/Measures/MDirection.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <vector>
+#include <utility>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief list of tangent points and image centres used for uvw rotation
+/// @details An instance of this class is shared between all accessors produced
+/// by the same prefetching iterator. Accessors add directions requested by the
+/// gridders (in the main thread), the prefetching thread reads them back to
+/// compute rotated uvw's and delays in advance. Access is protected by a mutex.
+/// @ingroup parallel
+class UVWRotationHints {
+public:
+   /// @brief register tangent point used for uvw rotation
+   /// @details Nothing is done if the same tangent point is already known.
+   /// @param[in] tangentPoint tangent point
+   void addTangentPoint(const casacore::MDirection &tangentPoint);
+
+   /// @brief register tangent point and image centre used for delays
+   /// @details Nothing is done if the same pair of directions is already known.
+   /// @param[in] tangentPoint tangent point
+   /// @param[in] imageCentre image centre
+   void addDelayDirections(const casacore::MDirection &tangentPoint, const casacore::MDirection &imageCentre);
+
+   /// @brief obtain a copy of all known tangent points
+   /// @return vector of tangent points
+   std::vector<casacore::MDirection> tangentPoints() const;
+
+   /// @brief obtain a copy of all known pairs of directions used for delays
+   /// @return vector of pairs of tangent point and image centre
+   std::vector<std::pair<casacore::MDirection, casacore::MDirection> > delayDirections() const;
+
+private:
+   /// @brief known tangent points
+   std::vector<casacore::MDirection> itsTangentPoints;
+
+   /// @brief known pairs of tangent point and image centre
+   std::vector<std::pair<casacore::MDirection, casacore::MDirection> > itsDelayDirections;
+
+   /// @brief synchronisation between the main and prefetching threads
+   mutable boost::mutex itsMutex;
+};
+
+/// @brief accessor returned by the prefetching iterator
+/// @details All data are copied from the original accessor into the memory
+/// held by this class. Therefore, any modification of visibilities is not
+/// propagated back to the original dataset. Rotated uvw's and delays are computed
+/// on request (and cached) by the base class. The conversions use casacore measures,
+/// which are not thread safe. Therefore, directions known at the time of reading are
+/// processed by fill (with the I/O mutex held by the caller) and the directions
+/// requested later are processed with the I/O mutex locked (if one is given).
+/// @ingroup parallel
+class PrefetchAccessor : public ParallelAccessor {
+public:
+   /// @brief constructor
+   /// @param[in] hints shared list of directions to be filled with requested tangent points
+   /// @param[in] cacheSize uvw-machine cache size
+   /// @param[in] tolerance pointing direction tolerance in radians, exceeding
+   /// which leads to initialisation of a new UVW machine and recompute of the rotated uvws/delays
+   /// @param[in] ioMutex optional mutex serialising the reads, it is locked while rotated uvw's
+   /// and delays are computed on request
+   PrefetchAccessor(const boost::shared_ptr<UVWRotationHints> &hints, size_t cacheSize = 1,
+                    double tolerance = 1e-6,
+                    const boost::shared_ptr<boost::mutex> &ioMutex = boost::shared_ptr<boost::mutex>());
+
+   /// @brief copy all data from the given accessor
+   /// @details This method is intended to be called from the prefetching thread. It
+   /// reads all the data and metadata which may be required by the measurement equations
+   /// and computes rotated uvw's and delays for all directions requested so far.
+   /// @param[in] acc accessor to copy the data from
+   void fill(const accessors::IConstDataAccessor &acc);
+
+   /// @brief uvw after rotation
+   /// @details The tangent point is stored in the list of hints, the
+   /// actual job is done by the base class with the I/O mutex locked.
+   /// @param[in] tangentPoint tangent point to rotate the coordinates to
+   /// @return uvw after rotation to the new coordinate system for each row
+   virtual const casacore::Vector<casacore::RigidVector<casacore::Double, 3> >&
+                 rotatedUVW(const casacore::MDirection &tangentPoint) const;
+
+   /// @brief delay associated with uvw rotation
+   /// @details Both directions are stored in the list of hints, the actual job is
+   /// done by the base class with the I/O mutex locked.
+   /// @param[in] tangentPoint tangent point to rotate the coordinates to
+   /// @param[in] imageCentre image centre (additional translation is done if imageCentre!=tangentPoint)
+   /// @return delays corresponding to the uvw rotation for each row
+   virtual const casacore::Vector<casacore::Double>& uvwRotationDelay(
+                 const casacore::MDirection &tangentPoint, const casacore::MDirection &imageCentre) const;
+
+private:
+   /// @brief lock the I/O mutex, if any
+   /// @return lock object (doesn't own a mutex if no I/O mutex is set)
+   boost::unique_lock<boost::mutex> lockIO() const;
+
+   /// @brief shared list of requested directions
+   boost::shared_ptr<UVWRotationHints> itsHints;
+
+   /// @brief mutex serialising the reads and measures conversions (may be empty)
+   boost::shared_ptr<boost::mutex> itsIOMutex;
+};
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef ASKAP_SYNTHESIS_PREFETCH_ACCESSOR_H
@@ -0,0 +1,246 @@
+/// @file
+/// @brief iterator reading data ahead in a background thread
+/// @details This is an adapter wrapping another data iterator (normally the table-based
+/// one). The original iterator is advanced in a separate thread which copies each chunk
+/// of data (including rotated uvw's and delays for known tangent points) into memory.
+/// Therefore, disk access and data conversion happen at the same time as the measurement
+/// equation processes the previous chunk of data. The number of chunks read ahead is
+/// controlled by the queue depth.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#include <askap/parallel/PrefetchIterator.h>
+#include <askap/askap_synthesis.h>
+#include <askap/AskapError.h>
+#include <askap/AskapLogging.h>
+
+#include <boost/bind.hpp>
+
+#include <exception>
+
+ASKAP_LOGGER(logger, ".parallel");
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief constructor
+/// @details The background thread is started immediately.
+/// @param[in] iter iterator to wrap (it is advanced in the background thread)
+/// @param[in] depth number of chunks to read ahead (should be positive)
+/// @param[in] cacheSize uvw-machine cache size
+/// @param[in] tolerance pointing direction tolerance in radians, exceeding
+/// which leads to initialisation of a new UVW machine and recompute of the rotated uvws/delays
+/// @param[in] ioMutex optional mutex locked while the original iterator is accessed. It allows
+/// several instances of this class to read tables in different threads (casacore tables are
+/// not thread safe). An empty shared pointer means no locking is done.
+PrefetchIterator::PrefetchIterator(const accessors::IDataSharedIter &iter, size_t depth,
+                                   size_t cacheSize, double tolerance,
+                                   const boost::shared_ptr<boost::mutex> &ioMutex) :
+   itsIter(iter), itsDepth(depth), itsCacheSize(cacheSize), itsTolerance(tolerance),
+   itsIOMutex(ioMutex), itsHints(new UVWRotationHints), itsPrefetchDone(false), itsStopRequested(false),
+   itsNotAtOrigin(false)
+{
+  ASKAPCHECK(itsDepth > 0, "Prefetch queue depth should be positive");
+  ASKAPLOG_DEBUG_STR(logger, "Data will be read ahead in a separate thread, queue depth = "<<itsDepth);
+  startPrefetch();
+  advance();
+}
+
+/// @brief destructor, stops the background thread
+PrefetchIterator::~PrefetchIterator()
+{
+  stopPrefetch();
+  // release the original iterator (and possibly the tables) with the I/O lock held
+  boost::unique_lock<boost::mutex> ioLock = lockIO();
+  itsIter = accessors::IDataSharedIter();
+}
+
+/// @brief reference to data accessor (current chunk)
+/// @return a reference to the current chunk
+/// @note constness of the return type is changed to allow read/write
+/// operations.
+accessors::IDataAccessor& PrefetchIterator::operator*() const
+{
+  ASKAPCHECK(itsCurrent, "An attempt to obtain accessor following the end of iteration");
+  return *itsCurrent;
+}
+
+/// @brief choose buffer
+/// @details This operation is not supported by this iterator
+/// @param[in] bufferID  the name of the buffer to choose
+void PrefetchIterator::chooseBuffer(const std::string &bufferID)
+{
+  ASKAPTHROW(AskapError, "An attempt to choose the buffer "<<bufferID<<
+             ". Operation is not supported by the prefetching iterator");
+}
+
+/// Switch the output of operator* and operator-> to the original
+/// state (present after the iterator is just constructed)
+/// where they point to the primary visibility data. This method
+/// is indended to cancel the results of chooseBuffer(casacore::uInt)
+///
+void PrefetchIterator::chooseOriginal() {}
+
+/// @brief access to a buffer
+/// @details This operation is not supported by this iterator
+/// @param[in] bufferID the name of the buffer requested
+/// @return a reference to writable data accessor to the
+///         buffer requested
+accessors::IDataAccessor& PrefetchIterator::buffer(const std::string &bufferID) const
+{
+  ASKAPTHROW(AskapError, "An attempt to access the buffer "<<bufferID<<
+             ". Operation is not supported by the prefetching iterator");
+}
+
+/// @brief Restart the iteration from the beginning
+/// @details The background thread is restarted unless the iterator is still at
+/// the origin (so the data read ahead can be reused)
+void PrefetchIterator::init()
+{
+  if (itsNotAtOrigin) {
+      stopPrefetch();
+      {
+        boost::unique_lock<boost::mutex> ioLock = lockIO();
+        itsIter.init();
+      }
+      itsNotAtOrigin = false;
+      startPrefetch();
+      advance();
+  }
+}
+
+/// Checks whether there are more data available.
+/// @return True if there are more data available
+casacore::Bool PrefetchIterator::hasMore() const throw()
+{
+  return static_cast<bool>(itsCurrent);
+}
+
+/// advance the iterator one step further
+/// @return True if there are more data (so constructions like
+///         while(it.next()) {} are possible)
+casacore::Bool PrefetchIterator::next()
+{
+  itsNotAtOrigin = true;
+  advance();
+  return hasMore();
+}
+
+/// @brief obtain the next chunk from the queue
+/// @details This method waits until either the next chunk is read by the
+/// background thread or the end of the data is reached.
+void PrefetchIterator::advance()
+{
+  // release the current chunk before waiting, so the memory can be reused
+  itsCurrent.reset();
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  while (itsQueue.empty() && !itsPrefetchDone) {
+         itsDataReady.wait(lock);
+  }
+  if (!itsQueue.empty()) {
+      itsCurrent = itsQueue.front();
+      itsQueue.pop_front();
+      itsSpaceReady.notify_one();
+  } else if (itsError.size() > 0) {
+      ASKAPTHROW(AskapError, "Error reading data in the prefetching thread: "<<itsError);
+  }
+}
+
+/// @brief start the background thread
+void PrefetchIterator::startPrefetch()
+{
+  ASKAPDEBUGASSERT(!itsThread);
+  itsQueue.clear();
+  itsPrefetchDone = false;
+  itsStopRequested = false;
+  itsError = "";
+  itsThread.reset(new boost::thread(boost::bind(&PrefetchIterator::prefetch, this)));
+}
+
+/// @brief stop the background thread
+/// @details Any data read ahead are discarded
+void PrefetchIterator::stopPrefetch()
+{
+  if (itsThread) {
+      {
+        boost::unique_lock<boost::mutex> lock(itsMutex);
+        itsStopRequested = true;
+        itsSpaceReady.notify_all();
+      }
+      itsThread->join();
+      itsThread.reset();
+  }
+  itsQueue.clear();
+  itsCurrent.reset();
+}
+
+/// @brief main method of the background thread
+void PrefetchIterator::prefetch()
+{
+  try {
+     while (true) {
+          boost::shared_ptr<PrefetchAccessor> acc;
+          {
+            boost::unique_lock<boost::mutex> ioLock = lockIO();
+            if (!itsIter.hasMore()) {
+                break;
+            }
+            acc.reset(new PrefetchAccessor(itsHints, itsCacheSize, itsTolerance, itsIOMutex));
+            acc->fill(*itsIter);
+            itsIter.next();
+          }
+          boost::unique_lock<boost::mutex> lock(itsMutex);
+          while ((itsQueue.size() >= itsDepth) && !itsStopRequested) {
+                 itsSpaceReady.wait(lock);
+          }
+          if (itsStopRequested) {
+              break;
+          }
+          itsQueue.push_back(acc);
+          itsDataReady.notify_one();
+     }
+  }
+  catch (const std::exception &ex) {
+     boost::unique_lock<boost::mutex> lock(itsMutex);
+     itsError = ex.what();
+  }
+  boost::unique_lock<boost::mutex> lock(itsMutex);
+  itsPrefetchDone = true;
+  itsDataReady.notify_all();
+}
+
+/// @brief lock the I/O mutex, if any
+/// @return lock object (doesn't own a mutex if no I/O mutex is set)
+boost::unique_lock<boost::mutex> PrefetchIterator::lockIO() const
+{
+  if (itsIOMutex) {
+      return boost::unique_lock<boost::mutex>(*itsIOMutex);
+  }
+  return boost::unique_lock<boost::mutex>();
+}
+
+} // namespace synthesis
+
+} // namespace askap
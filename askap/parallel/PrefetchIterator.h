@@ -0,0 +1,199 @@
+/// @file
+/// @brief iterator reading data ahead in a background thread
+/// @details This is an adapter wrapping another data iterator (normally the table-based
+/// one). The original iterator is advanced in a separate thread which copies each chunk
+/// of data (including rotated uvw's and delays for known tangent points) into memory.
+/// Therefore, disk access and data conversion happen at the same time as the measurement
+/// equation processes the previous chunk of data. The number of chunks read ahead is
+/// controlled by the queue depth.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#ifndef ASKAP_SYNTHESIS_PREFETCH_ITERATOR_H
+#define ASKAP_SYNTHESIS_PREFETCH_ITERATOR_H
+
+#include <askap/dataaccess/IDataIterator.h>
+#include <askap/dataaccess/SharedIter.h>
+#include <askap/parallel/PrefetchAccessor.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <deque>
+#include <string>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief iterator reading data ahead in a background thread
+/// @details This is an implementation of data iterator (see Base/accessors) which wraps
+/// another iterator and reads data ahead in a separate thread. Each chunk is copied
+/// into a stand-alone accessor, so the main thread never touches the original iterator.
+/// The design is intended for read-only passes over the data (e.g. calculation of normal
+/// equations in imaging and calibration). Visibilities can be modified in the returned
+/// accessor, but changes are not written back to the dataset. Buffers are not supported.
+/// @note The original iterator is accessed from the background thread only. Some thread
+/// safety of casacore (i.e. measures conversion) is assumed, as the uvw rotation can be
+/// performed in both threads at the same time.
+/// @ingroup parallel
+class PrefetchIterator : public accessors::IDataIterator {
+public:
+   /// @brief constructor
+   /// @details The background thread is started immediately.
+   /// @param[in] iter iterator to wrap (it is advanced in the background thread)
+   /// @param[in] depth number of chunks to read ahead (should be positive)
+   /// @param[in] cacheSize uvw-machine cache size
+   /// @param[in] tolerance pointing direction tolerance in radians, exceeding
+   /// which leads to initialisation of a new UVW machine and recompute of the rotated uvws/delays
+   /// @param[in] ioMutex optional mutex locked while the original iterator is accessed. It allows
+   /// several instances of this class to read tables in different threads (casacore tables are
+   /// not thread safe). An empty shared pointer means no locking is done.
+   explicit PrefetchIterator(const accessors::IDataSharedIter &iter, size_t depth = 2,
+                             size_t cacheSize = 1, double tolerance = 1e-6,
+                             const boost::shared_ptr<boost::mutex> &ioMutex = boost::shared_ptr<boost::mutex>());
+
+   /// @brief destructor, stops the background thread
+   virtual ~PrefetchIterator();
+
+   /// @brief reference to data accessor (current chunk)
+   /// @return a reference to the current chunk
+   /// @note constness of the return type is changed to allow read/write
+   /// operations.
+   virtual accessors::IDataAccessor& operator*() const;
+
+   /// @brief choose buffer
+   /// @details This operation is not supported by this iterator
+   /// @param[in] bufferID  the name of the buffer to choose
+   virtual void chooseBuffer(const std::string &bufferID);
+
+   /// Switch the output of operator* and operator-> to the original
+   /// state (present after the iterator is just constructed)
+   /// where they point to the primary visibility data. This method
+   /// is indended to cancel the results of chooseBuffer(casacore::uInt)
+   ///
+   virtual void chooseOriginal();
+
+   /// @brief access to a buffer
+   /// @details This operation is not supported by this iterator
+   /// @param[in] bufferID the name of the buffer requested
+   /// @return a reference to writable data accessor to the
+   ///         buffer requested
+   virtual accessors::IDataAccessor& buffer(const std::string &bufferID) const;
+
+   /// @brief Restart the iteration from the beginning
+   /// @details The background thread is restarted unless the iterator is still at
+   /// the origin (so the data read ahead can be reused)
+   virtual void init();
+
+   /// Checks whether there are more data available.
+   /// @return True if there are more data available
+   casacore::Bool hasMore() const throw();
+
+   /// advance the iterator one step further
+   /// @return True if there are more data (so constructions like
+   ///         while(it.next()) {} are possible)
+   casacore::Bool next();
+
+   /// @brief number of chunks read ahead
+   /// @return queue depth
+   inline size_t depth() const { return itsDepth; }
+
+protected:
+   /// @brief obtain the next chunk from the queue
+   /// @details This method waits until either the next chunk is read by the
+   /// background thread or the end of the data is reached.
+   void advance();
+
+   /// @brief start the background thread
+   void startPrefetch();
+
+   /// @brief stop the background thread
+   /// @details Any data read ahead are discarded
+   void stopPrefetch();
+
+   /// @brief main method of the background thread
+   void prefetch();
+
+   /// @brief lock the I/O mutex, if any
+   /// @return lock object (doesn't own a mutex if no I/O mutex is set)
+   boost::unique_lock<boost::mutex> lockIO() const;
+
+private:
+   /// @brief wrapped iterator (accessed from the background thread only while it runs)
+   accessors::IDataSharedIter itsIter;
+
+   /// @brief maximum number of chunks in the queue
+   size_t itsDepth;
+
+   /// @brief uvw-machine cache size
+   size_t itsCacheSize;
+
+   /// @brief direction tolerance for uvw-machine cache
+   double itsTolerance;
+
+   /// @brief mutex serialising access to the original iterator (may be empty)
+   boost::shared_ptr<boost::mutex> itsIOMutex;
+
+   /// @brief directions requested by gridders, shared between all accessors
+   boost::shared_ptr<UVWRotationHints> itsHints;
+
+   /// @brief current accessor, empty pointer if the end of iteration is reached
+   boost::shared_ptr<PrefetchAccessor> itsCurrent;
+
+   /// @brief chunks read ahead
+   std::deque<boost::shared_ptr<PrefetchAccessor> > itsQueue;
+
+   /// @brief true if the background thread reached the end of data
+   bool itsPrefetchDone;
+
+   /// @brief true if the background thread has to terminate
+   bool itsStopRequested;
+
+   /// @brief error message if the background thread has failed
+   std::string itsError;
+
+   /// @brief true, if next has been called since the last restart
+   bool itsNotAtOrigin;
+
+   /// @brief synchronisation of the queue
+   boost::mutex itsMutex;
+
+   /// @brief notification that a new chunk has been queued (or the end of data is reached)
+   boost::condition_variable itsDataReady;
+
+   /// @brief notification that a chunk has been taken from the queue
+   boost::condition_variable itsSpaceReady;
+
+   /// @brief background thread
+   boost::shared_ptr<boost::thread> itsThread;
+};
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef ASKAP_SYNTHESIS_PREFETCH_ITERATOR_H
@@ -51,6 +51,7 @@
 #include <Blob/BlobString.h>
 #include <Blob/BlobIBufString.h>
 #include <Blob/BlobOBufString.h>
+#include <Blob/BlobIBufVector.h>
 #include <Blob/BlobIStream.h>
 #include <Blob/BlobOStream.h>
 
@@ -96,6 +97,10 @@ namespace askap
       } else {
           ASKAPTHROW(AskapError, "Unsupported frequency frame "<<freqFrame);
       }    
+      // lossless compression of the model broadcast: none, rle (zero runs) or shuffle (byte shuffle + zero runs)
+      itsModelCompression = CompressedBlobCodec::modeFromString(parset.getString("modelcompression", "rle"));
+      ASKAPLOG_DEBUG_STR(logger, "Model broadcast will use "<<CompressedBlobCodec::toString(itsModelCompression)<<
+                         " encoding");
       const std::string parString = itsComms.isParallel() ? "parallel" : "serial";
       std::string mwString = itsComms.isWorker() ? "worker" : "master";
       if (itsComms.isWorker() && itsComms.isMaster()) {
@@ -277,7 +282,15 @@ namespace askap
         out.putStart("model", 1);
         out << model;
         out.putEnd();
-        itsComms.broadcastBlob(bs ,0);
+
+        // sparse models (e.g. early in the clean) and single precision values held as doubles
+        // compress well, the model is encoded straight into the blob string which is broadcast
+        LOFAR::BlobString encodedBS;
+        encodedBS.resize(CompressedBlobCodec::maxEncodedSize(bs.size()));
+        encodedBS.resize(CompressedBlobCodec::encode(bs.data(), bs.size(), itsModelCompression, encodedBS.data()));
+        ASKAPLOG_DEBUG_STR(logger, "Model serialised into "<<bs.size()<<" bytes, "<<encodedBS.size()<<
+                           " bytes after "<<CompressedBlobCodec::toString(itsModelCompression)<<" encoding");
+        itsComms.broadcastBlob(encodedBS, 0);
     }
 
     /// @brief actual implementation of the model receive
@@ -293,7 +306,9 @@ namespace askap
         LOFAR::BlobString bs;
         bs.resize(0);
         itsComms.broadcastBlob(bs, 0);
-        LOFAR::BlobIBufString bib(bs);
+        std::vector<int8_t> decoded;
+        CompressedBlobCodec::decode(bs.data(), bs.size(), decoded);
+        LOFAR::BlobIBufVector<int8_t> bib(decoded);
         LOFAR::BlobIStream in(bib);
         int version=in.getStart("model");
         ASKAPASSERT(version==1);
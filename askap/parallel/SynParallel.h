@@ -38,6 +38,7 @@
 
 
 #include <askapparallel/AskapParallel.h>
+#include <askap/parallel/CompressedBlobCodec.h>
 #include <casacore/measures/Measures/MFrequency.h>
 
 namespace askap
@@ -134,6 +135,11 @@ namespace askap
       /// obtain frequency reference frame
       inline casacore::MFrequency::Ref getFreqRefFrame() const { return itsFreqRefFrame;}
 
+      /// @brief encoding used for serialised models
+      /// @details to be used in derived classes sending other large blobs
+      /// @return encoding mode selected in the parset (modelcompression)
+      inline CompressedBlobCodec::Mode modelCompression() const { return itsModelCompression;}
+
       /// @brief helper method to create and configure gridder
       /// @details It is expected to be called from the constructor of derived classes
       /// @param[in] comms communications object
@@ -148,6 +154,9 @@ namespace askap
       /// @details We may want to simulate/image in different reference frames.
       /// This field contains the reference frame selected in the parset.
       casacore::MFrequency::Ref itsFreqRefFrame;    
+
+      /// @brief encoding of the serialised model for broadcast
+      CompressedBlobCodec::Mode itsModelCompression;
     };
 
   }
@@ -0,0 +1,275 @@
+/// @file
+/// @brief base class for multi-threaded in-place processing of a dataset
+/// @details Data are processed in three stages working in parallel: a reader thread
+/// copies chunks of data into memory, a number of worker threads process them and a writer
+/// thread puts the resulting visibilities (and, optionally, flags) back into the dataset.
+/// Stages are connected by bounded queues, so the memory footprint doesn't depend on the
+/// size of the dataset. Disk access (which is not thread safe in casacore) is serialised,
+/// but overlaps with the calculation done by the workers. Derived classes only implement
+/// the operation on one chunk.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+
+#include <askap/parallel/VisProcessingPipeline.h>
+#include <askap/askap_synthesis.h>
+#include <askap/AskapError.h>
+#include <askap/AskapLogging.h>
+#include <askap/AskapUtil.h>
+#include <askap/dataaccess/IFlagDataAccessor.h>
+
+#include <casacore/casa/OS/Timer.h>
+
+#include <boost/thread/thread.hpp>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+
+#include <exception>
+
+ASKAP_LOGGER(logger, ".parallel");
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief constructor
+/// @param[in] nWorkers number of worker threads (should be positive)
+/// @param[in] depth maximum number of chunks waiting in each queue (should be positive)
+/// @param[in] updateFlags if true, flags are written back together with visibilities
+/// (processChunk is expected to fill the flag cube of each chunk)
+/// @param[in] ioMutex optional mutex serialising the table access, it can be shared with
+/// other code accessing tables from the worker threads. A new mutex is created if this
+/// parameter is empty.
+/// @param[in] cacheSize uvw-machine cache size for the chunk copies
+/// @param[in] tolerance pointing direction tolerance in radians, exceeding
+/// which leads to initialisation of a new UVW machine and recompute of the rotated uvws/delays
+VisProcessingPipeline::VisProcessingPipeline(size_t nWorkers, size_t depth, bool updateFlags,
+                                             const boost::shared_ptr<boost::mutex> &ioMutex,
+                                             size_t cacheSize, double tolerance) :
+   itsNWorkers(nWorkers), itsDepth(depth), itsUpdateFlags(updateFlags), itsUVWMachineCacheSize(cacheSize),
+   itsUVWMachineCacheTolerance(tolerance), itsHints(new UVWRotationHints), itsNextToWrite(0),
+   itsReadDone(false), itsWorkersDone(0), itsStopRequested(false), itsCalculationTime(0.),
+   itsIOMutex(ioMutex)
+{
+  ASKAPCHECK(itsNWorkers > 0, "At least one worker thread is required for the pipeline");
+  ASKAPCHECK(itsDepth > 0, "Pipeline queue depth should be positive");
+  if (!itsIOMutex) {
+      itsIOMutex.reset(new boost::mutex);
+  }
+}
+
+/// @brief virtual destructor to keep the compiler happy
+VisProcessingPipeline::~VisProcessingPipeline() {}
+
+/// @brief process the whole dataset
+/// @details This method starts all threads and returns after all data are written.
+/// Any error in the threads is rethrown as AskapError.
+/// @param[in] readIter iterator to read the data from
+/// @param[in] writeIter iterator to write the processed data to (must give the same
+/// chunks as readIter)
+void VisProcessingPipeline::run(const accessors::IDataSharedIter &readIter, const accessors::IDataSharedIter &writeIter)
+{
+  ASKAPCHECK(readIter && writeIter, "Both input and output iterators should be defined");
+  itsInput.clear();
+  itsOutput.clear();
+  itsNextToWrite = 0;
+  itsReadDone = false;
+  itsWorkersDone = 0;
+  itsStopRequested = false;
+  itsError = "";
+  itsCalculationTime = 0.;
+
+  ASKAPLOG_INFO_STR(logger, "Data will be processed by "<<itsNWorkers<<
+                    " worker thread(s), queue depth = "<<itsDepth);
+  accessors::IDataSharedIter readIterCopy(readIter);
+  accessors::IDataSharedIter writeIterCopy(writeIter);
+  boost::thread_group threads;
+  threads.create_thread(boost::bind(&VisProcessingPipeline::read, this, boost::ref(readIterCopy)));
+  for (size_t worker = 0; worker < itsNWorkers; ++worker) {
+       threads.create_thread(boost::bind(&VisProcessingPipeline::process, this, worker));
+  }
+  threads.create_thread(boost::bind(&VisProcessingPipeline::write, this, boost::ref(writeIterCopy)));
+  threads.join_all();
+
+  ASKAPCHECK(itsError.size() == 0, "Error processing data in the pipeline: "<<itsError);
+  ASKAPLOG_DEBUG_STR(logger, "Pipeline has processed "<<itsNextToWrite<<" chunks");
+}
+
+/// @brief main method of the reader thread
+/// @param[in] iter iterator to read the data from
+void VisProcessingPipeline::read(accessors::IDataSharedIter &iter)
+{
+  try {
+     {
+       boost::lock_guard<boost::mutex> ioLock(*itsIOMutex);
+       iter.init();
+     }
+     for (size_t seqNo = 0; true; ++seqNo) {
+          boost::shared_ptr<Chunk> chunk(new Chunk);
+          chunk->itsSeqNo = seqNo;
+          {
+            boost::lock_guard<boost::mutex> ioLock(*itsIOMutex);
+            if (!iter.hasMore()) {
+                break;
+            }
+            // rotations requested by the workers for new directions are done with the I/O mutex locked
+            chunk->itsData.reset(new PrefetchAccessor(itsHints, itsUVWMachineCacheSize, itsUVWMachineCacheTolerance,
+                                                      itsIOMutex));
+            chunk->itsData->fill(*iter);
+            iter.next();
+          }
+          boost::unique_lock<boost::mutex> lock(itsMutex);
+          while ((itsInput.size() >= itsDepth) && !itsStopRequested) {
+                 itsStateChanged.wait(lock);
+          }
+          if (itsStopRequested) {
+              break;
+          }
+          itsInput.push_back(chunk);
+          itsStateChanged.notify_all();
+     }
+  }
+  catch (const std::exception &ex) {
+     abort(std::string("reader: ") + ex.what());
+  }
+  boost::lock_guard<boost::mutex> lock(itsMutex);
+  itsReadDone = true;
+  itsStateChanged.notify_all();
+}
+
+/// @brief main method of a worker thread
+/// @param[in] worker index of the worker thread
+void VisProcessingPipeline::process(size_t worker)
+{
+  double calculationTime = 0.;
+  try {
+     casacore::Timer timer;
+     while (true) {
+          boost::shared_ptr<Chunk> chunk;
+          {
+            boost::unique_lock<boost::mutex> lock(itsMutex);
+            while (itsInput.empty() && !itsReadDone && !itsStopRequested) {
+                   itsStateChanged.wait(lock);
+            }
+            if (itsStopRequested || itsInput.empty()) {
+                break;
+            }
+            chunk = itsInput.front();
+            itsInput.pop_front();
+            itsStateChanged.notify_all();
+          }
+          ASKAPDEBUGASSERT(chunk);
+          ASKAPDEBUGASSERT(chunk->itsData);
+          timer.mark();
+          processChunk(worker, *chunk);
+          calculationTime += timer.real();
+
+          // chunks too far ahead of the writer are held back to limit the memory footprint,
+          // the chunk to be written next is always accepted
+          boost::unique_lock<boost::mutex> lock(itsMutex);
+          while ((chunk->itsSeqNo >= itsNextToWrite + itsDepth) && !itsStopRequested) {
+                 itsStateChanged.wait(lock);
+          }
+          if (itsStopRequested) {
+              break;
+          }
+          itsOutput[chunk->itsSeqNo] = chunk;
+          itsStateChanged.notify_all();
+     }
+  }
+  catch (const std::exception &ex) {
+     abort(std::string("worker: ") + ex.what());
+  }
+  boost::lock_guard<boost::mutex> lock(itsMutex);
+  itsCalculationTime += calculationTime;
+  ++itsWorkersDone;
+  itsStateChanged.notify_all();
+}
+
+/// @brief main method of the writer thread
+/// @param[in] iter iterator to write the data to
+void VisProcessingPipeline::write(accessors::IDataSharedIter &iter)
+{
+  try {
+     {
+       boost::lock_guard<boost::mutex> ioLock(*itsIOMutex);
+       iter.init();
+     }
+     while (true) {
+          boost::shared_ptr<Chunk> chunk;
+          {
+            boost::unique_lock<boost::mutex> lock(itsMutex);
+            std::map<size_t, boost::shared_ptr<Chunk> >::iterator it = itsOutput.find(itsNextToWrite);
+            while ((it == itsOutput.end()) && (itsWorkersDone < itsNWorkers) && !itsStopRequested) {
+                   itsStateChanged.wait(lock);
+                   it = itsOutput.find(itsNextToWrite);
+            }
+            if (itsStopRequested || (it == itsOutput.end())) {
+                break;
+            }
+            chunk = it->second;
+            itsOutput.erase(it);
+          }
+          ASKAPDEBUGASSERT(chunk);
+          const accessors::IConstDataAccessor &data = *chunk->itsData;
+          {
+            boost::lock_guard<boost::mutex> ioLock(*itsIOMutex);
+            ASKAPCHECK(iter.hasMore(), "Output iterator has fewer chunks than the input one");
+            ASKAPCHECK((iter->nRow() == data.nRow()) && (iter->nChannel() == data.nChannel()) &&
+                       (iter->nPol() == data.nPol()) && (iter->time() == data.time()),
+                       "Chunk "<<chunk->itsSeqNo<<" of the output iterator doesn't match the input one");
+            iter->rwVisibility() = data.visibility();
+            if (itsUpdateFlags) {
+                const boost::shared_ptr<accessors::IFlagDataAccessor> fda =
+                      boost::dynamic_pointer_cast<accessors::IFlagDataAccessor>(boost::shared_ptr<accessors::IDataAccessor>(iter.operator->(), utility::NullDeleter()));
+                ASKAPCHECK(fda, "Data accessor is of type which does not support overwritting flag information");
+                fda->rwFlag() = chunk->itsFlag;
+            }
+            iter.next();
+          }
+          boost::lock_guard<boost::mutex> lock(itsMutex);
+          ++itsNextToWrite;
+          itsStateChanged.notify_all();
+     }
+  }
+  catch (const std::exception &ex) {
+     abort(std::string("writer: ") + ex.what());
+  }
+}
+
+/// @brief stop all threads because of an error
+/// @param[in] error error message
+void VisProcessingPipeline::abort(const std::string &error)
+{
+  boost::lock_guard<boost::mutex> lock(itsMutex);
+  if (itsError.size() == 0) {
+      itsError = error;
+  }
+  itsStopRequested = true;
+  itsStateChanged.notify_all();
+}
+
+} // namespace synthesis
+
+} // namespace askap
@@ -0,0 +1,203 @@
+/// @file
+/// @brief base class for multi-threaded in-place processing of a dataset
+/// @details Data are processed in three stages working in parallel: a reader thread
+/// copies chunks of data into memory, a number of worker threads process them and a writer
+/// thread puts the resulting visibilities (and, optionally, flags) back into the dataset.
+/// Stages are connected by bounded queues, so the memory footprint doesn't depend on the
+/// size of the dataset. Disk access (which is not thread safe in casacore) is serialised,
+/// but overlaps with the calculation done by the workers. Derived classes only implement
+/// the operation on one chunk.
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+
+#ifndef ASKAP_SYNTHESIS_VIS_PROCESSING_PIPELINE_H
+#define ASKAP_SYNTHESIS_VIS_PROCESSING_PIPELINE_H
+
+#include <askap/dataaccess/SharedIter.h>
+#include <askap/dataaccess/IDataIterator.h>
+#include <askap/parallel/PrefetchAccessor.h>
+
+#include <casacore/casa/Arrays/Cube.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+
+#include <deque>
+#include <map>
+#include <string>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief base class for multi-threaded in-place processing of a dataset
+/// @details The data are read through one iterator and written through another, which
+/// should be set up with the same selection and chunk size (i.e. two iterators over the same
+/// measurement set). The table access is serialised with a mutex, therefore it is possible for
+/// both iterators to refer to the same table. The mutex can be shared with other code accessing
+/// tables from the worker threads. Chunks are written in the same order as they are read.
+/// Derived classes implement processChunk, which is called concurrently from all worker threads
+/// (each with its own worker index, so the per-thread state can be kept in derived classes).
+/// @ingroup parallel
+class VisProcessingPipeline {
+public:
+   /// @brief constructor
+   /// @param[in] nWorkers number of worker threads (should be positive)
+   /// @param[in] depth maximum number of chunks waiting in each queue (should be positive)
+   /// @param[in] updateFlags if true, flags are written back together with visibilities
+   /// (processChunk is expected to fill the flag cube of each chunk)
+   /// @param[in] ioMutex optional mutex serialising the table access, it can be shared with
+   /// other code accessing tables from the worker threads. A new mutex is created if this
+   /// parameter is empty.
+   /// @param[in] cacheSize uvw-machine cache size for the chunk copies
+   /// @param[in] tolerance pointing direction tolerance in radians, exceeding
+   /// which leads to initialisation of a new UVW machine and recompute of the rotated uvws/delays
+   VisProcessingPipeline(size_t nWorkers, size_t depth, bool updateFlags = false,
+                         const boost::shared_ptr<boost::mutex> &ioMutex = boost::shared_ptr<boost::mutex>(),
+                         size_t cacheSize = 1, double tolerance = 1e-6);
+
+   /// @brief virtual destructor to keep the compiler happy
+   virtual ~VisProcessingPipeline();
+
+   /// @brief process the whole dataset
+   /// @details This method starts all threads and returns after all data are written.
+   /// Any error in the threads is rethrown as AskapError.
+   /// @param[in] readIter iterator to read the data from
+   /// @param[in] writeIter iterator to write the processed data to (must give the same
+   /// chunks as readIter)
+   void run(const accessors::IDataSharedIter &readIter, const accessors::IDataSharedIter &writeIter);
+
+   /// @brief number of chunks processed by the last run
+   /// @return number of chunks
+   inline size_t nChunks() const { return itsNextToWrite; }
+
+   /// @brief time spent by the workers in calculation
+   /// @details This is the sum for all workers over the last run.
+   /// @return time in seconds
+   inline double calculationTime() const { return itsCalculationTime; }
+
+   /// @brief number of worker threads
+   /// @return number of workers
+   inline size_t nWorkers() const { return itsNWorkers; }
+
+protected:
+   /// @brief chunk of data passed between the stages
+   struct Chunk {
+      /// @brief sequence number of the chunk
+      size_t itsSeqNo;
+      /// @brief copy of the data
+      boost::shared_ptr<PrefetchAccessor> itsData;
+      /// @brief processed flags (only used if flags are updated)
+      casacore::Cube<casacore::Bool> itsFlag;
+   };
+
+   /// @brief process one chunk
+   /// @details This method is called from the worker threads. Visibilities should be updated
+   /// in the chunk copy. If flags are updated, the flag cube of the chunk should be filled.
+   /// @param[in] worker index of the worker thread (from 0 to nWorkers-1)
+   /// @param[in] chunk chunk to process
+   virtual void processChunk(size_t worker, Chunk &chunk) const = 0;
+
+   /// @brief true, if flags are written back
+   /// @return true, if the flag cube of each chunk is written back
+   inline bool updateFlags() const { return itsUpdateFlags; }
+
+private:
+   /// @brief main method of the reader thread
+   /// @param[in] iter iterator to read the data from
+   void read(accessors::IDataSharedIter &iter);
+
+   /// @brief main method of a worker thread
+   /// @param[in] worker index of the worker thread
+   void process(size_t worker);
+
+   /// @brief main method of the writer thread
+   /// @param[in] iter iterator to write the data to
+   void write(accessors::IDataSharedIter &iter);
+
+   /// @brief stop all threads because of an error
+   /// @param[in] error error message
+   void abort(const std::string &error);
+
+   /// @brief number of worker threads
+   size_t itsNWorkers;
+
+   /// @brief maximum number of chunks in each queue
+   size_t itsDepth;
+
+   /// @brief true, if flags are written back
+   bool itsUpdateFlags;
+
+   /// @brief uvw-machine cache size for the chunk copies
+   size_t itsUVWMachineCacheSize;
+
+   /// @brief pointing direction tolerance for the uvw machine cache (in radians)
+   double itsUVWMachineCacheTolerance;
+
+   /// @brief tangent points requested while processing chunks
+   /// @details These are shared by all chunks and persist between runs, so the rotated
+   /// uvw's (if required at all) are computed by the reader for all but the first chunk.
+   boost::shared_ptr<UVWRotationHints> itsHints;
+
+   /// @brief chunks read but not yet processed
+   std::deque<boost::shared_ptr<Chunk> > itsInput;
+
+   /// @brief chunks processed but not yet written, indexed by sequence number
+   std::map<size_t, boost::shared_ptr<Chunk> > itsOutput;
+
+   /// @brief sequence number of the next chunk to write
+   size_t itsNextToWrite;
+
+   /// @brief true, if the reader has reached the end of the data
+   bool itsReadDone;
+
+   /// @brief number of workers which have finished
+   size_t itsWorkersDone;
+
+   /// @brief true, if all threads should stop (due to an error)
+   bool itsStopRequested;
+
+   /// @brief error message from any of the threads
+   std::string itsError;
+
+   /// @brief time spent in calculation (summed for all workers)
+   double itsCalculationTime;
+
+   /// @brief synchronisation of the queues
+   boost::mutex itsMutex;
+
+   /// @brief notification about any change of the state
+   boost::condition_variable itsStateChanged;
+
+   /// @brief serialisation of the table access
+   boost::shared_ptr<boost::mutex> itsIOMutex;
+};
+
+} // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef ASKAP_SYNTHESIS_VIS_PROCESSING_PIPELINE_H
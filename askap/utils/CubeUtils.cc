@@ -0,0 +1,379 @@
+/// @file CubeUtils.cc
+///
+/// @brief helpers to copy large cubes in slabs
+/// @details These utilities are used by cubemerge and cubeslice to copy
+/// images which don't fit into memory. The data are split into slabs along one
+/// axis, which are read by a number of threads and written by the calling thread,
+/// so reads and writes of different slabs overlap.
+///
+/// @copyright (c) 2012 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+// Package level header file
+#include "askap/askap_synthesis.h"
+
+// own includes
+#include <askap/utils/CubeUtils.h>
+
+// System includes
+#include <algorithm>
+#include <deque>
+#include <limits>
+
+// other 3rd party
+#include <askap/AskapError.h>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/condition_variable.hpp>
+#include <casacore/casa/Arrays/Array.h>
+#include <casacore/casa/Arrays/ArrayMath.h>
+#include <casacore/casa/Arrays/Slicer.h>
+#include <casacore/images/Images/PagedImage.h>
+
+namespace askap {
+
+namespace {
+
+/// @brief queue of slabs passed from the readers to the writer
+/// @details The number of slabs in memory is bounded, counting the slabs being read and
+/// written as well as those waiting in the queue. A reader reserves a buffer before it
+/// starts reading and the writer releases it once the slab has been written.
+class SlabQueue {
+public:
+    /// @brief constructor
+    /// @param[in] maxSize maximum number of slabs held in memory
+    /// @param[in] nReaders number of threads adding slabs
+    SlabQueue(size_t maxSize, int nReaders) : itsMaxSize(maxSize), itsNBuffers(0),
+              itsNActiveReaders(nReaders), itsAborted(false) {}
+
+    /// @brief reserve a buffer for the next slab, waiting for one to be released
+    /// @return false if the copy has been aborted
+    bool reserve() {
+        boost::unique_lock<boost::mutex> lock(itsMutex);
+        while (!itsAborted && itsNBuffers >= itsMaxSize) {
+            itsCondition.wait(lock);
+        }
+        if (itsAborted) {
+            return false;
+        }
+        ++itsNBuffers;
+        return true;
+    }
+
+    /// @brief release a buffer, after the slab has been written or if it failed to read
+    void release() {
+        boost::lock_guard<boost::mutex> lock(itsMutex);
+        ASKAPDEBUGASSERT(itsNBuffers > 0);
+        --itsNBuffers;
+        itsCondition.notify_all();
+    }
+
+    /// @brief add a slab read into a reserved buffer
+    /// @param[in] slab index of the slab
+    /// @param[in] buf data of the slab
+    void push(size_t slab, const casacore::Array<casacore::Float> &buf) {
+        boost::lock_guard<boost::mutex> lock(itsMutex);
+        itsQueue.push_back(std::make_pair(slab, buf));
+        itsCondition.notify_all();
+    }
+
+    /// @brief take the next slab, waiting for one to be read
+    /// @param[out] slab index of the slab
+    /// @param[out] buf data of the slab
+    /// @return false if all readers have finished and the queue is empty
+    bool pop(size_t &slab, casacore::Array<casacore::Float> &buf) {
+        boost::unique_lock<boost::mutex> lock(itsMutex);
+        while (itsQueue.empty() && itsNActiveReaders > 0) {
+            itsCondition.wait(lock);
+        }
+        if (itsQueue.empty()) {
+            return false;
+        }
+        slab = itsQueue.front().first;
+        buf.reference(itsQueue.front().second);
+        itsQueue.pop_front();
+        return true;
+    }
+
+    /// @brief signal that a reader has finished
+    void readerDone() {
+        boost::lock_guard<boost::mutex> lock(itsMutex);
+        --itsNActiveReaders;
+        itsCondition.notify_all();
+    }
+
+    /// @brief stop the readers, e.g. if the writer has failed
+    void abort() {
+        boost::lock_guard<boost::mutex> lock(itsMutex);
+        itsAborted = true;
+        itsCondition.notify_all();
+    }
+
+private:
+    /// @brief slabs waiting to be written
+    std::deque<std::pair<size_t, casacore::Array<casacore::Float> > > itsQueue;
+    /// @brief maximum number of slabs held in memory
+    size_t itsMaxSize;
+    /// @brief number of reserved buffers (slabs being read, queued or being written)
+    size_t itsNBuffers;
+    /// @brief number of readers which haven't finished yet
+    int itsNActiveReaders;
+    /// @brief true if the readers have to stop
+    bool itsAborted;
+    /// @brief synchronisation between threads
+    boost::mutex itsMutex;
+    /// @brief signalled whenever the queue or the state changes
+    boost::condition_variable itsCondition;
+};
+
+/// @brief shared counter handing out the slabs to the readers
+/// @details Readers take the next slab in order which hasn't been taken yet. A casa image
+/// can't be read by several threads at the same time, so the reader taking the first
+/// slab of an input owns this input and reads all its slabs; the counter skips slabs of
+/// the inputs which are already owned. This way the inputs are shared out dynamically
+/// and a reader which has finished early moves on to the next input.
+class SlabCounter {
+public:
+    /// @brief constructor
+    /// @param[in] slabs all slabs to copy
+    /// @param[in] nInputs number of input images
+    SlabCounter(const std::vector<ImageSlab> &slabs, size_t nInputs) : itsSlabs(slabs),
+                itsNextSlab(0), itsOwned(nInputs, false) {}
+
+    /// @brief take the next input nobody reads yet
+    /// @param[out] first index of its first slab not taken yet
+    /// @return false if there is nothing left to read
+    bool next(size_t &first) {
+        boost::lock_guard<boost::mutex> lock(itsMutex);
+        while (itsNextSlab < itsSlabs.size() && itsOwned[itsSlabs[itsNextSlab].input]) {
+            ++itsNextSlab;
+        }
+        if (itsNextSlab == itsSlabs.size()) {
+            return false;
+        }
+        first = itsNextSlab++;
+        itsOwned[itsSlabs[first].input] = true;
+        return true;
+    }
+
+private:
+    /// @brief all slabs to copy
+    const std::vector<ImageSlab> &itsSlabs;
+    /// @brief index of the next slab to consider
+    size_t itsNextSlab;
+    /// @brief true for the inputs which are already owned by a reader
+    std::vector<bool> itsOwned;
+    /// @brief synchronisation between readers
+    boost::mutex itsMutex;
+};
+
+/// @brief thread reading slabs of the inputs handed out by the shared counter
+/// @param[in] inputs names of the input images
+/// @param[in] slabs all slabs to copy
+/// @param[in] counter shared counter of the slabs
+/// @param[in] queue queue to put the slabs into
+/// @param[in] peaks maximum of each input
+/// @param[in] sums sum of each input
+/// @param[in] ioMutex mutex serialising all casacore calls
+/// @param[out] error error message (empty if successful)
+void readSlabs(const std::vector<std::string> &inputs, const std::vector<ImageSlab> &slabs,
+               SlabCounter &counter, SlabQueue &queue, std::vector<float> &peaks,
+               std::vector<double> &sums, boost::mutex &ioMutex, std::string &error) {
+    bool reserved = false;
+    // the image is opened, read and closed with the mutex locked
+    boost::shared_ptr<casacore::PagedImage<casacore::Float> > img;
+    try {
+        size_t first = 0;
+        bool aborted = false;
+        while (!aborted && counter.next(first)) {
+            const size_t input = slabs[first].input;
+            ASKAPDEBUGASSERT(input < inputs.size());
+            {
+                boost::lock_guard<boost::mutex> ioLock(ioMutex);
+                img.reset();
+                img.reset(new casacore::PagedImage<casacore::Float>(inputs[input]));
+            }
+            for (size_t slab = first; slab < slabs.size(); ++slab) {
+                const ImageSlab &s = slabs[slab];
+                if (s.input != input) {
+                    continue;
+                }
+                // the buffer is reserved before reading, so the slabs being read count
+                if (!queue.reserve()) {
+                    aborted = true;
+                    break;
+                }
+                reserved = true;
+                casacore::Array<casacore::Float> buf;
+                {
+                    boost::lock_guard<boost::mutex> ioLock(ioMutex);
+                    buf = img->getSlice(casacore::Slicer(s.blc, s.trc, casacore::Slicer::endIsLast));
+                }
+                if (buf.nelements() > 0) {
+                    peaks[input] = std::max(peaks[input], casacore::max(buf));
+                    sums[input] += casacore::sum(buf);
+                }
+                queue.push(slab, buf);
+                reserved = false;
+            }
+        }
+    } catch (const std::exception &ex) {
+        error = ex.what();
+        if (reserved) {
+            queue.release();
+        }
+    }
+    try {
+        boost::lock_guard<boost::mutex> ioLock(ioMutex);
+        img.reset();
+    } catch (const std::exception &ex) {
+        if (error.empty()) {
+            error = ex.what();
+        }
+    }
+    queue.readerDone();
+}
+
+} // anonymous namespace
+
+SlabWriteToken::SlabWriteToken(askapparallel::AskapParallel &comms, int nRounds) :
+               itsComms(comms), itsNRounds(nRounds), itsNRoundsDone(0) {}
+
+void SlabWriteToken::acquire() {
+    ASKAPCHECK(itsNRoundsDone < itsNRounds, "Rank "<<itsComms.rank()<<" has more slabs to write than "
+               <<itsNRounds<<" rounds of the write token");
+    if (!itsComms.isMaster()) {
+        int buf;
+        itsComms.receive((void *) &buf, sizeof(int), itsComms.rank() - 1);
+    }
+}
+
+void SlabWriteToken::release() {
+    if (itsComms.rank() < itsComms.nProcs() - 1) {
+        int buf = 0;
+        itsComms.send((void *) &buf, sizeof(int), itsComms.rank() + 1);
+    }
+    ++itsNRoundsDone;
+}
+
+void SlabWriteToken::finish() {
+    while (itsNRoundsDone < itsNRounds) {
+        acquire();
+        release();
+    }
+}
+
+int slabDepth(const casacore::IPosition &shape, casacore::uInt axis, size_t maxMemory,
+              int nBuffers, int granularity) {
+    ASKAPCHECK(axis < shape.nelements(), "Axis "<<axis<<" doesn't exist in the shape "<<shape);
+    ASKAPCHECK(nBuffers > 0, "Number of buffers should be positive");
+    const size_t planeBytes = size_t(shape.product() / shape(axis)) * sizeof(casacore::Float);
+    int depth = std::min(size_t(shape(axis)), maxMemory / (planeBytes * nBuffers));
+    if (granularity > 1 && depth > granularity) {
+        depth -= depth % granularity;
+    }
+    return depth > 1 ? depth : 1;
+}
+
+std::vector<ImageSlab> makeSlabs(size_t input, const casacore::IPosition &blc,
+                                 const casacore::IPosition &trc, const casacore::IPosition &where,
+                                 casacore::uInt axis, int depth) {
+    ASKAPCHECK(axis < blc.nelements(), "Axis "<<axis<<" doesn't exist in the region "<<blc<<" - "<<trc);
+    ASKAPCHECK(depth > 0, "Slab depth should be positive");
+    std::vector<ImageSlab> slabs;
+    for (int start = blc(axis); start <= trc(axis); start += depth) {
+        ImageSlab slab;
+        slab.input = input;
+        slab.blc = blc;
+        slab.trc = trc;
+        slab.where = where;
+        slab.blc(axis) = start;
+        slab.trc(axis) = std::min(start + depth - 1, int(trc(axis)));
+        slab.where(axis) += start - blc(axis);
+        slabs.push_back(slab);
+    }
+    return slabs;
+}
+
+void copySlabs(const std::vector<std::string> &inputs, const std::vector<ImageSlab> &slabs,
+               casacore::ImageInterface<casacore::Float> &output, int nReaders, int nBuffers,
+               std::vector<float> &peaks, std::vector<double> &sums,
+               const boost::shared_ptr<ISlabWriteGuard> &guard) {
+    ASKAPCHECK(nReaders > 0, "Number of reading threads should be positive");
+    ASKAPCHECK(nBuffers > 0, "Number of buffers should be positive");
+    peaks.assign(inputs.size(), -std::numeric_limits<float>::max());
+    sums.assign(inputs.size(), 0.);
+    // an input is only read by one thread, so there is no point having more readers than inputs
+    nReaders = std::min(nReaders, int(inputs.size()));
+    if (slabs.size() == 0 || nReaders == 0) {
+        return;
+    }
+
+    SlabCounter counter(slabs, inputs.size());
+    SlabQueue queue(nBuffers, nReaders);
+    boost::mutex ioMutex;
+    std::vector<std::string> errors(nReaders);
+    boost::thread_group readers;
+    for (int reader = 0; reader < nReaders; ++reader) {
+        readers.create_thread(boost::bind(readSlabs, boost::cref(inputs), boost::cref(slabs),
+                    boost::ref(counter), boost::ref(queue), boost::ref(peaks), boost::ref(sums),
+                    boost::ref(ioMutex), boost::ref(errors[reader])));
+    }
+    try {
+        size_t slab;
+        casacore::Array<casacore::Float> buf;
+        while (queue.pop(slab, buf)) {
+            // the token is taken before the mutex, so readers carry on while waiting for it
+            if (guard) {
+                guard->acquire();
+            }
+            {
+                boost::lock_guard<boost::mutex> ioLock(ioMutex);
+                output.putSlice(buf, slabs[slab].where);
+                if (guard) {
+                    // other processes must see the data and get the table lock
+                    output.flush();
+                    output.unlock();
+                }
+            }
+            if (guard) {
+                guard->release();
+            }
+            // drop the reference, so the memory is freed before the buffer is reused
+            buf.resize();
+            queue.release();
+        }
+    } catch (...) {
+        queue.abort();
+        readers.join_all();
+        throw;
+    }
+    readers.join_all();
+    for (int reader = 0; reader < nReaders; ++reader) {
+        ASKAPCHECK(errors[reader].empty(), "Error reading the input in thread "<<reader<<": "<<errors[reader]);
+    }
+}
+
+} // namespace askap
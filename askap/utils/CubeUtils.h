@@ -0,0 +1,156 @@
+#ifndef ASKAP_UTILS_CUBEUTILS_H
+#define ASKAP_UTILS_CUBEUTILS_H
+
+/// @file CubeUtils.h
+///
+/// @brief helpers to copy large cubes in slabs
+/// @details These utilities are used by cubemerge and cubeslice to copy
+/// images which don't fit into memory. The data are split into slabs along one
+/// axis, which are read by a number of threads and written by the calling thread,
+/// so reads and writes of different slabs overlap.
+///
+/// @copyright (c) 2012 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+// System includes
+#include <string>
+#include <vector>
+
+// other 3rd party
+#include <boost/shared_ptr.hpp>
+#include <casacore/casa/Arrays/IPosition.h>
+#include <casacore/images/Images/ImageInterface.h>
+#include <askapparallel/AskapParallel.h>
+
+namespace askap {
+
+/// @brief a part of an input image copied into the output image
+struct ImageSlab {
+    /// @brief index of the input image
+    size_t input;
+    /// @brief bottom left corner in the input image
+    casacore::IPosition blc;
+    /// @brief top right corner (inclusive) in the input image
+    casacore::IPosition trc;
+    /// @brief position of the blc in the output image
+    casacore::IPosition where;
+};
+
+/// @brief interface serialising the writes of several processes into the same output
+/// @details copySlabs calls acquire before each slab is written and release after
+/// it has been written and flushed, both from the calling thread.
+class ISlabWriteGuard {
+public:
+    /// @brief virtual destructor to keep the compiler happy
+    virtual ~ISlabWriteGuard() {}
+
+    /// @brief wait until this process is allowed to write
+    virtual void acquire() = 0;
+
+    /// @brief allow other processes to write
+    virtual void release() = 0;
+};
+
+/// @brief write token passed from rank to rank
+/// @details Several processes writing one casa image share the table files and the lock,
+/// so the writes are serialised by a token, as in linmos-mpi. Each write is a round: every
+/// rank waits for the token from rank-1, writes one slab and passes the token to rank+1.
+/// Ranks may have different numbers of slabs, so those with nothing left to write keep
+/// the token moving until the number of rounds (the largest number of slabs of any rank)
+/// is reached (see finish).
+class SlabWriteToken : public ISlabWriteGuard {
+public:
+    /// @brief constructor
+    /// @param[in] comms communication object
+    /// @param[in] nRounds number of rounds (the same for all ranks)
+    SlabWriteToken(askapparallel::AskapParallel &comms, int nRounds);
+
+    /// @brief wait for the token from the previous rank
+    virtual void acquire();
+
+    /// @brief pass the token to the next rank
+    virtual void release();
+
+    /// @brief take part in the rounds left, without writing
+    void finish();
+
+private:
+    /// @brief communication object
+    askapparallel::AskapParallel &itsComms;
+    /// @brief number of rounds
+    int itsNRounds;
+    /// @brief number of rounds done so far
+    int itsNRoundsDone;
+};
+
+/// @brief number of planes in a slab
+/// @details The slab is made as thick as the memory limit allows. If possible,
+/// its thickness is a multiple of the granularity (e.g. the tile size along the axis),
+/// so different slabs are stored in different tiles of the output.
+/// @param[in] shape shape of the region to copy
+/// @param[in] axis axis the region is split along
+/// @param[in] maxMemory maximum memory in bytes for all slabs held at the same time
+/// @param[in] nBuffers number of slabs held at the same time
+/// @param[in] granularity preferred multiple of the number of planes
+/// @return number of planes in a slab (at least 1)
+int slabDepth(const casacore::IPosition &shape, casacore::uInt axis, size_t maxMemory,
+              int nBuffers, int granularity);
+
+/// @brief split a region of an input image into slabs
+/// @param[in] input index of the input image
+/// @param[in] blc bottom left corner of the region in the input image
+/// @param[in] trc top right corner (inclusive) of the region in the input image
+/// @param[in] where position of the blc in the output image (may have more axes)
+/// @param[in] axis axis to split the region along
+/// @param[in] depth number of planes in a slab
+/// @return slabs covering the region
+std::vector<ImageSlab> makeSlabs(size_t input, const casacore::IPosition &blc,
+                                 const casacore::IPosition &trc, const casacore::IPosition &where,
+                                 casacore::uInt axis, int depth);
+
+/// @brief copy slabs of casa images into the output image
+/// @details Slabs are read by nReaders threads taking the inputs in turn from a shared
+/// counter (an image is only read by one thread). Up to nBuffers slabs are held in memory,
+/// including the slabs being read and the one being written, while the calling thread
+/// writes them to the output in the order they were read. The peak and the sum of each
+/// input are accumulated as the data pass through. casacore is not thread safe, so all
+/// image access (opening the inputs, reads and writes) is serialised by one mutex, only
+/// the copying and the statistics overlap with it.
+/// @param[in] inputs names of the input casa images
+/// @param[in] slabs slabs to copy
+/// @param[in] output output image
+/// @param[in] nReaders number of threads reading the inputs
+/// @param[in] nBuffers maximum number of slabs held in memory (use at least nReaders + 1
+/// for reading to overlap with writing)
+/// @param[out] peaks maximum of each input (only over the copied slabs)
+/// @param[out] sums sum of each input (only over the copied slabs)
+/// @param[in] guard optional serialisation of the writes with other processes writing
+/// the same output
+void copySlabs(const std::vector<std::string> &inputs, const std::vector<ImageSlab> &slabs,
+               casacore::ImageInterface<casacore::Float> &output, int nReaders, int nBuffers,
+               std::vector<float> &peaks, std::vector<double> &sums,
+               const boost::shared_ptr<ISlabWriteGuard> &guard = boost::shared_ptr<ISlabWriteGuard>());
+
+} // namespace askap
+
+#endif
@@ -0,0 +1,51 @@
+/// @file HashUtils.cc
+///
+/// @brief non-cryptographic hash of binary data
+/// @details The FNV-1a hash is used to form keys of the caches of predicted visibilities
+/// and of rotated uvw's. It is fast and good enough to distinguish the data, the keys are
+/// not written anywhere but the cache files created by the same version of the code.
+///
+/// @copyright (c) 2012 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+// own includes
+#include <askap/utils/HashUtils.h>
+
+namespace askap {
+
+/// @brief update FNV-1a hash with the given bytes
+/// @param[in] hash current value of the hash
+/// @param[in] data pointer to the data
+/// @param[in] size number of bytes
+/// @return updated hash
+uint64_t hashBytes(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+         hash ^= bytes[i];
+         hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+} // namespace askap
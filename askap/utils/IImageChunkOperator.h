@@ -0,0 +1,59 @@
+#ifndef ASKAP_UTILS_IIMAGECHUNKOPERATOR_H
+#define ASKAP_UTILS_IIMAGECHUNKOPERATOR_H
+
+/// @file IImageChunkOperator.h
+///
+/// @brief interface of an operation applied to an image chunk by chunk
+/// @details Operations of this type are applied by ImageStreamer to all chunks of
+/// an image. Chunks are processed by several threads at the same time, the index of
+/// the calling thread is passed to allow per-thread accumulation without locking.
+///
+/// @copyright (c) 2012 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+// other 3rd party
+#include <casacore/casa/Arrays/Array.h>
+#include <casacore/casa/Arrays/IPosition.h>
+
+namespace askap {
+
+/// @brief interface of an operation applied to an image chunk by chunk
+class IImageChunkOperator {
+public:
+    /// @brief virtual destructor to keep the compiler happy
+    virtual ~IImageChunkOperator() {}
+
+    /// @brief process one chunk
+    /// @details This method is called from several threads at the same time
+    /// (each with a different chunk and thread index).
+    /// @param[in] chunk pixels of the chunk (contiguous in memory), may be changed
+    /// @param[in] blc position of the chunk in the image
+    /// @param[in] thread index of the calling thread
+    /// @return true if the chunk has been changed and has to be written back
+    virtual bool process(casacore::Array<casacore::Float> &chunk, const casacore::IPosition &blc,
+                         int thread) = 0;
+};
+
+} // namespace askap
+
+#endif
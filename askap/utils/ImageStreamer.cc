@@ -0,0 +1,231 @@
+/// @file ImageStreamer.cc
+///
+/// @brief apply an operation to an image chunk by chunk
+/// @details This class is used by the small image tools (imgstat, imgNaN2zero,
+/// imgscale, maskBadChannels) to process images of any size with bounded memory.
+/// The image (or a region of it) is split into chunks made of whole storage tiles.
+/// Chunks are read, processed and, if changed, written back in place by a number of
+/// threads. Image access is serialised, so reading and writing by one thread
+/// overlaps with processing by the others.
+///
+/// @copyright (c) 2012 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+// Package level header file
+#include "askap/askap_synthesis.h"
+
+// own includes
+#include <askap/utils/ImageStreamer.h>
+
+// System includes
+#include <algorithm>
+
+// other 3rd party
+#include <askap/AskapError.h>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/thread.hpp>
+#include <casacore/casa/Arrays/Array.h>
+#include <casacore/images/Images/ImageOpener.h>
+#include <casacore/lattices/Lattices/TiledShape.h>
+
+// System includes
+#include <limits>
+
+namespace askap {
+
+ImageStreamer::ImageStreamer(accessors::IImageAccess<casacore::Float> &iacc, const std::string &name,
+                             int nThreads, size_t maxMemory) :
+      itsImageAccess(iacc), itsName(name), itsShape(iacc.shape(name)), itsBlc(itsShape.nelements(), 0),
+      itsTrc(itsShape - 1), itsApplyMask(false), itsWholeAxes(itsShape.nelements(), false),
+      itsNThreads(nThreads), itsMaxMemory(maxMemory)
+{
+    ASKAPCHECK(nThreads > 0, "Number of threads should be positive, you have "<<nThreads);
+    ASKAPCHECK(itsShape.nelements() > 0, "Image "<<name<<" has no axes");
+    // the accessor interface doesn't expose the storage layout, so the image is opened
+    // directly (read only) to find its tiles; the default tiling is a fallback for the
+    // images casacore can't open by this name
+    try {
+        casacore::LatticeBase *lattice = casacore::ImageOpener::openImage(name);
+        casacore::ImageInterface<casacore::Float> *image = dynamic_cast<casacore::ImageInterface<casacore::Float>*>(lattice);
+        if (image != NULL) {
+            itsImage.reset(image);
+        } else {
+            delete lattice;
+        }
+    } catch (const std::exception &) {
+        itsImage.reset();
+    }
+    if (itsImage && (itsImage->shape() == itsShape)) {
+        itsTileShape = itsImage->niceCursorShape(std::numeric_limits<casacore::uInt>::max());
+    } else {
+        itsTileShape = casacore::TiledShape(itsShape).tileShape();
+    }
+}
+
+void ImageStreamer::setRegion(const casacore::IPosition &blc, const casacore::IPosition &trc)
+{
+    ASKAPCHECK(blc.nelements() == itsShape.nelements() && trc.nelements() == itsShape.nelements(),
+               "Region "<<blc<<" - "<<trc<<" doesn't match the image shape "<<itsShape);
+    for (casacore::uInt dim = 0; dim < itsShape.nelements(); ++dim) {
+         ASKAPCHECK(blc(dim) >= 0 && blc(dim) <= trc(dim) && trc(dim) < itsShape(dim),
+                    "Region "<<blc<<" - "<<trc<<" is outside the image of shape "<<itsShape);
+    }
+    itsBlc = blc;
+    itsTrc = trc;
+}
+
+void ImageStreamer::keepWhole(casacore::uInt axis)
+{
+    ASKAPCHECK(axis < itsShape.nelements(), "Axis "<<axis<<" doesn't exist in the image of shape "<<itsShape);
+    itsWholeAxes[axis] = true;
+}
+
+bool ImageStreamer::applyMask()
+{
+    ASKAPCHECK(itsImage, "Unable to open "<<itsName<<" to read its pixel mask");
+    itsApplyMask = itsImage->isMasked();
+    return itsApplyMask;
+}
+
+casacore::IPosition ImageStreamer::chunkShape() const
+{
+    const casacore::IPosition regionShape = itsTrc - itsBlc + 1;
+    const casacore::IPosition &tile = itsTileShape;
+    casacore::IPosition chunk(regionShape.nelements());
+    for (casacore::uInt dim = 0; dim < chunk.nelements(); ++dim) {
+         chunk(dim) = itsWholeAxes[dim] ? regionShape(dim) : std::min(tile(dim), regionShape(dim));
+    }
+    // each thread holds up to two chunks (e.g. the one being processed and a copy made by the accessor)
+    const size_t maxElements = std::max(size_t(1), itsMaxMemory / (sizeof(casacore::Float) * 2 * itsNThreads));
+    for (casacore::uInt dim = 0; dim < chunk.nelements(); ++dim) {
+         if (chunk(dim) == regionShape(dim)) {
+             continue;
+         }
+         const size_t others = chunk.product() / chunk(dim);
+         const size_t nTiles = maxElements / (others * chunk(dim));
+         if (nTiles > 1) {
+             chunk(dim) = std::min(size_t(regionShape(dim)), size_t(chunk(dim)) * nTiles);
+         }
+         if (chunk(dim) < regionShape(dim)) {
+             break;
+         }
+    }
+    return chunk;
+}
+
+void ImageStreamer::run(IImageChunkOperator &op)
+{
+    const casacore::IPosition chunk = chunkShape();
+    std::vector<casacore::IPosition> chunks;
+    casacore::IPosition pos(itsBlc);
+    while (true) {
+         chunks.push_back(pos);
+         casacore::uInt dim = 0;
+         for (; dim < pos.nelements(); ++dim) {
+              pos(dim) += chunk(dim);
+              if (pos(dim) <= itsTrc(dim)) {
+                  break;
+              }
+              pos(dim) = itsBlc(dim);
+         }
+         if (dim == pos.nelements()) {
+             break;
+         }
+    }
+
+    size_t nextChunk = 0;
+    const int nThreads = std::min(itsNThreads, int(chunks.size()));
+    std::vector<std::string> errors(nThreads);
+    if (nThreads == 1) {
+        processChunks(op, chunks, chunk, nextChunk, 0, errors[0]);
+    } else {
+        boost::thread_group threads;
+        for (int thread = 0; thread < nThreads; ++thread) {
+             threads.create_thread(boost::bind(&ImageStreamer::processChunks, this, boost::ref(op),
+                      boost::cref(chunks), boost::cref(chunk), boost::ref(nextChunk), thread,
+                      boost::ref(errors[thread])));
+        }
+        threads.join_all();
+    }
+    for (int thread = 0; thread < nThreads; ++thread) {
+         ASKAPCHECK(errors[thread].empty(), "Error processing "<<itsName<<" in thread "<<thread<<": "<<errors[thread]);
+    }
+}
+
+void ImageStreamer::processChunks(IImageChunkOperator &op, const std::vector<casacore::IPosition> &chunks,
+                                  const casacore::IPosition &shape, size_t &nextChunk, int thread,
+                                  std::string &error)
+{
+    try {
+        while (true) {
+            size_t index;
+            {
+                boost::lock_guard<boost::mutex> lock(itsChunkMutex);
+                if (nextChunk >= chunks.size()) {
+                    break;
+                }
+                index = nextChunk++;
+            }
+            const casacore::IPosition &blc = chunks[index];
+            casacore::IPosition trc(blc + shape - 1);
+            for (casacore::uInt dim = 0; dim < trc.nelements(); ++dim) {
+                 trc(dim) = std::min(trc(dim), itsTrc(dim));
+            }
+            casacore::Array<casacore::Float> buf;
+            casacore::Array<casacore::Bool> mask;
+            {
+                boost::lock_guard<boost::mutex> lock(itsIOMutex);
+                buf = itsImageAccess.read(itsName, blc, trc);
+                if (itsApplyMask) {
+                    mask = itsImage->getMaskSlice(blc, trc - blc + 1);
+                }
+            }
+            if (!buf.contiguousStorage()) {
+                casacore::Array<casacore::Float> contiguousBuf = buf.copy();
+                buf.reference(contiguousBuf);
+            }
+            if (itsApplyMask) {
+                ASKAPDEBUGASSERT(mask.shape() == buf.shape());
+                casacore::Float *data = buf.data();
+                bool deleteIt = false;
+                const casacore::Bool *good = mask.getStorage(deleteIt);
+                for (size_t i = 0; i < buf.nelements(); ++i) {
+                     if (!good[i]) {
+                         data[i] = std::numeric_limits<casacore::Float>::quiet_NaN();
+                     }
+                }
+                mask.freeStorage(good, deleteIt);
+            }
+            if (op.process(buf, blc, thread)) {
+                ASKAPCHECK(!itsApplyMask, "Chunks with masked pixels replaced by NaNs can't be written back");
+                boost::lock_guard<boost::mutex> lock(itsIOMutex);
+                itsImageAccess.write(itsName, buf, blc);
+            }
+        }
+    } catch (const std::exception &ex) {
+        error = ex.what();
+    }
+}
+
+} // namespace askap
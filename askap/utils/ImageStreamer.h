@@ -0,0 +1,159 @@
+#ifndef ASKAP_UTILS_IMAGESTREAMER_H
+#define ASKAP_UTILS_IMAGESTREAMER_H
+
+/// @file ImageStreamer.h
+///
+/// @brief apply an operation to an image chunk by chunk
+/// @details This class is used by the small image tools (imgstat, imgNaN2zero,
+/// imgscale, maskBadChannels) to process images of any size with bounded memory.
+/// The image (or a region of it) is split into chunks made of whole storage tiles
+/// (the tile shape is taken from the image on disk if it can be opened by casacore,
+/// otherwise the default tiling of the image shape is assumed). Chunks are read,
+/// processed and, if changed, written back in place by a number of threads. Image
+/// access is serialised, so reading and writing by one thread overlaps with
+/// processing by the others.
+///
+/// @copyright (c) 2012 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+// System includes
+#include <string>
+#include <vector>
+
+// other 3rd party
+#include <boost/thread/mutex.hpp>
+#include <boost/shared_ptr.hpp>
+#include <casacore/casa/Arrays/IPosition.h>
+#include <casacore/images/Images/ImageInterface.h>
+
+// Local packages includes
+#include <askap/imageaccess/IImageAccess.h>
+#include <askap/utils/IImageChunkOperator.h>
+
+namespace askap {
+
+/// @brief apply an operation to an image chunk by chunk
+class ImageStreamer {
+public:
+    /// @brief constructor
+    /// @param[in] iacc image accessor
+    /// @param[in] name image name
+    /// @param[in] nThreads number of threads processing chunks
+    /// @param[in] maxMemory maximum memory in bytes used by all chunks held at the same time
+    ImageStreamer(accessors::IImageAccess<casacore::Float> &iacc, const std::string &name,
+                  int nThreads = 1, size_t maxMemory = 1024 * 1024 * 1024);
+
+    /// @brief restrict processing to a region
+    /// @param[in] blc bottom left corner of the region
+    /// @param[in] trc top right corner (inclusive) of the region
+    void setRegion(const casacore::IPosition &blc, const casacore::IPosition &trc);
+
+    /// @brief make chunks contain the whole length of an axis
+    /// @details This is used for operations which need e.g. whole spectra or whole planes.
+    /// @param[in] axis axis to keep whole
+    void keepWhole(casacore::uInt axis);
+
+    /// @brief pass masked pixels to the operation as NaNs
+    /// @details The pixel mask of the image (if any) is read together with each chunk
+    /// and the pixels which are masked out are replaced by NaNs, which all operations
+    /// ignore. This is only allowed for operations which don't write the chunks back.
+    /// @return true if the image has a pixel mask
+    bool applyMask();
+
+    /// @brief shape of the image
+    /// @return shape of the whole image
+    inline const casacore::IPosition& shape() const { return itsShape; }
+
+    /// @brief number of threads
+    /// @return number of threads processing chunks
+    inline int nThreads() const { return itsNThreads; }
+
+    /// @brief shape of the chunks
+    /// @details Chunks are made of whole storage tiles and are extended along the
+    /// axes (starting from the first one) as far as the memory limit allows.
+    /// If the image can't be opened directly, the default tiling of the image
+    /// shape is used instead of the actual storage tiles.
+    /// Chunks at the edges of the region may be smaller.
+    /// @return shape of a chunk
+    casacore::IPosition chunkShape() const;
+
+    /// @brief apply an operation to all chunks of the region
+    /// @param[in] op operation
+    void run(IImageChunkOperator &op);
+
+private:
+    /// @brief thread processing chunks
+    /// @param[in] op operation
+    /// @param[in] chunks bottom left corners of all chunks
+    /// @param[in] shape shape of a chunk
+    /// @param[in] nextChunk index of the next chunk to process (shared between threads)
+    /// @param[in] thread index of this thread
+    /// @param[out] error error message (empty if successful)
+    void processChunks(IImageChunkOperator &op, const std::vector<casacore::IPosition> &chunks,
+                       const casacore::IPosition &shape, size_t &nextChunk, int thread,
+                       std::string &error);
+
+    /// @brief image accessor
+    accessors::IImageAccess<casacore::Float> &itsImageAccess;
+
+    /// @brief image name
+    std::string itsName;
+
+    /// @brief shape of the image
+    casacore::IPosition itsShape;
+
+    /// @brief bottom left corner of the region
+    casacore::IPosition itsBlc;
+
+    /// @brief top right corner of the region
+    casacore::IPosition itsTrc;
+
+    /// @brief image opened directly to get the storage tiles and the pixel mask
+    /// @details This is an empty pointer if casacore can't open the image by name.
+    boost::shared_ptr<casacore::ImageInterface<casacore::Float> > itsImage;
+
+    /// @brief shape of the storage tiles
+    casacore::IPosition itsTileShape;
+
+    /// @brief true if masked pixels are replaced by NaNs
+    bool itsApplyMask;
+
+    /// @brief true for axes kept whole in the chunks
+    std::vector<bool> itsWholeAxes;
+
+    /// @brief number of threads
+    int itsNThreads;
+
+    /// @brief maximum memory in bytes
+    size_t itsMaxMemory;
+
+    /// @brief mutex protecting the chunk counter
+    boost::mutex itsChunkMutex;
+
+    /// @brief mutex serialising the image access
+    boost::mutex itsIOMutex;
+};
+
+} // namespace askap
+
+#endif
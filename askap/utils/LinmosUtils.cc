@@ -36,6 +36,9 @@
 #include <sstream>
 #include <typeinfo>
 #include <iostream>
+#include <algorithm>
+#include <map>
+#include <cmath>
 
 // other 3rd party
 #include <Common/ParameterSet.h>
@@ -45,7 +48,11 @@
 #include <boost/algorithm/string.hpp>
 #include <casacore/casa/Arrays/Array.h>
 #include <casacore/casa/IO.h>
+#include <casacore/casa/Arrays/IPosition.h>
+#include <casacore/lattices/Lattices/TiledShape.h>
 #include <casacore/coordinates/Coordinates/Coordinate.h>
+#include <casacore/coordinates/Coordinates/CoordinateSystem.h>
+#include <casacore/coordinates/Coordinates/DirectionCoordinate.h>
 #include <casacore/images/Images/ImageRegrid.h>
 
 // Local packages includes
@@ -176,5 +183,170 @@ Vector<MVDirection> loadBeamCentres(const LOFAR::ParameterSet &parset,
 
 }
 
+/// @brief number of consecutive channels sharing storage in the output cube
+/// @details Channel slabs starting at a multiple of this number don't share storage
+/// units (tiles for casa images, 2880-byte records for FITS) with other slabs, so they
+/// can be written by different processes at the same time.
+/// @param[in] imageType image type ("casa" or "fits")
+/// @param[in] shape shape of the output cube (spectral axis is the fourth one)
+/// @return number of channels per storage unit
+int channelWriteGranularity(const std::string &imageType, const casacore::IPosition &shape) {
+    ASKAPCHECK(shape.nelements() >= 4, "Expect at least 4-dimensional cubes, shape = "<<shape);
+    if (imageType == "fits") {
+        // the data start at a record boundary, planes are aligned if the slab size
+        // is a multiple of the record size
+        const size_t recordSize = 2880;
+        size_t a = recordSize;
+        size_t b = sizeof(float) * shape(0) * shape(1) * shape(2);
+        while (b != 0) {
+               const size_t t = a % b;
+               a = b;
+               b = t;
+        }
+        return recordSize / a;
+    }
+    // casa images are created with the default tile shape
+    const int depth = casacore::TiledShape(shape).tileShape()(3);
+    return depth > 1 ? depth : 1;
+}
+
+/// @brief balanced allocation of channels to ranks
+/// @details Channels are given out in contiguous slabs of whole storage units (see
+/// channelWriteGranularity), the number of units per rank differs by at most one.
+/// Ranks left without work get an empty allocation.
+/// @param[in] nChan total number of channels
+/// @param[in] nRanks number of ranks sharing the work
+/// @param[in] rank rank to get the allocation for
+/// @param[in] granularity number of channels per storage unit
+/// @param[out] start first channel of the allocation
+/// @param[out] size number of channels in the allocation
+void allocateChannels(int nChan, int nRanks, int rank, int granularity, int &start, int &size) {
+    ASKAPCHECK(nRanks > 0, "Number of ranks should be positive");
+    ASKAPCHECK((rank >= 0) && (rank < nRanks), "Rank "<<rank<<" is outside [0,"<<nRanks<<")");
+    ASKAPCHECK(granularity > 0, "Granularity should be positive");
+    const int nUnits = (nChan + granularity - 1) / granularity;
+    const int unitsPerRank = nUnits / nRanks;
+    const int remainder = nUnits % nRanks;
+    const int firstUnit = rank * unitsPerRank + std::min(rank, remainder);
+    const int nMyUnits = unitsPerRank + (rank < remainder ? 1 : 0);
+    start = std::min(nChan, firstUnit * granularity);
+    size = std::min(nChan, (firstUnit + nMyUnits) * granularity) - start;
+}
+
+/// @brief find which Taylor term an image name refers to
+/// @param[in] name image name
+/// @param[in] nTerms number of Taylor terms
+/// @return index of the first "taylor.N" (N < nTerms) found in the name or -1 if there is none
+int taylorTermIndex(const std::string &name, int nTerms) {
+    for (int n = 0; n < nTerms; ++n) {
+         const string taylorN = "taylor." + boost::lexical_cast<string>(n);
+         if (name.find(taylorN) != string::npos) {
+             return n;
+         }
+    }
+    return -1;
+}
+
+/// @brief name of another Taylor term of the same image
+/// @param[in] name image name containing "taylor.N" for the given term
+/// @param[in] term Taylor term the name refers to
+/// @param[in] newTerm Taylor term to get the name for
+/// @return image name with "taylor.term" replaced by "taylor.newTerm"
+std::string taylorTermName(const std::string &name, int term, int newTerm) {
+    const string taylorN = "taylor." + boost::lexical_cast<string>(term);
+    const size_t pos = name.find(taylorN);
+    ASKAPCHECK(pos != string::npos, "Image name "<<name<<" doesn't contain "<<taylorN);
+    string result(name);
+    result.replace(pos, taylorN.length(), "taylor." + boost::lexical_cast<string>(newTerm));
+    return result;
+}
+
+/// @brief group the mosaics of different Taylor terms of the same field
+/// @details Mosaics whose names differ only in the Taylor term (see taylorTermIndex) are
+/// put into the same group, so they can be built together. Other mosaics form groups of
+/// their own. If nTerms is zero, every mosaic is a group of its own.
+/// @param[in] outImgNames names of the output mosaics
+/// @param[in] nTerms number of Taylor terms
+/// @return groups of mosaic names
+std::vector<std::vector<std::string> > groupTaylorMosaics(const std::vector<std::string> &outImgNames, int nTerms) {
+    std::vector<std::vector<std::string> > groups;
+    // index of the group for each name with the Taylor term replaced by term 0
+    std::map<std::string, size_t> groupIndex;
+    for (std::vector<std::string>::const_iterator ci = outImgNames.begin(); ci != outImgNames.end(); ++ci) {
+         const int term = taylorTermIndex(*ci, nTerms);
+         if (term < 0) {
+             groups.push_back(std::vector<std::string>(1, *ci));
+             continue;
+         }
+         const std::string key = taylorTermName(*ci, term, 0);
+         const std::map<std::string, size_t>::const_iterator it = groupIndex.find(key);
+         if (it == groupIndex.end()) {
+             groupIndex[key] = groups.size();
+             groups.push_back(std::vector<std::string>(1, *ci));
+         } else {
+             groups[it->second].push_back(*ci);
+         }
+    }
+    return groups;
+}
+
+/// @brief find the part of an input image overlapping a tile of the output
+/// @details Points along the border of the tile are converted to the pixel coordinates of
+/// the input image, the bounding box of these points is extended by a margin for the
+/// interpolation and clipped to the input image. Only the direction axes (the first two)
+/// are changed, the other axes of inBlc and inTrc are left as given.
+/// @param[in] tileCoordSys coordinate system of the tile
+/// @param[in] tileShape shape of the tile
+/// @param[in] inCoordSys coordinate system of the input image
+/// @param[in] inShape shape of the input image
+/// @param[in,out] inBlc bottom left corner of the overlapping part of the input image
+/// @param[in,out] inTrc top right corner (inclusive) of the overlapping part of the input image
+/// @return false if the input image doesn't overlap with the tile
+bool overlappingRegion(const casacore::CoordinateSystem &tileCoordSys, const casacore::IPosition &tileShape,
+                       const casacore::CoordinateSystem &inCoordSys, const casacore::IPosition &inShape,
+                       casacore::IPosition &inBlc, casacore::IPosition &inTrc) {
+    ASKAPDEBUGASSERT(tileShape.nelements() >= 2);
+    ASKAPDEBUGASSERT(inShape.nelements() >= 2);
+    const DirectionCoordinate tileDC = tileCoordSys.directionCoordinate(tileCoordSys.findCoordinate(Coordinate::DIRECTION));
+    const DirectionCoordinate inDC = inCoordSys.directionCoordinate(inCoordSys.findCoordinate(Coordinate::DIRECTION));
+    // extra pixels for the interpolation kernel of the regridder
+    const double margin = 3.;
+    // number of points per edge of the tile, enough to follow the curvature of the projection
+    const int nSteps = 16;
+    double xMin = inShape(0), xMax = -1., yMin = inShape(1), yMax = -1.;
+    casacore::Vector<casacore::Double> pixel(2);
+    casacore::Vector<casacore::Double> inPixel(2);
+    casacore::MVDirection world;
+    for (int edge = 0; edge < 4; ++edge) {
+         for (int step = 0; step <= nSteps; ++step) {
+              const double frac = double(step) / nSteps;
+              // edges of the pixel area, i.e. half a pixel outside the pixel centres
+              const double x = -0.5 + frac * tileShape(0);
+              const double y = -0.5 + frac * tileShape(1);
+              pixel(0) = (edge == 0) ? -0.5 : ((edge == 1) ? tileShape(0) - 0.5 : x);
+              pixel(1) = (edge < 2) ? y : ((edge == 2) ? -0.5 : tileShape(1) - 0.5);
+              if (!tileDC.toWorld(world, pixel) || !inDC.toPixel(inPixel, world)) {
+                  continue;
+              }
+              xMin = std::min(xMin, inPixel(0));
+              xMax = std::max(xMax, inPixel(0));
+              yMin = std::min(yMin, inPixel(1));
+              yMax = std::max(yMax, inPixel(1));
+         }
+    }
+    const int blcX = std::max(0, int(floor(xMin - margin)));
+    const int blcY = std::max(0, int(floor(yMin - margin)));
+    const int trcX = std::min(int(inShape(0)) - 1, int(ceil(xMax + margin)));
+    const int trcY = std::min(int(inShape(1)) - 1, int(ceil(yMax + margin)));
+    if ((blcX > trcX) || (blcY > trcY)) {
+        return false;
+    }
+    inBlc(0) = blcX;
+    inBlc(1) = blcY;
+    inTrc(0) = trcX;
+    inTrc(1) = trcY;
+    return true;
+}
+
 } // namespace askap
 
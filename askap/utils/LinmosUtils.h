@@ -31,8 +31,12 @@
 ///
 /// @author Max Voronkov <maxim.voronkov@csiro.au>
 /// @author Daniel Mitchell <daniel.mitchell@csiro.au>
-// other 3rd party
 
+// System includes
+#include <string>
+#include <vector>
+
+// other 3rd party
 #include <Common/ParameterSet.h>
 #include <boost/shared_ptr.hpp>
 #include <boost/lexical_cast.hpp>
@@ -40,6 +44,7 @@
 #include <boost/algorithm/string.hpp>
 #include <casacore/casa/Arrays/Array.h>
 #include <casacore/coordinates/Coordinates/Coordinate.h>
+#include <casacore/coordinates/Coordinates/CoordinateSystem.h>
 #include <casacore/images/Images/ImageRegrid.h>
 
 // Local packages includes
@@ -73,6 +78,65 @@ Vector<MVDirection> loadBeamCentres(const LOFAR::ParameterSet &parset,
                                     const accessors::IImageAccess<casacore::Float> &iacc,
                                     const vector<string> &inImgNames);
 
+/// @brief number of consecutive channels sharing storage in the output cube
+/// @details Channel slabs starting at a multiple of this number don't share storage
+/// units (tiles for casa images, 2880-byte records for FITS) with other slabs, so they
+/// can be written by different processes at the same time.
+/// @param[in] imageType image type ("casa" or "fits")
+/// @param[in] shape shape of the output cube (spectral axis is the fourth one)
+/// @return number of channels per storage unit
+int channelWriteGranularity(const std::string &imageType, const casacore::IPosition &shape);
+
+/// @brief balanced allocation of channels to ranks
+/// @details Channels are given out in contiguous slabs of whole storage units (see
+/// channelWriteGranularity), the number of units per rank differs by at most one.
+/// Ranks left without work get an empty allocation.
+/// @param[in] nChan total number of channels
+/// @param[in] nRanks number of ranks sharing the work
+/// @param[in] rank rank to get the allocation for
+/// @param[in] granularity number of channels per storage unit
+/// @param[out] start first channel of the allocation
+/// @param[out] size number of channels in the allocation
+void allocateChannels(int nChan, int nRanks, int rank, int granularity, int &start, int &size);
+
+/// @brief find which Taylor term an image name refers to
+/// @param[in] name image name
+/// @param[in] nTerms number of Taylor terms
+/// @return index of the first "taylor.N" (N < nTerms) found in the name or -1 if there is none
+int taylorTermIndex(const std::string &name, int nTerms);
+
+/// @brief name of another Taylor term of the same image
+/// @param[in] name image name containing "taylor.N" for the given term
+/// @param[in] term Taylor term the name refers to
+/// @param[in] newTerm Taylor term to get the name for
+/// @return image name with "taylor.term" replaced by "taylor.newTerm"
+std::string taylorTermName(const std::string &name, int term, int newTerm);
+
+/// @brief group the mosaics of different Taylor terms of the same field
+/// @details Mosaics whose names differ only in the Taylor term (see taylorTermIndex) are
+/// put into the same group, so they can be built together. Other mosaics form groups of
+/// their own. If nTerms is zero, every mosaic is a group of its own.
+/// @param[in] outImgNames names of the output mosaics
+/// @param[in] nTerms number of Taylor terms
+/// @return groups of mosaic names
+std::vector<std::vector<std::string> > groupTaylorMosaics(const std::vector<std::string> &outImgNames, int nTerms);
+
+/// @brief find the part of an input image overlapping a tile of the output
+/// @details Points along the border of the tile are converted to the pixel coordinates of
+/// the input image, the bounding box of these points is extended by a margin for the
+/// interpolation and clipped to the input image. Only the direction axes (the first two)
+/// are changed, the other axes of inBlc and inTrc are left as given.
+/// @param[in] tileCoordSys coordinate system of the tile
+/// @param[in] tileShape shape of the tile
+/// @param[in] inCoordSys coordinate system of the input image
+/// @param[in] inShape shape of the input image
+/// @param[in,out] inBlc bottom left corner of the overlapping part of the input image
+/// @param[in,out] inTrc top right corner (inclusive) of the overlapping part of the input image
+/// @return false if the input image doesn't overlap with the tile
+bool overlappingRegion(const casacore::CoordinateSystem &tileCoordSys, const casacore::IPosition &tileShape,
+                       const casacore::CoordinateSystem &inCoordSys, const casacore::IPosition &inShape,
+                       casacore::IPosition &inBlc, casacore::IPosition &inTrc);
+
 } // namespace askap
 
 #endif
@@ -0,0 +1,106 @@
+/// @file MSUtils.cc
+///
+/// @brief helpers to split measurement sets between beams
+/// @details These utilities are used by the applications which distribute the beams of
+/// one dataset between ranks (e.g. ccalapply and ccontsubtract with splitbeams).
+///
+/// @copyright (c) 2012 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+// Package level header file
+#include "askap/askap_synthesis.h"
+
+// own includes
+#include <askap/utils/MSUtils.h>
+
+// System includes
+#include <iomanip>
+#include <sstream>
+
+// other 3rd party
+#include <askap/AskapError.h>
+#include <askap/AskapLogging.h>
+#include <casacore/casa/Arrays/ArrayMath.h>
+#include <casacore/tables/Tables/Table.h>
+#include <casacore/tables/Tables/TableRecord.h>
+#include <casacore/tables/Tables/ScalarColumn.h>
+#include <casacore/tables/TaQL/ExprNode.h>
+
+ASKAP_LOGGER(logger, ".msutils");
+
+namespace askap {
+
+/// @brief obtain the number of beams in the dataset
+/// @details The number of beams is one more than the largest feed ID in the FEED subtable.
+/// @param[in] ms measurement set name
+/// @return number of beams
+casacore::uInt nBeamsInDataset(const std::string &ms)
+{
+    const casacore::Table msTable(ms);
+    const casacore::Table feedTable = msTable.keywordSet().asTable("FEED");
+    ASKAPCHECK(feedTable.nrow() > 0, "FEED subtable of "<<ms<<" is empty");
+    const casacore::ROScalarColumn<casacore::Int> feedIDs(feedTable, "FEED_ID");
+    const casacore::Int maxFeedID = casacore::max(feedIDs.getColumn());
+    ASKAPCHECK(maxFeedID >= 0, "Unexpected feed ID "<<maxFeedID<<" in "<<ms);
+    return static_cast<casacore::uInt>(maxFeedID) + 1;
+}
+
+/// @brief form the name of a per-beam dataset
+/// @details All occurrences of %b in the pattern are replaced by the two-digit beam number
+/// (e.g. beam%b.ms gives beam07.ms for beam 7).
+/// @param[in] pattern name with the %b placeholder
+/// @param[in] beam beam number
+/// @return name of the dataset for the given beam
+std::string beamDatasetName(const std::string &pattern, casacore::uInt beam)
+{
+    ASKAPCHECK(pattern.find("%b") != std::string::npos, "Dataset name "<<pattern<<
+               " should contain %b to be replaced by the beam number");
+    std::ostringstream os;
+    os<<std::setw(2)<<std::setfill('0')<<beam;
+    std::string result(pattern);
+    for (size_t pos = result.find("%b"); pos != std::string::npos; pos = result.find("%b", pos)) {
+         result.replace(pos, 2, os.str());
+    }
+    return result;
+}
+
+/// @brief copy one beam of the dataset into a new measurement set
+/// @details All rows with FEED1 equal to the given beam are copied together with all subtables.
+/// The output is created from scratch, an existing table of the same name is overwritten.
+/// Several processes can copy different beams of the same dataset at the same time, as the
+/// input is only read.
+/// @param[in] ms input measurement set name
+/// @param[in] beam beam to copy
+/// @param[in] out output measurement set name
+void copyBeam(const std::string &ms, casacore::uInt beam, const std::string &out)
+{
+    ASKAPCHECK(ms != out, "Beam "<<beam<<" can't be copied into the input dataset "<<ms);
+    const casacore::Table msTable(ms);
+    const casacore::Table selection = msTable(msTable.col("FEED1") == static_cast<casacore::Int>(beam));
+    ASKAPCHECK(selection.nrow() > 0, "No data found for beam "<<beam<<" in "<<ms);
+    ASKAPLOG_INFO_STR(logger, "Copying "<<selection.nrow()<<" rows of beam "<<beam<<" from "<<ms<<" to "<<out);
+    // the reference table is written as a plain table with the values of the selected rows
+    selection.deepCopy(out, casacore::Table::New, casacore::True);
+}
+
+} // namespace askap
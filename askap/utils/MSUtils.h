@@ -0,0 +1,67 @@
+#ifndef ASKAP_UTILS_MSUTILS_H
+#define ASKAP_UTILS_MSUTILS_H
+
+/// @file MSUtils.h
+///
+/// @brief helpers to split measurement sets between beams
+/// @details These utilities are used by the applications which distribute the beams of
+/// one dataset between ranks (e.g. ccalapply and ccontsubtract with splitbeams).
+///
+/// @copyright (c) 2012 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+// System includes
+#include <string>
+
+// other 3rd party
+#include <casacore/casa/aipstype.h>
+
+namespace askap {
+
+/// @brief obtain the number of beams in the dataset
+/// @details The number of beams is one more than the largest feed ID in the FEED subtable.
+/// @param[in] ms measurement set name
+/// @return number of beams
+casacore::uInt nBeamsInDataset(const std::string &ms);
+
+/// @brief form the name of a per-beam dataset
+/// @details All occurrences of %b in the pattern are replaced by the two-digit beam number
+/// (e.g. beam%b.ms gives beam07.ms for beam 7).
+/// @param[in] pattern name with the %b placeholder
+/// @param[in] beam beam number
+/// @return name of the dataset for the given beam
+std::string beamDatasetName(const std::string &pattern, casacore::uInt beam);
+
+/// @brief copy one beam of the dataset into a new measurement set
+/// @details All rows with FEED1 equal to the given beam are copied together with all subtables.
+/// The output is created from scratch, an existing table of the same name is overwritten.
+/// Several processes can copy different beams of the same dataset at the same time, as the
+/// input is only read.
+/// @param[in] ms input measurement set name
+/// @param[in] beam beam to copy
+/// @param[in] out output measurement set name
+void copyBeam(const std::string &ms, casacore::uInt beam, const std::string &out);
+
+} // namespace askap
+
+#endif // #ifndef ASKAP_UTILS_MSUTILS_H
@@ -0,0 +1,436 @@
+/// @file SpectralBaselineFitter.cc
+///
+/// @brief robust polynomial fit of the continuum for many spectra at once
+/// @details This class is used by imcontsub to subtract the continuum from every
+/// spectrum of a cube. The polynomial basis is the same for all spectra, so the normal
+/// matrix of the unmasked fit and its inverse are computed once. The spectra are
+/// processed in blocks: the right hand sides of all spectra in a block are obtained
+/// by a single matrix product, and only spectra with masked channels need their
+/// normal matrix updated and solved separately. Blocks can be processed in parallel.
+///
+/// @copyright (c) 2019 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+// Package level header file
+#include "askap/askap_synthesis.h"
+
+// own includes
+#include <askap/utils/SpectralBaselineFitter.h>
+
+// System includes
+#include <algorithm>
+#include <cmath>
+
+// other 3rd party
+#include <askap/AskapError.h>
+#include <boost/bind.hpp>
+#include <boost/ref.hpp>
+#include <boost/thread/thread.hpp>
+#include <casacore/casa/BasicMath/Math.h>
+
+namespace askap {
+
+namespace {
+
+/// @brief fractile of a set of values
+/// @details The same element is selected as by casacore's fractile. The order of
+/// the values is changed.
+/// @param[in] values values (not empty)
+/// @param[in] fraction fraction between 0 and 1
+/// @return fractile
+float fractile(std::vector<float> &values, float fraction) {
+    ASKAPDEBUGASSERT(values.size() > 0);
+    const size_t pos = size_t((values.size() - 1) * fraction + 0.01);
+    std::nth_element(values.begin(), values.begin() + pos, values.end());
+    return values[pos];
+}
+
+} // anonymous namespace
+
+SpectralBaselineFitter::SpectralBaselineFitter(casacore::uInt nChan, int order, float threshold, int nIter) :
+      itsNChan(nChan), itsNTerms(std::min(order + 1, int(nChan))), itsThreshold(threshold), itsNIter(nIter)
+{
+    ASKAPCHECK(nChan > 0, "Spectra should have at least one channel");
+    ASKAPCHECK(order >= 0, "Polynomial order should not be negative, you have "<<order);
+    ASKAPCHECK(nIter > 0, "Number of clipping iterations should be positive, you have "<<nIter);
+
+    const int k = itsNTerms;
+    itsBasis.resize(size_t(nChan) * k);
+    itsNormal.assign(k * k, 0.);
+    for (casacore::uInt chan = 0; chan < nChan; ++chan) {
+         const double t = nChan > 1 ? 2. * chan / (nChan - 1) - 1. : 0.;
+         double *p = &itsBasis[size_t(chan) * k];
+         p[0] = 1.;
+         for (int j = 1; j < k; ++j) {
+              p[j] = p[j - 1] * t;
+         }
+         for (int i = 0; i < k; ++i) {
+              for (int j = 0; j < k; ++j) {
+                   itsNormal[i * k + j] += p[i] * p[j];
+              }
+         }
+    }
+
+    // the inverse is used for all spectra without masked channels
+    itsInverse.assign(k * k, 0.);
+    std::vector<double> unit(k), column(k);
+    for (int j = 0; j < k; ++j) {
+         std::vector<double> normal(itsNormal);
+         std::fill(unit.begin(), unit.end(), 0.);
+         unit[j] = 1.;
+         solve(normal, &unit[0], &column[0], k);
+         for (int i = 0; i < k; ++i) {
+              itsInverse[i * k + j] = column[i];
+         }
+    }
+}
+
+void SpectralBaselineFitter::subtract(casacore::Cube<casacore::Float> &cube, int nThreads,
+                                      casacore::uInt blockSize) const
+{
+    ASKAPCHECK(cube.shape()(2) == int(itsNChan), "Cube has "<<cube.shape()(2)<<
+               " channels, the fitter is set up for "<<itsNChan);
+    ASKAPCHECK(cube.contiguousStorage(), "Cube is expected to be contiguous in memory");
+    ASKAPCHECK(nThreads > 0, "Number of threads should be positive");
+    ASKAPCHECK(blockSize > 0, "Block size should be positive");
+    const size_t nSpec = size_t(cube.shape()(0)) * cube.shape()(1);
+    float *data = cube.data();
+    size_t nextBlock = 0;
+    boost::mutex mutex;
+    if (nThreads == 1) {
+        std::string error;
+        subtractBlocks(data, nSpec, blockSize, nextBlock, mutex, error);
+        ASKAPCHECK(error.empty(), "Error fitting the spectra: "<<error);
+        return;
+    }
+    std::vector<std::string> errors(nThreads);
+    boost::thread_group threads;
+    for (int thread = 0; thread < nThreads; ++thread) {
+         threads.create_thread(boost::bind(&SpectralBaselineFitter::subtractBlocks, this, data, nSpec,
+                  blockSize, boost::ref(nextBlock), boost::ref(mutex), boost::ref(errors[thread])));
+    }
+    threads.join_all();
+    for (int thread = 0; thread < nThreads; ++thread) {
+         ASKAPCHECK(errors[thread].empty(), "Error fitting the spectra in thread "<<thread<<": "<<errors[thread]);
+    }
+}
+
+void SpectralBaselineFitter::subtractBlocks(float *data, size_t nSpec, casacore::uInt blockSize,
+                                            size_t &nextBlock, boost::mutex &mutex, std::string &error) const
+{
+    try {
+        std::vector<float> buf;
+        while (true) {
+            size_t start;
+            {
+                boost::lock_guard<boost::mutex> lock(mutex);
+                start = nextBlock * blockSize;
+                if (start >= nSpec) {
+                    break;
+                }
+                ++nextBlock;
+            }
+            // copy the block, so the spectra are contiguous for each channel
+            const casacore::uInt nBlockSpec = std::min(size_t(blockSize), nSpec - start);
+            buf.resize(size_t(itsNChan) * nBlockSpec);
+            for (casacore::uInt chan = 0; chan < itsNChan; ++chan) {
+                 const float *src = data + chan * nSpec + start;
+                 std::copy(src, src + nBlockSpec, buf.begin() + size_t(chan) * nBlockSpec);
+            }
+            subtractBlock(&buf[0], nBlockSpec);
+            for (casacore::uInt chan = 0; chan < itsNChan; ++chan) {
+                 const std::vector<float>::const_iterator src = buf.begin() + size_t(chan) * nBlockSpec;
+                 std::copy(src, src + nBlockSpec, data + chan * nSpec + start);
+            }
+        }
+    } catch (const std::exception &ex) {
+        error = ex.what();
+    }
+}
+
+void SpectralBaselineFitter::subtractBlock(float *data, casacore::uInt nSpec) const
+{
+    const casacore::uInt n = itsNChan;
+    const int k = itsNTerms;
+    std::vector<float> spec(n);
+    std::vector<float> work;
+    work.reserve(n);
+    std::vector<bool> mask(n);
+    // data with the masked channels set to zero
+    std::vector<float> masked(size_t(n) * nSpec);
+    std::vector<double> normals(size_t(nSpec) * k * k);
+    std::vector<int> nTerms(nSpec);
+    std::vector<bool> fullMask(nSpec);
+    std::vector<double> rhs(size_t(k) * nSpec);
+    std::vector<double> coeffs(size_t(k) * nSpec, 0.);
+    std::vector<double> specRhs(k), specCoeffs(k), normal(k * k);
+
+    for (int iter = 0; iter < itsNIter; ++iter) {
+         // masks and normal matrices of individual spectra
+         for (casacore::uInt spc = 0; spc < nSpec; ++spc) {
+              for (casacore::uInt chan = 0; chan < n; ++chan) {
+                   spec[chan] = data[size_t(chan) * nSpec + spc];
+              }
+              if (iter == 0) {
+                  lineMask(spec, mask, work);
+              } else {
+                  for (casacore::uInt chan = 0; chan < n; ++chan) {
+                       const double *p = &itsBasis[size_t(chan) * k];
+                       double model = 0.;
+                       for (int j = 0; j < k; ++j) {
+                            model += p[j] * coeffs[size_t(j) * nSpec + spc];
+                       }
+                       spec[chan] -= model;
+                  }
+                  clipMask(spec, mask, work);
+              }
+              casacore::uInt nGood = 0;
+              for (casacore::uInt chan = 0; chan < n; ++chan) {
+                   const size_t index = size_t(chan) * nSpec + spc;
+                   if (mask[chan]) {
+                       masked[index] = data[index];
+                       ++nGood;
+                   } else {
+                       masked[index] = 0.;
+                   }
+              }
+              fullMask[spc] = (nGood == n);
+              nTerms[spc] = std::min(k, int(nGood));
+              if (fullMask[spc]) {
+                  continue;
+              }
+              // downdate the full normal matrix if only a few channels are masked,
+              // otherwise build it from the unmasked channels
+              double *nm = &normals[size_t(spc) * k * k];
+              const bool downdate = (n - nGood <= nGood);
+              if (downdate) {
+                  std::copy(itsNormal.begin(), itsNormal.end(), nm);
+              } else {
+                  std::fill(nm, nm + k * k, 0.);
+              }
+              for (casacore::uInt chan = 0; chan < n; ++chan) {
+                   if (mask[chan] != downdate) {
+                       const double *p = &itsBasis[size_t(chan) * k];
+                       const double sign = downdate ? -1. : 1.;
+                       for (int i = 0; i < k; ++i) {
+                            for (int j = 0; j < k; ++j) {
+                                 nm[i * k + j] += sign * p[i] * p[j];
+                            }
+                       }
+                   }
+              }
+         }
+
+         // right hand sides of all spectra in one product
+         std::fill(rhs.begin(), rhs.end(), 0.);
+         for (casacore::uInt chan = 0; chan < n; ++chan) {
+              const float *m = &masked[size_t(chan) * nSpec];
+              for (int j = 0; j < k; ++j) {
+                   const double p = itsBasis[size_t(chan) * k + j];
+                   double *r = &rhs[size_t(j) * nSpec];
+                   for (casacore::uInt spc = 0; spc < nSpec; ++spc) {
+                        r[spc] += p * m[spc];
+                   }
+              }
+         }
+
+         // spectra without masked channels share the precomputed inverse
+         std::fill(coeffs.begin(), coeffs.end(), 0.);
+         for (int i = 0; i < k; ++i) {
+              double *c = &coeffs[size_t(i) * nSpec];
+              for (int j = 0; j < k; ++j) {
+                   const double inv = itsInverse[i * k + j];
+                   const double *r = &rhs[size_t(j) * nSpec];
+                   for (casacore::uInt spc = 0; spc < nSpec; ++spc) {
+                        c[spc] += inv * r[spc];
+                   }
+              }
+         }
+         for (casacore::uInt spc = 0; spc < nSpec; ++spc) {
+              if (fullMask[spc]) {
+                  continue;
+              }
+              for (int j = 0; j < k; ++j) {
+                   specRhs[j] = rhs[size_t(j) * nSpec + spc];
+              }
+              std::copy(normals.begin() + size_t(spc) * k * k, normals.begin() + size_t(spc + 1) * k * k,
+                        normal.begin());
+              solve(normal, &specRhs[0], &specCoeffs[0], nTerms[spc]);
+              for (int j = 0; j < k; ++j) {
+                   coeffs[size_t(j) * nSpec + spc] = specCoeffs[j];
+              }
+         }
+    }
+
+    // subtract the model
+    for (casacore::uInt chan = 0; chan < n; ++chan) {
+         float *d = data + size_t(chan) * nSpec;
+         for (int j = 0; j < k; ++j) {
+              const double p = itsBasis[size_t(chan) * k + j];
+              const double *c = &coeffs[size_t(j) * nSpec];
+              for (casacore::uInt spc = 0; spc < nSpec; ++spc) {
+                   d[spc] -= p * c[spc];
+              }
+         }
+    }
+}
+
+void SpectralBaselineFitter::lineMask(const std::vector<float> &spec, std::vector<bool> &mask,
+                                      std::vector<float> &work) const
+{
+    const casacore::uInt n = itsNChan;
+    // take every 10th point (or fewer for long spectra) and exclude NaNs and extreme outliers
+    const casacore::uInt inc = std::max(1u, std::min(n / 10, 10u));
+    const casacore::uInt n1 = n / inc;
+    work.clear();
+    for (casacore::uInt i = 0; i < n1; ++i) {
+         if (!casacore::isNaN(spec[i * inc])) {
+             work.push_back(spec[i * inc]);
+         }
+    }
+    double xmean = 0.;
+    double offset = 0.;
+    double slope = 0.;
+    if (work.size() > 0) {
+        const float q5 = fractile(work, 0.05f);
+        const float q95 = fractile(work, 0.95f);
+        // fit a line to the remaining points
+        casacore::uInt nGood = 0;
+        double sumx = 0.;
+        double sumy = 0.;
+        for (casacore::uInt i = 0; i < n1; ++i) {
+             const float y = spec[i * inc];
+             if (!casacore::isNaN(y) && (y >= q5) && (y <= q95)) {
+                 sumx += i * inc;
+                 sumy += y;
+                 ++nGood;
+             }
+        }
+        if (nGood > 0) {
+            xmean = sumx / nGood;
+            offset = sumy / nGood;
+            double sumxy = 0.;
+            double sumxx = 0.;
+            for (casacore::uInt i = 0; i < n1; ++i) {
+                 const float y = spec[i * inc];
+                 if (!casacore::isNaN(y) && (y >= q5) && (y <= q95)) {
+                     const double x = i * inc - xmean;
+                     sumxy += x * y;
+                     sumxx += x * x;
+                 }
+            }
+            if (sumxx > 0.) {
+                slope = sumxy / sumxx;
+            }
+        }
+    }
+    std::vector<float> resid(n);
+    for (casacore::uInt i = 0; i < n; ++i) {
+         resid[i] = spec[i] - (offset + slope * (i - xmean));
+    }
+    clipMask(resid, mask, work);
+}
+
+void SpectralBaselineFitter::clipMask(const std::vector<float> &resid, std::vector<bool> &mask,
+                                      std::vector<float> &work) const
+{
+    work.clear();
+    for (casacore::uInt i = 0; i < itsNChan; ++i) {
+         if (!casacore::isNaN(resid[i])) {
+             work.push_back(resid[i]);
+         }
+    }
+    if (work.size() == 0) {
+        std::fill(mask.begin(), mask.end(), false);
+        return;
+    }
+    const float q15 = fractile(work, 0.15f);
+    const float q50 = fractile(work, 0.50f);
+    // just copying python version - iqr should really be 2*(q50-q25)
+    const float iqr = (1 / 1.35) * 2 * (q50 - q15);
+    const float low = q50 - itsThreshold * iqr;
+    const float high = q50 + itsThreshold * iqr;
+    for (casacore::uInt i = 0; i < itsNChan; ++i) {
+         // comparisons with NaN are false, so NaNs are masked
+         mask[i] = (resid[i] >= low) && (resid[i] <= high);
+    }
+}
+
+void SpectralBaselineFitter::solve(std::vector<double> &normal, const double *rhs, double *coeffs,
+                                   int nTerms) const
+{
+    const int k = itsNTerms;
+    ASKAPDEBUGASSERT(nTerms <= k);
+    std::fill(coeffs, coeffs + k, 0.);
+    const std::vector<double> original(normal);
+    double maxDiag = 0.;
+    for (int i = 0; i < nTerms; ++i) {
+         maxDiag = std::max(maxDiag, std::abs(normal[i * k + i]));
+    }
+    // Cholesky decomposition of the leading nTerms x nTerms block, reducing the order
+    // if the matrix is singular
+    while (nTerms > 0) {
+         int failed = -1;
+         for (int j = 0; j < nTerms && failed < 0; ++j) {
+              double diag = normal[j * k + j];
+              for (int l = 0; l < j; ++l) {
+                   diag -= normal[j * k + l] * normal[j * k + l];
+              }
+              if (diag <= 1e-12 * maxDiag) {
+                  failed = j;
+                  break;
+              }
+              diag = std::sqrt(diag);
+              normal[j * k + j] = diag;
+              for (int i = j + 1; i < nTerms; ++i) {
+                   double value = normal[i * k + j];
+                   for (int l = 0; l < j; ++l) {
+                        value -= normal[i * k + l] * normal[j * k + l];
+                   }
+                   normal[i * k + j] = value / diag;
+              }
+         }
+         if (failed < 0) {
+             break;
+         }
+         nTerms = failed;
+         normal = original;
+    }
+    // forward and back substitution
+    for (int i = 0; i < nTerms; ++i) {
+         double value = rhs[i];
+         for (int l = 0; l < i; ++l) {
+              value -= normal[i * k + l] * coeffs[l];
+         }
+         coeffs[i] = value / normal[i * k + i];
+    }
+    for (int i = nTerms - 1; i >= 0; --i) {
+         double value = coeffs[i];
+         for (int l = i + 1; l < nTerms; ++l) {
+              value -= normal[l * k + i] * coeffs[l];
+         }
+         coeffs[i] = value / normal[i * k + i];
+    }
+}
+
+} // namespace askap
@@ -0,0 +1,132 @@
+#ifndef ASKAP_UTILS_SPECTRALBASELINEFITTER_H
+#define ASKAP_UTILS_SPECTRALBASELINEFITTER_H
+
+/// @file SpectralBaselineFitter.h
+///
+/// @brief robust polynomial fit of the continuum for many spectra at once
+/// @details This class is used by imcontsub to subtract the continuum from every
+/// spectrum of a cube. The polynomial basis is the same for all spectra, so the normal
+/// matrix of the unmasked fit and its inverse are computed once. The spectra are
+/// processed in blocks: the right hand sides of all spectra in a block are obtained
+/// by a single matrix product, and only spectra with masked channels need their
+/// normal matrix updated and solved separately. Blocks can be processed in parallel.
+///
+/// @copyright (c) 2019 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+// System includes
+#include <string>
+#include <vector>
+
+// other 3rd party
+#include <casacore/casa/Arrays/Cube.h>
+#include <boost/thread/mutex.hpp>
+
+namespace askap {
+
+/// @brief robust polynomial fit of the continuum for many spectra at once
+/// @details For every spectrum a line is first fitted to a subset of channels
+/// (excluding the outliers), and channels deviating from it by more than threshold
+/// times the robust spread are masked. A polynomial of the given order is then fitted
+/// to the unmasked channels and subtracted. With more than one iteration, the mask is
+/// rebuilt from the residuals of the previous polynomial fit before fitting again.
+class SpectralBaselineFitter {
+public:
+    /// @brief constructor
+    /// @param[in] nChan number of spectral channels
+    /// @param[in] order order of the polynomial
+    /// @param[in] threshold clipping threshold in units of the robust spread
+    /// @param[in] nIter number of clipping iterations (at least 1)
+    SpectralBaselineFitter(casacore::uInt nChan, int order, float threshold, int nIter = 1);
+
+    /// @brief subtract the continuum from all spectra of a cube
+    /// @param[in] cube cube with spectra along the last axis, changed in place
+    /// @param[in] nThreads number of threads
+    /// @param[in] blockSize number of spectra processed together
+    void subtract(casacore::Cube<casacore::Float> &cube, int nThreads, casacore::uInt blockSize) const;
+
+    /// @brief subtract the continuum from a block of spectra
+    /// @details The data are stored channel by channel, i.e. element (chan, spec) is
+    /// at data[chan * nSpec + spec].
+    /// @param[in] data spectra, changed in place
+    /// @param[in] nSpec number of spectra
+    void subtractBlock(float *data, casacore::uInt nSpec) const;
+
+private:
+    /// @brief thread processing blocks of a cube
+    /// @param[in] data start of the cube
+    /// @param[in] nSpec number of spectra in the cube
+    /// @param[in] blockSize number of spectra processed together
+    /// @param[in] nextBlock index of the next block to process (shared between threads)
+    /// @param[in] mutex mutex protecting nextBlock
+    /// @param[out] error error message (empty if successful)
+    void subtractBlocks(float *data, size_t nSpec, casacore::uInt blockSize, size_t &nextBlock,
+                        boost::mutex &mutex, std::string &error) const;
+
+    /// @brief build the initial mask of a spectrum from a robust line fit
+    /// @param[in] spec spectrum (nChan elements)
+    /// @param[out] mask true for channels used in the polynomial fit
+    /// @param[in] work scratch buffer
+    void lineMask(const std::vector<float> &spec, std::vector<bool> &mask, std::vector<float> &work) const;
+
+    /// @brief mask channels deviating from the median of the residuals
+    /// @param[in] resid residuals (nChan elements)
+    /// @param[out] mask true for channels within the threshold
+    /// @param[in] work scratch buffer
+    void clipMask(const std::vector<float> &resid, std::vector<bool> &mask, std::vector<float> &work) const;
+
+    /// @brief solve normal equations for the polynomial coefficients
+    /// @details If the matrix is singular, the order is reduced until it can be solved
+    /// and the higher order coefficients are set to zero.
+    /// @param[in] normal normal matrix (itsNTerms x itsNTerms), destroyed
+    /// @param[in] rhs right hand side
+    /// @param[out] coeffs coefficients
+    /// @param[in] nTerms number of terms to solve for (at most itsNTerms)
+    void solve(std::vector<double> &normal, const double *rhs, double *coeffs, int nTerms) const;
+
+    /// @brief number of spectral channels
+    casacore::uInt itsNChan;
+
+    /// @brief number of polynomial terms
+    int itsNTerms;
+
+    /// @brief clipping threshold
+    float itsThreshold;
+
+    /// @brief number of clipping iterations
+    int itsNIter;
+
+    /// @brief polynomial basis, element (chan, term) is at chan * itsNTerms + term
+    /// @details The channel number is scaled to [-1,1] to keep the normal matrix well conditioned.
+    std::vector<double> itsBasis;
+
+    /// @brief normal matrix of the unmasked fit
+    std::vector<double> itsNormal;
+
+    /// @brief inverse of the normal matrix of the unmasked fit
+    std::vector<double> itsInverse;
+};
+
+} // namespace askap
+
+#endif
@@ -0,0 +1,296 @@
+/// @file
+///
+/// @brief Unit tests for CalSolutionCache.
+/// @details The cache keeps time intervals with known solution IDs and the Jones
+/// matrices read so far. These tests use a solution source with several solutions
+/// changing with time and check that the cache gives the same answers as the source
+/// while querying it as little as possible.
+///
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#ifndef CAL_SOLUTION_CACHE_TEST_H
+#define CAL_SOLUTION_CACHE_TEST_H
+
+#include <askap/measurementequation/CalSolutionCache.h>
+#include <askap/calibaccess/ICalSolutionConstSource.h>
+#include <askap/calibaccess/CachedCalSolutionAccessor.h>
+#include <askap/calibaccess/CalParamNameHelper.h>
+#include <askap/scimath/fitting/Params.h>
+#include <askap/AskapError.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <map>
+#include <utility>
+
+namespace askap
+{
+  namespace synthesis
+  {
+
+    /// @brief solution source with IDs changing at fixed times
+    /// @details Solution ID is 10 before time 100, 20 between 100 and 200 and 30 afterwards.
+    /// Solutions differ in gains, bandpass depends on the channel. The number of queries
+    /// is counted.
+    class IntervalSolutionSourceStub : public accessors::ICalSolutionConstSource {
+    public:
+      /// @brief constructor
+      /// @param[in] nChan number of channels with the bandpass defined
+      explicit IntervalSolutionSourceStub(casacore::uInt nChan) : itsNIDQueries(0), itsNSolutionQueries(0) {
+         for (long id = 10; id <= 30; id += 10) {
+              boost::shared_ptr<scimath::Params> params(new scimath::Params);
+              for (casacore::uInt ant = 0; ant < 3; ++ant) {
+                   for (casacore::uInt beam = 0; beam < 2; ++beam) {
+                        const float amp = 1. + 0.01 * id + 0.1 * ant + 0.05 * beam;
+                        const std::string xxName = accessors::CalParamNameHelper::paramName(ant, beam, casacore::Stokes::XX);
+                        const std::string yyName = accessors::CalParamNameHelper::paramName(ant, beam, casacore::Stokes::YY);
+                        params->add(xxName, casacore::Complex(amp, 0.1 * id));
+                        params->add(yyName, casacore::Complex(amp, -0.1 * id));
+                        for (casacore::uInt chan = 0; chan < nChan; ++chan) {
+                             const casacore::Complex bp(1. + 0.02 * chan, 0.01 * chan);
+                             params->add(accessors::CalParamNameHelper::addChannelInfo(
+                                         accessors::CalParamNameHelper::bpPrefix() + xxName, chan), bp);
+                             params->add(accessors::CalParamNameHelper::addChannelInfo(
+                                         accessors::CalParamNameHelper::bpPrefix() + yyName, chan), conj(bp));
+                        }
+                   }
+              }
+              itsSolutions[id].reset(new accessors::CachedCalSolutionAccessor(params));
+         }
+      }
+
+      /// @brief obtain ID for the most recent solution
+      /// @return ID for the most recent solution
+      virtual long mostRecentSolution() const { return 30; }
+
+      /// @brief obtain solution ID for a given time
+      /// @param[in] time time stamp
+      /// @return solution ID
+      virtual long solutionID(const double time) const {
+         ++itsNIDQueries;
+         return time < 100. ? 10 : (time < 200. ? 20 : 30);
+      }
+
+      /// @brief obtain read-only accessor for a given solution ID
+      /// @param[in] id solution ID to read
+      /// @return shared pointer to an accessor object
+      virtual boost::shared_ptr<accessors::ICalSolutionConstAccessor> roSolution(const long id) const {
+         ++itsNSolutionQueries;
+         const std::map<long, boost::shared_ptr<accessors::ICalSolutionConstAccessor> >::const_iterator ci =
+               itsSolutions.find(id);
+         ASKAPCHECK(ci != itsSolutions.end(), "Solution ID = "<<id<<" is not defined");
+         return ci->second;
+      }
+
+      /// @brief number of solution ID queries so far
+      mutable size_t itsNIDQueries;
+
+      /// @brief number of accessor queries so far
+      mutable size_t itsNSolutionQueries;
+
+    private:
+      /// @brief accessors for every solution ID
+      std::map<long, boost::shared_ptr<accessors::ICalSolutionConstAccessor> > itsSolutions;
+    };
+
+    class CalSolutionCacheTest : public CppUnit::TestFixture
+    {
+      CPPUNIT_TEST_SUITE(CalSolutionCacheTest);
+      CPPUNIT_TEST(testIntervalLookup);
+      CPPUNIT_TEST(testBoundaries);
+      CPPUNIT_TEST(testIntervalMerging);
+      CPPUNIT_TEST(testJones);
+      CPPUNIT_TEST(testFetchBeyondCachedChannel);
+      CPPUNIT_TEST_SUITE_END();
+
+    public:
+      void setUp() {
+         itsSource.reset(new IntervalSolutionSourceStub(8));
+         itsCache.reset(new CalSolutionCache(itsSource));
+      }
+
+      void testIntervalLookup() {
+         CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(50.));
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(150.));
+         CPPUNIT_ASSERT_EQUAL(30l, itsCache->solutionID(250.));
+         CPPUNIT_ASSERT_EQUAL(size_t(3), itsSource->itsNIDQueries);
+         CPPUNIT_ASSERT_EQUAL(size_t(3), itsCache->nIntervals());
+         // the same times are served from the cache
+         CPPUNIT_ASSERT_EQUAL(30l, itsCache->solutionID(250.));
+         CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(50.));
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(150.));
+         CPPUNIT_ASSERT_EQUAL(size_t(3), itsSource->itsNIDQueries);
+
+         // times between the known intervals require a query, the answer extends one of them
+         CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(80.));
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(120.));
+         CPPUNIT_ASSERT_EQUAL(size_t(5), itsSource->itsNIDQueries);
+         CPPUNIT_ASSERT_EQUAL(size_t(3), itsCache->nIntervals());
+         // now [50,80], [120,150] and [250,250] are known
+         CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(65.));
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(135.));
+         CPPUNIT_ASSERT_EQUAL(size_t(5), itsSource->itsNIDQueries);
+
+         // times before the first and after the last interval
+         CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(0.));
+         CPPUNIT_ASSERT_EQUAL(30l, itsCache->solutionID(1000.));
+         CPPUNIT_ASSERT_EQUAL(size_t(7), itsSource->itsNIDQueries);
+         CPPUNIT_ASSERT_EQUAL(size_t(3), itsCache->nIntervals());
+         CPPUNIT_ASSERT_EQUAL(30l, itsCache->solutionID(500.));
+         CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(20.));
+         CPPUNIT_ASSERT_EQUAL(size_t(7), itsSource->itsNIDQueries);
+      }
+
+      void testBoundaries() {
+         CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(99.));
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(100.));
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(199.));
+         CPPUNIT_ASSERT_EQUAL(30l, itsCache->solutionID(200.));
+         CPPUNIT_ASSERT_EQUAL(size_t(4), itsSource->itsNIDQueries);
+         CPPUNIT_ASSERT_EQUAL(size_t(3), itsCache->nIntervals());
+
+         // interval ends are inclusive
+         CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(99.));
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(100.));
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(150.));
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(199.));
+         CPPUNIT_ASSERT_EQUAL(30l, itsCache->solutionID(200.));
+         CPPUNIT_ASSERT_EQUAL(size_t(4), itsSource->itsNIDQueries);
+
+         // the gaps between intervals are not assumed to belong to either side
+         CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(99.5));
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(199.5));
+         CPPUNIT_ASSERT_EQUAL(size_t(6), itsSource->itsNIDQueries);
+         CPPUNIT_ASSERT_EQUAL(size_t(3), itsCache->nIntervals());
+      }
+
+      void testIntervalMerging() {
+         // intervals are created in arbitrary order
+         CPPUNIT_ASSERT_EQUAL(30l, itsCache->solutionID(300.));
+         CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(10.));
+         CPPUNIT_ASSERT_EQUAL(size_t(2), itsCache->nIntervals());
+         // the query between two intervals with different IDs gives a new interval
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(180.));
+         CPPUNIT_ASSERT_EQUAL(size_t(3), itsCache->nIntervals());
+         // it is then extended backwards (start of the following interval moves) ...
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(110.));
+         // ... and forwards (end of the preceding interval moves)
+         CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(190.));
+         CPPUNIT_ASSERT_EQUAL(30l, itsCache->solutionID(250.));
+         CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(90.));
+         CPPUNIT_ASSERT_EQUAL(size_t(3), itsCache->nIntervals());
+         CPPUNIT_ASSERT_EQUAL(size_t(7), itsSource->itsNIDQueries);
+
+         // everything within the merged intervals is served from the cache
+         for (double time = 10.; time <= 90.; time += 5.) {
+              CPPUNIT_ASSERT_EQUAL(10l, itsCache->solutionID(time));
+         }
+         for (double time = 110.; time <= 190.; time += 5.) {
+              CPPUNIT_ASSERT_EQUAL(20l, itsCache->solutionID(time));
+         }
+         for (double time = 250.; time <= 300.; time += 5.) {
+              CPPUNIT_ASSERT_EQUAL(30l, itsCache->solutionID(time));
+         }
+         CPPUNIT_ASSERT_EQUAL(size_t(7), itsSource->itsNIDQueries);
+         CPPUNIT_ASSERT_EQUAL(size_t(3), itsCache->nIntervals());
+
+         // the source is not queried for solutions until they are needed
+         CPPUNIT_ASSERT_EQUAL(size_t(0), itsSource->itsNSolutionQueries);
+         CPPUNIT_ASSERT_EQUAL(size_t(0), itsCache->nSolutions());
+      }
+
+      void testJones() {
+         for (long id = 10; id <= 30; id += 10) {
+              const boost::shared_ptr<accessors::ICalSolutionConstAccessor> acc = itsSource->roSolution(id);
+              for (casacore::uInt ant = 0; ant < 3; ++ant) {
+                   for (casacore::uInt beam = 0; beam < 2; ++beam) {
+                        for (casacore::uInt chan = 0; chan < 8; ++chan) {
+                             checkJones(*acc, id, ant, beam, chan);
+                        }
+                   }
+              }
+         }
+         CPPUNIT_ASSERT_EQUAL(size_t(3), itsCache->nSolutions());
+         // 3 queries above and one per ID from the cache
+         CPPUNIT_ASSERT_EQUAL(size_t(6), itsSource->itsNSolutionQueries);
+         CPPUNIT_ASSERT(itsCache->roSolution(20) == itsSource->roSolution(20));
+         CPPUNIT_ASSERT_EQUAL(size_t(7), itsSource->itsNSolutionQueries);
+      }
+
+      void testFetchBeyondCachedChannel() {
+         const long id = itsCache->solutionID(150.);
+         const boost::shared_ptr<accessors::ICalSolutionConstAccessor> acc = itsSource->roSolution(id);
+         // start in the middle, so the channels up to this one are cached
+         checkJones(*acc, id, 1, 1, 3);
+         // then go beyond the cached channel, and back
+         checkJones(*acc, id, 1, 1, 7);
+         checkJones(*acc, id, 1, 1, 0);
+         checkJones(*acc, id, 1, 1, 5);
+         checkJones(*acc, id, 1, 1, 3);
+         // another antenna/beam pair is cached independently
+         checkJones(*acc, id, 2, 0, 1);
+         checkJones(*acc, id, 2, 0, 6);
+         checkJones(*acc, id, 1, 1, 7);
+         CPPUNIT_ASSERT_EQUAL(size_t(1), itsCache->nSolutions());
+         CPPUNIT_ASSERT_EQUAL(size_t(2), itsSource->itsNSolutionQueries);
+      }
+
+    protected:
+      /// @brief check Jones matrix obtained from the cache
+      /// @param[in] acc accessor of the solution source to compare with
+      /// @param[in] id solution ID
+      /// @param[in] ant antenna index
+      /// @param[in] beam beam index
+      /// @param[in] chan spectral channel
+      void checkJones(const accessors::ICalSolutionConstAccessor &acc, long id, casacore::uInt ant,
+                      casacore::uInt beam, casacore::uInt chan) const {
+         const std::pair<casacore::SquareMatrix<casacore::Complex, 2>, bool> expected = acc.jonesAndValidity(ant, beam, chan);
+         const std::pair<casacore::SquareMatrix<casacore::Complex, 2>, bool> result = itsCache->jonesAndValidity(id, ant, beam, chan);
+         CPPUNIT_ASSERT_EQUAL(expected.second, result.second);
+         for (casacore::uInt row = 0; row < 2; ++row) {
+              for (casacore::uInt col = 0; col < 2; ++col) {
+                   CPPUNIT_ASSERT_DOUBLES_EQUAL(0., abs(expected.first(row, col) - result.first(row, col)), 1e-6);
+              }
+         }
+         // the bandpass makes the diagonal channel dependent
+         const float amp = 1. + 0.01 * id + 0.1 * ant + 0.05 * beam;
+         CPPUNIT_ASSERT_DOUBLES_EQUAL(0., abs(casacore::Complex(amp, 0.1 * id) *
+                    casacore::Complex(1. + 0.02 * chan, 0.01 * chan) - result.first(0, 0)), 1e-5);
+      }
+
+    private:
+      /// @brief solution source
+      boost::shared_ptr<IntervalSolutionSourceStub> itsSource;
+
+      /// @brief cache to test
+      boost::shared_ptr<CalSolutionCache> itsCache;
+    };
+
+  } // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef CAL_SOLUTION_CACHE_TEST_H
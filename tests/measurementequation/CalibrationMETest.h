@@ -44,6 +44,7 @@
 #include <askap/measurementequation/Product.h>
 #include <askap/measurementequation/Sum.h>
 #include <askap/measurementequation/ZeroComponent.h>
+#include <askap/measurementequation/BlockDiagonalCalSolver.h>
 #include <askap/scimath/fitting/LinearSolver.h>
 #include <askap/dataaccess/DataIteratorStub.h>
 #include <askap/calibaccess/CalParamNameHelper.h>
@@ -55,6 +56,10 @@
 
 #include <boost/shared_ptr.hpp>
 
+#include <map>
+#include <string>
+#include <vector>
+
 
 namespace askap
 {
@@ -73,6 +78,8 @@ namespace askap
       */
       CPPUNIT_TEST(testSolveBPPreAvgSVD);
       CPPUNIT_TEST(testSolveBPPreAvgLSQR);
+      CPPUNIT_TEST(testSolveBPPreAvgBlockDiagonal);
+      CPPUNIT_TEST(testSolveMultiBeamBlockDiagonal);
       CPPUNIT_TEST_SUITE_END();
       
       private:
@@ -310,6 +317,12 @@ namespace askap
         {
             testSolveBPPreAvg("LSQR");
         }
+
+        void testSolveBPPreAvgBlockDiagonal()
+        {
+            // channels are solved for independently, use more than one thread
+            testSolveBPPreAvg("BlockDiagonal");
+        }
         
         void testSolveBPNoPreAvg()
         {
@@ -349,7 +362,120 @@ namespace askap
           checkSolution(true);                           
         }
         
+        void testSolveMultiBeamBlockDiagonal()
+        {
+          // spread baselines between beams, each beam has its own gains
+          const casacore::uInt nBeams = 3;
+          accessors::DataAccessorStub &da = dynamic_cast<accessors::DataAccessorStub&>(*idi);
+          for (casacore::uInt row = 0; row < da.nRow(); ++row) {
+               da.itsFeed1[row] = row % nBeams;
+               da.itsFeed2[row] = row % nBeams;
+          }
+          const std::vector<std::string> gainNames = params1->completions("gain.g11.");
+          CPPUNIT_ASSERT(gainNames.size() > 0);
+          for (std::vector<std::string>::const_iterator it = gainNames.begin(); it != gainNames.end(); ++it) {
+               // completions are in the form ant.0
+               const std::string antName = it->substr(0, it->find('.'));
+               const casacore::Complex beam0Gain = params1->complexValue("gain.g11." + *it);
+               for (casacore::uInt beam = 1; beam < nBeams; ++beam) {
+                    params1->add("gain.g11." + antName + "." + toString(beam),
+                                 beam0Gain * casacore::polar(1.f + 0.1f * beam, 0.3f * beam));
+                    params1->add("gain.g22." + antName + "." + toString(beam), 1.);
+                    params2->add("gain.g11." + antName + "." + toString(beam), casacore::Complex(1.0, 0.0));
+                    params2->add("gain.g22." + antName + "." + toString(beam), 1.0);
+                    params2->fix("gain.g22." + antName + "." + toString(beam));
+               }
+          }
+          eq1.reset(new METype(*params1, idi, p1));
+          initDataAndParameters();
+
+          typedef CalibrationME<NoXPolGain, PreAvgCalMEBase> PreAvgMEType;
+          PreAvgMEType preAvgEq;
+          idi.init();
+          preAvgEq.accumulate(idi, p2);
+
+          // reference solution with all beams at once, block-diagonal solution in one thread
+          // and in two threads (so one thread gets more than one block)
+          const boost::shared_ptr<Params> svdParams = params2->clone();
+          const boost::shared_ptr<Params> serialParams = params2->clone();
+          const boost::shared_ptr<Params> threadedParams = params2->clone();
+          for (size_t iter = 0; iter < 5; ++iter) {
+               GenericNormalEquations svdNE;
+               preAvgEq.setParameters(*svdParams);
+               preAvgEq.calcEquations(svdNE);
+               Quality svdQuality;
+               LinearSolver svdSolver;
+               svdSolver.addNormalEquations(svdNE);
+               svdSolver.setAlgorithm("SVD");
+               svdSolver.solveNormalEquations(*svdParams, svdQuality);
+               rotatePhasePerBeam(*svdParams);
+
+               GenericNormalEquations serialNE;
+               preAvgEq.setParameters(*serialParams);
+               preAvgEq.calcEquations(serialNE);
+               Quality serialQuality;
+               BlockDiagonalCalSolver serialSolver(0., 1);
+               serialSolver.addNormalEquations(serialNE);
+               serialSolver.solveNormalEquations(*serialParams, serialQuality);
+               rotatePhasePerBeam(*serialParams);
+
+               GenericNormalEquations threadedNE;
+               preAvgEq.setParameters(*threadedParams);
+               preAvgEq.calcEquations(threadedNE);
+               Quality threadedQuality;
+               BlockDiagonalCalSolver threadedSolver(0., 2);
+               threadedSolver.addNormalEquations(threadedNE);
+               threadedSolver.solveNormalEquations(*threadedParams, threadedQuality);
+               rotatePhasePerBeam(*threadedParams);
+
+               // blocks are solved independently, so the threaded result is the same
+               checkSameGains(*serialParams, *threadedParams, 1e-7);
+               CPPUNIT_ASSERT_EQUAL(serialQuality.rank(), threadedQuality.rank());
+               CPPUNIT_ASSERT_EQUAL(serialQuality.DOF(), threadedQuality.DOF());
+          }
+          // beams don't share any data, so both solvers converge to the same gains
+          checkSameGains(*svdParams, *serialParams, 1e-5);
+          const boost::shared_ptr<Params> expected = params1->clone();
+          rotatePhasePerBeam(*expected);
+          checkSameGains(*expected, *serialParams, 1e-5);
+        }
+
       private:
+        /// @brief helper method to take care of absolute phase uncertainty for each beam
+        /// @details The phase of the first antenna is set to zero separately for every beam
+        /// present in the parameters. Only g11 gains are rotated.
+        /// @param[in] params parameters to update
+        static void rotatePhasePerBeam(Params &params) {
+          const std::vector<std::string> names = params.completions("gain.g11.");
+          std::map<casacore::uInt, casacore::Complex> refPhaseTerms;
+          for (std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+               const accessors::JonesIndex index = accessors::CalParamNameHelper::parseParam("gain.g11." + *it).first;
+               if (index.antenna() == 0) {
+                   refPhaseTerms[index.beam()] = casacore::polar(1.f, -arg(params.complexValue("gain.g11." + *it)));
+               }
+          }
+          for (std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+               const std::string parname = "gain.g11." + *it;
+               const casacore::uInt beam = accessors::CalParamNameHelper::parseParam(parname).first.beam();
+               CPPUNIT_ASSERT(refPhaseTerms.find(beam) != refPhaseTerms.end());
+               params.update(parname, params.complexValue(parname) * refPhaseTerms[beam]);
+          }
+        }
+
+        /// @brief check that g11 gains are the same
+        /// @param[in] expected expected gains
+        /// @param[in] actual gains to check
+        /// @param[in] tolerance tolerance
+        static void checkSameGains(const Params &expected, const Params &actual, const double tolerance) {
+          const std::vector<std::string> names = expected.completions("gain.g11.");
+          CPPUNIT_ASSERT(names.size() > 0);
+          for (std::vector<std::string>::const_iterator it = names.begin(); it != names.end(); ++it) {
+               const std::string parname = "gain.g11." + *it;
+               CPPUNIT_ASSERT(actual.has(parname));
+               CPPUNIT_ASSERT_DOUBLES_EQUAL(0., abs(expected.complexValue(parname) - actual.complexValue(parname)), tolerance);
+          }
+        }
+
         void testSolveBPPreAvg(const std::string& solverType)
         {
           initDataAndParameters();
@@ -378,10 +504,16 @@ namespace askap
                bpEq.setParameters(*params2);
                bpEq.calcEquations(ne);
                Quality q;
-               LinearSolver solver1;
-               solver1.addNormalEquations(ne);
-               solver1.setAlgorithm(solverType);
-               solver1.solveNormalEquations(*params2,q);
+               if (solverType == "BlockDiagonal") {
+                   BlockDiagonalCalSolver solver1(0., 3);
+                   solver1.addNormalEquations(ne);
+                   solver1.solveNormalEquations(*params2,q);
+               } else {
+                   LinearSolver solver1;
+                   solver1.addNormalEquations(ne);
+                   solver1.setAlgorithm(solverType);
+                   solver1.solveNormalEquations(*params2,q);
+               }
                //std::cout<<q<<std::endl;
 
                // taking care of the absolute phase uncertainty
@@ -22,6 +22,9 @@
 ///
 
 #include <askap/measurementequation/ComponentEquation.h>
+#include <askap/measurementequation/BatchedComponentPredictor.h>
+#include <askap/measurementequation/UnpolarizedPointSource.h>
+#include <askap/measurementequation/UnpolarizedGaussianSource.h>
 #include <askap/scimath/fitting/LinearSolver.h>
 #include <askap/dataaccess/DataIteratorStub.h>
 #include <casacore/casa/aips.h>
@@ -55,6 +58,7 @@ namespace askap
       CPPUNIT_TEST_SUITE(ComponentEquationTest);
       CPPUNIT_TEST(testCopy);
       CPPUNIT_TEST(testPredict);
+      CPPUNIT_TEST(testBatchedPredict);
       CPPUNIT_TEST(testAssembly);
       CPPUNIT_TEST(testConstructNormalEquations);
       CPPUNIT_TEST(testSolveNormalEquationsSVD);
@@ -123,6 +127,64 @@ namespace askap
           p1->predict();
         }
 
+        void testBatchedPredict()
+        {
+          // evenly spaced channels (more than one anchor interval) and an irregular set
+          casacore::Vector<casacore::Double> evenFreq(150);
+          for (casacore::uInt chan = 0; chan < evenFreq.nelements(); ++chan) {
+               evenFreq[chan] = 1.4e9 - 1e6 * chan;
+          }
+          casacore::Vector<casacore::Double> unevenFreq(5);
+          unevenFreq[0] = 1.1e9;
+          unevenFreq[1] = 1.2e9;
+          unevenFreq[2] = 1.25e9;
+          unevenFreq[3] = 1.4e9;
+          unevenFreq[4] = 1.41e9;
+          CPPUNIT_ASSERT(BatchedComponentPredictor::evenlySpaced(evenFreq));
+          CPPUNIT_ASSERT(!BatchedComponentPredictor::evenlySpaced(unevenFreq));
+          checkBatchedPredict(evenFreq, 1);
+          checkBatchedPredict(evenFreq, 3);
+          checkBatchedPredict(unevenFreq, 2);
+        }
+
+        void checkBatchedPredict(const casacore::Vector<casacore::Double> &freq, size_t nThreads)
+        {
+          const casacore::uInt nRow = 7;
+          casacore::Vector<casacore::RigidVector<casacore::Double, 3> > uvw(nRow);
+          for (casacore::uInt row = 0; row < nRow; ++row) {
+               uvw[row] = casacore::RigidVector<casacore::Double, 3>(150. * row - 400., 97. * row + 30., 3. * row - 10.);
+          }
+          BatchedComponentPredictor batch;
+          batch.addPoint(1.5, 0.01, -0.02);
+          batch.addGaussian(100., 0.5, -0.3, 30.0*casacore::C::arcsec, 20.0*casacore::C::arcsec, -55*casacore::C::degree);
+          const UnpolarizedPointSource point("", 1.5, 0.01, -0.02);
+          const UnpolarizedGaussianSource gauss("", 100., 0.5, -0.3, 30.0*casacore::C::arcsec,
+                   20.0*casacore::C::arcsec, -55*casacore::C::degree);
+          CPPUNIT_ASSERT_EQUAL(size_t(2), batch.size());
+
+          // second plane is not affected, third is scaled
+          casacore::Vector<casacore::Complex> polFactors(3, casacore::Complex(0.,0.));
+          polFactors[0] = casacore::Complex(1.,0.);
+          polFactors[2] = casacore::Complex(0.,0.5);
+          casacore::Cube<casacore::Complex> vis(nRow, freq.nelements(), 3, casacore::Complex(1.,-1.));
+          batch.predict(uvw, freq, polFactors, vis, nThreads);
+
+          std::vector<double> pointVis(2 * freq.nelements());
+          std::vector<double> gaussVis(2 * freq.nelements());
+          for (casacore::uInt row = 0; row < nRow; ++row) {
+               point.calculate(uvw[row], freq, pointVis);
+               gauss.calculate(uvw[row], freq, gaussVis);
+               for (casacore::uInt chan = 0; chan < freq.nelements(); ++chan) {
+                    const casacore::Complex expected(pointVis[2 * chan] + gaussVis[2 * chan],
+                                                     pointVis[2 * chan + 1] + gaussVis[2 * chan + 1]);
+                    CPPUNIT_ASSERT(abs(vis(row, chan, 0) - casacore::Complex(1.,-1.) - expected) < 1e-4);
+                    CPPUNIT_ASSERT(abs(vis(row, chan, 1) - casacore::Complex(1.,-1.)) < 1e-6);
+                    CPPUNIT_ASSERT(abs(vis(row, chan, 2) - casacore::Complex(1.,-1.) -
+                                   casacore::Complex(0.,0.5) * expected) < 1e-4);
+               }
+          }
+        }
+
         void testAssembly()
         {
 // Predict with the "perfect" parameters"
@@ -44,6 +44,7 @@
 #include <askap/scimath/fitting/LinearSolver.h>
 #include <askap/dataaccess/DataIteratorStub.h>
 #include <askap/measurementequation/CalibrationApplicatorME.h>
+#include <askap/measurementequation/CalSolutionCache.h>
 #include <askap/calibaccess/CachedCalSolutionAccessor.h>
 #include <askap/calibaccess/CalSolutionSourceStub.h>
 #include <askap/measurementequation/CalibParamsMEAdapter.h>
@@ -70,6 +71,7 @@ namespace askap
       CPPUNIT_TEST(testSolvePreAvgSVD);
       CPPUNIT_TEST(testSolvePreAvgLSQR);
       CPPUNIT_TEST(testApplication);
+      CPPUNIT_TEST(testApplicationCached);
       CPPUNIT_TEST(testSimulation);
       CPPUNIT_TEST_SUITE_END();
      
@@ -345,7 +347,44 @@ namespace askap
           accessors::CalSolutionSourceStub src(boost::shared_ptr<accessors::CachedCalSolutionAccessor>(&acc,utility::NullDeleter()));
           CalibrationApplicatorME calME(boost::shared_ptr<accessors::CalSolutionSourceStub>(&src,utility::NullDeleter()));
           calME.correct(da);
+          checkCorrectedVisibilities(da);
+        }
+
+        void testApplicationCached() {
+          // same as testApplication, but the solution is accessed via the cache and rows are split between threads
+          CPPUNIT_ASSERT(itsIter);
+          accessors::DataAccessorStub &da = dynamic_cast<accessors::DataAccessorStub&>(*itsIter);
+          CPPUNIT_ASSERT(da.itsStokes.nelements() == 4);
+          da.rwVisibility().set(0.);
+
+          fillGainsAndLeakages();
+          CPPUNIT_ASSERT(itsParams1);
+
+          itsCE1.reset(new ComponentEquation(*itsParams1, itsIter));
+          typedef CalibrationME<Product<NoXPolGain,LeakageTerm> > METype2;
+
+          boost::shared_ptr<METype2> eq1(new METype2(*itsParams1,itsIter,itsCE1));
+          eq1->predict();
+
+          accessors::CachedCalSolutionAccessor acc(itsParams1);
+          boost::shared_ptr<accessors::CalSolutionSourceStub> src(new accessors::CalSolutionSourceStub(
+                    boost::shared_ptr<accessors::CachedCalSolutionAccessor>(&acc,utility::NullDeleter())));
+          boost::shared_ptr<CalSolutionCache> cache(new CalSolutionCache(src));
+          CalibrationApplicatorME calME(cache);
+          calME.numberOfThreads(3);
+          calME.correct(da);
+          checkCorrectedVisibilities(da);
+          CPPUNIT_ASSERT_EQUAL(size_t(1), cache->nSolutions());
+
+          // all times map to the same solution, so the intervals should merge into one
+          const long id = cache->solutionID(da.time());
+          CPPUNIT_ASSERT_EQUAL(id, cache->solutionID(da.time() + 100.));
+          CPPUNIT_ASSERT_EQUAL(id, cache->solutionID(da.time() - 100.));
+          CPPUNIT_ASSERT_EQUAL(id, cache->solutionID(da.time() + 50.));
+          CPPUNIT_ASSERT_EQUAL(size_t(1), cache->nIntervals());
+        }
 
+        void checkCorrectedVisibilities(const accessors::IConstDataAccessor &da) {
           // check visibilities after calibration application
           const casacore::Cube<casacore::Complex>& vis = da.visibility();
           for (casacore::uInt row = 0; row < da.nRow(); ++row) {
@@ -37,6 +37,7 @@
 #include <askap/dataaccess/DataIteratorStub.h>
 #include <cppunit/extensions/HelperMacros.h>
 #include <askap/measurementequation/PreAvgCalBuffer.h>
+#include <askap/measurementequation/BatchedPredictionAccessor.h>
 #include <askap/measurementequation/ComponentEquation.h>
 #include <askap/scimath/fitting/PolXProducts.h>
 
@@ -59,7 +60,11 @@ class PreAvgCalBufferTest : public CppUnit::TestFixture
   CPPUNIT_TEST(testBeamIndependent);
   CPPUNIT_TEST(testPolIndex);
   CPPUNIT_TEST(testAccumulate);
+  CPPUNIT_TEST(testBatchedAccumulate);
+  CPPUNIT_TEST(testRotatedUVWCache);
   CPPUNIT_TEST(testFDPAccumulate);
+  CPPUNIT_TEST(testInitFromChannel);
+  CPPUNIT_TEST(testMatchSwappedAntennas);
   CPPUNIT_TEST(testFDPInitExplicit);
   CPPUNIT_TEST(testAccumulateXPol);
   CPPUNIT_TEST_SUITE_END();
@@ -354,6 +359,90 @@ class PreAvgCalBufferTest : public CppUnit::TestFixture
          CPPUNIT_ASSERT_EQUAL(0u,pacBuf.ignoredDueToFlags());         
      }
 
+     void testBatchedAccumulate() {
+         PreAvgCalBuffer pacBuf;
+         CPPUNIT_ASSERT(itsME);
+         CPPUNIT_ASSERT(itsIter);
+         
+         // simulate visibilities
+         itsME->predict(*itsIter);
+
+         // two copies of the same chunk predicted in one go should give the same result as
+         // two consecutive accumulations
+         BatchedPredictionAccessor batch;
+         CPPUNIT_ASSERT(batch.isCompatible(*itsIter));
+         batch.append(*itsIter);
+         CPPUNIT_ASSERT(batch.isCompatible(*itsIter));
+         batch.append(*itsIter);
+         CPPUNIT_ASSERT_EQUAL(size_t(2u), batch.nChunks());
+         CPPUNIT_ASSERT_EQUAL(2u * itsIter->nRow(), batch.nAppendedRows());
+         batch.merge();
+         CPPUNIT_ASSERT_EQUAL(2u * itsIter->nRow(), batch.nRow());
+         CPPUNIT_ASSERT_EQUAL(itsIter->nChannel(), batch.nChannel());
+         CPPUNIT_ASSERT_EQUAL(itsIter->nPol(), batch.nPol());
+         const casacore::uInt nRow = itsIter->nRow();
+         for (casacore::uInt row = 0; row < nRow; ++row) {
+              CPPUNIT_ASSERT_EQUAL(itsIter->antenna1()[row], batch.antenna1()[row + nRow]);
+              CPPUNIT_ASSERT_EQUAL(itsIter->antenna2()[row], batch.antenna2()[row + nRow]);
+              CPPUNIT_ASSERT_DOUBLES_EQUAL(itsIter->uvw()[row](0), batch.uvw()[row + nRow](0), 1e-10);
+              CPPUNIT_ASSERT_DOUBLES_EQUAL(0., casacore::abs(itsIter->visibility()(row,0,0) - 
+                                           batch.visibility()(row + nRow,0,0)), 1e-6);
+         }
+
+         pacBuf.accumulate(batch, itsME);
+         CPPUNIT_ASSERT_EQUAL(0u,pacBuf.ignoredDueToType());
+         CPPUNIT_ASSERT_EQUAL(0u,pacBuf.ignoredNoMatch());
+         CPPUNIT_ASSERT_EQUAL(0u,pacBuf.ignoredDueToFlags());
+         CPPUNIT_ASSERT_EQUAL(nRow,pacBuf.nRow());
+         testResults(pacBuf,2);
+
+         // chunk with a different spectral setup can't be added
+         BatchedPredictionAccessor batch2;
+         batch2.append(*itsIter);
+         accessors::DataAccessorStub &da = dynamic_cast<accessors::DataAccessorStub&>(*itsIter);
+         da.itsFrequency[0] += 1e6;
+         CPPUNIT_ASSERT(!batch2.isCompatible(*itsIter));
+     }
+
+     void testRotatedUVWCache() {
+         boost::shared_ptr<RotatedUVWCache> cache(new RotatedUVWCache(1024 * 1024));
+         BatchedPredictionAccessor batch1(cache);
+         batch1.append(*itsIter);
+         batch1.merge();
+         const casacore::MDirection tangent(batch1.pointingDir1()[0], casacore::MDirection::J2000);
+         const casacore::Vector<casacore::RigidVector<casacore::Double, 3> > uvw1 = batch1.rotatedUVW(tangent).copy();
+         const casacore::Vector<casacore::Double> delay1 = batch1.uvwRotationDelay(tangent, tangent).copy();
+         CPPUNIT_ASSERT_EQUAL(size_t(0u), cache->nHits());
+         CPPUNIT_ASSERT_EQUAL(size_t(2u), cache->nMisses());
+
+         // the same data in another batch, rotation should be taken from the cache
+         BatchedPredictionAccessor batch2(cache);
+         batch2.append(*itsIter);
+         batch2.merge();
+         const casacore::Vector<casacore::RigidVector<casacore::Double, 3> > &uvw2 = batch2.rotatedUVW(tangent);
+         const casacore::Vector<casacore::Double> &delay2 = batch2.uvwRotationDelay(tangent, tangent);
+         CPPUNIT_ASSERT_EQUAL(size_t(2u), cache->nHits());
+         CPPUNIT_ASSERT_EQUAL(size_t(2u), cache->nMisses());
+         CPPUNIT_ASSERT_EQUAL(uvw1.nelements(), uvw2.nelements());
+         CPPUNIT_ASSERT_EQUAL(delay1.nelements(), delay2.nelements());
+         for (casacore::uInt row = 0; row < uvw1.nelements(); ++row) {
+              for (casacore::uInt dim = 0; dim < 3; ++dim) {
+                   CPPUNIT_ASSERT_DOUBLES_EQUAL(uvw1[row](dim), uvw2[row](dim), 1e-10);
+              }
+              CPPUNIT_ASSERT_DOUBLES_EQUAL(delay1[row], delay2[row], 1e-10);
+         }
+
+         // different uvw's should not match
+         accessors::DataAccessorStub &da = dynamic_cast<accessors::DataAccessorStub&>(*itsIter);
+         da.itsUVW[0](0) += 1.;
+         BatchedPredictionAccessor batch3(cache);
+         batch3.append(*itsIter);
+         batch3.merge();
+         batch3.rotatedUVW(tangent);
+         CPPUNIT_ASSERT_EQUAL(size_t(2u), cache->nHits());
+         CPPUNIT_ASSERT_EQUAL(size_t(3u), cache->nMisses());
+     }
+
      void testFDPAccumulate() {
          PreAvgCalBuffer pacBuf;
          CPPUNIT_ASSERT(itsME);
@@ -384,6 +473,71 @@ class PreAvgCalBufferTest : public CppUnit::TestFixture
          CPPUNIT_ASSERT_EQUAL(8u,pacBuf.nChannel());                  
      }
      
+     void testInitFromChannel() {
+         PreAvgCalBuffer fdpBuf;
+         CPPUNIT_ASSERT(itsME);
+         CPPUNIT_ASSERT(itsIter);
+         
+         // simulate visibilities
+         itsME->predict(*itsIter);
+         
+         // accumulate all 8 channels separately twice
+         fdpBuf.accumulate(*itsIter, itsME, true);
+         fdpBuf.accumulate(*itsIter, itsME, true);
+         CPPUNIT_ASSERT_EQUAL(8u,fdpBuf.nChannel());
+
+         // extract each channel into a frequency-independent buffer
+         PreAvgCalBuffer pacBuf;
+         for (casacore::uInt chan = 0; chan < fdpBuf.nChannel(); ++chan) {
+              pacBuf.initialise(fdpBuf, chan);
+              CPPUNIT_ASSERT_EQUAL(fdpBuf.nRow(),pacBuf.nRow());
+              CPPUNIT_ASSERT_EQUAL(1u,pacBuf.nChannel());
+              CPPUNIT_ASSERT_EQUAL(fdpBuf.nPol(),pacBuf.nPol());
+              CPPUNIT_ASSERT_EQUAL(1u,casacore::uInt(pacBuf.stokes().nelements()));
+              CPPUNIT_ASSERT_EQUAL(casacore::Stokes::I, pacBuf.stokes()[0]);
+              const scimath::PolXProducts &pxp = pacBuf.polXProducts();
+              for (casacore::uInt row=0; row<pacBuf.nRow(); ++row) {
+                   CPPUNIT_ASSERT_EQUAL(fdpBuf.antenna1()[row],pacBuf.antenna1()[row]);
+                   CPPUNIT_ASSERT_EQUAL(fdpBuf.antenna2()[row],pacBuf.antenna2()[row]);
+                   CPPUNIT_ASSERT_EQUAL(fdpBuf.feed1()[row],pacBuf.feed1()[row]);
+                   CPPUNIT_ASSERT_EQUAL(false, pacBuf.flag()(row,0,0));
+                   // 1 channel and 100 Jy source give sums of 10000 per accessor summed in
+                   CPPUNIT_ASSERT_DOUBLES_EQUAL(20000., double(real(pxp.getModelProduct(row,0,0,0))),2e-2);
+                   CPPUNIT_ASSERT_DOUBLES_EQUAL(20000., double(real(pxp.getModelMeasProduct(row,0,0,0))),2e-2);
+                   CPPUNIT_ASSERT_DOUBLES_EQUAL(0,double(imag(pxp.getModelMeasProduct(row,0,0,0))),1e-5);
+              }
+         }
+         // channel outside the source buffer
+         CPPUNIT_ASSERT_THROW(pacBuf.initialise(fdpBuf, 8u), AskapError);
+     }
+
+     void testMatchSwappedAntennas() {
+         // 20 antennas, 1 beam
+         PreAvgCalBuffer pacBuf(20,1);
+         CPPUNIT_ASSERT(itsME);
+         CPPUNIT_ASSERT(itsIter);
+         itsME->predict(*itsIter);
+         // swap antennas in all rows, baselines should no longer match buffer rows
+         accessors::DataAccessorStub &da = dynamic_cast<accessors::DataAccessorStub&>(*itsIter);
+         const casacore::Vector<casacore::uInt> ant1 = da.itsAntenna1.copy();
+         da.itsAntenna1 = da.itsAntenna2;
+         da.itsAntenna2 = ant1;
+         pacBuf.accumulate(*itsIter, itsME);
+         CPPUNIT_ASSERT_EQUAL(0u,pacBuf.ignoredDueToType());
+         // 435 baselines * 8 channels, accessor has 1 polarisation
+         CPPUNIT_ASSERT_EQUAL(3480u,pacBuf.ignoredNoMatch());
+         CPPUNIT_ASSERT_EQUAL(0u,pacBuf.ignoredDueToFlags());
+         // swap back, now 190 baselines should match
+         da.itsAntenna2 = da.itsAntenna1;
+         da.itsAntenna1 = ant1;
+         pacBuf.accumulate(*itsIter, itsME);
+         CPPUNIT_ASSERT_EQUAL(3480u + 1960u,pacBuf.ignoredNoMatch());
+         for (casacore::uInt row=0; row<pacBuf.nRow(); ++row) {
+              CPPUNIT_ASSERT_EQUAL(false, pacBuf.flag()(row,0,0));
+              CPPUNIT_ASSERT_DOUBLES_EQUAL(80000., double(real(pacBuf.polXProducts().getModelProduct(row,0,0,0))),1e-2);
+         }
+     }
+
      void testFDPInitExplicit() {
          // 20 antennas instead of 30 available, 2 beams instead of 1 available in the stubbed, 8 channels
          // accessor
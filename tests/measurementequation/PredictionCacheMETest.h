@@ -0,0 +1,162 @@
+/// @file
+///
+/// @brief Unit tests for PredictionCacheME.
+/// @details The cache stores model visibilities predicted by a measurement equation,
+/// in memory and optionally on disk. These tests check that repeated predictions are
+/// served from the cache and that different models or settings are not mixed up.
+///
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#ifndef PREDICTION_CACHE_ME_TEST_H
+#define PREDICTION_CACHE_ME_TEST_H
+
+#include <askap/measurementequation/ComponentEquation.h>
+#include <askap/measurementequation/PredictionCacheME.h>
+#include <askap/scimath/fitting/Params.h>
+#include <askap/dataaccess/DataIteratorStub.h>
+#include <askap/dataaccess/DataAccessorStub.h>
+#include <casacore/casa/BasicSL/Constants.h>
+#include <casacore/casa/OS/Directory.h>
+#include <Common/ParameterSet.h>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <stdlib.h>
+
+namespace askap
+{
+  namespace synthesis
+  {
+
+    class PredictionCacheMETest : public CppUnit::TestFixture
+    {
+      CPPUNIT_TEST_SUITE(PredictionCacheMETest);
+      CPPUNIT_TEST(testPredictionCache);
+      CPPUNIT_TEST(testPredictionCacheSettings);
+      CPPUNIT_TEST_SUITE_END();
+
+      private:
+        scimath::Params itsParams1, itsParams2;
+        accessors::IDataSharedIter itsIter;
+
+      public:
+        void setUp()
+        {
+          itsIter = accessors::IDataSharedIter(new accessors::DataIteratorStub(1));
+
+          itsParams1 = scimath::Params();
+          itsParams1.add("flux.i.cena", 100.0);
+          itsParams1.add("direction.ra.cena", 0.5);
+          itsParams1.add("direction.dec.cena", -0.3);
+          itsParams1.add("shape.bmaj.cena", 30.0*casacore::C::arcsec);
+          itsParams1.add("shape.bmin.cena", 20.0*casacore::C::arcsec);
+          itsParams1.add("shape.bpa.cena", -55*casacore::C::degree);
+
+          itsParams2 = scimath::Params();
+          itsParams2.add("flux.i.cena", 100.0);
+          itsParams2.add("direction.ra.cena", 0.500005);
+          itsParams2.add("direction.dec.cena", -0.300003);
+          itsParams2.add("shape.bmaj.cena", 33.0*casacore::C::arcsec);
+          itsParams2.add("shape.bmin.cena", 22.0*casacore::C::arcsec);
+          itsParams2.add("shape.bpa.cena", -57*casacore::C::degree);
+        }
+
+        void testPredictionCache()
+        {
+          boost::shared_ptr<ComponentEquation> compEq(new ComponentEquation(itsParams1, itsIter));
+          PredictionCacheME cache(compEq, itsParams1);
+          CPPUNIT_ASSERT(PredictionCacheME::modelHash(itsParams1) != PredictionCacheME::modelHash(itsParams2));
+
+          accessors::DataAccessorStub acc(true);
+          const casacore::Cube<casacore::Complex> original = acc.visibility().copy();
+          compEq->predict(acc);
+          const casacore::Cube<casacore::Complex> expected = acc.visibility().copy();
+
+          for (int pass = 0; pass < 2; ++pass) {
+               acc.rwVisibility() = original;
+               cache.predict(acc);
+               CPPUNIT_ASSERT_EQUAL(size_t(1), cache.nMisses());
+               CPPUNIT_ASSERT_EQUAL(size_t(pass), cache.nHits());
+               for (casacore::uInt row = 0; row < acc.nRow(); ++row) {
+                    for (casacore::uInt chan = 0; chan < acc.nChannel(); ++chan) {
+                         for (casacore::uInt pol = 0; pol < acc.nPol(); ++pol) {
+                              CPPUNIT_ASSERT(abs(acc.visibility()(row, chan, pol) - expected(row, chan, pol)) < 1e-6);
+                         }
+                    }
+               }
+          }
+          // different uvw's give a different chunk
+          const casacore::uInt row = 0;
+          acc.itsUVW[row](0) += 1.;
+          cache.predict(acc);
+          CPPUNIT_ASSERT_EQUAL(size_t(2), cache.nMisses());
+        }
+
+        void testPredictionCacheSettings()
+        {
+          boost::shared_ptr<ComponentEquation> compEq(new ComponentEquation(itsParams1, itsIter));
+          char dirName[] = "/tmp/tPredictionCacheXXXXXX";
+          CPPUNIT_ASSERT(mkdtemp(dirName) != 0);
+          LOFAR::ParameterSet parset;
+          parset.add("modelcache", "true");
+          parset.add("modelcache.directory", dirName);
+          parset.add("gridder", "WProject");
+          parset.add("gridder.WProject.wmax", "1000");
+          LOFAR::ParameterSet otherParset;
+          otherParset.add("modelcache", "true");
+          otherParset.add("modelcache.directory", dirName);
+          otherParset.add("gridder", "WProject");
+          otherParset.add("gridder.WProject.wmax", "2000");
+
+          accessors::DataAccessorStub acc(true);
+          // the first cache writes the chunk to disk
+          boost::shared_ptr<PredictionCacheME const> cache =
+               boost::dynamic_pointer_cast<PredictionCacheME const>(PredictionCacheME::create(parset, compEq, itsParams1));
+          CPPUNIT_ASSERT(cache);
+          cache->predict(acc);
+          CPPUNIT_ASSERT_EQUAL(size_t(1), cache->nMisses());
+          // the same settings find it on disk
+          cache = boost::dynamic_pointer_cast<PredictionCacheME const>(PredictionCacheME::create(parset, compEq, itsParams1));
+          CPPUNIT_ASSERT(cache);
+          cache->predict(acc);
+          CPPUNIT_ASSERT_EQUAL(size_t(1), cache->nHits());
+          CPPUNIT_ASSERT_EQUAL(size_t(0), cache->nMisses());
+          // different gridder settings don't reuse it
+          cache = boost::dynamic_pointer_cast<PredictionCacheME const>(PredictionCacheME::create(otherParset, compEq, itsParams1));
+          CPPUNIT_ASSERT(cache);
+          cache->predict(acc);
+          CPPUNIT_ASSERT_EQUAL(size_t(0), cache->nHits());
+          CPPUNIT_ASSERT_EQUAL(size_t(1), cache->nMisses());
+          casacore::Directory(dirName).removeRecursive();
+        }
+    };
+
+  } // namespace synthesis
+
+} // namespace askap
+
+#endif // #ifndef PREDICTION_CACHE_ME_TEST_H
@@ -29,6 +29,7 @@
 
 // Test includes
 #include "ComponentEquationTest.h"
+#include "PredictionCacheMETest.h"
 #include "Calibrator1934Test.h"
 #include "VectorOperationsTest.h"
 #include "ImageDFTEquationTest.h"
@@ -42,6 +43,7 @@
 #include "PreAvgCalBufferTest.h"
 #include "RestoringBeamHelperTest.h"
 #include "VisMetaDataStatsTest.h"
+#include "CalSolutionCacheTest.h"
 
 #include <askapparallel/AskapParallel.h>
 
@@ -53,6 +55,7 @@ int main( int argc, char **argv)
 
     runner.addTest(askap::synthesis::VectorOperationsTest::suite());
     runner.addTest(askap::synthesis::ComponentEquationTest::suite());
+    runner.addTest(askap::synthesis::PredictionCacheMETest::suite());
     runner.addTest(askap::synthesis::Calibrator1934Test::suite());
     runner.addTest(askap::synthesis::PreAvgCalBufferTest::suite());
     runner.addTest(askap::synthesis::CalibrationMETest::suite());
@@ -65,6 +68,7 @@ int main( int argc, char **argv)
     runner.addTest(askap::synthesis::PolLeakageTest::suite());
     runner.addTest(askap::synthesis::RestoringBeamHelperTest::suite());
     runner.addTest(askap::synthesis::VisMetaDataStatsTest::suite());
+    runner.addTest(askap::synthesis::CalSolutionCacheTest::suite());
 
     const bool wasSucessful = runner.run();
 
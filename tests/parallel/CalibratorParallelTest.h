@@ -0,0 +1,263 @@
+/// @file
+///
+/// Unit test for the threaded parts of the calibrator: concurrent solution for
+/// independent beams and accumulation of the next solution interval in the background
+///
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#include <askap/parallel/CalibratorParallel.h>
+#include <askap/parallel/IntervalAccumulator.h>
+#include <askap/measurementequation/ComponentEquation.h>
+#include <askap/measurementequation/CalibrationME.h>
+#include <askap/measurementequation/PreAvgCalMEBase.h>
+#include <askap/measurementequation/NoXPolGain.h>
+#include <askap/scimath/fitting/LinearSolver.h>
+#include <askap/scimath/fitting/GenericNormalEquations.h>
+#include <askap/scimath/fitting/Quality.h>
+#include <askap/dataaccess/DataIteratorStub.h>
+#include <askap/dataaccess/SharedIter.h>
+#include <askap/AskapError.h>
+#include <askap/AskapUtil.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <boost/shared_ptr.hpp>
+
+#include <string>
+#include <vector>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief iterator stub failing when advanced
+class FailingIteratorStub : public accessors::DataIteratorStub {
+public:
+   /// @brief constructor
+   FailingIteratorStub() : accessors::DataIteratorStub(3) {}
+
+   /// @brief advance to the next chunk
+   /// @return never returns
+   virtual casacore::Bool next() {
+      ASKAPTHROW(AskapError, "Failure requested in the iterator stub");
+   }
+};
+
+class CalibratorParallelTest : public CppUnit::TestFixture
+{
+   CPPUNIT_TEST_SUITE(CalibratorParallelTest);
+   CPPUNIT_TEST(testSolveBeamsConcurrently);
+   CPPUNIT_TEST(testSingleBeam);
+   CPPUNIT_TEST(testIntervalAccumulator);
+   CPPUNIT_TEST_EXCEPTION(testIntervalAccumulatorError, AskapError);
+   CPPUNIT_TEST_SUITE_END();
+
+   typedef CalibrationME<NoXPolGain> METype;
+   typedef CalibrationME<NoXPolGain, PreAvgCalMEBase> PreAvgMEType;
+
+   /// @brief data iterator with two beams
+   accessors::IDataSharedIter itsIter;
+
+   /// @brief uncorrupted equation
+   boost::shared_ptr<ComponentEquation> itsPerfectME;
+
+   /// @brief gains used to simulate the data
+   scimath::Params itsTrueGains;
+
+   /// @brief initial gains to solve for
+   scimath::Params itsGuess;
+
+public:
+   void setUp() {
+       itsIter = accessors::IDataSharedIter(new accessors::DataIteratorStub(1));
+       accessors::DataAccessorStub &da = dynamic_cast<accessors::DataAccessorStub&>(*itsIter);
+       CPPUNIT_ASSERT_EQUAL(1u, da.itsStokes.nelements());
+       da.itsStokes[0] = casacore::Stokes::XX;
+       // every other baseline belongs to the second beam
+       for (casacore::uInt row = 0; row < da.nRow(); ++row) {
+            da.itsFeed1[row] = row % 2;
+            da.itsFeed2[row] = row % 2;
+       }
+
+       scimath::Params sources;
+       sources.add("flux.i.cena", 100.);
+       sources.add("direction.ra.cena", 0.5*casacore::C::arcsec);
+       sources.add("direction.dec.cena", -0.3*casacore::C::arcsec);
+       sources.add("shape.bmaj.cena", 3.0e-3*casacore::C::arcsec);
+       sources.add("shape.bmin.cena", 2.0e-3*casacore::C::arcsec);
+       sources.add("shape.bpa.cena", -55*casacore::C::degree);
+       itsPerfectME.reset(new ComponentEquation(sources, itsIter));
+
+       itsTrueGains = scimath::Params();
+       itsGuess = scimath::Params();
+       const casacore::uInt nAnt = 30;
+       for (casacore::uInt beam = 0; beam < 2; ++beam) {
+            for (casacore::uInt ant = 0; ant < nAnt; ++ant) {
+                 const std::string suffix = utility::toString(ant) + "." + utility::toString(beam);
+                 const casacore::Complex gain = casacore::polar(static_cast<float>(0.8 + 0.02 * ant + 0.1 * beam),
+                                                static_cast<float>(0.05 * ant - 0.3 * beam));
+                 itsTrueGains.add("gain.g11." + suffix, gain);
+                 itsTrueGains.add("gain.g22." + suffix, 1.);
+                 itsGuess.add("gain.g11." + suffix, casacore::Complex(1., 0.));
+                 itsGuess.add("gain.g22." + suffix, 1.);
+                 itsGuess.fix("gain.g22." + suffix);
+            }
+       }
+       // simulate corrupted visibilities
+       METype(itsTrueGains, itsIter, itsPerfectME).predict();
+   }
+
+   void testSolveBeamsConcurrently() {
+       boost::shared_ptr<PreAvgMEType> preAvgEq = accumulate();
+       scimath::Params joint(itsGuess);
+       scimath::Params perBeam(itsGuess);
+       for (size_t iter = 0; iter < 5; ++iter) {
+            scimath::Quality jointQuality;
+            solveJointly(*preAvgEq, joint, jointQuality);
+
+            scimath::Quality perBeamQuality;
+            // more threads than beams
+            CalibratorParallel::solveBeamsConcurrently(makeSolver(*preAvgEq, perBeam), perBeam, 3, perBeamQuality);
+
+            // independent blocks of the normal matrix, so the results should be identical
+            checkSameGains(joint, perBeam, 1e-5);
+            CPPUNIT_ASSERT_EQUAL(jointQuality.DOF(), perBeamQuality.DOF());
+            CPPUNIT_ASSERT_EQUAL(jointQuality.rank(), perBeamQuality.rank());
+            CPPUNIT_ASSERT(perBeamQuality.cond() > 0.);
+            CPPUNIT_ASSERT(perBeamQuality.cond() <= jointQuality.cond() * (1. + 1e-6));
+       }
+       // phases are degenerate, amplitudes should match the simulated gains
+       const std::vector<std::string> names = itsGuess.freeNames();
+       for (std::vector<std::string>::const_iterator ci = names.begin(); ci != names.end(); ++ci) {
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(abs(itsTrueGains.complexValue(*ci)), abs(perBeam.complexValue(*ci)), 1e-5);
+       }
+   }
+
+   void testSingleBeam() {
+       // parameters of one beam only, the solution is done directly by the given solver
+       boost::shared_ptr<PreAvgMEType> preAvgEq = accumulate();
+       scimath::Params joint(itsGuess);
+       scimath::Params oneBeam(itsGuess);
+       const std::vector<std::string> names = itsGuess.freeNames();
+       for (std::vector<std::string>::const_iterator ci = names.begin(); ci != names.end(); ++ci) {
+            if (ci->substr(ci->size() - 2) == ".1") {
+                joint.fix(*ci);
+                oneBeam.fix(*ci);
+            }
+       }
+       scimath::Quality jointQuality;
+       solveJointly(*preAvgEq, joint, jointQuality);
+       scimath::Quality oneBeamQuality;
+       CalibratorParallel::solveBeamsConcurrently(makeSolver(*preAvgEq, oneBeam), oneBeam, 2, oneBeamQuality);
+       checkSameGains(joint, oneBeam, 1e-6);
+       CPPUNIT_ASSERT_EQUAL(jointQuality.rank(), oneBeamQuality.rank());
+   }
+
+   void testIntervalAccumulator() {
+       IntervalAccumulator accumulator;
+       CPPUNIT_ASSERT(!accumulator.isStarted());
+       CPPUNIT_ASSERT(!accumulator.wait());
+
+       boost::shared_ptr<PreAvgMEType> foreground = accumulate();
+       boost::shared_ptr<PreAvgMEType> background(new PreAvgMEType);
+       itsIter.init();
+       accumulator.start(background, itsIter, itsPerfectME);
+       CPPUNIT_ASSERT(accumulator.isStarted());
+       const boost::shared_ptr<PreAvgCalMEBase> result = accumulator.wait();
+       CPPUNIT_ASSERT(!accumulator.isStarted());
+       CPPUNIT_ASSERT(result.get() == background.get());
+       CPPUNIT_ASSERT(!accumulator.wait());
+
+       // the same data should be accumulated in both cases
+       scimath::Params fromForeground(itsGuess);
+       scimath::Params fromBackground(itsGuess);
+       scimath::Quality quality;
+       solveJointly(*foreground, fromForeground, quality);
+       solveJointly(*background, fromBackground, quality);
+       checkSameGains(fromForeground, fromBackground, 1e-7);
+
+       // the accumulator can be reused
+       itsIter.init();
+       accumulator.start(boost::shared_ptr<PreAvgCalMEBase>(new PreAvgMEType), itsIter, itsPerfectME);
+       CPPUNIT_ASSERT(accumulator.wait());
+   }
+
+   void testIntervalAccumulatorError() {
+       accessors::IDataSharedIter failingIter(new FailingIteratorStub);
+       failingIter.init();
+       IntervalAccumulator accumulator;
+       accumulator.start(boost::shared_ptr<PreAvgCalMEBase>(new PreAvgMEType), failingIter, itsPerfectME);
+       // this should throw AskapError
+       accumulator.wait();
+   }
+
+protected:
+   /// @brief accumulate the data into a new pre-averaging equation
+   /// @return equation with accumulated data
+   boost::shared_ptr<PreAvgMEType> accumulate() {
+       boost::shared_ptr<PreAvgMEType> preAvgEq(new PreAvgMEType);
+       itsIter.init();
+       preAvgEq->accumulate(itsIter, itsPerfectME);
+       return preAvgEq;
+   }
+
+   /// @brief make SVD solver with normal equations for the given parameters
+   /// @param[in] eq pre-averaging equation with the data
+   /// @param[in] params current values of parameters
+   /// @return solver
+   static scimath::Solver::ShPtr makeSolver(PreAvgMEType &eq, const scimath::Params &params) {
+       scimath::GenericNormalEquations ne;
+       eq.setParameters(params);
+       eq.calcEquations(ne);
+       boost::shared_ptr<scimath::LinearSolver> solver(new scimath::LinearSolver);
+       solver->addNormalEquations(ne);
+       solver->setAlgorithm("SVD");
+       return solver;
+   }
+
+   /// @brief do one iteration solving for all beams at once
+   /// @param[in] eq pre-averaging equation with the data
+   /// @param[in] params parameters to update
+   /// @param[out] quality solution quality
+   static void solveJointly(PreAvgMEType &eq, scimath::Params &params, scimath::Quality &quality) {
+       makeSolver(eq, params)->solveNormalEquations(params, quality);
+   }
+
+   /// @brief check that free gains are the same
+   /// @param[in] expected expected gains
+   /// @param[in] actual gains to check
+   /// @param[in] tolerance tolerance
+   static void checkSameGains(const scimath::Params &expected, const scimath::Params &actual, double tolerance) {
+       const std::vector<std::string> names = expected.freeNames();
+       CPPUNIT_ASSERT(names.size() > 0);
+       for (std::vector<std::string>::const_iterator ci = names.begin(); ci != names.end(); ++ci) {
+            CPPUNIT_ASSERT(actual.isFree(*ci));
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(0., abs(expected.complexValue(*ci) - actual.complexValue(*ci)), tolerance);
+       }
+   }
+};
+
+} // namespace synthesis
+
+} // namespace askap
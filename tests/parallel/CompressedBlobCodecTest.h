@@ -0,0 +1,167 @@
+/// @file
+///
+/// Unit test for the compact encoding of serialised messages
+///
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#include <askap/parallel/CompressedBlobCodec.h>
+#include <askap/AskapError.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+
+#include <stdint.h>
+
+namespace askap {
+
+namespace synthesis {
+
+class CompressedBlobCodecTest : public CppUnit::TestFixture
+{
+   CPPUNIT_TEST_SUITE(CompressedBlobCodecTest);
+   CPPUNIT_TEST(testEmpty);
+   CPPUNIT_TEST(testZeros);
+   CPPUNIT_TEST(testOddSize);
+   CPPUNIT_TEST(testRandom);
+   CPPUNIT_TEST(testSinglePrecision);
+   CPPUNIT_TEST(testModeNames);
+   CPPUNIT_TEST_EXCEPTION(testTruncated, AskapError);
+   CPPUNIT_TEST_SUITE_END();
+public:
+
+   void testEmpty() {
+       const std::vector<int8_t> data;
+       roundTrip(data, CompressedBlobCodec::NONE);
+       roundTrip(data, CompressedBlobCodec::ZERO_RUNS);
+       roundTrip(data, CompressedBlobCodec::SHUFFLED_ZERO_RUNS);
+   }
+
+   void testZeros() {
+       const std::vector<int8_t> data(8192, 0);
+       CPPUNIT_ASSERT_EQUAL(data.size() + 9, roundTrip(data, CompressedBlobCodec::NONE));
+       CPPUNIT_ASSERT(roundTrip(data, CompressedBlobCodec::ZERO_RUNS) < 16);
+       CPPUNIT_ASSERT(roundTrip(data, CompressedBlobCodec::SHUFFLED_ZERO_RUNS) < 16);
+   }
+
+   void testOddSize() {
+       // not a whole number of 8-byte words, so the tail bypasses the shuffle
+       std::vector<int8_t> data(1003, 0);
+       for (size_t i = 0; i < data.size(); i += 5) {
+            data[i] = static_cast<int8_t>(i % 127 + 1);
+       }
+       data.back() = 3;
+       roundTrip(data, CompressedBlobCodec::NONE);
+       roundTrip(data, CompressedBlobCodec::ZERO_RUNS);
+       roundTrip(data, CompressedBlobCodec::SHUFFLED_ZERO_RUNS);
+       // short buffers with only the tail
+       for (size_t size = 1; size < 8; ++size) {
+            const std::vector<int8_t> tail(data.begin(), data.begin() + size);
+            roundTrip(tail, CompressedBlobCodec::ZERO_RUNS);
+            roundTrip(tail, CompressedBlobCodec::SHUFFLED_ZERO_RUNS);
+       }
+   }
+
+   void testRandom() {
+       srand(11);
+       std::vector<int8_t> data(65541);
+       for (size_t i = 0; i < data.size(); ++i) {
+            data[i] = static_cast<int8_t>(rand() % 256);
+       }
+       roundTrip(data, CompressedBlobCodec::NONE);
+       roundTrip(data, CompressedBlobCodec::ZERO_RUNS);
+       roundTrip(data, CompressedBlobCodec::SHUFFLED_ZERO_RUNS);
+       // random runs of zeros of various length between random bytes
+       for (size_t i = 0; i < data.size(); ++i) {
+            if (rand() % 3 == 0) {
+                const size_t end = std::min(data.size(), i + static_cast<size_t>(rand() % 12));
+                for (; i < end; ++i) {
+                     data[i] = 0;
+                }
+            }
+       }
+       roundTrip(data, CompressedBlobCodec::ZERO_RUNS);
+       roundTrip(data, CompressedBlobCodec::SHUFFLED_ZERO_RUNS);
+   }
+
+   void testSinglePrecision() {
+       // doubles converted from floats have zero low-order mantissa bytes
+       std::vector<double> values(1024);
+       srand(3);
+       for (size_t i = 0; i < values.size(); ++i) {
+            values[i] = static_cast<float>(rand()) / RAND_MAX;
+       }
+       const int8_t *ptr = reinterpret_cast<const int8_t*>(&values[0]);
+       const std::vector<int8_t> data(ptr, ptr + values.size() * sizeof(double));
+       const size_t rleSize = roundTrip(data, CompressedBlobCodec::ZERO_RUNS);
+       const size_t shuffledSize = roundTrip(data, CompressedBlobCodec::SHUFFLED_ZERO_RUNS);
+       CPPUNIT_ASSERT(shuffledSize < rleSize);
+       CPPUNIT_ASSERT(shuffledSize < data.size() * 7 / 8);
+   }
+
+   void testModeNames() {
+       CPPUNIT_ASSERT_EQUAL(CompressedBlobCodec::NONE, CompressedBlobCodec::modeFromString("none"));
+       CPPUNIT_ASSERT_EQUAL(CompressedBlobCodec::ZERO_RUNS, CompressedBlobCodec::modeFromString("rle"));
+       CPPUNIT_ASSERT_EQUAL(CompressedBlobCodec::SHUFFLED_ZERO_RUNS, CompressedBlobCodec::modeFromString("shuffle"));
+       CPPUNIT_ASSERT_EQUAL(std::string("shuffle"), CompressedBlobCodec::toString(CompressedBlobCodec::SHUFFLED_ZERO_RUNS));
+   }
+
+   void testTruncated() {
+       const std::vector<int8_t> data(100, 1);
+       std::vector<int8_t> encoded;
+       CompressedBlobCodec::encode(&data[0], data.size(), CompressedBlobCodec::ZERO_RUNS, encoded);
+       std::vector<int8_t> decoded;
+       // this should throw AskapError
+       CompressedBlobCodec::decode(&encoded[0], encoded.size() - 10, decoded);
+   }
+
+protected:
+
+   /// @brief encode and decode the buffer with both versions of encode
+   /// @param[in] data buffer to test
+   /// @param[in] mode encoding mode
+   /// @return size of the encoded buffer
+   static size_t roundTrip(const std::vector<int8_t> &data, CompressedBlobCodec::Mode mode) {
+       const void *ptr = data.size() > 0 ? &data[0] : NULL;
+       std::vector<int8_t> encoded;
+       CompressedBlobCodec::encode(ptr, data.size(), mode, encoded);
+       CPPUNIT_ASSERT(encoded.size() <= CompressedBlobCodec::maxEncodedSize(data.size()));
+
+       std::vector<int8_t> buffer(CompressedBlobCodec::maxEncodedSize(data.size()), 0x55);
+       const size_t size = CompressedBlobCodec::encode(ptr, data.size(), mode, &buffer[0]);
+       CPPUNIT_ASSERT_EQUAL(encoded.size(), size);
+       CPPUNIT_ASSERT(std::equal(encoded.begin(), encoded.end(), buffer.begin()));
+
+       std::vector<int8_t> decoded(3, 1);
+       CompressedBlobCodec::decode(&encoded[0], encoded.size(), decoded);
+       CPPUNIT_ASSERT(decoded == data);
+       return encoded.size();
+   }
+};
+
+} // namespace synthesis
+
+} // namespace askap
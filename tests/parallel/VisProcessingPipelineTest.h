@@ -0,0 +1,261 @@
+/// @file
+///
+/// Unit test for the multi-threaded in-place processing of visibilities
+///
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#include <askap/parallel/VisProcessingPipeline.h>
+#include <askap/parallel/CalApplyPipeline.h>
+#include <askap/measurementequation/ICalibrationApplicator.h>
+#include <askap/dataaccess/DataIteratorStub.h>
+#include <askap/dataaccess/SharedIter.h>
+#include <askap/AskapError.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <vector>
+
+namespace askap {
+
+namespace synthesis {
+
+/// @brief iterator stub with the chunk number stored in visibilities
+/// @details All visibilities of the current chunk are set to its sequence number.
+class NumberedIteratorStub : public accessors::DataIteratorStub {
+public:
+   /// @brief constructor
+   /// @param[in] nSteps number of chunks
+   explicit NumberedIteratorStub(casacore::uInt nSteps) : accessors::DataIteratorStub(nSteps), itsStep(0) {}
+
+   /// @brief restart the iteration
+   virtual void init() {
+      accessors::DataIteratorStub::init();
+      itsStep = 0;
+      (**this).rwVisibility().set(casacore::Complex(itsStep));
+   }
+
+   /// @brief advance to the next chunk
+   /// @return true if there are more data
+   virtual casacore::Bool next() {
+      const casacore::Bool result = accessors::DataIteratorStub::next();
+      ++itsStep;
+      (**this).rwVisibility().set(casacore::Complex(itsStep));
+      return result;
+   }
+private:
+   /// @brief current chunk number
+   casacore::uInt itsStep;
+};
+
+/// @brief iterator stub recording the visibilities written into it
+/// @details The first visibility of each chunk is recorded when the iterator is advanced.
+class RecordingIteratorStub : public accessors::DataIteratorStub {
+public:
+   /// @brief constructor
+   /// @param[in] nSteps number of chunks
+   explicit RecordingIteratorStub(casacore::uInt nSteps) : accessors::DataIteratorStub(nSteps) {}
+
+   /// @brief advance to the next chunk
+   /// @return true if there are more data
+   virtual casacore::Bool next() {
+      itsWritten.push_back(casacore::real((**this).visibility()(0,0,0)));
+      return accessors::DataIteratorStub::next();
+   }
+
+   /// @brief visibilities written so far, one per chunk
+   std::vector<float> itsWritten;
+};
+
+/// @brief pipeline doubling visibilities
+/// @details Chunks with even numbers are delayed, so they are completed out of order.
+/// Processing fails at the given chunk, if requested.
+class DoublingPipelineStub : public VisProcessingPipeline {
+public:
+   /// @brief constructor
+   /// @param[in] nWorkers number of worker threads
+   /// @param[in] depth queue depth
+   /// @param[in] failAt sequence number of the chunk to fail at, nothing fails if it exceeds the number of chunks
+   DoublingPipelineStub(size_t nWorkers, size_t depth, size_t failAt) :
+        VisProcessingPipeline(nWorkers, depth), itsFailAt(failAt) {}
+protected:
+   /// @brief process one chunk
+   /// @param[in] worker index of the worker thread
+   /// @param[in] chunk chunk to process
+   virtual void processChunk(size_t worker, Chunk &chunk) const {
+      CPPUNIT_ASSERT(worker < nWorkers());
+      ASKAPCHECK(chunk.itsSeqNo != itsFailAt, "Failure requested at chunk "<<itsFailAt);
+      if (chunk.itsSeqNo % 2 == 0) {
+          boost::this_thread::sleep(boost::posix_time::milliseconds(2));
+      }
+      chunk.itsData->rwVisibility() *= casacore::Complex(2.);
+   }
+private:
+   /// @brief sequence number of the chunk to fail at
+   size_t itsFailAt;
+};
+
+/// @brief applicator scaling visibilities by a constant gain
+/// @details The correction fails for the chunk with the given visibility, if requested.
+class ScalingApplicatorStub : public ICalibrationApplicator {
+public:
+   /// @brief constructor
+   /// @param[in] gain gain to multiply visibilities by
+   /// @param[in] failAt visibility value to fail at (negative for no failure)
+   ScalingApplicatorStub(float gain, float failAt) : itsGain(gain), itsFailAt(failAt) {}
+
+   /// @brief correct visibilities
+   /// @param[in] chunk chunk to correct
+   virtual void correct(accessors::IDataAccessor &chunk) const {
+      ASKAPCHECK(casacore::real(chunk.visibility()(0,0,0)) != itsFailAt, "Failure requested at "<<itsFailAt);
+      chunk.rwVisibility() *= casacore::Complex(itsGain);
+   }
+   virtual void scaleNoise(bool) {}
+   virtual void allowFlag(bool) {}
+   virtual void beamIndependent(bool) {}
+private:
+   /// @brief gain
+   float itsGain;
+   /// @brief visibility to fail at
+   float itsFailAt;
+};
+
+class VisProcessingPipelineTest : public CppUnit::TestFixture
+{
+   CPPUNIT_TEST_SUITE(VisProcessingPipelineTest);
+   CPPUNIT_TEST(testOrdering);
+   CPPUNIT_TEST(testSingleWorker);
+   CPPUNIT_TEST(testAbort);
+   CPPUNIT_TEST(testCalApplyOrdering);
+   CPPUNIT_TEST(testCalApplyAbort);
+   CPPUNIT_TEST_EXCEPTION(testNoWorkers, AskapError);
+   CPPUNIT_TEST_SUITE_END();
+public:
+
+   void testOrdering() {
+       DoublingPipelineStub pipeline(4, 3, 1000);
+       const std::vector<float> written = runPipeline(pipeline, 50);
+       CPPUNIT_ASSERT_EQUAL(size_t(50), pipeline.nChunks());
+       checkWritten(written, 50, 2.);
+       // the pipeline can be run again
+       checkWritten(runPipeline(pipeline, 7), 7, 2.);
+       CPPUNIT_ASSERT_EQUAL(size_t(7), pipeline.nChunks());
+   }
+
+   void testSingleWorker() {
+       DoublingPipelineStub pipeline(1, 1, 1000);
+       checkWritten(runPipeline(pipeline, 10), 10, 2.);
+   }
+
+   void testAbort() {
+       DoublingPipelineStub pipeline(3, 2, 7);
+       std::vector<float> written;
+       CPPUNIT_ASSERT(runAndCatch(pipeline, 40, written));
+       // nothing is written beyond the failed chunk, chunks before it are written in order
+       CPPUNIT_ASSERT(written.size() <= 7);
+       checkWritten(written, written.size(), 2.);
+   }
+
+   void testCalApplyOrdering() {
+       CalApplyPipeline pipeline(buildApplicators(3, -1.), 4);
+       CPPUNIT_ASSERT_EQUAL(size_t(3), pipeline.nWorkers());
+       checkWritten(runPipeline(pipeline, 30), 30, 3.);
+   }
+
+   void testCalApplyAbort() {
+       CalApplyPipeline pipeline(buildApplicators(2, 5.), 2);
+       std::vector<float> written;
+       CPPUNIT_ASSERT(runAndCatch(pipeline, 20, written));
+       CPPUNIT_ASSERT(written.size() <= 5);
+       checkWritten(written, written.size(), 3.);
+   }
+
+   void testNoWorkers() {
+       // this should throw AskapError
+       CalApplyPipeline pipeline(std::vector<boost::shared_ptr<ICalibrationApplicator> >(), 2);
+   }
+
+protected:
+
+   /// @brief run the pipeline over numbered chunks
+   /// @param[in] pipeline pipeline to test
+   /// @param[in] nChunks number of chunks
+   /// @return visibilities written, one per chunk
+   static std::vector<float> runPipeline(VisProcessingPipeline &pipeline, casacore::uInt nChunks) {
+       // the shared iterator owns the stub
+       RecordingIteratorStub *writer = new RecordingIteratorStub(nChunks);
+       const accessors::IDataSharedIter writeIter(writer);
+       pipeline.run(accessors::IDataSharedIter(new NumberedIteratorStub(nChunks)), writeIter);
+       return writer->itsWritten;
+   }
+
+   /// @brief run the pipeline which is expected to fail
+   /// @param[in] pipeline pipeline to test
+   /// @param[in] nChunks number of chunks
+   /// @param[out] written visibilities written before the failure, one per chunk
+   /// @return true, if the pipeline has thrown AskapError
+   static bool runAndCatch(VisProcessingPipeline &pipeline, casacore::uInt nChunks, std::vector<float> &written) {
+       RecordingIteratorStub *writer = new RecordingIteratorStub(nChunks);
+       const accessors::IDataSharedIter writeIter(writer);
+       bool caught = false;
+       try {
+          pipeline.run(accessors::IDataSharedIter(new NumberedIteratorStub(nChunks)), writeIter);
+       }
+       catch (const AskapError &) {
+          caught = true;
+       }
+       written = writer->itsWritten;
+       return caught;
+   }
+
+   /// @brief check that chunks are written in order
+   /// @param[in] written visibilities written, one per chunk
+   /// @param[in] nChunks expected number of chunks
+   /// @param[in] factor expected ratio of the written visibility to the chunk number
+   static void checkWritten(const std::vector<float> &written, size_t nChunks, float factor) {
+       CPPUNIT_ASSERT_EQUAL(nChunks, written.size());
+       for (size_t chunk = 0; chunk < written.size(); ++chunk) {
+            CPPUNIT_ASSERT_DOUBLES_EQUAL(factor * chunk, written[chunk], 1e-6);
+       }
+   }
+
+   /// @brief build applicators multiplying visibilities by 3
+   /// @param[in] nWorkers number of applicators
+   /// @param[in] failAt visibility value to fail at (negative for no failure)
+   /// @return vector of applicators
+   static std::vector<boost::shared_ptr<ICalibrationApplicator> > buildApplicators(size_t nWorkers, float failAt) {
+       std::vector<boost::shared_ptr<ICalibrationApplicator> > applicators;
+       for (size_t worker = 0; worker < nWorkers; ++worker) {
+            applicators.push_back(boost::shared_ptr<ICalibrationApplicator>(new ScalingApplicatorStub(3., failAt)));
+       }
+       return applicators;
+   }
+};
+
+} // namespace synthesis
+
+} // namespace askap
@@ -0,0 +1,223 @@
+/// @file
+///
+/// @brief Unit tests for SpectralBaselineFitter.
+/// @details Spectra are simulated as a quadratic continuum with a small deterministic
+/// ripple (playing the role of noise) and, optionally, a Gaussian line. After the
+/// continuum is subtracted, only the ripple and the line should remain.
+///
+///
+/// @copyright (c) 2007 CSIRO
+/// Australia Telescope National Facility (ATNF)
+/// Commonwealth Scientific and Industrial Research Organisation (CSIRO)
+/// PO Box 76, Epping NSW 1710, Australia
+/// atnf-enquiries@csiro.au
+///
+/// This file is part of the ASKAP software distribution.
+///
+/// The ASKAP software distribution is free software: you can redistribute it
+/// and/or modify it under the terms of the GNU General Public License as
+/// published by the Free Software Foundation; either version 2 of the License,
+/// or (at your option) any later version.
+///
+/// This program is distributed in the hope that it will be useful,
+/// but WITHOUT ANY WARRANTY; without even the implied warranty of
+/// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+/// GNU General Public License for more details.
+///
+/// You should have received a copy of the GNU General Public License
+/// along with this program; if not, write to the Free Software
+/// Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307 USA
+///
+
+#ifndef ASKAP_SPECTRAL_BASELINE_FITTER_TEST_H
+#define ASKAP_SPECTRAL_BASELINE_FITTER_TEST_H
+
+#include <askap/utils/SpectralBaselineFitter.h>
+#include <casacore/casa/Arrays/Cube.h>
+#include <casacore/casa/BasicMath/Math.h>
+
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace askap
+{
+
+    class SpectralBaselineFitterTest : public CppUnit::TestFixture
+    {
+      CPPUNIT_TEST_SUITE(SpectralBaselineFitterTest);
+      CPPUNIT_TEST(testPolynomial);
+      CPPUNIT_TEST(testPolynomialWithLine);
+      CPPUNIT_TEST(testNaNChannels);
+      CPPUNIT_TEST(testThreads);
+      CPPUNIT_TEST_SUITE_END();
+
+    public:
+
+      void testPolynomial() {
+         // nothing is clipped with such a threshold, all channels are fitted
+         const SpectralBaselineFitter fitter(theirNChan, 2, 1e4, 2);
+         std::vector<float> spec = simulate(0, -1.);
+         fitter.subtractBlock(&spec[0], 1);
+         checkResidual(spec, 0, -1., 5e-3);
+      }
+
+      void testPolynomialWithLine() {
+         std::vector<float> spec = simulate(1, 120.);
+         const std::vector<float> original(spec);
+         const SpectralBaselineFitter fitter(theirNChan, 2, 3., 3);
+         fitter.subtractBlock(&spec[0], 1);
+         checkResidual(spec, 1, 120., 5e-3);
+
+         // without masking of the line channels, the continuum is noticeably biased
+         spec = original;
+         const SpectralBaselineFitter unmaskedFitter(theirNChan, 2, 1e4, 1);
+         unmaskedFitter.subtractBlock(&spec[0], 1);
+         float maxError = 0.;
+         for (casacore::uInt chan = 0; chan < theirNChan; ++chan) {
+              maxError = std::max(maxError, std::abs(spec[chan] - ripple(chan, 1) - line(chan, 120.)));
+         }
+         CPPUNIT_ASSERT(maxError > 0.02);
+      }
+
+      void testNaNChannels() {
+         const SpectralBaselineFitter fitter(theirNChan, 2, 3., 3);
+         const float nan = std::numeric_limits<float>::quiet_NaN();
+
+         // a few flagged channels, the normal matrix is downdated
+         std::vector<float> spec = simulate(2, 60.);
+         spec[10] = nan;
+         spec[11] = nan;
+         spec[150] = nan;
+         fitter.subtractBlock(&spec[0], 1);
+         CPPUNIT_ASSERT(casacore::isNaN(spec[10]));
+         CPPUNIT_ASSERT(casacore::isNaN(spec[11]));
+         CPPUNIT_ASSERT(casacore::isNaN(spec[150]));
+         checkResidual(spec, 2, 60., 5e-3);
+
+         // most channels flagged, the normal matrix is built from the remaining ones
+         spec = simulate(3, 160.);
+         for (casacore::uInt chan = 0; chan < 120; ++chan) {
+              spec[chan] = nan;
+         }
+         fitter.subtractBlock(&spec[0], 1);
+         for (casacore::uInt chan = 0; chan < 120; ++chan) {
+              CPPUNIT_ASSERT(casacore::isNaN(spec[chan]));
+         }
+         checkResidual(spec, 3, 160., 1e-2);
+
+         // nothing to fit
+         spec.assign(theirNChan, nan);
+         fitter.subtractBlock(&spec[0], 1);
+         for (casacore::uInt chan = 0; chan < theirNChan; ++chan) {
+              CPPUNIT_ASSERT(casacore::isNaN(spec[chan]));
+         }
+      }
+
+      void testThreads() {
+         // spectra with and without lines and flagged channels
+         const casacore::uInt nx = 5;
+         const casacore::uInt ny = 7;
+         casacore::Cube<casacore::Float> cube(nx, ny, theirNChan);
+         for (casacore::uInt y = 0; y < ny; ++y) {
+              for (casacore::uInt x = 0; x < nx; ++x) {
+                   const casacore::uInt spc = x + nx * y;
+                   const std::vector<float> spec = simulate(spc, spc % 3 == 0 ? -1. : 30. + 4. * spc);
+                   for (casacore::uInt chan = 0; chan < theirNChan; ++chan) {
+                        cube(x, y, chan) = spec[chan];
+                   }
+                   if (spc % 4 == 0) {
+                       cube(x, y, (spc * 7) % theirNChan) = std::numeric_limits<float>::quiet_NaN();
+                   }
+                   if (spc == 17) {
+                       for (casacore::uInt chan = 0; chan < theirNChan; ++chan) {
+                            cube(x, y, chan) = std::numeric_limits<float>::quiet_NaN();
+                       }
+                   }
+              }
+         }
+         casacore::Cube<casacore::Float> threaded = cube.copy();
+
+         const SpectralBaselineFitter fitter(theirNChan, 2, 3., 3);
+         // all spectra in one block in the main thread ...
+         fitter.subtract(cube, 1, nx * ny);
+         // ... and small blocks (the last one incomplete) spread between threads
+         fitter.subtract(threaded, 3, 4);
+
+         for (casacore::uInt y = 0; y < ny; ++y) {
+              for (casacore::uInt x = 0; x < nx; ++x) {
+                   for (casacore::uInt chan = 0; chan < theirNChan; ++chan) {
+                        const float expected = cube(x, y, chan);
+                        const float result = threaded(x, y, chan);
+                        CPPUNIT_ASSERT_EQUAL(casacore::isNaN(expected), casacore::isNaN(result));
+                        if (!casacore::isNaN(expected)) {
+                            CPPUNIT_ASSERT_DOUBLES_EQUAL(expected, result, 1e-6);
+                            // the continuum is removed everywhere
+                            CPPUNIT_ASSERT(std::abs(result) < 2.1);
+                        }
+                   }
+              }
+         }
+      }
+
+    protected:
+
+      /// @brief simulate a spectrum
+      /// @param[in] spc spectrum number, changes the continuum and the ripple
+      /// @param[in] centre centre channel of the line, negative for no line
+      /// @return spectrum
+      static std::vector<float> simulate(casacore::uInt spc, float centre) {
+         std::vector<float> spec(theirNChan);
+         for (casacore::uInt chan = 0; chan < theirNChan; ++chan) {
+              const float continuum = 5. + 0.1 * spc + (0.01 - 0.001 * spc) * chan - 2e-5 * chan * chan;
+              spec[chan] = continuum + ripple(chan, spc) + line(chan, centre);
+         }
+         return spec;
+      }
+
+      /// @brief ripple playing the role of noise
+      /// @param[in] chan channel
+      /// @param[in] spc spectrum number
+      /// @return ripple value
+      static float ripple(casacore::uInt chan, casacore::uInt spc) {
+         return 0.01 * std::sin(1.7 * chan + 0.3 * spc);
+      }
+
+      /// @brief Gaussian line
+      /// @param[in] chan channel
+      /// @param[in] centre centre channel of the line, negative for no line
+      /// @return line value
+      static float line(casacore::uInt chan, float centre) {
+         if (centre < 0.) {
+             return 0.;
+         }
+         const double offset = (chan - centre) / 3.;
+         return 2. * std::exp(-0.5 * offset * offset);
+      }
+
+      /// @brief check that the ripple and the line remain after subtraction
+      /// @details Flagged channels are skipped.
+      /// @param[in] spec spectrum after subtraction
+      /// @param[in] spc spectrum number
+      /// @param[in] centre centre channel of the line, negative for no line
+      /// @param[in] tolerance tolerance
+      static void checkResidual(const std::vector<float> &spec, casacore::uInt spc, float centre, float tolerance) {
+         CPPUNIT_ASSERT_EQUAL(size_t(theirNChan), spec.size());
+         for (casacore::uInt chan = 0; chan < theirNChan; ++chan) {
+              if (!casacore::isNaN(spec[chan])) {
+                  CPPUNIT_ASSERT_DOUBLES_EQUAL(ripple(chan, spc) + line(chan, centre), spec[chan], tolerance);
+              }
+         }
+      }
+
+    private:
+      /// @brief number of spectral channels
+      static const casacore::uInt theirNChan = 200;
+    };
+
+} // namespace askap
+
+#endif // #ifndef ASKAP_SPECTRAL_BASELINE_FITTER_TEST_H